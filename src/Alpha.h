@@ -157,7 +157,8 @@ public:
     template <typename U,
             typename std::enable_if_t<std::is_floating_point<U>::value, int> = 0>
     constexpr Alpha<T, Color> scale(U factor) const {
-        return Alpha<T, Color>(_color.scale(), _alpha * factor);
+        return Alpha<T, Color>(
+                _color.scale(factor), T(_alpha.value * factor));
     }
 
     /// Set the alpha component explicitly.
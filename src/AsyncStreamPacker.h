@@ -0,0 +1,385 @@
+/** \file
+ *  Defines the AsyncStreamPacker class.
+ */
+#ifndef COLOR_ASYNCSTREAMPACKER_H_
+#define COLOR_ASYNCSTREAMPACKER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "Instrumentation.h"
+#include "Packer.h"
+#include "RingBuffer.h"
+#include "Sink.h"
+
+namespace color {
+
+/// What AsyncStreamPacker does when the writer thread falls behind.
+enum class BackpressurePolicy {
+    /// Wait until the writer thread frees a buffer.
+    Block,
+    /// Discard the colors that do not fit and count them in dropped().
+    Drop
+};
+
+/// Buffering parameters of an AsyncStreamPacker.
+struct AsyncStreamPackerOptions {
+    /// Size of each buffer in bytes.
+    std::size_t buffer_size = std::size_t(1) << 20;
+    /** Number of buffers, at least 2. Together with buffer_size this
+     *  bounds the memory used by the packer.
+     */
+    std::size_t num_buffers = 2;
+    BackpressurePolicy policy = BackpressurePolicy::Block;
+};
+
+/** Packs colors into a stream from a background thread.
+ *
+ *  Colors are packed into a front buffer on the calling thread. Full
+ *  buffers are handed to a writer thread which writes them to a Sink
+ *  while the caller keeps packing into the next free buffer, so the
+ *  caller only pays for packing unless all buffers are waiting to be
+ *  written. What happens then is chosen with BackpressurePolicy.
+ *
+ *  Like StreamPacker, an AsyncStreamPacker must only be used by one
+ *  thread at a time. The stream must not be accessed except through the
+ *  packer until release_stream() returns it. Write errors are reported
+ *  by good(), fail() and bad() once the failed buffer has been written;
+ *  call flush() to wait for that. An exception thrown by the sink on the
+ *  writer thread, such as from a stream with exceptions(badbit), sets
+ *  badbit and is rethrown by the next flush() or pack call.
+ *
+ *  Only flush() syncs the sink; destroying the packer or calling
+ *  release_stream() writes the remaining colors without waiting for them
+ *  to be durably stored. Flushing an FdSink opened with `O_DIRECT` writes
+ *  its partial last buffer without `O_DIRECT`, which stays off for all
+ *  later writes, so only flush where durability is needed.
+ */
+template <typename Color>
+class AsyncStreamPacker {
+public:
+    /** Construct an AsyncStreamPacker that packs to an std::ostream using
+     *  a given Packer. The AsyncStreamPacker takes ownership of both the
+     *  stream and the Packer.
+     */
+    AsyncStreamPacker(std::unique_ptr<std::ostream> owned_stream,
+            std::unique_ptr<Packer<Color>> packer,
+            AsyncStreamPackerOptions options = AsyncStreamPackerOptions())
+        : AsyncStreamPacker(
+                  std::make_unique<OstreamSink>(std::move(owned_stream)),
+                  std::move(packer),
+                  std::move(options)) {
+        m_ostream_sink = static_cast<OstreamSink*>(m_sink.get());
+    }
+
+    /** Construct an AsyncStreamPacker that packs to an std::ostream using
+     *  a given Packer. The AsyncStreamPacker does not take ownership of
+     *  the stream, so the stream must outlive it.
+     */
+    AsyncStreamPacker(std::ostream& referenced_stream,
+            std::unique_ptr<Packer<Color>> packer,
+            AsyncStreamPackerOptions options = AsyncStreamPackerOptions())
+        : AsyncStreamPacker(std::make_unique<OstreamSink>(referenced_stream),
+                  std::move(packer),
+                  std::move(options)) {
+        m_ostream_sink = static_cast<OstreamSink*>(m_sink.get());
+    }
+
+    /** Construct an AsyncStreamPacker that packs to a Sink, such as an
+     *  FdSink, using a given Packer. The AsyncStreamPacker takes ownership
+     *  of both the Sink and the Packer.
+     */
+    AsyncStreamPacker(std::unique_ptr<Sink> sink,
+            std::unique_ptr<Packer<Color>> packer,
+            AsyncStreamPackerOptions options = AsyncStreamPackerOptions())
+        : m_sink(std::move(sink)), m_packer(std::move(packer)),
+          m_policy(options.policy),
+          m_full(std::max<std::size_t>(options.num_buffers, 2)),
+          m_free(std::max<std::size_t>(options.num_buffers, 2)) {
+        const auto num_buffers = std::max<std::size_t>(options.num_buffers, 2);
+        const auto buffer_size =
+                std::max(options.buffer_size, m_packer->packed_size());
+        m_buffers.resize(num_buffers);
+        for(std::size_t i = 0; i < num_buffers; ++i) {
+            m_buffers[i].data.resize(buffer_size);
+            if(i > 0) {
+                m_free.try_push(&m_buffers[i]);
+            }
+        }
+        m_front = &m_buffers[0];
+        m_writer = std::thread([this] { write_loop(); });
+    }
+
+    /** Write all remaining colors and stop the writer thread, without
+     *  syncing the sink.
+     */
+    ~AsyncStreamPacker() { stop(); }
+
+    AsyncStreamPacker(const AsyncStreamPacker& other) = delete;
+    AsyncStreamPacker& operator=(const AsyncStreamPacker& other) = delete;
+
+    /// Pack one Color.
+    AsyncStreamPacker& operator<<(const Color& color) {
+        return pack_single(color);
+    }
+
+    /// Equivalent to operator<<(const Color&).
+    AsyncStreamPacker& pack_single(const Color& color) {
+        rethrow_error();
+        const auto size = m_packer->packed_size();
+        if(reserve(size)) {
+            m_packer->pack_single(color, m_front->data.data() + m_front->size);
+            m_front->size += size;
+        } else {
+            ++m_dropped;
+        }
+        return *this;
+    }
+
+    /// Pack all elements between \a first and \a last.
+    template <typename Iterator>
+    void pack(Iterator first, Iterator last) {
+        COLOR_INSTRUMENT_SCOPE(timer, "AsyncStreamPacker::pack", 0);
+        rethrow_error();
+        const auto size = m_packer->packed_size();
+        std::uint64_t count = 0;
+        while(first != last) {
+            if(!reserve(size)) {
+                m_dropped += std::distance(first, last);
+                break;
+            }
+            // Pack as many colors as fit into the front buffer at once.
+            auto fit = static_cast<std::ptrdiff_t>(
+                    (m_front->data.size() - m_front->size) / size);
+            auto mid = first;
+            std::ptrdiff_t n = 0;
+            for(; n < fit && mid != last; ++n) {
+                ++mid;
+            }
+            m_packer->pack(first, mid, m_front->data.data() + m_front->size);
+            m_front->size += n * size;
+            count += n;
+            first = mid;
+        }
+        COLOR_INSTRUMENT_ELEMENTS(timer, count);
+    }
+
+    /** Write everything packed so far and sync the sink, waiting until
+     *  the data is durably stored. Sinks that cannot sync, such as an
+     *  OstreamSink, are flushed instead; see Sink::sync().
+     *  \returns good().
+     */
+    bool flush() {
+        wait_flushed();
+        rethrow_error();
+        return good();
+    }
+
+    /// True if no write has failed.
+    bool good() const { return m_state.load() == std::ios_base::goodbit; }
+
+    /// Equivalent to Sink::fail() after the last failed write.
+    bool fail() const {
+        return (m_state.load() & (std::ios_base::failbit |
+                                          std::ios_base::badbit)) != 0;
+    }
+
+    /// Equivalent to Sink::bad() after the last failed write.
+    bool bad() const { return (m_state.load() & std::ios_base::badbit) != 0; }
+
+    /// Number of colors discarded by BackpressurePolicy::Drop.
+    std::uint64_t dropped() const { return m_dropped; }
+
+    /// Get the internal Packer.
+    const Packer<Color>& get_packer() const { return *m_packer; }
+
+    /** Write all remaining colors without syncing the sink, stop the
+     *  writer thread and take ownership of the internal std::ostream, or
+     *  return null if the stream is not owned or the AsyncStreamPacker
+     *  writes to another Sink. Afterward the AsyncStreamPacker object
+     *  should not be used.
+     */
+    std::unique_ptr<std::ostream> release_stream() {
+        stop();
+        return m_ostream_sink ? m_ostream_sink->release_stream() : nullptr;
+    }
+
+private:
+    struct Buffer {
+        std::vector<char> data;
+        std::size_t size = 0;
+    };
+
+    /** Make room for \a bytes in the front buffer.
+     *  \returns false if the colors have to be dropped.
+     */
+    bool reserve(std::size_t bytes) {
+        if(m_front->data.size() - m_front->size >= bytes) {
+            return true;
+        }
+        return submit_front(m_policy);
+    }
+
+    /// Hand the front buffer to the writer and take a free one.
+    bool submit_front(BackpressurePolicy policy) {
+        if(m_front->size == 0) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Buffer* next;
+        if(policy == BackpressurePolicy::Block) {
+            m_recycled.wait(lock, [&] { return m_free.try_pop(next); });
+        } else if(!m_free.try_pop(next)) {
+            return false;
+        }
+        m_full.try_push(m_front);
+        m_front = next;
+        m_work.notify_one();
+        return true;
+    }
+
+    void wait_flushed() {
+        submit_front(BackpressurePolicy::Block);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto ticket = ++m_flush_requested;
+        m_work.notify_one();
+        m_flushed.wait(lock, [&] { return m_flush_done >= ticket; });
+    }
+
+    /// Throw the exception the sink threw on the writer thread, if any.
+    void rethrow_error() {
+        if(!bad()) {
+            return;
+        }
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            error = m_error;
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void write_loop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;) {
+            Buffer* buffer;
+            if(m_full.try_pop(buffer)) {
+                lock.unlock();
+                try {
+                    write(buffer->data.data(), buffer->size);
+                } catch(...) {
+                    set_error(std::current_exception());
+                }
+                buffer->size = 0;
+                lock.lock();
+                m_free.try_push(buffer);
+                m_recycled.notify_one();
+            } else if(m_flush_done < m_flush_requested) {
+                const auto ticket = m_flush_requested;
+                lock.unlock();
+                if(good()) {
+                    try {
+                        m_sink->sync();
+                        update_state();
+                    } catch(...) {
+                        set_error(std::current_exception());
+                    }
+                }
+                lock.lock();
+                m_flush_done = ticket;
+                m_flushed.notify_all();
+            } else if(m_stopping) {
+                return;
+            } else {
+                m_work.wait(lock);
+            }
+        }
+    }
+
+    void write(const char* data, std::size_t size) {
+        // Once a write failed, later buffers are discarded rather than
+        // written after a gap.
+        if(!good()) {
+            return;
+        }
+        m_sink->write(data, size);
+        update_state();
+    }
+
+    /// Mirror the state of the sink in m_state for the packing thread.
+    void update_state() {
+        int state = std::ios_base::goodbit;
+        if(m_sink->fail()) {
+            state |= std::ios_base::failbit;
+        }
+        if(m_sink->bad()) {
+            state |= std::ios_base::badbit;
+        }
+        m_state.store(state);
+    }
+
+    /// Record an exception thrown by the sink on the writer thread.
+    void set_error(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_error = error;
+        }
+        m_state.fetch_or(std::ios_base::badbit);
+    }
+
+    void stop() {
+        if(!m_writer.joinable()) {
+            return;
+        }
+        // The writer drains every submitted buffer before it stops.
+        submit_front(BackpressurePolicy::Block);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_work.notify_one();
+        m_writer.join();
+    }
+
+    std::unique_ptr<Sink> m_sink;
+    /// m_sink if it is an OstreamSink, otherwise null.
+    OstreamSink* m_ostream_sink = nullptr;
+    std::unique_ptr<Packer<Color>> m_packer;
+    BackpressurePolicy m_policy;
+
+    std::vector<Buffer> m_buffers;
+    // Only touched by the packing thread.
+    Buffer* m_front;
+    std::uint64_t m_dropped = 0;
+
+    // The rings only order the buffers; they are accessed under m_mutex
+    // so the condition variables cannot miss a hand-over.
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_recycled;
+    std::condition_variable m_flushed;
+    SpscRing<Buffer*> m_full;
+    SpscRing<Buffer*> m_free;
+    std::uint64_t m_flush_requested = 0;
+    std::uint64_t m_flush_done = 0;
+    bool m_stopping = false;
+    std::atomic<int> m_state{std::ios_base::goodbit};
+    /// Thrown by the sink on the writer thread, rethrown by rethrow_error().
+    std::exception_ptr m_error;
+
+    std::thread m_writer;
+};
+}
+
+#endif
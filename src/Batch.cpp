@@ -0,0 +1,6 @@
+#include "Batch.h"
+
+namespace color {
+COLOR_FOR_EACH_ELEMENT_TYPE(COLOR_BATCH_TEMPLATES, )
+COLOR_FOR_EACH_FLOAT_TYPE(COLOR_BATCH_FLOAT_TEMPLATES, )
+}
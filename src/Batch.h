@@ -0,0 +1,636 @@
+/** \file
+ *  Conversions and casts over arrays of colors.
+ *
+ *  The functions in color::batch apply the single color operations of the
+ *  same name to every color of an array. They are dispatched at runtime
+ *  to a version compiled for the best instruction set the CPU supports
+ *  (see Dispatch.h), so prefer them over a loop for large buffers.
+ */
+#ifndef COLOR_BATCH_H_
+#define COLOR_BATCH_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "ClipTelemetry.h"
+#include "Dispatch.h"
+#include "Instrumentation.h"
+#include "Rgb.h"
+#include "Alpha.h"
+#include "ColorCast.h"
+#include "Hsv.h"
+#include "Hsl.h"
+#include "Hsi.h"
+
+namespace color {
+namespace details {
+
+/// Applies a stateless function object to every color of an array.
+template <typename In, typename Out, typename Fn>
+struct transform_kernel {
+    static COLOR_ALWAYS_INLINE void run(
+            const In* in, std::size_t count, Out* out) {
+        const auto fn = Fn();
+        for(std::size_t i = 0; i < count; ++i) {
+            out[i] = fn(in[i]);
+        }
+    }
+};
+
+struct to_hsv_fn {
+    template <typename Color>
+    auto operator()(const Color& color) const {
+        return color::to_hsv(color);
+    }
+};
+
+struct to_hsl_fn {
+    template <typename Color>
+    auto operator()(const Color& color) const {
+        return color::to_hsl(color);
+    }
+};
+
+struct to_hsi_fn {
+    template <typename Color>
+    auto operator()(const Color& color) const {
+        return color::to_hsi(color);
+    }
+};
+
+struct to_rgb_fn {
+    template <typename Color>
+    auto operator()(const Color& color) const {
+        return color::to_rgb(color);
+    }
+};
+
+template <typename To>
+struct color_cast_fn {
+    template <typename Color>
+    auto operator()(const Color& color) const {
+        return color::color_cast<To>(color);
+    }
+};
+
+template <typename Fn, typename In, typename Out>
+inline void dispatch_transform(const In* in, std::size_t count, Out* out) {
+    dispatch<transform_kernel<In, Out, Fn>>(in, count, out);
+}
+
+/// Hsi -> Rgb without the out of gamut fix up, see clip_oog_mode.
+struct to_rgb_preserve_fn {
+    template <typename T>
+    auto operator()(const Hsi<T>& color) const {
+        return color::to_rgb(color, HsiOutOfGamutMode::Preserve);
+    }
+};
+
+/** Clamps the elements of \a count colors to per channel bounds and/or
+ *  counts the elements outside of them.
+ *
+ *  The main loop works on NumChannels vectors at a time, so each vector
+ *  lane always sees the same channel and its bounds. Vector extensions
+ *  are used rather than relying on the auto-vectorizer, which does not
+ *  vectorize the floating point comparisons without -fno-trapping-math.
+ */
+template <typename T, int NumChannels, bool Write, bool Count>
+struct clamp_kernel {
+    using Int = std::conditional_t<sizeof(T) == 4, std::int32_t, std::int64_t>;
+
+    struct Scalars {
+        std::uint64_t clipped = 0;
+        double total = 0.0;
+        double max_error = 0.0;
+    };
+
+    static COLOR_ALWAYS_INLINE void scalar_step(const T* in,
+            std::size_t i,
+            const T* lo,
+            const T* hi,
+            T* out,
+            Scalars& s) {
+        const T value = in[i];
+        const auto c = i % NumChannels;
+        if(Count) {
+            const T error =
+                    std::max(std::max(lo[c] - value, value - hi[c]), T(0));
+            s.clipped += error > T(0);
+            s.total += error;
+            s.max_error = std::max<double>(s.max_error, error);
+        }
+        if(Write) {
+            out[i] = std::min(std::max(value, lo[c]), hi[c]);
+        }
+    }
+
+    template <IsaLevel Level>
+    static COLOR_ALWAYS_INLINE void run_at(const T* in,
+            std::size_t count,
+            const T* lo,
+            const T* hi,
+            T* out,
+            ClipCounts* counts) {
+        const auto n = count * NumChannels;
+        std::size_t i = 0;
+        auto s = Scalars();
+
+#ifdef COLOR_VECTOR_EXTENSIONS
+        constexpr int vector_bytes = isa_vector_bytes(Level);
+        typedef T Vec __attribute__((vector_size(vector_bytes)));
+        typedef Int Mask __attribute__((vector_size(vector_bytes)));
+        constexpr int width = vector_bytes / sizeof(T);
+        constexpr std::size_t lanes = NumChannels * width;
+        // Flush the lane counters before they can overflow.
+        constexpr std::size_t block = lanes * (std::size_t(1) << 30);
+
+        Vec lo_v[NumChannels], hi_v[NumChannels];
+        for(int k = 0; k < NumChannels; ++k) {
+            for(int l = 0; l < width; ++l) {
+                lo_v[k][l] = lo[(k * width + l) % NumChannels];
+                hi_v[k][l] = hi[(k * width + l) % NumChannels];
+            }
+        }
+        const Vec zero = {};
+        Vec total[NumChannels] = {};
+        Vec max_error[NumChannels] = {};
+
+        while(i + lanes <= n) {
+            Mask clipped[NumChannels] = {};
+            const auto end = i + std::min(block, (n - i) / lanes * lanes);
+            for(; i < end; i += lanes) {
+                COLOR_UNROLL
+                for(int k = 0; k < NumChannels; ++k) {
+                    Vec v;
+                    std::memcpy(&v, in + i + k * width, sizeof(Vec));
+                    if(Count) {
+                        const Vec below = lo_v[k] - v;
+                        const Vec above = v - hi_v[k];
+                        Vec error = below > above ? below : above;
+                        error = error > zero ? error : zero;
+                        clipped[k] -= error > zero;
+                        total[k] += error;
+                        max_error[k] =
+                                max_error[k] > error ? max_error[k] : error;
+                    }
+                    if(Write) {
+                        Vec c = v < lo_v[k] ? lo_v[k] : v;
+                        c = c > hi_v[k] ? hi_v[k] : c;
+                        std::memcpy(out + i + k * width, &c, sizeof(Vec));
+                    }
+                }
+            }
+            for(int k = 0; k < NumChannels; ++k) {
+                for(int l = 0; l < width; ++l) {
+                    s.clipped += std::uint64_t(clipped[k][l]);
+                }
+            }
+        }
+        for(int k = 0; k < NumChannels; ++k) {
+            for(int l = 0; l < width; ++l) {
+                s.total += total[k][l];
+                s.max_error = std::max<double>(s.max_error, max_error[k][l]);
+            }
+        }
+#endif
+
+        for(; i < n; ++i) {
+            scalar_step(in, i, lo, hi, out, s);
+        }
+        if(Count) {
+            counts->channels += n;
+            counts->clipped += s.clipped;
+            counts->total_error += s.total;
+            counts->max_error = std::max(counts->max_error, s.max_error);
+        }
+    }
+};
+
+/** Counts the elements color_cast would truncate or push out of range
+ *  when casting \a count colors with \a From elements to \a To.
+ *  \a scale and \a shift are the per channel affine map color_cast
+ *  applies, \a range the width of each destination channel. Like
+ *  color_cast, the map is evaluated in double precision.
+ */
+template <typename From, typename To, int NumChannels>
+struct cast_loss_kernel {
+    // An integer type wide enough to hold any in-range destination value.
+    using Whole = std::conditional_t<(sizeof(To) < 4), std::int32_t,
+            std::int64_t>;
+
+    struct Scalars {
+        std::uint64_t clipped = 0;
+        std::uint64_t truncated = 0;
+        double total = 0.0;
+        double max_error = 0.0;
+    };
+
+    static constexpr double lowest() { return std::numeric_limits<To>::lowest(); }
+    static constexpr double highest() { return std::numeric_limits<To>::max(); }
+
+    static COLOR_ALWAYS_INLINE void scalar_step(const From* in,
+            std::size_t i,
+            const double* scale,
+            const double* shift,
+            const double* range,
+            Scalars& s) {
+        const auto c = i % NumChannels;
+        const double value = double(in[i]) * scale[c] + shift[c];
+        const double bounded = std::min(std::max(value, lowest()), highest());
+        const double outside = std::abs(value - bounded);
+        const double fraction = bounded - double(static_cast<Whole>(bounded));
+        const double error = (outside + fraction) / range[c];
+        s.clipped += outside > 0.0;
+        s.truncated += outside == 0.0 && fraction != 0.0;
+        s.total += error;
+        s.max_error = std::max(s.max_error, error);
+    }
+
+    template <IsaLevel Level>
+    static COLOR_ALWAYS_INLINE void run_at(const From* in,
+            std::size_t count,
+            const double* scale,
+            const double* shift,
+            const double* range,
+            ClipCounts* counts) {
+        const auto n = count * NumChannels;
+        std::size_t i = 0;
+        auto s = Scalars();
+
+#ifdef COLOR_VECTOR_EXTENSIONS
+        constexpr int vector_bytes = isa_vector_bytes(Level);
+        typedef double Vec __attribute__((vector_size(vector_bytes)));
+        typedef std::int64_t Mask __attribute__((vector_size(vector_bytes)));
+        constexpr int width = vector_bytes / sizeof(double);
+        typedef From Source __attribute__((vector_size(width * sizeof(From))));
+        typedef Whole Wholes __attribute__((vector_size(width * sizeof(Whole))));
+        constexpr std::size_t lanes = NumChannels * width;
+
+        Vec scale_v[NumChannels], shift_v[NumChannels], inv_range_v[NumChannels];
+        for(int k = 0; k < NumChannels; ++k) {
+            for(int l = 0; l < width; ++l) {
+                const auto c = (k * width + l) % NumChannels;
+                scale_v[k][l] = scale[c];
+                shift_v[k][l] = shift[c];
+                inv_range_v[k][l] = 1.0 / range[c];
+            }
+        }
+        const Vec zero = {};
+        const Vec low = zero + lowest();
+        const Vec high = zero + highest();
+        Mask clipped[NumChannels] = {};
+        Mask truncated[NumChannels] = {};
+        Vec total[NumChannels] = {};
+        Vec max_error[NumChannels] = {};
+
+        for(; i + lanes <= n; i += lanes) {
+            COLOR_UNROLL
+            for(int k = 0; k < NumChannels; ++k) {
+                Source raw;
+                std::memcpy(&raw, in + i + k * width, sizeof(Source));
+                const Vec value = __builtin_convertvector(raw, Vec) * scale_v[k] +
+                        shift_v[k];
+                Vec bounded = value < low ? low : value;
+                bounded = bounded > high ? high : bounded;
+                Vec outside = value - bounded;
+                outside = outside < zero ? -outside : outside;
+                const Vec whole = __builtin_convertvector(
+                        __builtin_convertvector(bounded, Wholes), Vec);
+                const Vec fraction = bounded - whole;
+                const Mask is_clipped = outside > zero;
+                clipped[k] -= is_clipped;
+                truncated[k] -= (fraction != zero) & ~is_clipped;
+                const Vec error = (outside + fraction) * inv_range_v[k];
+                total[k] += error;
+                max_error[k] = max_error[k] > error ? max_error[k] : error;
+            }
+        }
+        for(int k = 0; k < NumChannels; ++k) {
+            for(int l = 0; l < width; ++l) {
+                s.clipped += std::uint64_t(clipped[k][l]);
+                s.truncated += std::uint64_t(truncated[k][l]);
+                s.total += total[k][l];
+                s.max_error = std::max(s.max_error, max_error[k][l]);
+            }
+        }
+#endif
+
+        for(; i < n; ++i) {
+            scalar_step(in, i, scale, shift, range, s);
+        }
+        counts->channels += n;
+        counts->clipped += s.clipped;
+        counts->truncated += s.truncated;
+        counts->total_error += s.total;
+        counts->max_error = std::max(counts->max_error, s.max_error);
+    }
+};
+
+template <typename Channel>
+struct channel_template;
+
+template <template <typename> class Channel, typename T>
+struct channel_template<Channel<T>> {
+    template <typename U>
+    using rebind = Channel<U>;
+};
+
+template <typename Color, std::size_t index>
+using channel_type = std::decay_t<
+        std::tuple_element_t<index, typename Color::ConstChannelTupleType>>;
+
+/// Bounds normalize() clamps channel \a index of Color to, if any.
+template <typename Color, std::size_t index>
+constexpr typename Color::ElementType normalize_bound(bool upper) {
+    using T = typename Color::ElementType;
+    using Channel = channel_type<Color, index>;
+    return std::is_same<Channel, BoundedChannel<T>>::value
+            ? (upper ? Channel::max_value() : Channel::min_value())
+            : (upper ? std::numeric_limits<T>::infinity()
+                     : -std::numeric_limits<T>::infinity());
+}
+
+template <typename Color, std::size_t... indices>
+constexpr std::array<typename Color::ElementType, sizeof...(indices)>
+normalize_bounds(bool upper, std::index_sequence<indices...>) {
+    return {{normalize_bound<Color, indices>(upper)...}};
+}
+
+/// The per channel affine map color_cast<To> applies, and the range of
+/// each destination channel.
+template <typename To, typename Color, std::size_t index>
+struct cast_channel {
+    using From = channel_type<Color, index>;
+    using Dest = typename channel_template<From>::template rebind<To>;
+
+    static constexpr double range() {
+        return double(Dest::end_point()) - double(Dest::min_value());
+    }
+    static constexpr double scale() {
+        return range() /
+                (double(From::end_point()) - double(From::min_value()));
+    }
+    static constexpr double shift() {
+        return double(Dest::min_value()) - double(From::min_value());
+    }
+};
+
+template <typename To, typename Color, std::size_t... indices>
+inline void cast_loss(const Color* in,
+        std::size_t count,
+        ClipCounts& counts,
+        std::index_sequence<indices...>) {
+    const double scale[] = {cast_channel<To, Color, indices>::scale()...};
+    const double shift[] = {cast_channel<To, Color, indices>::shift()...};
+    const double range[] = {cast_channel<To, Color, indices>::range()...};
+    dispatch<cast_loss_kernel<typename Color::ElementType,
+            To,
+            Color::num_channels>>(
+            in->data(), count, scale, shift, range, &counts);
+}
+
+template <typename In, typename Out>
+inline void batch_to_rgb(const In* in, std::size_t count, Out* out) {
+    dispatch_transform<to_rgb_fn>(in, count, out);
+}
+
+// With instrumentation on, convert without the gamut fix up and apply it
+// in a separate counting pass. The fix up only clamps each channel to at
+// most 1, so the result is identical.
+template <typename T>
+inline void batch_to_rgb(const Hsi<T>* in, std::size_t count, Rgb<T>* out) {
+#ifdef COLOR_ENABLE_INSTRUMENTATION
+    dispatch_transform<to_rgb_preserve_fn>(in, count, out);
+    const T lo[] = {-std::numeric_limits<T>::infinity(),
+            -std::numeric_limits<T>::infinity(),
+            -std::numeric_limits<T>::infinity()};
+    const T hi[] = {T(1.0), T(1.0), T(1.0)};
+    auto counts = ClipCounts();
+    dispatch<clamp_kernel<T, 3, true, true>>(
+            out->data(), count, lo, hi, out->data(), &counts);
+    instrumentation::record_clip("batch::to_rgb(Hsi)", counts);
+#else
+    dispatch_transform<to_rgb_fn>(in, count, out);
+#endif
+}
+}
+
+namespace batch {
+
+/** Convert \a count colors from \a in to HSV, writing them to \a out.
+ *  Equivalent to calling color::to_hsv on every color.
+ */
+template <typename In>
+void to_hsv(const In* in,
+        std::size_t count,
+        decltype(color::to_hsv(*in))* out) {
+    COLOR_INSTRUMENT_SCOPE(timer, "batch::to_hsv", count);
+    details::dispatch_transform<details::to_hsv_fn>(in, count, out);
+}
+
+/** Convert \a count colors from \a in to HSL, writing them to \a out.
+ *  Equivalent to calling color::to_hsl on every color.
+ */
+template <typename In>
+void to_hsl(const In* in,
+        std::size_t count,
+        decltype(color::to_hsl(*in))* out) {
+    COLOR_INSTRUMENT_SCOPE(timer, "batch::to_hsl", count);
+    details::dispatch_transform<details::to_hsl_fn>(in, count, out);
+}
+
+/** Convert \a count colors from \a in to HSI, writing them to \a out.
+ *  Equivalent to calling color::to_hsi on every color.
+ */
+template <typename In>
+void to_hsi(const In* in,
+        std::size_t count,
+        decltype(color::to_hsi(*in))* out) {
+    COLOR_INSTRUMENT_SCOPE(timer, "batch::to_hsi", count);
+    details::dispatch_transform<details::to_hsi_fn>(in, count, out);
+}
+
+/** Convert \a count colors from \a in to RGB, writing them to \a out.
+ *  Equivalent to calling color::to_rgb on every color, with the default
+ *  out of gamut handling for HSI.
+ */
+template <typename In>
+void to_rgb(const In* in,
+        std::size_t count,
+        decltype(color::to_rgb(*in))* out) {
+    COLOR_INSTRUMENT_SCOPE(timer, "batch::to_rgb", count);
+    details::batch_to_rgb(in, count, out);
+}
+
+/** Count the channel values of \a count colors that
+ *  color::color_cast<To> would push out of the range of \a To or
+ *  truncate. Casts to floating point types are treated as lossless.
+ */
+template <typename To, typename In>
+ClipCounts count_cast_loss(const In* in, std::size_t count) {
+    auto counts = ClipCounts();
+    if(std::is_integral<To>::value) {
+        details::cast_loss<To>(in,
+                count,
+                counts,
+                std::make_index_sequence<In::num_channels>());
+    } else {
+        counts.channels = count * In::num_channels;
+    }
+    return counts;
+}
+
+/** Cast the components of \a count colors from \a in to \a To, writing
+ *  the results to \a out. Equivalent to calling color::color_cast<To>
+ *  on every color.
+ *
+ *  With instrumentation enabled, narrowing casts record the values they
+ *  truncate as the clip telemetry operation "batch::color_cast".
+ */
+template <typename To, typename In>
+void color_cast(const In* in,
+        std::size_t count,
+        decltype(color::color_cast<To>(*in))* out) {
+    COLOR_INSTRUMENT_SCOPE(timer, "batch::color_cast", count);
+#ifdef COLOR_ENABLE_INSTRUMENTATION
+    if(std::is_integral<To>::value &&
+            !std::is_same<To, typename In::ElementType>::value) {
+        instrumentation::record_clip(
+                "batch::color_cast", count_cast_loss<To>(in, count));
+    }
+#endif
+    details::dispatch_transform<details::color_cast_fn<To>>(in, count, out);
+}
+
+/** Count the channel values of \a count colors that normalize() would
+ *  change, i.e. bounded channels outside of `[0, 1]`. Periodic channels
+ *  wrap rather than saturate and are not counted as clipped.
+ */
+template <typename Color>
+ClipCounts count_out_of_range(const Color* in, std::size_t count) {
+    using T = typename Color::ElementType;
+    static_assert(std::is_floating_point<T>::value,
+            "Only floating point channels can be out of range");
+    using indices = std::make_index_sequence<Color::num_channels>;
+    const auto lo = details::normalize_bounds<Color>(false, indices());
+    const auto hi = details::normalize_bounds<Color>(true, indices());
+    auto counts = ClipCounts();
+    dispatch<details::clamp_kernel<T, Color::num_channels, false, true>>(
+            in->data(),
+            count,
+            lo.data(),
+            hi.data(),
+            static_cast<T*>(nullptr),
+            &counts);
+    return counts;
+}
+
+/** Clamp the bounded channels of \a count colors to `[0, 1]` in place,
+ *  like assigning every BoundedChannel its normalize() value.
+ *
+ *  With instrumentation enabled, the clamped values are recorded as the
+ *  clip telemetry operation "batch::normalize".
+ */
+template <typename Color>
+void normalize(Color* colors, std::size_t count) {
+    using T = typename Color::ElementType;
+    static_assert(std::is_floating_point<T>::value,
+            "Integer channels are always normalized");
+    COLOR_INSTRUMENT_SCOPE(timer, "batch::normalize", count);
+    using indices = std::make_index_sequence<Color::num_channels>;
+    const auto lo = details::normalize_bounds<Color>(false, indices());
+    const auto hi = details::normalize_bounds<Color>(true, indices());
+#ifdef COLOR_ENABLE_INSTRUMENTATION
+    auto counts = ClipCounts();
+    dispatch<details::clamp_kernel<T, Color::num_channels, true, true>>(
+            colors->data(), count, lo.data(), hi.data(), colors->data(), &counts);
+    instrumentation::record_clip("batch::normalize", counts);
+#else
+    dispatch<details::clamp_kernel<T, Color::num_channels, true, false>>(
+            colors->data(),
+            count,
+            lo.data(),
+            hi.data(),
+            colors->data(),
+            static_cast<ClipCounts*>(nullptr));
+#endif
+}
+
+/** Clamp every channel of \a count colors to `[min, max]` in place,
+ *  like ChannelBase::clamp.
+ *
+ *  With instrumentation enabled, the clamped values are recorded as the
+ *  clip telemetry operation "batch::clamp", with errors in channel units.
+ */
+template <typename Color>
+void clamp(Color* colors,
+        std::size_t count,
+        typename Color::ElementType min,
+        typename Color::ElementType max) {
+    using T = typename Color::ElementType;
+    static_assert(std::is_floating_point<T>::value,
+            "batch::clamp supports floating point channels");
+    COLOR_INSTRUMENT_SCOPE(timer, "batch::clamp", count);
+    auto lo = std::array<T, Color::num_channels>();
+    auto hi = std::array<T, Color::num_channels>();
+    lo.fill(min);
+    hi.fill(max);
+#ifdef COLOR_ENABLE_INSTRUMENTATION
+    auto counts = ClipCounts();
+    dispatch<details::clamp_kernel<T, Color::num_channels, true, true>>(
+            colors->data(), count, lo.data(), hi.data(), colors->data(), &counts);
+    instrumentation::record_clip("batch::clamp", counts);
+#else
+    dispatch<details::clamp_kernel<T, Color::num_channels, true, false>>(
+            colors->data(),
+            count,
+            lo.data(),
+            hi.data(),
+            colors->data(),
+            static_cast<ClipCounts*>(nullptr));
+#endif
+}
+}
+}
+
+#ifdef COLOR_EXTERN_TEMPLATES
+#include "Instantiation.h"
+
+namespace color {
+#define COLOR_BATCH_TEMPLATES(prefix, T)                                       \
+    prefix template void batch::to_hsv(const Rgb<T>*, std::size_t, Hsv<T>*);   \
+    prefix template void batch::to_hsl(const Rgb<T>*, std::size_t, Hsl<T>*);   \
+    prefix template void batch::to_hsi(const Rgb<T>*, std::size_t, Hsi<T>*);   \
+    prefix template void batch::to_rgb(const Hsv<T>*, std::size_t, Rgb<T>*);   \
+    prefix template void batch::to_rgb(const Hsl<T>*, std::size_t, Rgb<T>*);   \
+    prefix template void batch::color_cast<std::uint8_t>(                      \
+            const Rgb<T>*, std::size_t, Rgb<std::uint8_t>*);                   \
+    prefix template void batch::color_cast<std::uint16_t>(                     \
+            const Rgb<T>*, std::size_t, Rgb<std::uint16_t>*);                  \
+    prefix template void batch::color_cast<float>(                             \
+            const Rgb<T>*, std::size_t, Rgb<float>*);                          \
+    prefix template void batch::color_cast<double>(                            \
+            const Rgb<T>*, std::size_t, Rgb<double>*);
+
+// Hsi -> Rgb and normalization only apply to floating point channels.
+#define COLOR_BATCH_FLOAT_TEMPLATES(prefix, T)                                 \
+    prefix template void batch::to_rgb(const Hsi<T>*, std::size_t, Rgb<T>*);   \
+    prefix template void batch::normalize(Rgb<T>*, std::size_t);               \
+    prefix template void batch::normalize(Rgba<T>*, std::size_t);              \
+    prefix template ClipCounts batch::count_out_of_range(                      \
+            const Rgb<T>*, std::size_t);
+
+COLOR_FOR_EACH_ELEMENT_TYPE(COLOR_BATCH_TEMPLATES, extern)
+COLOR_FOR_EACH_FLOAT_TYPE(COLOR_BATCH_FLOAT_TEMPLATES, extern)
+}
+#endif
+
+#endif
@@ -0,0 +1,913 @@
+/** \file
+ *  Block compression for packed color data.
+ *
+ *  Defines BlockEncoder and BlockDecoder, the in-memory functions
+ *  compress_blocks() and decompress_blocks(), and the CompressingSink and
+ *  DecompressingStreamBuf adapters for stream packers and unpackers.
+ */
+#ifndef COLOR_BLOCKCODEC_H_
+#define COLOR_BLOCKCODEC_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Dispatch.h"
+#include "Exceptions.h"
+#include "Instrumentation.h"
+#include "Parallel.h"
+#include "Sink.h"
+
+namespace color {
+
+/// Back end that compresses a filtered block.
+enum class BlockCodecMethod {
+    /// Store blocks uncompressed.
+    Store,
+    /// Run-length coding of repeated bytes; the fastest method.
+    Rle,
+    /** LZ77 with a hashed match finder; slower to encode than Rle, but it
+     *  also finds repeated sequences such as textures and gradients.
+     */
+    Lz
+};
+
+/// Parameters of the block codec.
+struct BlockCodecOptions {
+    /** Bytes of packed data per block, rounded down to a multiple of
+     *  stride. Larger blocks compress better; smaller blocks allow more
+     *  parallelism when decoding.
+     */
+    std::size_t block_size = std::size_t(1) << 16;
+    /** Bytes per packed color, usually Packer::packed_size(). The delta
+     *  filter subtracts each byte of the previous color.
+     */
+    std::size_t stride = 1;
+    /** Bytes per channel element, e.g. `sizeof(float)`. The shuffle
+     *  filter groups the n-th byte of every element together.
+     */
+    std::size_t element_size = 1;
+    /// Replace every color by its difference to the previous one.
+    bool delta = true;
+    /// Transpose the bytes of multi-byte elements into byte planes.
+    bool shuffle = true;
+    BlockCodecMethod method = BlockCodecMethod::Lz;
+};
+
+namespace details {
+
+inline void store_le(char* out, std::uint32_t value, int bytes) {
+    for(int i = 0; i < bytes; ++i) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+inline std::uint32_t load_le(const char* in, int bytes) {
+    std::uint32_t value = 0;
+    for(int i = 0; i < bytes; ++i) {
+        value |= std::uint32_t(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+/** Header in front of every encoded block. All fields are little endian:
+ *  raw size (4 bytes), payload size (4), stride (2), element size (1) and
+ *  flags (1), with the method in bits 0-1, delta in bit 2 and shuffle in
+ *  bit 3.
+ */
+struct BlockHeader {
+    static constexpr std::size_t size = 12;
+    static constexpr std::uint32_t max_block_size = std::uint32_t(1) << 30;
+
+    std::uint32_t raw_size = 0;
+    std::uint32_t payload_size = 0;
+    std::uint32_t stride = 1;
+    std::uint32_t element_size = 1;
+    BlockCodecMethod method = BlockCodecMethod::Store;
+    bool delta = false;
+    bool shuffle = false;
+
+    void store(char* out) const {
+        store_le(out, raw_size, 4);
+        store_le(out + 4, payload_size, 4);
+        store_le(out + 8, stride, 2);
+        store_le(out + 10, element_size, 1);
+        store_le(out + 11,
+                static_cast<std::uint32_t>(method) | (delta ? 4 : 0) |
+                        (shuffle ? 8 : 0),
+                1);
+    }
+
+    /// \throws CorruptDataError if the header is invalid.
+    static BlockHeader load(const char* in) {
+        auto header = BlockHeader();
+        header.raw_size = load_le(in, 4);
+        header.payload_size = load_le(in + 4, 4);
+        header.stride = load_le(in + 8, 2);
+        header.element_size = load_le(in + 10, 1);
+        const auto flags = load_le(in + 11, 1);
+        header.method = static_cast<BlockCodecMethod>(flags & 3);
+        header.delta = (flags & 4) != 0;
+        header.shuffle = (flags & 8) != 0;
+        if((flags & 3) > 2 || flags > 15 || header.stride == 0 ||
+                header.element_size == 0 ||
+                header.raw_size > max_block_size ||
+                header.payload_size > max_block_size) {
+            throw CorruptDataError("invalid block header");
+        }
+        // Reject sizes the payload cannot decode to before anyone
+        // allocates memory for them.
+        if(header.raw_size >
+                        max_raw_size(header.method, header.payload_size) ||
+                (header.method == BlockCodecMethod::Store &&
+                        header.raw_size != header.payload_size)) {
+            throw CorruptDataError("invalid block size");
+        }
+        return header;
+    }
+
+    /// The most bytes \a payload_size bytes encoded with \a method decode to.
+    static std::uint64_t max_raw_size(
+            BlockCodecMethod method, std::uint64_t payload_size);
+};
+
+inline void delta_encode(const unsigned char* in,
+        std::size_t size,
+        std::size_t stride,
+        unsigned char* out) {
+    const auto head = std::min(stride, size);
+    std::memcpy(out, in, head);
+    for(std::size_t i = head; i < size; ++i) {
+        out[i] = static_cast<unsigned char>(in[i] - in[i - stride]);
+    }
+}
+
+/** Undo delta_encode() for a \a Stride known at compile time. The running
+ *  sums of a whole color are kept in registers, so the bytes of a color
+ *  are added independently instead of in one long dependency chain.
+ */
+template <std::size_t Stride>
+void delta_decode_fixed(unsigned char* data, std::size_t size) {
+    unsigned char sum[Stride];
+    std::memcpy(sum, data, Stride);
+    std::size_t i = Stride;
+    for(; i + Stride <= size; i += Stride) {
+        COLOR_UNROLL
+        for(std::size_t b = 0; b < Stride; ++b) {
+            sum[b] = static_cast<unsigned char>(sum[b] + data[i + b]);
+            data[i + b] = sum[b];
+        }
+    }
+    for(; i < size; ++i) {
+        data[i] = static_cast<unsigned char>(data[i] + data[i - Stride]);
+    }
+}
+
+inline void delta_decode(
+        unsigned char* data, std::size_t size, std::size_t stride) {
+    if(size <= stride) {
+        return;
+    }
+    switch(stride) {
+    case 3:
+        return delta_decode_fixed<3>(data, size);
+    case 4:
+        return delta_decode_fixed<4>(data, size);
+    case 6:
+        return delta_decode_fixed<6>(data, size);
+    case 8:
+        return delta_decode_fixed<8>(data, size);
+    case 12:
+        return delta_decode_fixed<12>(data, size);
+    case 16:
+        return delta_decode_fixed<16>(data, size);
+    default:
+        for(std::size_t i = stride; i < size; ++i) {
+            data[i] = static_cast<unsigned char>(data[i] + data[i - stride]);
+        }
+    }
+}
+
+/// Transpose \a n elements of \a Size bytes at \a in into byte planes.
+template <std::size_t Size>
+void shuffle_fixed(
+        const unsigned char* in, std::size_t n, unsigned char* out) {
+    for(std::size_t j = 0; j < n; ++j) {
+        COLOR_UNROLL
+        for(std::size_t k = 0; k < Size; ++k) {
+            out[k * n + j] = in[j * Size + k];
+        }
+    }
+}
+
+template <std::size_t Size>
+void unshuffle_fixed(
+        const unsigned char* in, std::size_t n, unsigned char* out) {
+    for(std::size_t j = 0; j < n; ++j) {
+        COLOR_UNROLL
+        for(std::size_t k = 0; k < Size; ++k) {
+            out[j * Size + k] = in[k * n + j];
+        }
+    }
+}
+
+inline void shuffle_bytes(const unsigned char* in,
+        std::size_t size,
+        std::size_t element_size,
+        unsigned char* out) {
+    const auto n = size / element_size;
+    if(element_size == 2) {
+        shuffle_fixed<2>(in, n, out);
+    } else if(element_size == 4) {
+        shuffle_fixed<4>(in, n, out);
+    } else if(element_size == 8) {
+        shuffle_fixed<8>(in, n, out);
+    } else {
+        for(std::size_t k = 0; k < element_size; ++k) {
+            for(std::size_t j = 0; j < n; ++j) {
+                out[k * n + j] = in[j * element_size + k];
+            }
+        }
+    }
+    std::memcpy(out + n * element_size, in + n * element_size,
+            size - n * element_size);
+}
+
+inline void unshuffle_bytes(const unsigned char* in,
+        std::size_t size,
+        std::size_t element_size,
+        unsigned char* out) {
+    const auto n = size / element_size;
+    if(element_size == 2) {
+        unshuffle_fixed<2>(in, n, out);
+    } else if(element_size == 4) {
+        unshuffle_fixed<4>(in, n, out);
+    } else if(element_size == 8) {
+        unshuffle_fixed<8>(in, n, out);
+    } else {
+        for(std::size_t k = 0; k < element_size; ++k) {
+            for(std::size_t j = 0; j < n; ++j) {
+                out[j * element_size + k] = in[k * n + j];
+            }
+        }
+    }
+    std::memcpy(out + n * element_size, in + n * element_size,
+            size - n * element_size);
+}
+
+[[noreturn]] inline void throw_corrupt_block() {
+    throw CorruptDataError("corrupt compressed block");
+}
+
+// Run-length coding: a control byte below 128 is followed by that many
+// plus one literal bytes; a control byte c of 128 or more is followed by
+// one byte repeated c - 128 + rle_min_run times.
+static constexpr std::size_t rle_min_run = 3;
+static constexpr std::size_t rle_max_run = 127 + rle_min_run;
+static constexpr std::size_t rle_max_literals = 128;
+
+inline std::size_t rle_bound(std::size_t size) {
+    return size + size / rle_max_literals + 1;
+}
+
+inline std::size_t rle_encode(
+        const unsigned char* in, std::size_t size, unsigned char* out) {
+    auto op = out;
+    std::size_t literal_start = 0;
+    auto emit_literals = [&](std::size_t end) {
+        while(literal_start < end) {
+            const auto n = std::min(end - literal_start, rle_max_literals);
+            *op++ = static_cast<unsigned char>(n - 1);
+            std::memcpy(op, in + literal_start, n);
+            op += n;
+            literal_start += n;
+        }
+    };
+    std::size_t i = 0;
+    while(i < size) {
+        const auto limit = std::min(size - i, rle_max_run);
+        std::size_t run = 1;
+        while(run < limit && in[i + run] == in[i]) {
+            ++run;
+        }
+        if(run >= rle_min_run) {
+            emit_literals(i);
+            *op++ = static_cast<unsigned char>(128 + run - rle_min_run);
+            *op++ = in[i];
+            literal_start = i + run;
+        }
+        i += run;
+    }
+    emit_literals(size);
+    return op - out;
+}
+
+inline void rle_decode(const unsigned char* in,
+        std::size_t size,
+        unsigned char* out,
+        std::size_t out_size) {
+    const auto in_end = in + size;
+    const auto out_end = out + out_size;
+    while(in < in_end) {
+        const std::size_t control = *in++;
+        if(control < 128) {
+            const auto n = control + 1;
+            if(n > std::size_t(in_end - in) || n > std::size_t(out_end - out)) {
+                throw_corrupt_block();
+            }
+            std::memcpy(out, in, n);
+            in += n;
+            out += n;
+        } else {
+            const auto n = control - 128 + rle_min_run;
+            if(in == in_end || n > std::size_t(out_end - out)) {
+                throw_corrupt_block();
+            }
+            std::memset(out, *in++, n);
+            out += n;
+        }
+    }
+    if(out != out_end) {
+        throw_corrupt_block();
+    }
+}
+
+// LZ77 in sequences of a token byte, literals, a 2 byte offset and a
+// match length. The high nibble of the token is the literal count and the
+// low one the match length minus lz_min_match; 15 means the count
+// continues in the following bytes, each adding up to 255. The last
+// sequence only has literals.
+static constexpr int lz_hash_bits = 14;
+static constexpr std::size_t lz_min_match = 4;
+static constexpr std::size_t lz_max_offset = 65535;
+
+inline std::size_t lz_bound(std::size_t size) {
+    return size + size / 255 + 16;
+}
+
+inline std::uint64_t BlockHeader::max_raw_size(
+        BlockCodecMethod method, std::uint64_t payload_size) {
+    switch(method) {
+    case BlockCodecMethod::Rle:
+        // A repeated run is two bytes.
+        return payload_size / 2 * rle_max_run;
+    case BlockCodecMethod::Lz:
+        // Every length byte beyond a token, offset pair adds up to 255.
+        return payload_size * 255 + 16;
+    default:
+        return payload_size;
+    }
+}
+
+inline std::uint32_t read_u32(const unsigned char* p) {
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline std::uint64_t read_u64(const unsigned char* p) {
+    std::uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline unsigned char* lz_write_count(unsigned char* op, std::size_t n) {
+    for(; n >= 255; n -= 255) {
+        *op++ = 255;
+    }
+    *op++ = static_cast<unsigned char>(n);
+    return op;
+}
+
+inline unsigned char* lz_write_literals(unsigned char* op,
+        const unsigned char* literals,
+        std::size_t n,
+        std::size_t match_code) {
+    *op++ = static_cast<unsigned char>(
+            (std::min<std::size_t>(n, 15) << 4) |
+            std::min<std::size_t>(match_code, 15));
+    if(n >= 15) {
+        op = lz_write_count(op, n - 15);
+    }
+    std::memcpy(op, literals, n);
+    return op + n;
+}
+
+/** \a table must have `1 << lz_hash_bits` entries. Its contents only
+ *  speed up matching, so it does not need to be cleared between blocks.
+ */
+inline std::size_t lz_encode(const unsigned char* in,
+        std::size_t size,
+        unsigned char* out,
+        std::uint32_t* table) {
+    auto op = out;
+    std::size_t anchor = 0;
+    std::size_t ip = 0;
+    std::size_t misses = 0;
+    while(size >= lz_min_match && ip <= size - lz_min_match) {
+        const auto sequence = read_u32(in + ip);
+        const auto hash = (sequence * 2654435761u) >> (32 - lz_hash_bits);
+        const std::size_t candidate = table[hash];
+        table[hash] = static_cast<std::uint32_t>(ip);
+        if(candidate >= ip || ip - candidate > lz_max_offset ||
+                read_u32(in + candidate) != sequence) {
+            // Skip faster through data that does not compress.
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+        auto length = lz_min_match;
+        while(ip + length + 8 <= size &&
+                read_u64(in + candidate + length) ==
+                        read_u64(in + ip + length)) {
+            length += 8;
+        }
+        while(ip + length < size && in[candidate + length] == in[ip + length]) {
+            ++length;
+        }
+        const auto match_code = length - lz_min_match;
+        op = lz_write_literals(op, in + anchor, ip - anchor, match_code);
+        store_le(reinterpret_cast<char*>(op),
+                static_cast<std::uint32_t>(ip - candidate), 2);
+        op += 2;
+        if(match_code >= 15) {
+            op = lz_write_count(op, match_code - 15);
+        }
+        ip += length;
+        anchor = ip;
+    }
+    op = lz_write_literals(op, in + anchor, size - anchor, 0);
+    return op - out;
+}
+
+inline std::size_t lz_read_count(
+        const unsigned char*& ip, const unsigned char* end) {
+    std::size_t n = 0;
+    unsigned char byte;
+    do {
+        if(ip == end) {
+            throw_corrupt_block();
+        }
+        byte = *ip++;
+        n += byte;
+    } while(byte == 255);
+    return n;
+}
+
+inline void lz_decode(const unsigned char* in,
+        std::size_t size,
+        unsigned char* out,
+        std::size_t out_size) {
+    const auto in_end = in + size;
+    const auto out_begin = out;
+    const auto out_end = out + out_size;
+    for(;;) {
+        if(in == in_end) {
+            throw_corrupt_block();
+        }
+        const auto token = *in++;
+        std::size_t literals = token >> 4;
+        if(literals == 15) {
+            literals += lz_read_count(in, in_end);
+        }
+        if(literals > std::size_t(in_end - in) ||
+                literals > std::size_t(out_end - out)) {
+            throw_corrupt_block();
+        }
+        if(literals <= 16 && in_end - in >= 16 && out_end - out >= 16) {
+            // A fixed size copy is much cheaper for the short literal runs
+            // typical of color data. The extra bytes are overwritten later.
+            std::memcpy(out, in, 16);
+        } else {
+            std::memcpy(out, in, literals);
+        }
+        in += literals;
+        out += literals;
+        if(in == in_end) {
+            break;
+        }
+        if(in_end - in < 2) {
+            throw_corrupt_block();
+        }
+        const std::size_t offset =
+                load_le(reinterpret_cast<const char*>(in), 2);
+        in += 2;
+        std::size_t length = token & 15;
+        if(length == 15) {
+            length += lz_read_count(in, in_end);
+        }
+        length += lz_min_match;
+        if(offset == 0 || offset > std::size_t(out - out_begin) ||
+                length > std::size_t(out_end - out)) {
+            throw_corrupt_block();
+        }
+        if(offset >= 16 && length <= 16 && out_end - out >= 16) {
+            std::memcpy(out, out - offset, 16);
+            out += length;
+        } else if(offset == 1) {
+            std::memset(out, out[-1], length);
+            out += length;
+        } else {
+            // Overlapping matches repeat the last offset bytes, which can
+            // be copied in pieces of up to offset bytes.
+            while(length > 0) {
+                const auto n = std::min(length, offset);
+                std::memcpy(out, out - offset, n);
+                out += n;
+                length -= n;
+            }
+        }
+    }
+    if(out != out_end) {
+        throw_corrupt_block();
+    }
+}
+}
+
+/** Encodes blocks of packed colors.
+ *
+ *  Every block is encoded on its own: the delta filter, the byte shuffle
+ *  and the back end all start over, so blocks can be decoded independently
+ *  and in parallel. Blocks that do not get smaller are stored as they are.
+ *  A BlockEncoder keeps its scratch buffers between blocks; use one per
+ *  thread.
+ */
+class BlockEncoder {
+public:
+    explicit BlockEncoder(BlockCodecOptions options = BlockCodecOptions())
+        : m_options(options) {
+        m_options.stride = std::min<std::size_t>(
+                std::max<std::size_t>(m_options.stride, 1), 0xffff);
+        m_options.element_size = std::min<std::size_t>(
+                std::max<std::size_t>(m_options.element_size, 1), 0xff);
+        m_options.block_size = std::max(
+                std::min<std::size_t>(m_options.block_size,
+                        details::BlockHeader::max_block_size),
+                m_options.stride);
+        m_options.block_size -= m_options.block_size % m_options.stride;
+        if(m_options.method == BlockCodecMethod::Lz) {
+            m_table.resize(std::size_t(1) << details::lz_hash_bits);
+        }
+    }
+
+    /** Append one encoded block holding \a size bytes from \a data to
+     *  \a out. \a size must not be larger than block_size().
+     */
+    void encode(const char* data, std::size_t size, std::vector<char>& out) {
+        using details::BlockHeader;
+        auto header = BlockHeader();
+        header.raw_size = static_cast<std::uint32_t>(size);
+        header.stride = static_cast<std::uint32_t>(m_options.stride);
+        header.element_size =
+                static_cast<std::uint32_t>(m_options.element_size);
+        header.method = m_options.method;
+
+        auto src = reinterpret_cast<const unsigned char*>(data);
+        if(m_options.method != BlockCodecMethod::Store) {
+            if(m_options.delta && m_options.stride < size) {
+                m_filtered.resize(size);
+                details::delta_encode(
+                        src, size, m_options.stride, m_filtered.data());
+                src = m_filtered.data();
+                header.delta = true;
+            }
+            if(m_options.shuffle && m_options.element_size > 1) {
+                m_shuffled.resize(size);
+                details::shuffle_bytes(
+                        src, size, m_options.element_size, m_shuffled.data());
+                src = m_shuffled.data();
+                header.shuffle = true;
+            }
+        }
+
+        const auto start = out.size();
+        const auto bound = m_options.method == BlockCodecMethod::Lz
+                ? details::lz_bound(size)
+                : details::rle_bound(size);
+        out.resize(start + BlockHeader::size + bound);
+        auto payload = reinterpret_cast<unsigned char*>(
+                &out[start + BlockHeader::size]);
+        std::size_t payload_size = size;
+        if(m_options.method == BlockCodecMethod::Rle) {
+            payload_size = details::rle_encode(src, size, payload);
+        } else if(m_options.method == BlockCodecMethod::Lz) {
+            payload_size =
+                    details::lz_encode(src, size, payload, m_table.data());
+        }
+        if(payload_size >= size) {
+            header.method = BlockCodecMethod::Store;
+            header.delta = false;
+            header.shuffle = false;
+            std::memcpy(payload, data, size);
+            payload_size = size;
+        }
+        header.payload_size = static_cast<std::uint32_t>(payload_size);
+        header.store(&out[start]);
+        out.resize(start + BlockHeader::size + payload_size);
+    }
+
+    /// The size of the blocks after rounding.
+    std::size_t block_size() const { return m_options.block_size; }
+
+    /// The options after rounding.
+    const BlockCodecOptions& options() const { return m_options; }
+
+private:
+    BlockCodecOptions m_options;
+    std::vector<unsigned char> m_filtered;
+    std::vector<unsigned char> m_shuffled;
+    std::vector<std::uint32_t> m_table;
+};
+
+/** Decodes blocks written by a BlockEncoder.
+ *  A BlockDecoder keeps a scratch buffer between blocks; use one per
+ *  thread.
+ */
+class BlockDecoder {
+public:
+    /** Decode the block with \a header, whose payload is at \a payload,
+     *  into `header.raw_size` bytes at \a out.
+     *  \throws CorruptDataError if the payload is malformed.
+     */
+    void decode(const details::BlockHeader& header,
+            const char* payload,
+            char* out) {
+        COLOR_INSTRUMENT_SCOPE(
+                timer, "BlockDecoder::decode", header.raw_size);
+        auto src = reinterpret_cast<const unsigned char*>(payload);
+        auto dst = reinterpret_cast<unsigned char*>(out);
+        const auto size = header.raw_size;
+        if(header.method == BlockCodecMethod::Store) {
+            if(header.payload_size != size) {
+                details::throw_corrupt_block();
+            }
+            std::memcpy(dst, src, size);
+            return;
+        }
+        auto target = dst;
+        if(header.shuffle) {
+            m_scratch.resize(size);
+            target = m_scratch.data();
+        }
+        if(header.method == BlockCodecMethod::Rle) {
+            details::rle_decode(src, header.payload_size, target, size);
+        } else {
+            details::lz_decode(src, header.payload_size, target, size);
+        }
+        if(header.shuffle) {
+            details::unshuffle_bytes(target, size, header.element_size, dst);
+        }
+        if(header.delta) {
+            details::delta_decode(dst, size, header.stride);
+        }
+    }
+
+private:
+    std::vector<unsigned char> m_scratch;
+};
+
+/** Compress \a size bytes of packed colors at \a data into independent
+ *  blocks, encoding blocks on \a num_threads threads. 0 uses every
+ *  hardware thread.
+ */
+inline std::vector<char> compress_blocks(const char* data,
+        std::size_t size,
+        BlockCodecOptions options = BlockCodecOptions(),
+        int num_threads = 1) {
+    COLOR_INSTRUMENT_SCOPE(timer, "compress_blocks", size);
+    const auto block_size = BlockEncoder(options).block_size();
+    const auto num_blocks = (size + block_size - 1) / block_size;
+    if(num_threads <= 0) {
+        num_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+    auto parts = std::vector<std::vector<char>>(std::min<std::size_t>(
+            num_threads, std::max<std::size_t>(num_blocks, 1)));
+    const auto blocks_per_part = (num_blocks + parts.size() - 1) / parts.size();
+    details::parallel_parts(parts.size(), num_threads, 1,
+            [&](std::size_t first, std::size_t last) {
+                auto encoder = BlockEncoder(options);
+                for(auto part = first; part < last; ++part) {
+                    const auto begin =
+                            std::min(part * blocks_per_part, num_blocks);
+                    const auto end =
+                            std::min(begin + blocks_per_part, num_blocks);
+                    for(auto block = begin; block < end; ++block) {
+                        const auto offset = block * block_size;
+                        encoder.encode(data + offset,
+                                std::min(block_size, size - offset),
+                                parts[part]);
+                    }
+                }
+            });
+    auto out = std::move(parts[0]);
+    for(std::size_t i = 1; i < parts.size(); ++i) {
+        out.insert(out.end(), parts[i].begin(), parts[i].end());
+    }
+    return out;
+}
+
+/** Decompress the blocks in \a size bytes at \a data, decoding blocks on
+ *  \a num_threads threads. 0 uses every hardware thread.
+ *  \throws CorruptDataError if the data is truncated or malformed.
+ */
+inline std::vector<char> decompress_blocks(
+        const char* data, std::size_t size, int num_threads = 0) {
+    using details::BlockHeader;
+    COLOR_INSTRUMENT_SCOPE(timer, "decompress_blocks", 0);
+    struct Block {
+        BlockHeader header;
+        std::size_t in_offset;
+        std::size_t out_offset;
+    };
+    // The headers give the position of every block in the output, so the
+    // blocks can then be decoded in any order.
+    auto blocks = std::vector<Block>();
+    std::size_t in_offset = 0;
+    std::size_t out_offset = 0;
+    while(in_offset < size) {
+        if(size - in_offset < BlockHeader::size) {
+            throw CorruptDataError("truncated block header");
+        }
+        const auto header = BlockHeader::load(data + in_offset);
+        in_offset += BlockHeader::size;
+        if(size - in_offset < header.payload_size) {
+            throw CorruptDataError("truncated block");
+        }
+        blocks.push_back(Block{header, in_offset, out_offset});
+        in_offset += header.payload_size;
+        out_offset += header.raw_size;
+    }
+    auto out = std::vector<char>(out_offset);
+    details::parallel_parts(blocks.size(), num_threads, 1,
+            [&](std::size_t first, std::size_t last) {
+                auto decoder = BlockDecoder();
+                for(auto i = first; i < last; ++i) {
+                    decoder.decode(blocks[i].header,
+                            data + blocks[i].in_offset,
+                            out.data() + blocks[i].out_offset);
+                }
+            });
+    COLOR_INSTRUMENT_ELEMENTS(timer, out.size());
+    return out;
+}
+
+/** Sink that compresses everything written to it into independent blocks
+ *  and writes them to another Sink.
+ *
+ *  Writes are collected into blocks of BlockCodecOptions::block_size
+ *  bytes; flush() also ends the current block. Since stream packers only
+ *  write whole colors, every block starts at a color as long as
+ *  BlockCodecOptions::stride is the packed size of a color. The result can
+ *  be read with DecompressingStreamBuf, StreamUnpacker::enable_decompression()
+ *  or decompress_blocks().
+ */
+class CompressingSink : public Sink {
+public:
+    CompressingSink(std::unique_ptr<Sink> inner,
+            BlockCodecOptions options = BlockCodecOptions())
+        : m_inner(std::move(inner)), m_encoder(options) {
+        m_raw.resize(m_encoder.block_size());
+    }
+
+    /** Compress and write the last block. Errors are swallowed here, so
+     *  call flush() first to see them.
+     */
+    ~CompressingSink() override {
+        try {
+            flush();
+        } catch(...) {
+        }
+    }
+
+    CompressingSink(const CompressingSink& other) = delete;
+    CompressingSink& operator=(const CompressingSink& other) = delete;
+
+    void write(const void* data, std::size_t size) override {
+        auto bytes = static_cast<const char*>(data);
+        const auto block_size = m_raw.size();
+        while(size > 0) {
+            if(m_used == 0 && size >= block_size) {
+                write_block(bytes, block_size);
+                bytes += block_size;
+                size -= block_size;
+                continue;
+            }
+            const auto n = std::min(size, block_size - m_used);
+            std::memcpy(m_raw.data() + m_used, bytes, n);
+            commit(n);
+            bytes += n;
+            size -= n;
+        }
+    }
+
+    void* reserve(std::size_t size) override {
+        return size <= m_raw.size() - m_used ? m_raw.data() + m_used : nullptr;
+    }
+
+    void commit(std::size_t size) override {
+        m_used += size;
+        if(m_used == m_raw.size()) {
+            write_block(m_raw.data(), m_used);
+            m_used = 0;
+        }
+    }
+
+    bool flush() override {
+        if(m_used > 0) {
+            write_block(m_raw.data(), m_used);
+            m_used = 0;
+        }
+        return m_inner->flush();
+    }
+
+    /// End the current block and sync the inner Sink.
+    bool sync() override {
+        if(m_used > 0) {
+            write_block(m_raw.data(), m_used);
+            m_used = 0;
+        }
+        return m_inner->sync();
+    }
+
+    bool good() const override { return m_inner->good(); }
+
+    bool fail() const override { return m_inner->fail(); }
+
+    bool bad() const override { return m_inner->bad(); }
+
+    /// Get the Sink the compressed blocks are written to.
+    Sink& get_inner() { return *m_inner; }
+
+private:
+    void write_block(const char* data, std::size_t size) {
+        m_encoded.clear();
+        m_encoder.encode(data, size, m_encoded);
+        m_inner->write(m_encoded.data(), m_encoded.size());
+    }
+
+    std::unique_ptr<Sink> m_inner;
+    BlockEncoder m_encoder;
+    std::vector<char> m_raw;
+    std::size_t m_used = 0;
+    std::vector<char> m_encoded;
+};
+
+/** Input stream buffer that decompresses blocks written by a
+ *  CompressingSink from another stream buffer.
+ *
+ *  Blocks are decoded one at a time as they are read. Malformed data
+ *  throws CorruptDataError from the read, which std::istream turns into
+ *  `badbit`. Seeking is not supported.
+ */
+class DecompressingStreamBuf : public std::streambuf {
+public:
+    explicit DecompressingStreamBuf(std::streambuf* source)
+        : m_source(source) {}
+
+protected:
+    int_type underflow() override {
+        using details::BlockHeader;
+        if(gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        // Skip blocks that decode to nothing in a loop, so a long run of
+        // them cannot exhaust the stack.
+        do {
+            char header_bytes[BlockHeader::size];
+            const auto read = m_source->sgetn(header_bytes, BlockHeader::size);
+            if(read == 0) {
+                setg(nullptr, nullptr, nullptr);
+                return traits_type::eof();
+            }
+            if(read < std::streamsize(BlockHeader::size)) {
+                throw CorruptDataError("truncated block header");
+            }
+            const auto header = BlockHeader::load(header_bytes);
+            m_payload.resize(header.payload_size);
+            if(m_source->sgetn(m_payload.data(), header.payload_size) <
+                    std::streamsize(header.payload_size)) {
+                throw CorruptDataError("truncated block");
+            }
+            m_raw.resize(header.raw_size);
+            m_decoder.decode(header, m_payload.data(), m_raw.data());
+        } while(m_raw.empty());
+        setg(m_raw.data(), m_raw.data(), m_raw.data() + m_raw.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::streamsize showmanyc() override { return egptr() - gptr(); }
+
+private:
+    std::streambuf* m_source;
+    BlockDecoder m_decoder;
+    std::vector<char> m_payload;
+    std::vector<char> m_raw;
+};
+}
+
+#endif
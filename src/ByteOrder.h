@@ -0,0 +1,149 @@
+/** \file
+ *  Byte order detection and bulk byte swapping.
+ */
+#ifndef COLOR_BYTEORDER_H_
+#define COLOR_BYTEORDER_H_
+
+#include <cstdint>
+#include <cstring>
+
+#include "Dispatch.h"
+
+namespace color {
+
+/// Order of the bytes of multi-byte values in memory or in a file.
+enum class ByteOrder { Little, Big };
+
+/// Return the byte order of the target.
+constexpr ByteOrder native_byte_order() {
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) &&               \
+        __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return ByteOrder::Big;
+#else
+    return ByteOrder::Little;
+#endif
+}
+
+namespace details {
+
+template <std::size_t Size>
+struct unsigned_of_size;
+
+template <>
+struct unsigned_of_size<1> {
+    using type = std::uint8_t;
+};
+
+template <>
+struct unsigned_of_size<2> {
+    using type = std::uint16_t;
+};
+
+template <>
+struct unsigned_of_size<4> {
+    using type = std::uint32_t;
+};
+
+template <>
+struct unsigned_of_size<8> {
+    using type = std::uint64_t;
+};
+
+/** Copies \a count values of type U from \a src to \a dst with their
+ *  bytes reversed. \a src and \a dst may be the same.
+ *
+ *  The swap exchanges neighboring bytes, then pairs of bytes and so on,
+ *  using only shifts and masks, so the same code works on scalars and
+ *  on vectors of U.
+ */
+template <typename U>
+struct byteswap_kernel {
+    template <typename V>
+    static COLOR_ALWAYS_INLINE void swap(V& x) {
+        COLOR_UNROLL
+        for(int s = 8; s < int(sizeof(U)) * 8; s *= 2) {
+            const auto mask =
+                    static_cast<U>(U(~U(0)) / static_cast<U>((U(1) << s) + 1));
+            x = static_cast<V>(((x & mask) << s) | ((x >> s) & mask));
+        }
+    }
+
+    template <IsaLevel Level>
+    static COLOR_ALWAYS_INLINE void run_at(
+            const unsigned char* src, std::size_t count, unsigned char* dst) {
+        std::size_t i = 0;
+
+#ifdef COLOR_VECTOR_EXTENSIONS
+        constexpr int vector_bytes = isa_vector_bytes(Level);
+        typedef U Vec __attribute__((vector_size(vector_bytes)));
+        constexpr std::size_t width = vector_bytes / sizeof(U);
+        for(; i + width <= count; i += width) {
+            Vec v;
+            std::memcpy(&v, src + i * sizeof(U), sizeof(Vec));
+            swap(v);
+            std::memcpy(dst + i * sizeof(U), &v, sizeof(Vec));
+        }
+#endif
+
+        for(; i < count; ++i) {
+            U x;
+            std::memcpy(&x, src + i * sizeof(U), sizeof(U));
+            swap(x);
+            std::memcpy(dst + i * sizeof(U), &x, sizeof(U));
+        }
+    }
+};
+}
+
+/// Return \a value with its bytes reversed.
+template <typename T>
+COLOR_ALWAYS_INLINE T byteswap_value(T value) {
+    using U = typename details::unsigned_of_size<sizeof(T)>::type;
+    U bits;
+    std::memcpy(&bits, &value, sizeof(T));
+    details::byteswap_kernel<U>::swap(bits);
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+}
+
+/** Copy \a count values of \a Size bytes each from \a src to \a dst,
+ *  reversing the bytes of every value. \a src and \a dst may be the same.
+ */
+template <std::size_t Size>
+inline void byteswap_bytes(
+        const unsigned char* src, std::size_t count, unsigned char* dst) {
+    using U = typename details::unsigned_of_size<Size>::type;
+    dispatch<details::byteswap_kernel<U>>(src, count, dst);
+}
+
+template <>
+inline void byteswap_bytes<1>(
+        const unsigned char* src, std::size_t count, unsigned char* dst) {
+    if(src != dst) {
+        std::memcpy(dst, src, count);
+    }
+}
+
+/** Copy \a count values from \a src to \a dst with their bytes reversed.
+ *  T may be any arithmetic type. \a src and \a dst may be the same.
+ */
+template <typename T>
+inline void byteswap_copy(const T* src, std::size_t count, T* dst) {
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 ||
+                    sizeof(T) == 8,
+            "byteswap supports 1, 2, 4 and 8 byte values");
+    byteswap_bytes<sizeof(T)>(reinterpret_cast<const unsigned char*>(src),
+            count,
+            reinterpret_cast<unsigned char*>(dst));
+}
+
+/** Reverse the byte order of \a count values at \a data in place.
+ *  T may be any arithmetic type; single bytes are left unchanged.
+ */
+template <typename T>
+inline void byteswap(T* data, std::size_t count) {
+    byteswap_copy(data, count, data);
+}
+}
+
+#endif
@@ -0,0 +1,182 @@
+/** \file
+ *  Byte permutation kernels for packing and unpacking colors.
+ */
+#ifndef COLOR_BYTESHUFFLE_H_
+#define COLOR_BYTESHUFFLE_H_
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "Dispatch.h"
+
+// A shuffle with a runtime pattern compiles to `pshufb` on SSSE3. Clang
+// only supports constant patterns in vector extensions.
+#if defined(COLOR_X86_DISPATCH) && !defined(__clang__)
+#define COLOR_BYTE_SHUFFLE 1
+#endif
+
+namespace color {
+namespace details {
+
+/** A permutation of the bytes of a color, which moves, duplicates, zeroes
+ *  and byte swaps elements at once.
+ *
+ *  Colors of up to 16 bytes are permuted several at a time with a single
+ *  `pshufb`, whose control vector is built once by make_byte_shuffle().
+ */
+struct ByteShuffle {
+    static constexpr std::size_t vector_bytes = 16;
+
+    std::size_t in_size = 0;
+    std::size_t out_size = 0;
+    /// Source byte of each byte of an output color, or -1 for a fill byte.
+    std::vector<int> sources;
+    /// Byte written where the source is -1, or empty for zero.
+    std::vector<unsigned char> fill;
+    /// Colors permuted per vector, or 0 if a color does not fit.
+    std::size_t colors_per_vector = 0;
+    /// `pshufb` control for colors_per_vector colors; 0x80 writes zero.
+    std::array<unsigned char, vector_bytes> pattern{};
+    /// Fill bytes for colors_per_vector colors, OR'ed into the result.
+    std::array<unsigned char, vector_bytes> fill_pattern{};
+};
+
+/** Build the ByteShuffle from colors of \a in_size bytes to colors of
+ *  `sources.size()` bytes, where byte k of an output color is byte
+ *  `sources[k]` of the input color, or `fill[k]` if that is -1. An empty
+ *  \a fill writes zero.
+ */
+inline ByteShuffle make_byte_shuffle(std::size_t in_size,
+        std::vector<int> sources,
+        std::vector<unsigned char> fill = {}) {
+    auto shuffle = ByteShuffle();
+    shuffle.in_size = in_size;
+    shuffle.out_size = sources.size();
+    shuffle.sources = std::move(sources);
+    if(!fill.empty()) {
+        fill.resize(shuffle.out_size);
+        for(std::size_t k = 0; k < shuffle.out_size; ++k) {
+            if(shuffle.sources[k] >= 0) {
+                fill[k] = 0;
+            }
+        }
+    }
+    shuffle.fill = std::move(fill);
+    const auto largest = std::max(shuffle.in_size, shuffle.out_size);
+    if(largest == 0 || largest > ByteShuffle::vector_bytes) {
+        return shuffle;
+    }
+    shuffle.colors_per_vector = ByteShuffle::vector_bytes / largest;
+    shuffle.pattern.fill(0x80);
+    for(std::size_t p = 0; p < shuffle.colors_per_vector; ++p) {
+        for(std::size_t k = 0; k < shuffle.out_size; ++k) {
+            const auto source = shuffle.sources[k];
+            if(source >= 0) {
+                shuffle.pattern[p * shuffle.out_size + k] =
+                        static_cast<unsigned char>(p * in_size + source);
+            } else if(!shuffle.fill.empty()) {
+                shuffle.fill_pattern[p * shuffle.out_size + k] =
+                        shuffle.fill[k];
+            }
+        }
+    }
+    return shuffle;
+}
+
+/** Return whether byte_shuffle_kernel permutes colors with \a shuffle in
+ *  vectors at the active IsaLevel. Otherwise element-wise kernels are
+ *  faster.
+ */
+inline bool use_byte_shuffle(const ByteShuffle& shuffle) {
+#ifdef COLOR_BYTE_SHUFFLE
+    return shuffle.colors_per_vector > 0 &&
+            active_isa_level() >= IsaLevel::Ssse3;
+#else
+    (void)shuffle;
+    return false;
+#endif
+}
+
+/** Applies a ByteShuffle to \a count colors.
+ *  From SSSE3 on, every 16 byte load yields colors_per_vector colors.
+ *  The 16 byte stores overlap the next colors, which are written
+ *  afterward, so only loads and stores that stay within the buffers are
+ *  vectorized and the rest is permuted byte by byte.
+ */
+struct byte_shuffle_kernel {
+    template <IsaLevel Level>
+    static COLOR_ALWAYS_INLINE void run_at(const unsigned char* src,
+            std::size_t count,
+            const ByteShuffle* shuffle,
+            unsigned char* dst) {
+        auto i = vector_loop(src,
+                count,
+                *shuffle,
+                dst,
+                std::integral_constant<bool, (Level >= IsaLevel::Ssse3)>());
+
+        const auto in_size = shuffle->in_size;
+        const auto out_size = shuffle->out_size;
+        const auto sources = shuffle->sources.data();
+        const auto fill =
+                shuffle->fill.empty() ? nullptr : shuffle->fill.data();
+        for(; i < count; ++i) {
+            const auto in = src + i * in_size;
+            auto out = dst + i * out_size;
+            for(std::size_t k = 0; k < out_size; ++k) {
+                out[k] = sources[k] >= 0 ? in[sources[k]]
+                                         : (fill ? fill[k] : 0);
+            }
+        }
+    }
+
+private:
+    static COLOR_ALWAYS_INLINE std::size_t vector_loop(const unsigned char*,
+            std::size_t,
+            const ByteShuffle&,
+            unsigned char*,
+            std::false_type) {
+        return 0;
+    }
+
+    static COLOR_ALWAYS_INLINE std::size_t vector_loop(const unsigned char* src,
+            std::size_t count,
+            const ByteShuffle& shuffle,
+            unsigned char* dst,
+            std::true_type) {
+        std::size_t i = 0;
+#ifdef COLOR_BYTE_SHUFFLE
+        typedef unsigned char Vec
+                __attribute__((vector_size(ByteShuffle::vector_bytes)));
+        const auto step = shuffle.colors_per_vector;
+        if(step == 0) {
+            return 0;
+        }
+        const auto in_size = shuffle.in_size;
+        const auto out_size = shuffle.out_size;
+        const auto vector_bytes = ByteShuffle::vector_bytes;
+        // The shuffle takes indices modulo 16, so zero bytes are masked.
+        Vec pattern, keep, fill;
+        std::memcpy(&pattern, shuffle.pattern.data(), vector_bytes);
+        std::memcpy(&fill, shuffle.fill_pattern.data(), vector_bytes);
+        keep = (pattern & 0x80) == 0;
+        pattern &= 0x0f;
+        while(i * in_size + vector_bytes <= count * in_size &&
+                i * out_size + vector_bytes <= count * out_size) {
+            Vec v;
+            std::memcpy(&v, src + i * in_size, vector_bytes);
+            v = (__builtin_shuffle(v, pattern) & keep) | fill;
+            std::memcpy(dst + i * out_size, &v, vector_bytes);
+            i += step;
+        }
+#endif
+        return i;
+    }
+};
+}
+}
+
+#endif
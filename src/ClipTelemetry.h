@@ -0,0 +1,293 @@
+/** \file
+ *  Statistics about channel values lost to clipping and truncation.
+ *
+ *  Several operations silently discard data: to_rgb(const Hsi<T>&) clips
+ *  out of gamut results, BoundedChannel::normalize() and clamp() saturate,
+ *  and color_cast truncates when narrowing. The batch versions of these
+ *  operations (see Batch.h) can count what they discard with vectorized
+ *  kernels. When `COLOR_ENABLE_INSTRUMENTATION` is defined they record
+ *  the counts per call site, which can be read back with clip_snapshot()
+ *  to find the pipeline stages that destroy data.
+ *
+ *  Call sites are labeled with ScopedClipSite. Operations outside any
+ *  labeled scope are recorded under the site "unlabeled".
+ */
+#ifndef COLOR_CLIPTELEMETRY_H_
+#define COLOR_CLIPTELEMETRY_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "Instrumentation.h"
+
+namespace color {
+
+/** Counts of channel values changed by a lossy batch operation.
+ *  Errors are in normalized units, i.e. as a fraction of the channel's
+ *  range, so they are comparable between element types.
+ */
+struct ClipCounts {
+    /// Number of channel values inspected.
+    std::uint64_t channels = 0;
+    /// Values outside the representable or allowed range.
+    std::uint64_t clipped = 0;
+    /// In-range values that lost precision.
+    std::uint64_t truncated = 0;
+    /// Sum of the errors of all clipped and truncated values.
+    double total_error = 0.0;
+    /// Largest single error.
+    double max_error = 0.0;
+
+    ClipCounts& operator+=(const ClipCounts& rhs) {
+        channels += rhs.channels;
+        clipped += rhs.clipped;
+        truncated += rhs.truncated;
+        total_error += rhs.total_error;
+        max_error = std::max(max_error, rhs.max_error);
+        return *this;
+    }
+};
+
+namespace instrumentation {
+
+/// Site recorded for operations outside of any ScopedClipSite.
+static constexpr const char* unlabeled_site = "unlabeled";
+
+/// Maximum number of distinct (site, operation) pairs that can be recorded.
+static constexpr int max_clip_entries = 128;
+
+/// ClipCounts accumulated for one operation at one call site.
+struct ClipStats {
+    const char* site;
+    const char* operation;
+    /// Number of recorded batch calls.
+    std::uint64_t calls;
+    ClipCounts counts;
+};
+
+namespace details {
+
+struct ClipCounters {
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> channels{0};
+    std::atomic<std::uint64_t> clipped{0};
+    std::atomic<std::uint64_t> truncated{0};
+    std::atomic<double> total_error{0.0};
+    std::atomic<double> max_error{0.0};
+
+    /// Add \a counts. Only the owning thread may call this.
+    void add(const ClipCounts& counts, std::uint64_t num_calls = 1) {
+        details::add(calls, num_calls);
+        details::add(channels, counts.channels);
+        details::add(clipped, counts.clipped);
+        details::add(truncated, counts.truncated);
+        total_error.store(total_error.load(std::memory_order_relaxed) +
+                        counts.total_error,
+                std::memory_order_relaxed);
+        max_error.store(
+                std::max(max_error.load(std::memory_order_relaxed),
+                        counts.max_error),
+                std::memory_order_relaxed);
+    }
+
+    ClipCounts load(std::uint64_t& num_calls) const {
+        auto out = ClipCounts();
+        num_calls = calls.load(std::memory_order_relaxed);
+        out.channels = channels.load(std::memory_order_relaxed);
+        out.clipped = clipped.load(std::memory_order_relaxed);
+        out.truncated = truncated.load(std::memory_order_relaxed);
+        out.total_error = total_error.load(std::memory_order_relaxed);
+        out.max_error = max_error.load(std::memory_order_relaxed);
+        return out;
+    }
+
+    void reset() {
+        calls.store(0, std::memory_order_relaxed);
+        channels.store(0, std::memory_order_relaxed);
+        clipped.store(0, std::memory_order_relaxed);
+        truncated.store(0, std::memory_order_relaxed);
+        total_error.store(0.0, std::memory_order_relaxed);
+        max_error.store(0.0, std::memory_order_relaxed);
+    }
+};
+
+using ClipTable = std::array<ClipCounters, max_clip_entries>;
+
+struct ClipRegistry {
+    std::mutex mutex;
+    std::array<const char*, max_clip_entries> sites{};
+    std::array<const char*, max_clip_entries> operations{};
+    int num_entries = 0;
+    std::vector<ClipTable*> live;
+    ClipTable retired;
+};
+
+inline ClipRegistry& clip_registry() {
+    // Never destroyed, see registry().
+    static auto* instance = new ClipRegistry();
+    return *instance;
+}
+
+inline void merge(ClipCounters& into, const ClipCounters& from) {
+    std::uint64_t calls;
+    const auto counts = from.load(calls);
+    into.add(counts, calls);
+}
+
+/// A thread's clip counters and its cache of registered entries.
+class ThreadClipCounters {
+public:
+    ThreadClipCounters() {
+        auto& reg = clip_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.live.push_back(&m_table);
+    }
+
+    ~ThreadClipCounters() {
+        auto& reg = clip_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for(int i = 0; i < reg.num_entries; ++i) {
+            merge(reg.retired[i], m_table[i]);
+        }
+        reg.live.erase(std::find(reg.live.begin(), reg.live.end(), &m_table));
+    }
+
+    /** Return the entry id of (site, operation), or -1 if the registry is
+     *  full. Looks in a per thread cache keyed on the string addresses
+     *  first, so the registry is only locked once per pair and thread.
+     */
+    int entry(const char* site, const char* operation) {
+        for(const auto& cached : m_cache) {
+            if(cached.site == site && cached.operation == operation) {
+                return cached.id;
+            }
+        }
+        const auto id = register_entry(site, operation);
+        m_cache.push_back({site, operation, id});
+        return id;
+    }
+
+    ClipCounters& operator[](int id) { return m_table[id]; }
+
+    ClipTable& table() { return m_table; }
+
+    /// Label set by the innermost ScopedClipSite on this thread.
+    const char* site = unlabeled_site;
+
+private:
+    static int register_entry(const char* site, const char* operation) {
+        auto& reg = clip_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for(int i = 0; i < reg.num_entries; ++i) {
+            if(std::strcmp(reg.sites[i], site) == 0 &&
+                    std::strcmp(reg.operations[i], operation) == 0) {
+                return i;
+            }
+        }
+        if(reg.num_entries == max_clip_entries) {
+            return -1;
+        }
+        reg.sites[reg.num_entries] = site;
+        reg.operations[reg.num_entries] = operation;
+        return reg.num_entries++;
+    }
+
+    struct CacheEntry {
+        const char* site;
+        const char* operation;
+        int id;
+    };
+
+    ClipTable m_table;
+    std::vector<CacheEntry> m_cache;
+};
+
+inline ThreadClipCounters& thread_clip_counters() {
+    static thread_local ThreadClipCounters counters;
+    return counters;
+}
+}
+
+/** Labels the batch operations of the enclosing scope on the current
+ *  thread with \a site, which must outlive the program (e.g. a string
+ *  literal). Scopes nest; the innermost label is used.
+ */
+class ScopedClipSite {
+public:
+    explicit ScopedClipSite(const char* site)
+        : m_previous(details::thread_clip_counters().site) {
+        details::thread_clip_counters().site = site;
+    }
+
+    ~ScopedClipSite() { details::thread_clip_counters().site = m_previous; }
+
+    ScopedClipSite(const ScopedClipSite& other) = delete;
+    ScopedClipSite& operator=(const ScopedClipSite& other) = delete;
+
+private:
+    const char* m_previous;
+};
+
+/** Record the result of one batch \a operation at the current call site.
+ *  Called by the batch functions when instrumentation is enabled.
+ */
+inline void record_clip(const char* operation, const ClipCounts& counts) {
+    auto& counters = details::thread_clip_counters();
+    const auto id = counters.entry(counters.site, operation);
+    if(id >= 0) {
+        counters[id].add(counts);
+    }
+}
+
+/// Return the recorded counts of every (site, operation) pair.
+inline std::vector<ClipStats> clip_snapshot() {
+    auto& reg = details::clip_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto out = std::vector<ClipStats>();
+    for(int i = 0; i < reg.num_entries; ++i) {
+        auto stats = ClipStats{reg.sites[i], reg.operations[i], 0, {}};
+        stats.counts = reg.retired[i].load(stats.calls);
+        for(auto table : reg.live) {
+            std::uint64_t calls;
+            stats.counts += (*table)[i].load(calls);
+            stats.calls += calls;
+        }
+        out.push_back(stats);
+    }
+    return out;
+}
+
+/** Return the recorded counts of \a operation at \a site, or zeros if it
+ *  was never recorded.
+ */
+inline ClipStats clip_snapshot(const char* site, const char* operation) {
+    for(const auto& stats : clip_snapshot()) {
+        if(std::strcmp(stats.site, site) == 0 &&
+                std::strcmp(stats.operation, operation) == 0) {
+            return stats;
+        }
+    }
+    return ClipStats{site, operation, 0, {}};
+}
+
+/** Reset the clip counters of the calling thread and of exited threads.
+ *  As with reset(), other running threads keep their counts.
+ */
+inline void reset_clip() {
+    auto& reg = details::clip_registry();
+    auto& own = details::thread_clip_counters().table();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for(int i = 0; i < max_clip_entries; ++i) {
+        reg.retired[i].reset();
+        own[i].reset();
+    }
+}
+}
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <tuple>
 #include <type_traits>
 #include <cmath>
+#include <utility>
 
 namespace color {
 
@@ -76,6 +77,135 @@ inline bool float_eq(const Color& lhs,
 
     return is_equal;
 }
+
+namespace details {
+
+/// True for the color classes, which provide channel tuples and data().
+template <typename T, typename = void>
+struct is_color : std::false_type {};
+
+template <typename T>
+struct is_color<T,
+        decltype(void(std::declval<typename T::ConstChannelTupleType>()),
+                void(std::declval<const T&>().data()),
+                void(T::num_channels))> : std::true_type {};
+
+template <typename Color>
+using enable_if_color_t = std::enable_if_t<is_color<Color>::value, int>;
+
+template <typename S>
+using enable_if_scalar_t = std::enable_if_t<std::is_arithmetic<S>::value, int>;
+
+/// Combine the elements of two colors pairwise with \a op.
+template <typename Color, typename Op>
+inline Color zip_elements(const Color& lhs, const Color& rhs, Op op) {
+    using T = typename Color::ElementType;
+    auto out = Color();
+    for(int k = 0; k < Color::num_channels; ++k) {
+        out.data()[k] = static_cast<T>(op(lhs.data()[k], rhs.data()[k]));
+    }
+    return out;
+}
+
+/// Apply \a op to every element of a color.
+template <typename Color, typename Op>
+inline Color map_elements(const Color& color, Op op) {
+    using T = typename Color::ElementType;
+    auto out = Color();
+    for(int k = 0; k < Color::num_channels; ++k) {
+        out.data()[k] = static_cast<T>(op(color.data()[k]));
+    }
+    return out;
+}
+}
+
+/** \name Arithmetic
+ *  Element-wise arithmetic on colors of the same type. Every element is
+ *  computed in the promoted type of the operands and converted back to
+ *  the element type, like Rgb::scale(), so integer results wrap and
+ *  truncate, and floating point results are not normalized. The product
+ *  of two colors multiplies their elements, which modulates one color by
+ *  another for floating point colors.
+ *
+ *  For whole buffers of colors, the expressions of Expressions.h compute
+ *  the same results in a single pass.
+ */
+///@{
+template <typename Color, details::enable_if_color_t<Color> = 0>
+inline Color operator+(const Color& lhs, const Color& rhs) {
+    return details::zip_elements(
+            lhs, rhs, [](auto a, auto b) { return a + b; });
+}
+
+template <typename Color, details::enable_if_color_t<Color> = 0>
+inline Color operator-(const Color& lhs, const Color& rhs) {
+    return details::zip_elements(
+            lhs, rhs, [](auto a, auto b) { return a - b; });
+}
+
+template <typename Color, details::enable_if_color_t<Color> = 0>
+inline Color operator*(const Color& lhs, const Color& rhs) {
+    return details::zip_elements(
+            lhs, rhs, [](auto a, auto b) { return a * b; });
+}
+
+template <typename Color,
+        typename S,
+        details::enable_if_color_t<Color> = 0,
+        details::enable_if_scalar_t<S> = 0>
+inline Color operator*(const Color& color, S factor) {
+    return details::map_elements(
+            color, [factor](auto a) { return a * factor; });
+}
+
+template <typename Color,
+        typename S,
+        details::enable_if_color_t<Color> = 0,
+        details::enable_if_scalar_t<S> = 0>
+inline Color operator*(S factor, const Color& color) {
+    return color * factor;
+}
+
+template <typename Color,
+        typename S,
+        details::enable_if_color_t<Color> = 0,
+        details::enable_if_scalar_t<S> = 0>
+inline Color operator/(const Color& color, S divisor) {
+    return details::map_elements(
+            color, [divisor](auto a) { return a / divisor; });
+}
+
+template <typename Color, details::enable_if_color_t<Color> = 0>
+inline Color& operator+=(Color& lhs, const Color& rhs) {
+    return lhs = lhs + rhs;
+}
+
+template <typename Color, details::enable_if_color_t<Color> = 0>
+inline Color& operator-=(Color& lhs, const Color& rhs) {
+    return lhs = lhs - rhs;
+}
+
+template <typename Color, details::enable_if_color_t<Color> = 0>
+inline Color& operator*=(Color& lhs, const Color& rhs) {
+    return lhs = lhs * rhs;
+}
+
+template <typename Color,
+        typename S,
+        details::enable_if_color_t<Color> = 0,
+        details::enable_if_scalar_t<S> = 0>
+inline Color& operator*=(Color& color, S factor) {
+    return color = color * factor;
+}
+
+template <typename Color,
+        typename S,
+        details::enable_if_color_t<Color> = 0,
+        details::enable_if_scalar_t<S> = 0>
+inline Color& operator/=(Color& color, S divisor) {
+    return color = color / divisor;
+}
+///@}
 }
 
 #endif
@@ -0,0 +1,194 @@
+/** \file
+ *  Defines ColorSpan, a view of colors in memory that is not owned, and
+ *  color_span_cast(), which views a byte buffer as colors without copying.
+ */
+#ifndef COLOR_COLORSPAN_H_
+#define COLOR_COLORSPAN_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <type_traits>
+
+#include "Exceptions.h"
+
+namespace color {
+
+namespace details {
+
+/** Checks at compile time that the bytes of \a Color are exactly its
+ *  channel elements, so a buffer of elements in channel order can be
+ *  viewed as colors.
+ */
+template <typename Color>
+struct color_layout {
+    using ElementType = typename Color::ElementType;
+
+    static_assert(std::is_standard_layout<Color>::value,
+            "Color must be standard layout to be viewed in place");
+    static_assert(std::is_trivially_copyable<Color>::value &&
+                    std::is_trivially_destructible<Color>::value,
+            "Color must be trivially copyable to be viewed in place");
+    static_assert(sizeof(Color) == Color::num_channels * sizeof(ElementType),
+            "Color must consist of exactly its channel elements");
+    static_assert(alignof(Color) == alignof(ElementType),
+            "Color must be aligned like its elements");
+
+    /// Return whether \a address is aligned for Color.
+    static bool is_aligned(const void* address) {
+        const auto bits = reinterpret_cast<std::uintptr_t>(address);
+        return bits % alignof(Color) == 0;
+    }
+};
+}
+
+/** A view of \a size colors stored contiguously at \a data, like
+ *  `std::span`. Use `ColorSpan<const Color>` for read-only views.
+ *
+ *  ColorSpan is usually created by color_span_cast() or
+ *  FlatColorUnpacker::view() over a byte buffer whose layout is exactly
+ *  that of \a Color, which is then read without unpacking.
+ *
+ *  ## Aliasing
+ *
+ *  Colors are trivially copyable and consist of nothing but their
+ *  elements (see details::color_layout), so bytes in that layout are
+ *  valid colors. A viewed buffer must not be accessed through other types
+ *  than Color, its ElementType or a character type while the view is in
+ *  use, e.g. by packing a different type into it. Buffers filled by
+ *  `read()`, `memcpy()`, `mmap()` or as arrays of characters or elements
+ *  are fine.
+ */
+template <typename Color>
+class ColorSpan {
+    static_assert(sizeof(details::color_layout<std::remove_cv_t<Color>>) > 0,
+            "checks the layout of Color");
+
+public:
+    using element_type = Color;
+    using value_type = std::remove_cv_t<Color>;
+    using ElementType = std::conditional_t<std::is_const<Color>::value,
+            const typename value_type::ElementType,
+            typename value_type::ElementType>;
+    using iterator = Color*;
+    using reverse_iterator = std::reverse_iterator<Color*>;
+
+    /// Construct an empty view.
+    constexpr ColorSpan() = default;
+
+    /// Construct a view of \a size colors at \a data.
+    constexpr ColorSpan(Color* data, std::size_t size)
+        : m_data(data), m_size(size) {}
+
+    /// Construct a read-only view from a mutable one.
+    template <typename Other,
+            typename = std::enable_if_t<
+                    std::is_convertible<Other (*)[], Color (*)[]>::value>>
+    constexpr ColorSpan(const ColorSpan<Other>& other)
+        : m_data(other.data()), m_size(other.size()) {}
+
+    constexpr Color* data() const { return m_data; }
+
+    constexpr std::size_t size() const { return m_size; }
+
+    constexpr std::size_t size_bytes() const {
+        return m_size * sizeof(Color);
+    }
+
+    constexpr bool empty() const { return m_size == 0; }
+
+    constexpr iterator begin() const { return m_data; }
+
+    constexpr iterator end() const { return m_data + m_size; }
+
+    reverse_iterator rbegin() const { return reverse_iterator(end()); }
+
+    reverse_iterator rend() const { return reverse_iterator(begin()); }
+
+    Color& operator[](std::size_t index) const {
+        assert(index < m_size && "ColorSpan index out of range");
+        return m_data[index];
+    }
+
+    Color& front() const { return (*this)[0]; }
+
+    Color& back() const { return (*this)[m_size - 1]; }
+
+    /// Get the channel elements of all colors, in memory order.
+    ElementType* elements() const {
+        return reinterpret_cast<ElementType*>(m_data);
+    }
+
+    /// Get a view of the \a count colors starting at \a offset.
+    ColorSpan subspan(std::size_t offset, std::size_t count) const {
+        assert(offset + count <= m_size && "ColorSpan subspan out of range");
+        return ColorSpan(m_data + offset, count);
+    }
+
+    /// Get a view of the colors starting at \a offset.
+    ColorSpan subspan(std::size_t offset) const {
+        return subspan(offset, m_size - offset);
+    }
+
+    /// Get a view of the first \a count colors.
+    ColorSpan first(std::size_t count) const { return subspan(0, count); }
+
+    /// Get a view of the last \a count colors.
+    ColorSpan last(std::size_t count) const {
+        return subspan(m_size - count, count);
+    }
+
+private:
+    Color* m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+/// Return whether \a address is aligned to be viewed as Color.
+template <typename Color>
+bool is_color_aligned(const void* address) {
+    return details::color_layout<std::remove_cv_t<Color>>::is_aligned(
+            address);
+}
+
+namespace details {
+
+template <typename Color, typename Byte>
+ColorSpan<Color> color_span_cast(Byte* data, std::size_t num_bytes) {
+    using Layout = color_layout<std::remove_cv_t<Color>>;
+    if(!Layout::is_aligned(data)) {
+        throw AlignmentError("Cannot view memory as colors: address is not "
+                             "aligned to " +
+                std::to_string(alignof(Color)) + " bytes");
+    }
+    assert(num_bytes % sizeof(Color) == 0 &&
+            "num_bytes must be a multiple of the size of a color");
+    return ColorSpan<Color>(
+            reinterpret_cast<Color*>(data), num_bytes / sizeof(Color));
+}
+}
+
+/** View \a num_bytes bytes at \a data as colors, without copying. The
+ *  elements of the colors must be stored in channel order and the native
+ *  byte order.
+ *  \throws AlignmentError if \a data is not aligned for Color.
+ */
+template <typename Color>
+ColorSpan<const Color> color_span_cast(
+        const void* data, std::size_t num_bytes) {
+    return details::color_span_cast<const Color>(
+            static_cast<const unsigned char*>(data), num_bytes);
+}
+
+/** View \a num_bytes bytes at \a data as mutable colors, without copying.
+ *  \throws AlignmentError if \a data is not aligned for Color.
+ */
+template <typename Color>
+ColorSpan<Color> color_span_cast(void* data, std::size_t num_bytes) {
+    return details::color_span_cast<Color>(
+            static_cast<unsigned char*>(data), num_bytes);
+}
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <tuple>
 
 #include "Channel.h"
+#include "Color.h"
 
 namespace color {
 
@@ -0,0 +1,239 @@
+/** \file
+ *  Runtime selection of instruction set specific kernels.
+ *
+ *  The library is compiled for the baseline target of the including
+ *  program, so bulk kernels are additionally compiled for a set of
+ *  instruction set levels and the best supported version is selected the
+ *  first time a kernel is called. The selection can be capped with the
+ *  `COLOR_ISA_LEVEL` environment variable (`scalar`, `sse2`, `ssse3`,
+ *  `avx2` or `avx512`), which is primarily useful for testing.
+ *
+ *  Dispatch is only available with GCC-compatible compilers on x86;
+ *  elsewhere every kernel resolves to its scalar version.
+ */
+#ifndef COLOR_DISPATCH_H_
+#define COLOR_DISPATCH_H_
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) &&         \
+        !defined(COLOR_DISABLE_DISPATCH)
+#define COLOR_X86_DISPATCH 1
+#endif
+
+#if defined(__GNUC__)
+#define COLOR_ALWAYS_INLINE inline __attribute__((always_inline))
+// Kernels may use GCC vector extensions, which each target specific
+// version lowers to its own instruction set.
+#define COLOR_VECTOR_EXTENSIONS 1
+#else
+#define COLOR_ALWAYS_INLINE inline
+#endif
+
+// Keep separately rounded multiplications and additions in kernels from
+// being fused into FMA instructions where a target provides them, so every
+// level computes the same results as the scalar code. Clang only fuses
+// within a single expression by default.
+#if defined(__GNUC__) && !defined(__clang__)
+#define COLOR_NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define COLOR_NO_FP_CONTRACT
+#endif
+
+// Fully unroll the following short loop, so arrays of vector accumulators
+// it indexes stay in registers.
+#if defined(__clang__)
+#define COLOR_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define COLOR_UNROLL _Pragma("GCC unroll 8")
+#else
+#define COLOR_UNROLL
+#endif
+
+namespace color {
+
+/// Instruction set levels kernels are compiled for, in increasing order.
+enum class IsaLevel { Scalar = 0, Sse2, Ssse3, Avx2, Avx512 };
+
+static constexpr int num_isa_levels = 5;
+
+/// Return the lower case name of an IsaLevel, as used by `COLOR_ISA_LEVEL`.
+inline const char* isa_level_name(IsaLevel level) {
+    switch(level) {
+    case IsaLevel::Scalar:
+        return "scalar";
+    case IsaLevel::Sse2:
+        return "sse2";
+    case IsaLevel::Ssse3:
+        return "ssse3";
+    case IsaLevel::Avx2:
+        return "avx2";
+    case IsaLevel::Avx512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+/** Parse an IsaLevel from its name.
+ *  \returns false if \a name is not the name of an IsaLevel.
+ */
+inline bool parse_isa_level(const char* name, IsaLevel& out) {
+    for(int i = 0; i < num_isa_levels; ++i) {
+        const auto level = static_cast<IsaLevel>(i);
+        if(std::strcmp(name, isa_level_name(level)) == 0) {
+            out = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Return the highest IsaLevel supported by the running CPU.
+inline IsaLevel detected_isa_level() {
+#ifdef COLOR_X86_DISPATCH
+    static const IsaLevel level = [] {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f") &&
+                __builtin_cpu_supports("avx512bw") &&
+                __builtin_cpu_supports("avx512vl")) {
+            return IsaLevel::Avx512;
+        } else if(__builtin_cpu_supports("avx2")) {
+            return IsaLevel::Avx2;
+        } else if(__builtin_cpu_supports("ssse3")) {
+            return IsaLevel::Ssse3;
+        } else if(__builtin_cpu_supports("sse2")) {
+            return IsaLevel::Sse2;
+        }
+        return IsaLevel::Scalar;
+    }();
+    return level;
+#else
+    return IsaLevel::Scalar;
+#endif
+}
+
+/** Return the IsaLevel kernels are dispatched to.
+ *  This is detected_isa_level(), lowered to the level named by the
+ *  `COLOR_ISA_LEVEL` environment variable if it is set. The value is
+ *  computed once; changing the environment afterward has no effect.
+ */
+inline IsaLevel active_isa_level() {
+    static const IsaLevel level = [] {
+        auto out = detected_isa_level();
+        auto forced = IsaLevel::Scalar;
+        const char* env = std::getenv("COLOR_ISA_LEVEL");
+        if(env && parse_isa_level(env, forced) && forced < out) {
+            out = forced;
+        }
+        return out;
+    }();
+    return level;
+}
+
+/** Return the widest vector size in bytes that kernels written with
+ *  vector extensions should use at \a level. Wider vectors are split
+ *  into several registers, which is slower on SSE than using the native
+ *  width and unrolling.
+ */
+constexpr int isa_vector_bytes(IsaLevel level) {
+    return level >= IsaLevel::Avx2 ? 32 : 16;
+}
+
+namespace details {
+
+// Kernels that depend on the level define `template <IsaLevel> run_at`,
+// all others a plain `run`.
+template <typename Kernel, IsaLevel Level, typename... Args>
+COLOR_ALWAYS_INLINE auto run_kernel(int, Args... args)
+        -> decltype(Kernel::template run_at<Level>(args...)) {
+    Kernel::template run_at<Level>(args...);
+}
+
+template <typename Kernel, IsaLevel Level, typename... Args>
+COLOR_ALWAYS_INLINE void run_kernel(long, Args... args) {
+    Kernel::run(args...);
+}
+
+/** Compiles a kernel once per IsaLevel.
+ *  The kernel body is either `Kernel::run(Args...)` or, if it needs to
+ *  know the level it is compiled for, `Kernel::run_at<IsaLevel>(Args...)`.
+ *  It must be declared COLOR_ALWAYS_INLINE, so that it is compiled into
+ *  each of the target specific wrappers below rather than called from
+ *  them.
+ */
+template <typename Kernel, typename... Args>
+struct isa_variants {
+    using FnType = void (*)(Args...);
+
+    COLOR_NO_FP_CONTRACT static void scalar(Args... args) {
+        run_kernel<Kernel, IsaLevel::Scalar>(0, args...);
+    }
+
+#ifdef COLOR_X86_DISPATCH
+    __attribute__((target("sse2"))) COLOR_NO_FP_CONTRACT static void sse2(
+            Args... args) {
+        run_kernel<Kernel, IsaLevel::Sse2>(0, args...);
+    }
+
+    __attribute__((target("ssse3"))) COLOR_NO_FP_CONTRACT static void ssse3(
+            Args... args) {
+        run_kernel<Kernel, IsaLevel::Ssse3>(0, args...);
+    }
+
+    __attribute__((target("avx2"))) COLOR_NO_FP_CONTRACT static void avx2(
+            Args... args) {
+        run_kernel<Kernel, IsaLevel::Avx2>(0, args...);
+    }
+
+    __attribute__((target("avx512f,avx512bw,avx512vl")))
+    COLOR_NO_FP_CONTRACT static void avx512(Args... args) {
+        run_kernel<Kernel, IsaLevel::Avx512>(0, args...);
+    }
+#endif
+
+    /** Return the version of the kernel compiled for \a level.
+     *  \a level must be supported by the running CPU.
+     */
+    static FnType get(IsaLevel level) {
+#ifdef COLOR_X86_DISPATCH
+        switch(level) {
+        case IsaLevel::Avx512:
+            return &avx512;
+        case IsaLevel::Avx2:
+            return &avx2;
+        case IsaLevel::Ssse3:
+            return &ssse3;
+        case IsaLevel::Sse2:
+            return &sse2;
+        case IsaLevel::Scalar:
+            break;
+        }
+#endif
+        return &scalar;
+    }
+};
+}
+
+/** Call the active_isa_level() version of a kernel.
+ *  The version is resolved on the first call and cached, so after that
+ *  dispatching costs one indirect call.
+ */
+template <typename Kernel, typename... Args>
+inline void dispatch(Args... args) {
+    static const auto fn =
+            details::isa_variants<Kernel, Args...>::get(active_isa_level());
+    fn(args...);
+}
+
+/** Call the version of a kernel compiled for a specific \a level,
+ *  bypassing the cached selection. \a level must not exceed
+ *  detected_isa_level(). Used to cross-check levels against each other.
+ */
+template <typename Kernel, typename... Args>
+inline void dispatch_at(IsaLevel level, Args... args) {
+    details::isa_variants<Kernel, Args...>::get(level)(args...);
+}
+}
+
+#endif
@@ -33,6 +33,38 @@ class InvalidPackingFormatError : public Exception {
 public:
     InvalidPackingFormatError(std::string what) : Exception(std::move(what)) {}
 };
+
+/// Thrown when encoded data is truncated or malformed.
+class CorruptDataError : public Exception {
+public:
+    CorruptDataError(std::string what) : Exception(std::move(what)) {}
+};
+
+/// Thrown when an image header is malformed or does not match the color
+/// type it is read into.
+class ImageFormatError : public Exception {
+public:
+    ImageFormatError(std::string what) : Exception(std::move(what)) {}
+};
+
+/// Thrown when memory is not aligned for the type it is viewed as.
+class AlignmentError : public Exception {
+public:
+    AlignmentError(std::string what) : Exception(std::move(what)) {}
+};
+
+/// Thrown when an operating system I/O call fails.
+class IOError : public Exception {
+public:
+    IOError(std::string what, int error_code)
+        : Exception(std::move(what)), m_error_code(error_code) {}
+
+    /// The `errno` value reported by the failed call.
+    int error_code() const { return m_error_code; }
+
+private:
+    int m_error_code;
+};
 }
 
 #endif
@@ -0,0 +1,688 @@
+/** \file
+ *  Expression templates for element-wise arithmetic on buffers of colors.
+ *
+ *  Applying the color operations of Rgb, Alpha and the cylindrical colors
+ *  buffer by buffer makes one pass over memory, and one temporary buffer,
+ *  per operation. The expressions in color::expr instead record a whole
+ *  formula and compute it in a single loop over the elements when it is
+ *  evaluated:
+ *
+ *      auto a = expr::buffer(src);
+ *      auto b = expr::buffer(dst);
+ *      (a * k + b.inverse()).normalize().eval(out);
+ *
+ *  Every operation converts its result to the element type, like the
+ *  color operations and the operators of Color.h, so an expression yields
+ *  exactly the colors its operations would yield one at a time. The
+ *  dispatched kernels are compiled without contracting multiplications
+ *  and additions into FMA instructions, so this holds at every level.
+ *
+ *  When all channels of a color are of the same kind, as for Rgb and
+ *  Rgba, and the expression uses no constant colors, the buffers are read
+ *  as flat arrays of elements. For floating point elements the loop is
+ *  then written with vector extensions and dispatched like the kernels of
+ *  Dispatch.h, as compilers do not vectorize the branches of clamp() and
+ *  normalize() or the possible aliasing of the output on their own. Other
+ *  expressions are computed color by color, with the channels unrolled.
+ *
+ *  Expressions refer to the buffers they read and must not outlive them.
+ *  The output of eval() may be one of the buffers read, since every
+ *  element only depends on the elements at the same position.
+ */
+#ifndef COLOR_EXPRESSIONS_H_
+#define COLOR_EXPRESSIONS_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Channel.h"
+#include "Color.h"
+#include "ColorSpan.h"
+#include "Dispatch.h"
+
+namespace color {
+namespace expr {
+namespace details {
+
+/// Size of the leaves that apply to buffers of any size.
+static constexpr std::size_t any_size =
+        std::numeric_limits<std::size_t>::max();
+
+/// The channel type of channel \a C of \a Color, e.g. BoundedChannel<T>.
+template <typename Color, std::size_t C>
+using channel_t = std::decay_t<
+        std::tuple_element_t<C, typename Color::ConstChannelTupleType>>;
+
+template <typename Color, typename Indices>
+struct same_channels_impl;
+
+template <typename Color, std::size_t... C>
+struct same_channels_impl<Color, std::index_sequence<C...>>
+        : std::is_same<std::tuple<channel_t<Color, C>...>,
+                  std::tuple<channel_t<Color, 0 * C>...>> {};
+
+/// True if every channel of \a Color is of the same channel type.
+template <typename Color>
+struct same_channels
+        : same_channels_impl<Color,
+                  std::make_index_sequence<Color::num_channels>> {};
+
+/** True if the channels of \a Color are floating point BoundedChannels,
+ *  whose operations have vector versions.
+ */
+template <typename Color>
+struct bounded_float_channels
+        : std::integral_constant<bool,
+                  same_channels<Color>::value &&
+                          std::is_floating_point<
+                                  typename Color::ElementType>::value &&
+                          std::is_same<channel_t<Color, 0>,
+                                  BoundedChannel<typename Color::ElementType>>::
+                                  value> {};
+
+inline std::size_t common_size(std::size_t lhs, std::size_t rhs) {
+    assert((lhs == rhs || lhs == any_size || rhs == any_size) &&
+            "buffers in an expression must have the same size");
+    return lhs < rhs ? lhs : rhs;
+}
+
+/// Set every lane of \a v to \a value.
+template <typename Vec, typename T>
+COLOR_ALWAYS_INLINE void splat(T value, Vec& v) {
+    for(std::size_t l = 0; l < sizeof(Vec) / sizeof(T); ++l) {
+        v[l] = value;
+    }
+}
+
+/** Evaluates a flat, vectorizable expression into \a num_elements
+ *  elements, a vector of elements at a time. The elements left over are
+ *  computed one at a time.
+ */
+template <typename Expr>
+struct eval_kernel {
+    using T = typename Expr::ElementType;
+
+    template <IsaLevel Level>
+    static COLOR_ALWAYS_INLINE void run_at(
+            const Expr* expr, std::size_t num_elements, T* out) {
+        const Expr local = *expr;
+        std::size_t i = 0;
+#ifdef COLOR_VECTOR_EXTENSIONS
+        constexpr int vector_bytes = isa_vector_bytes(Level);
+        typedef T Vec __attribute__((vector_size(vector_bytes)));
+        constexpr std::size_t width = vector_bytes / sizeof(T);
+        for(; i + width <= num_elements; i += width) {
+            // Every input is loaded before the store, so out may be one of
+            // the buffers read.
+            Vec v;
+            local.load(i, v);
+            std::memcpy(out + i, &v, sizeof(Vec));
+        }
+#endif
+        for(; i < num_elements; ++i) {
+            out[i] = local.template at<0>(i);
+        }
+    }
+};
+
+struct add_op {
+    template <typename A, typename B>
+    static COLOR_ALWAYS_INLINE auto apply(A a, B b) {
+        return a + b;
+    }
+
+    template <typename Vec>
+    static COLOR_ALWAYS_INLINE void apply_to(Vec& a, const Vec& b) {
+        a = a + b;
+    }
+};
+
+struct sub_op {
+    template <typename A, typename B>
+    static COLOR_ALWAYS_INLINE auto apply(A a, B b) {
+        return a - b;
+    }
+
+    template <typename Vec>
+    static COLOR_ALWAYS_INLINE void apply_to(Vec& a, const Vec& b) {
+        a = a - b;
+    }
+};
+
+struct mul_op {
+    template <typename A, typename B>
+    static COLOR_ALWAYS_INLINE auto apply(A a, B b) {
+        return a * b;
+    }
+
+    template <typename Vec>
+    static COLOR_ALWAYS_INLINE void apply_to(Vec& a, const Vec& b) {
+        a = a * b;
+    }
+};
+
+struct div_op {
+    template <typename A, typename B>
+    static COLOR_ALWAYS_INLINE auto apply(A a, B b) {
+        return a / b;
+    }
+
+    template <typename Vec>
+    static COLOR_ALWAYS_INLINE void apply_to(Vec& a, const Vec& b) {
+        a = a / b;
+    }
+};
+}
+
+template <typename Derived, typename Color>
+class ColorExpr;
+
+template <typename Base, typename Color>
+class InverseExpr;
+template <typename Base, typename Color>
+class NormalizeExpr;
+template <typename Base, typename Color>
+class ClampExpr;
+template <typename Lhs, typename Rhs, typename Pos, typename Color>
+class LerpExpr;
+template <typename Op, typename Lhs, typename Rhs, typename Color>
+class BinaryExpr;
+template <typename Color>
+class ConstantExpr;
+template <typename S, typename Color>
+class ScalarExpr;
+
+/** Base of all expressions over buffers of \a Color.
+ *
+ *  \a Derived implements `std::size_t size()`, the number of colors or
+ *  details::any_size for constants, `template <std::size_t C> T at(i)`,
+ *  which computes element \a i of the flat array of elements, in channel
+ *  \a C, and `static constexpr bool flat`, which is true if at() computes
+ *  the same for every channel and may be called with `C = 0` throughout.
+ *  Flat expressions that also set `vectorizable` implement
+ *  `template <typename Vec> void load(i, Vec& v)`, which computes the
+ *  elements from \a i on into \a v, a vector extension type, exactly
+ *  like at(). Vectors are not passed by value, as the expressions are
+ *  compiled for several IsaLevels with different calling conventions.
+ */
+template <typename Derived, typename Color>
+class ColorExpr {
+public:
+    using value_type = Color;
+    using ElementType = typename Color::ElementType;
+
+    /// Number of colors the expression computes.
+    std::size_t size() const { return derived().size(); }
+
+    /// The inverse of every color, see Rgb::inverse().
+    InverseExpr<Derived, Color> inverse() const {
+        return InverseExpr<Derived, Color>(derived());
+    }
+
+    /// Every color normalized, see Rgb::normalize().
+    NormalizeExpr<Derived, Color> normalize() const {
+        return NormalizeExpr<Derived, Color>(derived());
+    }
+
+    /// Every channel clamped to `[min, max]`, see Rgb::clamp().
+    ClampExpr<Derived, Color> clamp(ElementType min, ElementType max) const {
+        return ClampExpr<Derived, Color>(derived(), min, max);
+    }
+
+    /// Every color multiplied by \a factor, see Rgb::scale().
+    template <typename U,
+            typename std::enable_if_t<std::is_floating_point<U>::value,
+                    int> = 0>
+    BinaryExpr<details::mul_op, Derived, ScalarExpr<U, Color>, Color> scale(
+            U factor) const {
+        return {derived(), ScalarExpr<U, Color>(factor)};
+    }
+
+    /** Interpolate between every color and the color at the same position
+     *  of \a end, see Rgb::lerp().
+     */
+    template <typename End, typename Pos>
+    LerpExpr<Derived, End, Pos, Color> lerp(
+            const ColorExpr<End, Color>& end, Pos pos) const {
+        return {derived(), static_cast<const End&>(end), pos};
+    }
+
+    /// Interpolate between every color and the constant color \a end.
+    template <typename Pos>
+    LerpExpr<Derived, ConstantExpr<Color>, Pos, Color> lerp(
+            const Color& end, Pos pos) const {
+        return {derived(), ConstantExpr<Color>(end), pos};
+    }
+
+    /** Compute the expression into the size() colors at \a out in a
+     *  single pass.
+     */
+    void eval(Color* out) const {
+        static_assert(sizeof(color::details::color_layout<Color>) > 0,
+                "checks the layout of Color");
+        // A copy on the stack, which the compiler keeps in registers, as
+        // stores through out could otherwise alias the buffer pointers.
+        const Derived local = derived();
+        const auto count = local.size();
+        assert(count != details::any_size &&
+                "expression must read at least one buffer");
+        auto elements = reinterpret_cast<ElementType*>(out);
+        eval_elements(local,
+                count,
+                elements,
+                std::integral_constant<bool, Derived::flat>(),
+                std::integral_constant<bool, Derived::vectorizable>());
+    }
+
+    /// Compute the expression into \a out, which must have size() colors.
+    void eval(ColorSpan<Color> out) const {
+        assert(out.size() == size() && "output must have size() colors");
+        eval(out.data());
+    }
+
+    /// Compute the expression into a new vector.
+    std::vector<Color> to_vector() const {
+        auto out = std::vector<Color>(size());
+        eval(out.data());
+        return out;
+    }
+
+private:
+    const Derived& derived() const {
+        return static_cast<const Derived&>(*this);
+    }
+
+    static void eval_elements(const Derived& local,
+            std::size_t count,
+            ElementType* out,
+            std::true_type,
+            std::true_type) {
+        dispatch<details::eval_kernel<Derived>>(
+                &local, count * Color::num_channels, out);
+    }
+
+    static void eval_elements(const Derived& local,
+            std::size_t count,
+            ElementType* out,
+            std::true_type,
+            std::false_type) {
+        const auto num_elements = count * Color::num_channels;
+        for(std::size_t i = 0; i < num_elements; ++i) {
+            out[i] = local.template at<0>(i);
+        }
+    }
+
+    template <typename Vectorizable>
+    static void eval_elements(const Derived& local,
+            std::size_t count,
+            ElementType* out,
+            std::false_type,
+            Vectorizable) {
+        for(std::size_t i = 0; i < count; ++i) {
+            eval_color(local,
+                    i * Color::num_channels,
+                    out,
+                    std::make_index_sequence<Color::num_channels>());
+        }
+    }
+
+    template <std::size_t... C>
+    static void eval_color(const Derived& local,
+            std::size_t first,
+            ElementType* out,
+            std::index_sequence<C...>) {
+        const int expand[] = {
+                (out[first + C] = local.template at<C>(first + C), 0)...};
+        (void)expand;
+    }
+};
+
+/// An expression reading the colors of a buffer.
+template <typename Color>
+class BufferExpr : public ColorExpr<BufferExpr<Color>, Color> {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat = true;
+    static constexpr bool vectorizable = std::is_floating_point<T>::value;
+
+    BufferExpr(const Color* colors, std::size_t size)
+        : m_elements(reinterpret_cast<const T*>(colors)), m_size(size) {}
+
+    std::size_t size() const { return m_size; }
+
+    template <std::size_t C>
+    T at(std::size_t i) const {
+        return m_elements[i];
+    }
+
+    template <typename Vec>
+    COLOR_ALWAYS_INLINE void load(std::size_t i, Vec& v) const {
+        std::memcpy(&v, m_elements + i, sizeof(Vec));
+    }
+
+private:
+    const T* m_elements;
+    std::size_t m_size;
+};
+
+/// An expression that is the same color at every position.
+template <typename Color>
+class ConstantExpr : public ColorExpr<ConstantExpr<Color>, Color> {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat = false;
+    static constexpr bool vectorizable = false;
+
+    explicit ConstantExpr(const Color& color) : m_color(color) {}
+
+    std::size_t size() const { return details::any_size; }
+
+    template <std::size_t C>
+    T at(std::size_t) const {
+        return m_color.data()[C];
+    }
+
+private:
+    Color m_color;
+};
+
+/// A scalar operand, which applies to every element.
+template <typename S, typename Color>
+class ScalarExpr {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat = true;
+    // Computing with the scalar converted to T only gives the same results
+    // if T is what the scalar is converted to anyway.
+    static constexpr bool vectorizable = std::is_floating_point<T>::value &&
+            std::is_same<std::common_type_t<T, S>, T>::value;
+
+    explicit ScalarExpr(S value) : m_value(value) {}
+
+    std::size_t size() const { return details::any_size; }
+
+    template <std::size_t C>
+    S at(std::size_t) const {
+        return m_value;
+    }
+
+    template <typename Vec>
+    COLOR_ALWAYS_INLINE void load(std::size_t, Vec& v) const {
+        details::splat(T(m_value), v);
+    }
+
+private:
+    S m_value;
+};
+
+/// An element-wise operation of two operands, e.g. a sum.
+template <typename Op, typename Lhs, typename Rhs, typename Color>
+class BinaryExpr : public ColorExpr<BinaryExpr<Op, Lhs, Rhs, Color>, Color> {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat = Lhs::flat && Rhs::flat;
+    static constexpr bool vectorizable =
+            Lhs::vectorizable && Rhs::vectorizable;
+
+    BinaryExpr(Lhs lhs, Rhs rhs)
+        : m_lhs(std::move(lhs)), m_rhs(std::move(rhs)) {}
+
+    std::size_t size() const {
+        return details::common_size(m_lhs.size(), m_rhs.size());
+    }
+
+    template <std::size_t C>
+    T at(std::size_t i) const {
+        return static_cast<T>(Op::apply(
+                m_lhs.template at<C>(i), m_rhs.template at<C>(i)));
+    }
+
+    template <typename Vec>
+    COLOR_ALWAYS_INLINE void load(std::size_t i, Vec& v) const {
+        Vec rhs;
+        m_lhs.load(i, v);
+        m_rhs.load(i, rhs);
+        Op::apply_to(v, rhs);
+    }
+
+private:
+    Lhs m_lhs;
+    Rhs m_rhs;
+};
+
+/// Rgb::inverse() of every color.
+template <typename Base, typename Color>
+class InverseExpr : public ColorExpr<InverseExpr<Base, Color>, Color> {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat =
+            Base::flat && details::same_channels<Color>::value;
+    static constexpr bool vectorizable = Base::vectorizable &&
+            details::bounded_float_channels<Color>::value;
+
+    explicit InverseExpr(Base base) : m_base(std::move(base)) {}
+
+    std::size_t size() const { return m_base.size(); }
+
+    template <std::size_t C>
+    T at(std::size_t i) const {
+        using Channel = details::channel_t<Color, C>;
+        return Channel(m_base.template at<C>(i)).inverse();
+    }
+
+    template <typename Vec>
+    COLOR_ALWAYS_INLINE void load(std::size_t i, Vec& v) const {
+        m_base.load(i, v);
+        v = T(1) - v;
+    }
+
+private:
+    Base m_base;
+};
+
+/// Rgb::normalize() of every color.
+template <typename Base, typename Color>
+class NormalizeExpr : public ColorExpr<NormalizeExpr<Base, Color>, Color> {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat =
+            Base::flat && details::same_channels<Color>::value;
+    static constexpr bool vectorizable = Base::vectorizable &&
+            details::bounded_float_channels<Color>::value;
+
+    explicit NormalizeExpr(Base base) : m_base(std::move(base)) {}
+
+    std::size_t size() const { return m_base.size(); }
+
+    template <std::size_t C>
+    T at(std::size_t i) const {
+        using Channel = details::channel_t<Color, C>;
+        return Channel(m_base.template at<C>(i)).normalize();
+    }
+
+    template <typename Vec>
+    COLOR_ALWAYS_INLINE void load(std::size_t i, Vec& v) const {
+        const Vec zero = {};
+        Vec one;
+        details::splat(T(1), one);
+        m_base.load(i, v);
+        v = v < zero ? zero : (v > one ? one : v);
+    }
+
+private:
+    Base m_base;
+};
+
+/// Rgb::clamp() of every color.
+template <typename Base, typename Color>
+class ClampExpr : public ColorExpr<ClampExpr<Base, Color>, Color> {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat = Base::flat;
+    static constexpr bool vectorizable = Base::vectorizable;
+
+    ClampExpr(Base base, T min, T max)
+        : m_base(std::move(base)), m_min(min), m_max(max) {}
+
+    std::size_t size() const { return m_base.size(); }
+
+    template <std::size_t C>
+    T at(std::size_t i) const {
+        const T value = m_base.template at<C>(i);
+        return value < m_min ? m_min : (value > m_max ? m_max : value);
+    }
+
+    template <typename Vec>
+    COLOR_ALWAYS_INLINE void load(std::size_t i, Vec& v) const {
+        Vec min, max;
+        details::splat(m_min, min);
+        details::splat(m_max, max);
+        m_base.load(i, v);
+        v = v < min ? min : (v > max ? max : v);
+    }
+
+private:
+    Base m_base;
+    T m_min;
+    T m_max;
+};
+
+/// Rgb::lerp() between the colors of two operands.
+template <typename Lhs, typename Rhs, typename Pos, typename Color>
+class LerpExpr : public ColorExpr<LerpExpr<Lhs, Rhs, Pos, Color>, Color> {
+public:
+    using T = typename Color::ElementType;
+
+    static constexpr bool flat = Lhs::flat && Rhs::flat &&
+            details::same_channels<Color>::value;
+    static constexpr bool vectorizable = Lhs::vectorizable &&
+            Rhs::vectorizable &&
+            details::bounded_float_channels<Color>::value &&
+            std::is_same<Pos, T>::value;
+
+    LerpExpr(Lhs lhs, Rhs rhs, Pos pos)
+        : m_lhs(std::move(lhs)), m_rhs(std::move(rhs)), m_pos(pos) {}
+
+    std::size_t size() const {
+        return details::common_size(m_lhs.size(), m_rhs.size());
+    }
+
+    template <std::size_t C>
+    T at(std::size_t i) const {
+        using Channel = details::channel_t<Color, C>;
+        return Channel(m_lhs.template at<C>(i))
+                .lerp(m_rhs.template at<C>(i), m_pos);
+    }
+
+    template <typename Vec>
+    COLOR_ALWAYS_INLINE void load(std::size_t i, Vec& v) const {
+        // As details::lerp_flat().
+        const T inv_pos = T(1) - m_pos;
+        Vec end;
+        m_lhs.load(i, v);
+        m_rhs.load(i, end);
+        v = inv_pos * v + m_pos * end;
+    }
+
+private:
+    Lhs m_lhs;
+    Rhs m_rhs;
+    Pos m_pos;
+};
+
+/// An expression reading \a size colors at \a colors.
+template <typename Color>
+BufferExpr<Color> buffer(const Color* colors, std::size_t size) {
+    return BufferExpr<Color>(colors, size);
+}
+
+/// An expression reading the colors of a ColorSpan.
+template <typename Color>
+BufferExpr<std::remove_cv_t<Color>> buffer(ColorSpan<Color> colors) {
+    return BufferExpr<std::remove_cv_t<Color>>(colors.data(), colors.size());
+}
+
+/// An expression reading the colors of a vector.
+template <typename Color>
+BufferExpr<Color> buffer(const std::vector<Color>& colors) {
+    return BufferExpr<Color>(colors.data(), colors.size());
+}
+
+template <typename Color>
+BufferExpr<Color> buffer(const std::vector<Color>&& colors) = delete;
+
+/** \name Operators
+ *  Element-wise arithmetic of two expressions, of an expression and a
+ *  constant color, and of an expression and a scalar, as defined for
+ *  single colors in Color.h.
+ */
+///@{
+#define COLOR_EXPR_BINARY_OPERATOR(symbol, op)                                 \
+    template <typename L, typename R, typename Color>                          \
+    BinaryExpr<details::op, L, R, Color> operator symbol(                      \
+            const ColorExpr<L, Color>& lhs, const ColorExpr<R, Color>& rhs) {  \
+        return {static_cast<const L&>(lhs), static_cast<const R&>(rhs)};       \
+    }                                                                          \
+                                                                               \
+    template <typename L, typename Color>                                      \
+    BinaryExpr<details::op, L, ConstantExpr<Color>, Color> operator symbol(    \
+            const ColorExpr<L, Color>& lhs, const Color& rhs) {                \
+        return {static_cast<const L&>(lhs), ConstantExpr<Color>(rhs)};         \
+    }                                                                          \
+                                                                               \
+    template <typename R, typename Color>                                      \
+    BinaryExpr<details::op, ConstantExpr<Color>, R, Color> operator symbol(    \
+            const Color& lhs, const ColorExpr<R, Color>& rhs) {                \
+        return {ConstantExpr<Color>(lhs), static_cast<const R&>(rhs)};         \
+    }
+
+COLOR_EXPR_BINARY_OPERATOR(+, add_op)
+COLOR_EXPR_BINARY_OPERATOR(-, sub_op)
+COLOR_EXPR_BINARY_OPERATOR(*, mul_op)
+
+#undef COLOR_EXPR_BINARY_OPERATOR
+
+template <typename L,
+        typename Color,
+        typename S,
+        color::details::enable_if_scalar_t<S> = 0>
+BinaryExpr<details::mul_op, L, ScalarExpr<S, Color>, Color> operator*(
+        const ColorExpr<L, Color>& lhs, S factor) {
+    return {static_cast<const L&>(lhs), ScalarExpr<S, Color>(factor)};
+}
+
+template <typename R,
+        typename Color,
+        typename S,
+        color::details::enable_if_scalar_t<S> = 0>
+BinaryExpr<details::mul_op, ScalarExpr<S, Color>, R, Color> operator*(
+        S factor, const ColorExpr<R, Color>& rhs) {
+    return {ScalarExpr<S, Color>(factor), static_cast<const R&>(rhs)};
+}
+
+template <typename L,
+        typename Color,
+        typename S,
+        color::details::enable_if_scalar_t<S> = 0>
+BinaryExpr<details::div_op, L, ScalarExpr<S, Color>, Color> operator/(
+        const ColorExpr<L, Color>& lhs, S divisor) {
+    return {static_cast<const L&>(lhs), ScalarExpr<S, Color>(divisor)};
+}
+///@}
+}
+}
+
+#endif
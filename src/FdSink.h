@@ -0,0 +1,309 @@
+/** \file
+ *  Defines the FdSink class.
+ *
+ *  FdSink uses POSIX file descriptors and is only available on POSIX
+ *  systems.
+ */
+#ifndef COLOR_FDSINK_H_
+#define COLOR_FDSINK_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "Exceptions.h"
+#include "Sink.h"
+
+namespace color {
+
+/// Options of an FdSink.
+struct FdSinkOptions {
+    /** Size of the write buffer in bytes, rounded up to a multiple of
+     *  FdSink::alignment.
+     */
+    std::size_t buffer_size = std::size_t(1) << 20;
+    /** Open files with `O_DIRECT`, bypassing the page cache, where
+     *  supported. Where the file system rejects it, the file is opened
+     *  without; see FdSink::direct(). Only used by the constructor taking
+     *  a path.
+     */
+    bool direct = false;
+    /** Advise the kernel with `posix_fadvise` that written ranges will
+     *  not be read again, so a long running dump does not evict the rest
+     *  of the page cache. Dirty pages are only dropped once written back.
+     */
+    bool drop_cache = false;
+};
+
+/** Sink writing to a POSIX file descriptor without going through
+ *  iostreams.
+ *
+ *  Small writes are collected in a large aligned buffer, which is written
+ *  with a single `pwrite` once full. A write at least as large as the
+ *  buffer is written together with the buffered bytes by one `pwritev`
+ *  instead of being copied. Non-seekable descriptors such as pipes use
+ *  `write`/`writev` instead.
+ *
+ *  With FdSinkOptions::direct, every write goes through the buffer so the
+ *  kernel only sees aligned, full-buffer writes. flush() writes a final
+ *  partial buffer with `O_DIRECT` turned off, and it stays off for later
+ *  writes.
+ *
+ *  Errors opening the file are thrown as IOError; write errors set the
+ *  error state like in any Sink, with the `errno` value available from
+ *  error_code().
+ */
+class FdSink : public Sink {
+public:
+    /// Alignment of the buffer, and of buffer sizes, in bytes.
+    static constexpr std::size_t alignment = 4096;
+
+    /** Construct an FdSink writing to the file at \a path, which is
+     *  created or truncated. The file is closed when the FdSink is
+     *  destroyed.
+     *  \throws IOError if the file cannot be opened.
+     */
+    explicit FdSink(
+            const std::string& path, FdSinkOptions options = FdSinkOptions())
+        : m_options(options), m_owns_fd(true) {
+        auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+        if(m_options.direct) {
+            flags |= O_DIRECT;
+            m_direct = true;
+        }
+#else
+        m_options.direct = false;
+#endif
+        do {
+            m_fd = ::open(path.c_str(), flags, 0644);
+        } while(m_fd < 0 && errno == EINTR);
+#ifdef O_DIRECT
+        if(m_fd < 0 && errno == EINVAL && m_direct) {
+            // File systems such as tmpfs reject O_DIRECT.
+            flags &= ~O_DIRECT;
+            m_direct = false;
+            m_options.direct = false;
+            do {
+                m_fd = ::open(path.c_str(), flags, 0644);
+            } while(m_fd < 0 && errno == EINTR);
+        }
+#endif
+        if(m_fd < 0) {
+            const int error = errno;
+            throw IOError("open " + path + ": " + std::strerror(error), error);
+        }
+        try {
+            init();
+        } catch(...) {
+            ::close(m_fd);
+            throw;
+        }
+    }
+
+    /** Construct an FdSink writing to the open file descriptor \a fd,
+     *  starting at its current offset. The FdSink does not take ownership
+     *  of \a fd, which must stay open as long as the FdSink is used.
+     *  The offset of a seekable \a fd is moved past the written bytes by
+     *  flush(), sync() and the destructor, not by every write.
+     */
+    explicit FdSink(int fd, FdSinkOptions options = FdSinkOptions())
+        : m_options(options), m_fd(fd), m_owns_fd(false) {
+        m_options.direct = false;
+        init();
+    }
+
+    /// Write any buffered bytes and close the file if it is owned.
+    ~FdSink() override {
+        flush();
+        if(m_owns_fd && m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    FdSink(const FdSink& other) = delete;
+    FdSink& operator=(const FdSink& other) = delete;
+
+    void write(const void* data, std::size_t size) override {
+        if(!good()) {
+            return;
+        }
+        auto bytes = static_cast<const char*>(data);
+        if(!m_direct && size >= m_capacity) {
+            // Write the buffered bytes and the data in one call, without
+            // copying the data.
+            write_out(m_buffer.get(), m_used, bytes, size);
+            m_used = 0;
+            return;
+        }
+        while(size > 0) {
+            const auto chunk = std::min(size, m_capacity - m_used);
+            std::memcpy(m_buffer.get() + m_used, bytes, chunk);
+            m_used += chunk;
+            bytes += chunk;
+            size -= chunk;
+            if(m_used == m_capacity) {
+                write_out(m_buffer.get(), m_used, nullptr, 0);
+                m_used = 0;
+                if(!good()) {
+                    return;
+                }
+            }
+        }
+    }
+
+    bool flush() override {
+        if(m_used > 0 && good()) {
+#ifdef O_DIRECT
+            if(m_direct && m_used % alignment != 0) {
+                // The tail cannot be written with O_DIRECT. Later writes
+                // would no longer be aligned either.
+                ::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+                m_direct = false;
+            }
+#endif
+            write_out(m_buffer.get(), m_used, nullptr, 0);
+            m_used = 0;
+        }
+        if(!m_owns_fd && m_seekable && good() &&
+                ::lseek(m_fd, m_offset, SEEK_SET) < 0) {
+            // pwrite leaves the offset alone, but the caller continues
+            // after the written bytes like after a plain write.
+            m_error = errno;
+        }
+        return good();
+    }
+
+    /** Flush, then wait until the written data is durably stored.
+     *  \returns good().
+     */
+    bool sync() override {
+        if(!flush()) {
+            return false;
+        }
+#ifdef __linux__
+        const int result = ::fdatasync(m_fd);
+#else
+        const int result = ::fsync(m_fd);
+#endif
+        if(result != 0) {
+            m_error = errno;
+        }
+        return good();
+    }
+
+    bool good() const override { return m_error == 0; }
+
+    bool fail() const override { return m_error != 0; }
+
+    bool bad() const override { return m_error != 0; }
+
+    /// The `errno` value of the first failed call, or 0.
+    int error_code() const { return m_error; }
+
+    /** Whether writes currently use `O_DIRECT`. False if
+     *  FdSinkOptions::direct was not set, if the file system does not
+     *  support it and the file was opened without, or once flush() has
+     *  written a partial buffer and turned it off.
+     */
+    bool direct() const { return m_direct; }
+
+    /// Get the file descriptor.
+    int fd() const { return m_fd; }
+
+private:
+    struct FreeDeleter {
+        void operator()(char* p) const { std::free(p); }
+    };
+
+    void init() {
+        m_capacity = std::max<std::size_t>(m_options.buffer_size, 1);
+        m_capacity = (m_capacity + alignment - 1) / alignment * alignment;
+        void* buffer = nullptr;
+        if(::posix_memalign(&buffer, alignment, m_capacity) != 0) {
+            throw std::bad_alloc();
+        }
+        m_buffer.reset(static_cast<char*>(buffer));
+        m_offset = ::lseek(m_fd, 0, SEEK_CUR);
+        m_seekable = m_offset >= 0;
+    }
+
+    /// Write \a size0 bytes from \a data0 followed by \a size1 from \a data1.
+    void write_out(const char* data0,
+            std::size_t size0,
+            const char* data1,
+            std::size_t size1) {
+        struct iovec parts[2] = {{const_cast<char*>(data0), size0},
+                {const_cast<char*>(data1), size1}};
+        struct iovec* iov = parts;
+        int count = size1 > 0 ? 2 : 1;
+        const auto start = m_offset;
+        while(count > 0) {
+            ssize_t result;
+            if(m_seekable) {
+                result = count == 1
+                        ? ::pwrite(m_fd, iov[0].iov_base, iov[0].iov_len,
+                                  m_offset)
+                        : ::pwritev(m_fd, iov, count, m_offset);
+            } else {
+                result = ::writev(m_fd, iov, count);
+            }
+            if(result < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                m_error = errno;
+                return;
+            }
+            if(result == 0) {
+                // No progress, which retrying would not change.
+                m_error = EIO;
+                return;
+            }
+            if(m_seekable) {
+                m_offset += result;
+            }
+            // Skip the parts that were written completely.
+            auto written = static_cast<std::size_t>(result);
+            while(count > 0 && written >= iov[0].iov_len) {
+                written -= iov[0].iov_len;
+                ++iov;
+                --count;
+            }
+            if(count > 0) {
+                iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + written;
+                iov[0].iov_len -= written;
+            }
+        }
+#ifdef POSIX_FADV_DONTNEED
+        if(m_options.drop_cache && m_seekable) {
+            ::posix_fadvise(m_fd, start, m_offset - start, POSIX_FADV_DONTNEED);
+        }
+#else
+        (void)start;
+#endif
+    }
+
+    FdSinkOptions m_options;
+    int m_fd;
+    bool m_owns_fd;
+    bool m_direct = false;
+    bool m_seekable = false;
+    off_t m_offset = 0;
+    int m_error = 0;
+
+    std::unique_ptr<char, FreeDeleter> m_buffer;
+    std::size_t m_capacity = 0;
+    std::size_t m_used = 0;
+};
+}
+
+#endif
@@ -0,0 +1,190 @@
+/** \file
+ *  Defines the FdUnpacker class.
+ *
+ *  FdUnpacker uses POSIX file descriptors and is only available on POSIX
+ *  systems.
+ */
+#ifndef COLOR_FDUNPACKER_H_
+#define COLOR_FDUNPACKER_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Exceptions.h"
+#include "Instrumentation.h"
+#include "Unpacker.h"
+
+namespace color {
+
+/** Random-access unpacking from a file descriptor.
+ *
+ *  Every color occupies exactly `packed_size()` bytes, so the color at
+ *  any index can be read directly. Reads use `pread` and never move a
+ *  shared file offset, so read_at() may be called concurrently from any
+ *  number of threads, e.g. to read disjoint ranges of a large file in
+ *  parallel.
+ *
+ *  Errors reported by the operating system are thrown as IOError.
+ */
+template <typename Color>
+class FdUnpacker {
+public:
+    /** Construct an FdUnpacker reading the file at \a path with a given
+     *  Unpacker. The file is closed when the FdUnpacker is destroyed.
+     *  \throws IOError if the file cannot be opened.
+     */
+    FdUnpacker(const std::string& path,
+            std::unique_ptr<Unpacker<Color>> unpacker)
+        : m_unpacker(std::move(unpacker)), m_owns_fd(true) {
+        do {
+            m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        } while(m_fd < 0 && errno == EINTR);
+        if(m_fd < 0) {
+            const int error = errno;
+            throw_error("open " + path, error);
+        }
+    }
+
+    /** Construct an FdUnpacker reading from the open file descriptor
+     *  \a fd with a given Unpacker. The FdUnpacker does not take ownership
+     *  of \a fd, which must stay open as long as the FdUnpacker is used.
+     */
+    FdUnpacker(int fd, std::unique_ptr<Unpacker<Color>> unpacker)
+        : m_unpacker(std::move(unpacker)), m_fd(fd), m_owns_fd(false) {}
+
+    ~FdUnpacker() {
+        if(m_owns_fd && m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    FdUnpacker(const FdUnpacker& other) = delete;
+    FdUnpacker& operator=(const FdUnpacker& other) = delete;
+
+    /** Get the number of whole colors in the file.
+     *  \throws IOError if the file cannot be inspected.
+     */
+    std::uint64_t size() const {
+        struct stat info;
+        if(::fstat(m_fd, &info) != 0) {
+            throw_error("fstat", errno);
+        }
+        return static_cast<std::uint64_t>(info.st_size) /
+                m_unpacker->packed_size();
+    }
+
+    /** Unpack up to \a n colors starting at the color at \a index,
+     *  writing them to \a out. Thread-safe.
+     *  \returns The number of colors unpacked, which is less than \a n if
+     *  the end of the file is reached. Colors whose offsets do not fit into
+     *  `off_t` are past the end of any file, so none of them are read.
+     *  \throws IOError if a read fails.
+     */
+    template <typename OutIterator>
+    std::size_t read_at(
+            std::uint64_t index, std::size_t n, OutIterator out) const {
+        COLOR_INSTRUMENT_SCOPE(timer, "FdUnpacker::read_at", 0);
+        const auto color_size = m_unpacker->packed_size();
+        const auto max_index =
+                std::uint64_t(std::numeric_limits<off_t>::max()) / color_size;
+        if(index >= max_index) {
+            return 0;
+        }
+        n = static_cast<std::size_t>(
+                std::min<std::uint64_t>(n, max_index - index));
+        // Each call reads through its own buffer, so callers on different
+        // threads never share state. Small reads, such as sampling single
+        // colors, use the stack; large ones are read in blocks.
+        const auto block_colors = std::max<std::size_t>(
+                std::min(n, max_block_bytes / color_size), 1);
+        char local[local_bytes];
+        auto heap = std::vector<char>();
+        auto buffer = local;
+        if(block_colors * color_size > local_bytes) {
+            heap.resize(block_colors * color_size);
+            buffer = heap.data();
+        }
+
+        std::size_t count = 0;
+        auto offset = index * color_size;
+        while(count < n) {
+            const auto wanted = std::min(n - count, block_colors);
+            const auto bytes = read_fully(buffer,
+                    wanted * color_size,
+                    static_cast<off_t>(offset));
+            const auto read = bytes / color_size;
+            m_unpacker->unpack(buffer, read * color_size, out);
+            count += read;
+            offset += read * color_size;
+            if(read < wanted) {
+                break;
+            }
+        }
+        COLOR_INSTRUMENT_ELEMENTS(timer, count);
+        return count;
+    }
+
+    /// Unpack up to \a n colors starting at \a index into a vector.
+    std::vector<Color> read_at(std::uint64_t index, std::size_t n) const {
+        auto out = std::vector<Color>(n);
+        out.resize(read_at(index, n, out.begin()));
+        return out;
+    }
+
+    /// Get the file descriptor.
+    int fd() const { return m_fd; }
+
+    /// Get the internal Unpacker.
+    const Unpacker<Color>& get_unpacker() const { return *m_unpacker; }
+
+private:
+    /// Reads up to this size do not allocate.
+    static constexpr std::size_t local_bytes = 4096;
+    /// Upper bound on the buffer a single read_at() call allocates.
+    static constexpr std::size_t max_block_bytes = std::size_t(1) << 20;
+
+    /** Read up to \a size bytes at \a offset, retrying short reads.
+     *  \returns The number of bytes read, less than \a size at the end of
+     *  the file.
+     */
+    std::size_t read_fully(char* out, std::size_t size, off_t offset) const {
+        std::size_t done = 0;
+        while(done < size) {
+            const auto result = ::pread(m_fd, out + done, size - done,
+                    offset + static_cast<off_t>(done));
+            if(result < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw_error("pread", errno);
+            }
+            if(result == 0) {
+                break;
+            }
+            done += static_cast<std::size_t>(result);
+        }
+        return done;
+    }
+
+    [[noreturn]] static void throw_error(const std::string& call, int error) {
+        throw IOError(call + ": " + std::strerror(error), error);
+    }
+
+    std::unique_ptr<Unpacker<Color>> m_unpacker;
+    int m_fd;
+    bool m_owns_fd;
+};
+}
+
+#endif
@@ -0,0 +1,5 @@
+#include "FlatColorPacker.h"
+
+namespace color {
+COLOR_FOR_EACH_ELEMENT_TYPE(COLOR_FLAT_PACKER_TEMPLATES, )
+}
@@ -6,15 +6,49 @@
 
 #include "Packer.h"
 
+#include <cstring>
 #include <tuple>
 #include <type_traits>
 #include <string>
 
+#include "ByteOrder.h"
+#include "ByteShuffle.h"
+#include "Dispatch.h"
+#include "Instrumentation.h"
 #include "Exceptions.h"
 
 
 namespace color {
 
+namespace details {
+
+/** Bulk kernel for FlatColorPacker.
+ *  FormatSize is the length of the packing format, or 0 if it is only
+ *  known at runtime. Fixing the common sizes lets the inner loop unroll.
+ *  Swap reverses the bytes of every element as it is written.
+ */
+template <typename T, int NumChannels, int FormatSize, bool Swap = false>
+struct flat_pack_kernel {
+    static COLOR_ALWAYS_INLINE void run(const T* src,
+            std::size_t count,
+            const int* format,
+            std::size_t format_size,
+            T* dst) {
+        const auto size = FormatSize != 0 ? FormatSize : format_size;
+        for(std::size_t i = 0; i < count; ++i) {
+            for(std::size_t j = 0; j < size; ++j) {
+                const auto elem = format[j];
+                dst[j] = elem != packer_index_skip
+                        ? (Swap ? byteswap_value(src[elem]) : src[elem])
+                        : T(0);
+            }
+            src += NumChannels;
+            dst += size;
+        }
+    }
+};
+}
+
 /** Packer class for packing color components into an array without conversion.
  *  FlatColorPacker supports reordering components, skipping elements and
  *  replicating component values in order to adapt to many pixel formats.
@@ -27,6 +61,10 @@ namespace color {
  *
  *  Thus, packing a color writes sizeof(Color::ElementType)*`pack_order.size()`
  *  bytes.
+ *
+ *  Elements are written in the native byte order unless another ByteOrder
+ *  is set, e.g. ByteOrder::Big for network protocols. The bytes are then
+ *  swapped in the same pass that reorders the components.
  */
 template <typename Color>
 class FlatColorPacker : public Packer<Color> {
@@ -38,6 +76,11 @@ public:
         set_packing_format(std::move(pack_order));
     }
 
+    FlatColorPacker(std::vector<int> pack_order, ByteOrder byte_order) {
+        set_packing_format(std::move(pack_order));
+        set_byte_order(byte_order);
+    }
+
     FlatColorPacker(const FlatColorPacker& other) = default;
     FlatColorPacker(FlatColorPacker&& other) noexcept = default;
     FlatColorPacker& operator=(const FlatColorPacker& other) = default;
@@ -55,7 +98,7 @@ public:
 
         for(auto elem : m_pack_format) {
             if(elem != packer_index_skip) {
-                *out_elems = data[elem];
+                *out_elems = m_swap ? byteswap_value(data[elem]) : data[elem];
             } else {
                 *out_elems = ElementType(0);
             }
@@ -64,6 +107,36 @@ public:
         return out_elems;
     }
 
+    virtual void* pack_contiguous(
+            const Color* src, std::size_t count, void* out) const override {
+        static_assert(sizeof(Color) == Color::num_channels * sizeof(ElementType),
+                "Color must consist of exactly its channel elements");
+
+        COLOR_INSTRUMENT_SCOPE(timer, "FlatColorPacker::pack", count);
+        const auto in_elems = src->data();
+        auto out_elems = reinterpret_cast<ElementType*>(out);
+        const auto format_size = m_pack_format.size();
+
+        if(m_is_identity_format) {
+            if(m_swap) {
+                byteswap_copy(in_elems, count * format_size, out_elems);
+            } else {
+                std::memcpy(out_elems, in_elems, count * sizeof(Color));
+            }
+        } else if(details::use_byte_shuffle(m_shuffle)) {
+            dispatch<details::byte_shuffle_kernel>(
+                    reinterpret_cast<const unsigned char*>(in_elems),
+                    count,
+                    &m_shuffle,
+                    reinterpret_cast<unsigned char*>(out_elems));
+        } else if(m_swap) {
+            pack_reordered<true>(in_elems, count, out_elems);
+        } else {
+            pack_reordered<false>(in_elems, count, out_elems);
+        }
+        return out_elems + count * format_size;
+    }
+
     /** Set the packing format.
      *  \throw InvalidPackingFormatError An out-of-range index
      *  was supplied in \a value.
@@ -80,12 +153,103 @@ public:
             }
         }
         m_pack_format = std::move(value);
+        m_is_identity_format = m_pack_format.size() == Color::num_channels;
+        for(std::size_t i = 0; i < m_pack_format.size(); ++i) {
+            m_is_identity_format &= m_pack_format[i] == int(i);
+        }
+        update_shuffle();
+        return *this;
+    }
+
+    /** Set the byte order elements are written in. Single byte elements
+     *  are not affected.
+     */
+    FlatColorPacker& set_byte_order(ByteOrder value) {
+        m_byte_order = value;
+        m_swap = sizeof(ElementType) > 1 && value != native_byte_order();
+        update_shuffle();
         return *this;
     }
 
+    /// Return the byte order elements are written in.
+    ByteOrder byte_order() const { return m_byte_order; }
+
 protected:
+    /// Build the byte permutation that packs a color.
+    void update_shuffle() {
+        const auto size = sizeof(ElementType);
+        auto sources = std::vector<int>();
+        for(auto elem : m_pack_format) {
+            for(std::size_t b = 0; b < size; ++b) {
+                const auto byte = m_swap ? size - 1 - b : b;
+                sources.push_back(elem == packer_index_skip
+                                ? -1
+                                : int(elem * size + byte));
+            }
+        }
+        m_shuffle =
+                details::make_byte_shuffle(sizeof(Color), std::move(sources));
+    }
+
+    template <bool Swap>
+    void pack_reordered(const ElementType* in_elems,
+            std::size_t count,
+            ElementType* out_elems) const {
+        const auto format_size = m_pack_format.size();
+        if(format_size == 3) {
+            dispatch<details::flat_pack_kernel<ElementType,
+                    Color::num_channels,
+                    3,
+                    Swap>>(in_elems,
+                    count,
+                    m_pack_format.data(),
+                    format_size,
+                    out_elems);
+        } else if(format_size == 4) {
+            dispatch<details::flat_pack_kernel<ElementType,
+                    Color::num_channels,
+                    4,
+                    Swap>>(in_elems,
+                    count,
+                    m_pack_format.data(),
+                    format_size,
+                    out_elems);
+        } else {
+            dispatch<details::flat_pack_kernel<ElementType,
+                    Color::num_channels,
+                    0,
+                    Swap>>(in_elems,
+                    count,
+                    m_pack_format.data(),
+                    format_size,
+                    out_elems);
+        }
+    }
+
     std::vector<int> m_pack_format;
+    /// True if packing is a plain copy of the in-memory channel order.
+    bool m_is_identity_format = false;
+    ByteOrder m_byte_order = native_byte_order();
+    /// True if elements are written in the other byte order.
+    bool m_swap = false;
+    details::ByteShuffle m_shuffle;
 };
 }
 
+#ifdef COLOR_EXTERN_TEMPLATES
+#include "Instantiation.h"
+#include "Rgb.h"
+#include "Alpha.h"
+
+namespace color {
+#define COLOR_FLAT_PACKER_TEMPLATES(prefix, T)                                 \
+    prefix template class Packer<Rgb<T>>;                                      \
+    prefix template class Packer<Rgba<T>>;                                     \
+    prefix template class FlatColorPacker<Rgb<T>>;                             \
+    prefix template class FlatColorPacker<Rgba<T>>;
+
+COLOR_FOR_EACH_ELEMENT_TYPE(COLOR_FLAT_PACKER_TEMPLATES, extern)
+}
+#endif
+
 #endif
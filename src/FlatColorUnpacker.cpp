@@ -0,0 +1,5 @@
+#include "FlatColorUnpacker.h"
+
+namespace color {
+COLOR_FOR_EACH_ELEMENT_TYPE(COLOR_FLAT_UNPACKER_TEMPLATES, )
+}
@@ -6,13 +6,55 @@
 
 #include "Unpacker.h"
 
+#include <array>
+#include <cstring>
 #include <vector>
 #include <string>
 
+#include "ByteOrder.h"
+#include "ByteShuffle.h"
+#include "ColorSpan.h"
+#include "Dispatch.h"
+#include "Instrumentation.h"
 #include "Exceptions.h"
 
 namespace color {
 
+namespace details {
+
+/** Bulk kernel for FlatColorUnpacker.
+ *  \a sources holds, for each channel, the index of the packed element it
+ *  is read from, or -1 if the channel is not present and should be zeroed.
+ *  FormatSize is the number of packed elements per color, or 0 if it is
+ *  only known at runtime. Swap reverses the bytes of every element as it
+ *  is read.
+ */
+template <typename T, int NumChannels, int FormatSize, bool Swap = false>
+struct flat_unpack_kernel {
+    static COLOR_ALWAYS_INLINE void run(const T* src,
+            std::size_t count,
+            const int* sources,
+            std::size_t format_size,
+            T* dst) {
+        const auto size = FormatSize != 0 ? FormatSize : format_size;
+        int local_sources[NumChannels];
+        for(int c = 0; c < NumChannels; ++c) {
+            local_sources[c] = sources[c];
+        }
+        for(std::size_t i = 0; i < count; ++i) {
+            for(int c = 0; c < NumChannels; ++c) {
+                const auto elem = local_sources[c];
+                dst[c] = elem != -1
+                        ? (Swap ? byteswap_value(src[elem]) : src[elem])
+                        : T(0);
+            }
+            src += size;
+            dst += NumChannels;
+        }
+    }
+};
+}
+
 /** Unpacker class for unpacking a color from an array of components without
  * conversion.
  *  FlatColorUnpacker is the unpacking counterpart to FlatColorPacker and
@@ -21,7 +63,8 @@ namespace color {
  *  reordering components and skipping array elements to match most pixel
  * formats.
  *
- *  FlatColorUnpacker is configured the same way as FlatColorPacker.
+ *  FlatColorUnpacker is configured the same way as FlatColorPacker,
+ *  including the ByteOrder of the packed elements.
  */
 template <typename Color>
 class FlatColorUnpacker : public Unpacker<Color> {
@@ -34,6 +77,11 @@ public:
         set_packing_format(std::move(pack_format));
     }
 
+    FlatColorUnpacker(std::vector<int> pack_format, ByteOrder byte_order) {
+        set_packing_format(std::move(pack_format));
+        set_byte_order(byte_order);
+    }
+
     virtual ~FlatColorUnpacker() {}
 
     FlatColorUnpacker(const FlatColorUnpacker& other) = default;
@@ -50,13 +98,86 @@ public:
         auto in_elems = reinterpret_cast<const ElementType*>(in);
         for(auto elem : m_pack_format) {
             if(elem != -1) {
-                out.data()[elem] = *in_elems;
+                out.data()[elem] =
+                        m_swap ? byteswap_value(*in_elems) : *in_elems;
             }
             ++in_elems;
         }
         return in_elems;
     }
 
+    virtual const void* unpack_contiguous(
+            const void* src, std::size_t count, Color* out) const override {
+        static_assert(sizeof(Color) == Color::num_channels * sizeof(ElementType),
+                "Color must consist of exactly its channel elements");
+
+        COLOR_INSTRUMENT_SCOPE(timer, "FlatColorUnpacker::unpack", count);
+        const auto in_elems = reinterpret_cast<const ElementType*>(src);
+        const auto out_elems = out->data();
+        const auto format_size = m_pack_format.size();
+
+        if(m_is_identity_format) {
+            if(m_swap) {
+                byteswap_copy(in_elems, count * format_size, out_elems);
+            } else {
+                std::memcpy(out_elems, in_elems, count * sizeof(Color));
+            }
+        } else if(details::use_byte_shuffle(m_shuffle)) {
+            dispatch<details::byte_shuffle_kernel>(
+                    reinterpret_cast<const unsigned char*>(in_elems),
+                    count,
+                    &m_shuffle,
+                    reinterpret_cast<unsigned char*>(out_elems));
+        } else if(m_swap) {
+            unpack_reordered<true>(in_elems, count, out_elems);
+        } else {
+            unpack_reordered<false>(in_elems, count, out_elems);
+        }
+        return in_elems + count * format_size;
+    }
+
+    /** Return whether colors packed at \a src can be viewed in place with
+     *  view(): the packing format is the identity, elements are in the
+     *  native byte order and \a src is aligned for Color.
+     */
+    bool can_view(const void* src) const {
+        return m_is_identity_format && !m_swap && is_color_aligned<Color>(src);
+    }
+
+    /** View \a num_bytes bytes of packed colors at \a src as colors,
+     *  without copying. The view aliases \a src; see ColorSpan.
+     *  \throws InvalidPackingFormatError if the packed layout is not that of
+     *  Color.
+     *  \throws AlignmentError if \a src is not aligned for Color.
+     */
+    ColorSpan<const Color> view(const void* src, std::size_t num_bytes) const {
+        if(!m_is_identity_format || m_swap) {
+            throw InvalidPackingFormatError(
+                    "Cannot view packed colors in place: the packing format "
+                    "is not the layout of the color type");
+        }
+        return color_span_cast<Color>(src, num_bytes);
+    }
+
+    /** View \a num_bytes bytes of packed colors at \a src in place if
+     *  can_view(), or else unpack them into \a storage and view that.
+     *  Either way, the view is only valid as long as \a src and
+     *  \a storage are.
+     */
+    ColorSpan<const Color> view_or_unpack(const void* src,
+            std::size_t num_bytes,
+            std::vector<Color>& storage) const {
+        if(can_view(src)) {
+            return view(src, num_bytes);
+        }
+        const auto count = num_bytes / packed_size();
+        storage.resize(count);
+        if(count != 0) {
+            unpack_contiguous(src, count, storage.data());
+        }
+        return ColorSpan<const Color>(storage.data(), count);
+    }
+
     /** Set the packing format.
      *  \throw InvalidPackingFormatError An out-of-range index
      *  was supplied in \a value.
@@ -73,15 +194,119 @@ public:
             }
         }
         m_pack_format = std::move(value);
+
+        // Later elements win when a channel appears more than once,
+        // matching unpack_single.
+        m_channel_sources.fill(-1);
+        m_is_identity_format = m_pack_format.size() == Color::num_channels;
+        for(std::size_t i = 0; i < m_pack_format.size(); ++i) {
+            if(m_pack_format[i] != -1) {
+                m_channel_sources[m_pack_format[i]] = int(i);
+            }
+            m_is_identity_format &= m_pack_format[i] == int(i);
+        }
+        update_shuffle();
         return *this;
     }
 
     /// Return the packing format
     const std::vector<int>& packing_format() const { return m_pack_format; }
 
+    /// Return the packed element index each channel is read from, or -1.
+    const std::array<int, Color::num_channels>& channel_sources() const {
+        return m_channel_sources;
+    }
+
+    /** Set the byte order elements are read in. Single byte elements are
+     *  not affected.
+     */
+    FlatColorUnpacker& set_byte_order(ByteOrder value) {
+        m_byte_order = value;
+        m_swap = sizeof(ElementType) > 1 && value != native_byte_order();
+        update_shuffle();
+        return *this;
+    }
+
+    /// Return the byte order elements are read in.
+    ByteOrder byte_order() const { return m_byte_order; }
+
 private:
+    /// Build the byte permutation that unpacks a color.
+    void update_shuffle() {
+        const auto size = sizeof(ElementType);
+        auto sources = std::vector<int>();
+        for(auto elem : m_channel_sources) {
+            for(std::size_t b = 0; b < size; ++b) {
+                const auto byte = m_swap ? size - 1 - b : b;
+                sources.push_back(
+                        elem == -1 ? -1 : int(elem * size + byte));
+            }
+        }
+        m_shuffle = details::make_byte_shuffle(
+                m_pack_format.size() * size, std::move(sources));
+    }
+
+    template <bool Swap>
+    void unpack_reordered(const ElementType* in_elems,
+            std::size_t count,
+            ElementType* out_elems) const {
+        const auto format_size = m_pack_format.size();
+        if(format_size == 3) {
+            dispatch<details::flat_unpack_kernel<ElementType,
+                    Color::num_channels,
+                    3,
+                    Swap>>(in_elems,
+                    count,
+                    m_channel_sources.data(),
+                    format_size,
+                    out_elems);
+        } else if(format_size == 4) {
+            dispatch<details::flat_unpack_kernel<ElementType,
+                    Color::num_channels,
+                    4,
+                    Swap>>(in_elems,
+                    count,
+                    m_channel_sources.data(),
+                    format_size,
+                    out_elems);
+        } else {
+            dispatch<details::flat_unpack_kernel<ElementType,
+                    Color::num_channels,
+                    0,
+                    Swap>>(in_elems,
+                    count,
+                    m_channel_sources.data(),
+                    format_size,
+                    out_elems);
+        }
+    }
+
     std::vector<int> m_pack_format;
+    /// Packed element index each channel is read from, or -1.
+    std::array<int, Color::num_channels> m_channel_sources{};
+    /// True if unpacking is a plain copy into the in-memory channel order.
+    bool m_is_identity_format = false;
+    ByteOrder m_byte_order = native_byte_order();
+    /// True if elements are read in the other byte order.
+    bool m_swap = false;
+    details::ByteShuffle m_shuffle;
 };
 }
 
+#ifdef COLOR_EXTERN_TEMPLATES
+#include "Instantiation.h"
+#include "Rgb.h"
+#include "Alpha.h"
+
+namespace color {
+#define COLOR_FLAT_UNPACKER_TEMPLATES(prefix, T)                               \
+    prefix template class Unpacker<Rgb<T>>;                                    \
+    prefix template class Unpacker<Rgba<T>>;                                   \
+    prefix template class FlatColorUnpacker<Rgb<T>>;                           \
+    prefix template class FlatColorUnpacker<Rgba<T>>;
+
+COLOR_FOR_EACH_ELEMENT_TYPE(COLOR_FLAT_UNPACKER_TEMPLATES, extern)
+}
+#endif
+
 #endif
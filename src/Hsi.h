@@ -177,7 +177,7 @@ template <typename T,
         typename FloatType = float,
         typename std::enable_if_t<std::is_integral<T>::value, int> = 0>
 inline Hsi<T> to_hsi(const Rgb<T>& from) {
-    return color_cast<T>(to_hsl(color_cast<FloatType>(from)));
+    return color_cast<T>(to_hsi(color_cast<FloatType>(from)));
 }
 
 template <typename T,
@@ -0,0 +1,201 @@
+/** \file
+ *  Defines the HugePageResource class.
+ *
+ *  HugePageResource uses POSIX memory mapping and is only available on
+ *  POSIX systems. Transparent huge pages are requested on Linux.
+ */
+#ifndef COLOR_HUGEPAGERESOURCE_H_
+#define COLOR_HUGEPAGERESOURCE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "MemoryResource.h"
+#include "Parallel.h"
+
+namespace color {
+
+/// Options of HugePageResource.
+struct HugePageOptions {
+    /** Allocations of at least this many bytes are mapped directly and
+     *  aligned to huge pages. Smaller ones go to the upstream resource.
+     */
+    std::size_t min_bytes = std::size_t(1) << 21;
+    /// Ask for transparent huge pages with `madvise(MADV_HUGEPAGE)`.
+    bool huge_pages = true;
+    /** Touch every page of a mapped allocation in parallel before
+     *  returning it, in the parts Unpacker::unpack_parallel() later
+     *  processes, so that each page is placed on the NUMA node of the
+     *  thread that later unpacks into it. See first_touch().
+     */
+    bool first_touch = false;
+    /// Threads for first_touch, 0 for every hardware thread.
+    int num_threads = 0;
+    /** Size of the elements the allocations hold, such as
+     *  `sizeof(Rgb<float>)`, so that first_touch splits them on the same
+     *  element boundaries as Unpacker::unpack_parallel(). 0 is treated
+     *  as 1.
+     */
+    std::size_t element_size = 1;
+};
+
+namespace details {
+
+/** Split \a count elements of \a element_size bytes like
+ *  Unpacker::unpack_parallel() splits the colors it unpacks and call
+ *  `part(begin, end)` with the byte offsets of each part on its own thread.
+ */
+template <typename Function>
+void first_touch_parts(std::uint64_t count,
+        std::size_t element_size,
+        int num_threads,
+        Function part) {
+    element_size = std::max<std::size_t>(element_size, 1);
+    parallel_parts(count,
+            num_threads,
+            parallel_min_part(element_size),
+            [&](std::uint64_t begin, std::uint64_t end) {
+                part(begin * element_size, end * element_size);
+            });
+}
+}
+
+/** Touch every page of the \a count elements of \a element_size bytes at
+ *  \a data on \a num_threads threads, 0 for every hardware thread,
+ *  keeping their contents. An \a element_size of 0 is treated as 1.
+ *
+ *  Operating systems place a page on the NUMA node of the thread that
+ *  first writes it. Each thread touches one contiguous part, split like
+ *  Unpacker::unpack_parallel() splits \a count colors of \a element_size
+ *  bytes on the same number of threads. On Linux both pin the thread of
+ *  each part to the same CPU, so that each thread of the unpack finds its
+ *  part in local memory.
+ */
+inline void first_touch(void* data,
+        std::size_t count,
+        std::size_t element_size,
+        int num_threads = 0) {
+    const auto page_size = std::size_t(::sysconf(_SC_PAGESIZE));
+    const auto first = static_cast<volatile unsigned char*>(data);
+    details::first_touch_parts(count,
+            element_size,
+            num_threads,
+            [&](std::uint64_t begin, std::uint64_t end) {
+                for(auto i = begin; i < end; i += page_size) {
+                    first[i] = first[i];
+                }
+                if(begin < end) {
+                    first[end - 1] = first[end - 1];
+                }
+            });
+}
+
+/** A resource that maps large allocations directly from the operating
+ *  system, aligned to and backed by transparent huge pages, for buffers
+ *  such as frame stacks and large palettes where TLB misses matter:
+ *
+ *      auto options = HugePageOptions();
+ *      options.first_touch = true;
+ *      options.element_size = sizeof(Rgb<float>);
+ *      HugePageResource resource(options);
+ *      auto frame = unpacker.unpack_parallel(src, num_bytes,
+ *              PolymorphicAllocator<Rgb<float>>(&resource));
+ *
+ *  With HugePageOptions::first_touch and a matching
+ *  HugePageOptions::element_size, the pages are placed on the NUMA nodes
+ *  of the threads that Unpacker::unpack_parallel() uses to fill them.
+ *  Without first_touch, a page lands on the node of the thread that first
+ *  writes it: one of the unpacking threads for the vector
+ *  unpack_parallel() returns, which it does not initialize first, and the
+ *  constructing thread for containers sized any other way.
+ *
+ *  Allocations smaller than HugePageOptions::min_bytes are forwarded to an
+ *  upstream resource. Huge pages are a request only; without kernel
+ *  support the memory is backed by regular pages.
+ */
+class HugePageResource : public MemoryResource {
+public:
+    /// Size and alignment of huge pages on x86-64 and most other systems.
+    static constexpr std::size_t huge_page_size = std::size_t(1) << 21;
+
+    explicit HugePageResource(HugePageOptions options = HugePageOptions(),
+            MemoryResource* upstream = get_default_resource())
+        : m_options(options), m_upstream(upstream) {}
+
+    const HugePageOptions& options() const { return m_options; }
+
+    /// The resource small allocations are forwarded to.
+    MemoryResource* upstream_resource() const { return m_upstream; }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if(bytes < m_options.min_bytes) {
+            return m_upstream->allocate(bytes, alignment);
+        }
+        const auto align =
+                std::max(alignment, std::size_t(huge_page_size));
+        const auto size = mapped_size(bytes);
+        // Map enough to find an aligned block and unmap the rest.
+        const auto extra = align - std::size_t(::sysconf(_SC_PAGESIZE));
+        void* mapped = ::mmap(nullptr, size + extra, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapped == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        const auto start = reinterpret_cast<std::uintptr_t>(mapped);
+        const auto aligned = (start + align - 1) & ~std::uintptr_t(align - 1);
+        const auto head = aligned - start;
+        if(head > 0) {
+            ::munmap(mapped, head);
+        }
+        if(extra > head) {
+            ::munmap(reinterpret_cast<void*>(aligned + size), extra - head);
+        }
+        const auto data = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+        if(m_options.huge_pages) {
+            // Fails harmlessly if transparent huge pages are disabled.
+            ::madvise(data, size, MADV_HUGEPAGE);
+        }
+#endif
+        if(m_options.first_touch) {
+            const auto element_size =
+                    std::max<std::size_t>(m_options.element_size, 1);
+            first_touch(data,
+                    bytes / element_size,
+                    element_size,
+                    m_options.num_threads);
+        }
+        return data;
+    }
+
+    void do_deallocate(
+            void* p, std::size_t bytes, std::size_t alignment) override {
+        if(bytes < m_options.min_bytes) {
+            m_upstream->deallocate(p, bytes, alignment);
+        } else {
+            ::munmap(p, mapped_size(bytes));
+        }
+    }
+
+    bool do_is_equal(const MemoryResource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    /// Round \a bytes up to whole huge pages.
+    static std::size_t mapped_size(std::size_t bytes) {
+        return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+    }
+
+    HugePageOptions m_options;
+    MemoryResource* m_upstream;
+};
+}
+
+#endif
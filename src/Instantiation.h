@@ -0,0 +1,36 @@
+/** \file
+ *  Support for the optional precompiled cppcolor library.
+ *
+ *  The library is header-only, but the cppcolor CMake target (built with
+ *  `-DBUILD_LIBRARY=1`) compiles the specializations most programs use
+ *  once: the packers for Rgb and Rgba colors and the batch kernels, whose
+ *  per instruction set variants are the bulk of their code. Targets that
+ *  link cppcolor get `COLOR_EXTERN_TEMPLATES` defined, which makes the
+ *  headers declare those specializations `extern template` so they are no
+ *  longer instantiated in every translation unit.
+ *
+ *  The single color conversions stay inline in the headers. Explicit
+ *  instantiation declarations do not apply to inline functions, and they
+ *  must remain inlinable into per pixel loops.
+ */
+#ifndef COLOR_INSTANTIATION_H_
+#define COLOR_INSTANTIATION_H_
+
+#include <cstdint>
+
+/** Expand `X(prefix, T)` for every channel element type cppcolor
+ *  instantiates. Headers pass `extern` as \a prefix to declare their
+ *  specializations, library sources pass nothing to define them.
+ */
+#define COLOR_FOR_EACH_ELEMENT_TYPE(X, prefix)                                 \
+    X(prefix, std::uint8_t)                                                    \
+    X(prefix, std::uint16_t)                                                   \
+    X(prefix, float)                                                           \
+    X(prefix, double)
+
+/// As COLOR_FOR_EACH_ELEMENT_TYPE, for floating point element types only.
+#define COLOR_FOR_EACH_FLOAT_TYPE(X, prefix)                                   \
+    X(prefix, float)                                                           \
+    X(prefix, double)
+
+#endif
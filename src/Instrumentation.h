@@ -0,0 +1,286 @@
+/** \file
+ *  Optional instrumentation of the bulk packing, unpacking and conversion
+ *  paths.
+ *
+ *  Instrumentation is compiled in by defining `COLOR_ENABLE_INSTRUMENTATION`
+ *  for every translation unit of a program. The precompiled cppcolor
+ *  library is never instrumented, so instrumented programs use the headers
+ *  only. CMake builds the unit tests both without it, as `tests`, and
+ *  with it, as `tests_instrumented`. Without it the COLOR_INSTRUMENT macros
+ *  used by the library expand to nothing, their arguments are not
+ *  evaluated and none of this header's functions are called.
+ *
+ *  When enabled, every instrumented call site counts calls, elements and
+ *  elapsed nanoseconds per kernel name. Counters live in thread local
+ *  storage, so the hot path never contends on shared cache lines; snapshot()
+ *  sums them over all live and exited threads.
+ *
+ *  If `<sys/sdt.h>` is available, each instrumented call also fires the
+ *  USDT probes `cppcolor:batch_start(name, elements)` and
+ *  `cppcolor:batch_done(name, elements, nanoseconds)`, which can be traced
+ *  with bpftrace or perf without rebuilding. The probes are a single nop
+ *  when no tracer is attached.
+ */
+#ifndef COLOR_INSTRUMENTATION_H_
+#define COLOR_INSTRUMENTATION_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined(COLOR_ENABLE_INSTRUMENTATION) && defined(COLOR_EXTERN_TEMPLATES)
+// The precompiled specializations would mix uninstrumented definitions
+// into the program.
+#error "instrumented programs cannot link the cppcolor library"
+#endif
+
+#if defined(COLOR_ENABLE_INSTRUMENTATION) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define COLOR_HAVE_USDT 1
+#endif
+#endif
+
+namespace color {
+namespace instrumentation {
+
+/// Maximum number of distinct kernel names that can be counted.
+static constexpr int max_kernels = 64;
+
+/// Aggregated counters for one kernel.
+struct KernelStats {
+    /// Name the kernel was registered with.
+    const char* name;
+    /// Number of instrumented calls.
+    std::uint64_t calls;
+    /// Total number of colors processed by those calls.
+    std::uint64_t elements;
+    /// Total wall clock time spent in those calls.
+    std::uint64_t nanoseconds;
+};
+
+namespace details {
+
+struct Counters {
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> elements{0};
+    std::atomic<std::uint64_t> nanoseconds{0};
+};
+
+using CounterTable = std::array<Counters, max_kernels>;
+
+/** Only the owning thread writes its counters, so updates are a relaxed
+ *  load and store rather than a locked read-modify-write. The atomics
+ *  just keep concurrent snapshots well defined.
+ */
+inline void add(std::atomic<std::uint64_t>& counter, std::uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+            std::memory_order_relaxed);
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::array<const char*, max_kernels> names{};
+    std::atomic<int> num_kernels{0};
+    /// Counter tables of running threads.
+    std::vector<const CounterTable*> live;
+    /// Totals folded in from exited threads.
+    CounterTable retired;
+};
+
+inline Registry& registry() {
+    // Never destroyed, so threads exiting during static destruction can
+    // still retire their counters.
+    static auto* instance = new Registry();
+    return *instance;
+}
+
+/// A thread's counters, registered for the lifetime of the thread.
+class ThreadCounters {
+public:
+    ThreadCounters() {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.live.push_back(&m_table);
+    }
+
+    ~ThreadCounters() {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for(int i = 0; i < max_kernels; ++i) {
+            add(reg.retired[i].calls, m_table[i].calls.load());
+            add(reg.retired[i].elements, m_table[i].elements.load());
+            add(reg.retired[i].nanoseconds, m_table[i].nanoseconds.load());
+        }
+        for(auto it = reg.live.begin(); it != reg.live.end(); ++it) {
+            if(*it == &m_table) {
+                reg.live.erase(it);
+                break;
+            }
+        }
+    }
+
+    Counters& operator[](int kernel) { return m_table[kernel]; }
+
+private:
+    CounterTable m_table;
+};
+
+inline ThreadCounters& thread_counters() {
+    static thread_local ThreadCounters counters;
+    return counters;
+}
+}
+
+/** Return the id of the kernel called \a name, registering it if needed.
+ *  Call sites cache the id, so this runs once per site. Returns -1 if
+ *  max_kernels names are already registered; such kernels are not counted.
+ */
+inline int register_kernel(const char* name) {
+    auto& reg = details::registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    const int num_kernels = reg.num_kernels.load();
+    for(int i = 0; i < num_kernels; ++i) {
+        if(std::strcmp(reg.names[i], name) == 0) {
+            return i;
+        }
+    }
+    if(num_kernels == max_kernels) {
+        return -1;
+    }
+    reg.names[num_kernels] = name;
+    reg.num_kernels.store(num_kernels + 1);
+    return num_kernels;
+}
+
+/** Record one call of \a kernel on the calling thread.
+ *  \a kernel is an id returned by register_kernel().
+ */
+inline void record(int kernel,
+        std::uint64_t elements,
+        std::uint64_t nanoseconds) {
+    if(kernel < 0) {
+        return;
+    }
+    auto& counters = details::thread_counters()[kernel];
+    details::add(counters.calls, 1);
+    details::add(counters.elements, elements);
+    details::add(counters.nanoseconds, nanoseconds);
+}
+
+/** Return the counters of every registered kernel, summed over all threads.
+ *  Counts from calls still in progress on other threads may or may not be
+ *  included.
+ */
+inline std::vector<KernelStats> snapshot() {
+    auto& reg = details::registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto out = std::vector<KernelStats>();
+    for(int i = 0; i < reg.num_kernels.load(); ++i) {
+        auto stats = KernelStats{reg.names[i],
+                reg.retired[i].calls.load(),
+                reg.retired[i].elements.load(),
+                reg.retired[i].nanoseconds.load()};
+        for(auto table : reg.live) {
+            stats.calls += (*table)[i].calls.load(std::memory_order_relaxed);
+            stats.elements +=
+                    (*table)[i].elements.load(std::memory_order_relaxed);
+            stats.nanoseconds +=
+                    (*table)[i].nanoseconds.load(std::memory_order_relaxed);
+        }
+        out.push_back(stats);
+    }
+    return out;
+}
+
+/** Return the counters of the kernel called \a name, summed over all
+ *  threads. All counters are zero if no such kernel was registered.
+ */
+inline KernelStats snapshot(const char* name) {
+    for(const auto& stats : snapshot()) {
+        if(std::strcmp(stats.name, name) == 0) {
+            return stats;
+        }
+    }
+    return KernelStats{name, 0, 0, 0};
+}
+
+/** Reset the counters of the calling thread and of exited threads.
+ *  Other running threads keep their counts, so call this while the
+ *  program is quiescent.
+ */
+inline void reset() {
+    auto& reg = details::registry();
+    auto& own = details::thread_counters();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for(int i = 0; i < max_kernels; ++i) {
+        for(auto counters : {&reg.retired[i], &own[i]}) {
+            counters->calls.store(0, std::memory_order_relaxed);
+            counters->elements.store(0, std::memory_order_relaxed);
+            counters->nanoseconds.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+/** Times a scope and records it as one call of a kernel on destruction.
+ *  The element count may be set after construction, for callers that
+ *  only know it once the work is done.
+ */
+class ScopedTimer {
+public:
+    ScopedTimer(int kernel, const char* name, std::uint64_t elements)
+        : m_kernel(kernel), m_name(name), m_elements(elements),
+          m_start(std::chrono::steady_clock::now()) {
+#ifdef COLOR_HAVE_USDT
+        DTRACE_PROBE2(cppcolor, batch_start, m_name, m_elements);
+#endif
+    }
+
+    ~ScopedTimer() {
+        const auto elapsed = std::chrono::duration_cast<
+                std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_start)
+                                     .count();
+#ifdef COLOR_HAVE_USDT
+        DTRACE_PROBE3(cppcolor, batch_done, m_name, m_elements, elapsed);
+#endif
+        record(m_kernel, m_elements, elapsed);
+    }
+
+    ScopedTimer(const ScopedTimer& other) = delete;
+    ScopedTimer& operator=(const ScopedTimer& other) = delete;
+
+    void set_elements(std::uint64_t elements) { m_elements = elements; }
+
+private:
+    int m_kernel;
+    const char* m_name;
+    std::uint64_t m_elements;
+    std::chrono::steady_clock::time_point m_start;
+};
+}
+}
+
+#ifdef COLOR_ENABLE_INSTRUMENTATION
+/** Time the rest of the enclosing scope as one call of the kernel \a name
+ *  (a string literal) processing \a elements colors. \a timer names the
+ *  ScopedTimer variable, so the element count can be updated later with
+ *  COLOR_INSTRUMENT_ELEMENTS.
+ */
+#define COLOR_INSTRUMENT_SCOPE(timer, name, elements)                          \
+    static const int timer##_kernel =                                          \
+            ::color::instrumentation::register_kernel(name);                   \
+    ::color::instrumentation::ScopedTimer timer(timer##_kernel, name, elements)
+
+/// Set the element count of a timer declared with COLOR_INSTRUMENT_SCOPE.
+#define COLOR_INSTRUMENT_ELEMENTS(timer, elements) timer.set_elements(elements)
+#else
+#define COLOR_INSTRUMENT_SCOPE(timer, name, elements)
+#define COLOR_INSTRUMENT_ELEMENTS(timer, elements)
+#endif
+
+#endif
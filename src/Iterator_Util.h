@@ -0,0 +1,59 @@
+#ifndef COLOR_ITERATOR_UTIL_H_
+#define COLOR_ITERATOR_UTIL_H_
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "MemoryResource.h"
+
+namespace color {
+namespace details {
+
+/** True if Iterator is known to point into contiguous storage of Value,
+ *  which lets bulk operations work on a raw pointer instead of going
+ *  through the iterator one element at a time.
+ */
+template <typename Iterator, typename Value>
+struct is_contiguous_iterator
+        : std::integral_constant<bool,
+                  std::is_same<Iterator, Value*>::value ||
+                          std::is_same<Iterator, const Value*>::value ||
+                          std::is_same<Iterator,
+                                  typename std::vector<Value>::iterator>::
+                                  value ||
+                          std::is_same<Iterator,
+                                  typename std::vector<Value>::const_iterator>::
+                                  value ||
+                          std::is_same<Iterator,
+                                  typename PmrVector<Value>::iterator>::value ||
+                          std::is_same<Iterator,
+                                  typename PmrVector<Value>::const_iterator>::
+                                  value ||
+                          std::is_same<Iterator,
+                                  typename UninitializedPmrVector<Value>::
+                                          iterator>::value ||
+                          std::is_same<Iterator,
+                                  typename UninitializedPmrVector<Value>::
+                                          const_iterator>::value> {};
+
+/** True for the lazy views of Views.h, which bulk operations read a chunk
+ *  at a time.
+ */
+template <typename T, typename = void>
+struct is_color_view : std::false_type {};
+
+template <typename T>
+struct is_color_view<T,
+        decltype(void(std::declval<typename T::color_view_tag*>()))>
+        : std::true_type {};
+
+/// Return a pointer to the element referenced by a contiguous iterator.
+template <typename Iterator>
+inline auto to_address(Iterator it) {
+    return &*it;
+}
+}
+}
+
+#endif
@@ -0,0 +1,296 @@
+/** \file
+ *  Defines the MappedColorSink class.
+ *
+ *  MappedColorSink uses POSIX memory mapping and is only available on
+ *  POSIX systems.
+ */
+#ifndef COLOR_MAPPEDCOLORSINK_H_
+#define COLOR_MAPPEDCOLORSINK_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Exceptions.h"
+#include "Instrumentation.h"
+#include "Packer.h"
+#include "Parallel.h"
+#include "Sink.h"
+
+namespace color {
+
+/** Packs a known number of colors straight into a memory-mapped file.
+ *
+ *  The file is sized to `count * packed_size()` bytes up front and mapped
+ *  into memory, so colors are packed directly into the page cache without
+ *  any intermediate buffer or system call per write.
+ *
+ *  pack_at() packs colors at any index and may be called concurrently
+ *  from any number of threads as long as they write disjoint ranges;
+ *  pack_parallel() splits a range across threads that way.
+ *
+ *  A MappedColorSink is also a Sink, so a StreamPacker can fill it
+ *  sequentially. StreamPacker packs into it in place through
+ *  Sink::reserve(). A sequential write beyond the end of the file sets the
+ *  error state.
+ *
+ *  Errors creating the file or finishing it in finalize() are thrown as
+ *  IOError.
+ */
+template <typename Color>
+class MappedColorSink : public Sink {
+public:
+    /** Create or truncate the file at \a path to hold \a count colors packed
+     *  with \a packer, reserve disk space for it and map it into memory.
+     *  \throws IOError if the file cannot be created or mapped, or there is
+     *  not enough space for it. The error code is `EFBIG` if its size does
+     *  not fit into `std::size_t` or `off_t`.
+     */
+    MappedColorSink(const std::string& path,
+            std::uint64_t count,
+            std::unique_ptr<Packer<Color>> packer)
+        : m_packer(std::move(packer)), m_count(count),
+          m_size(file_size(path, count, m_packer->packed_size())) {
+        do {
+            m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+        } while(m_fd < 0 && errno == EINTR);
+        if(m_fd < 0) {
+            throw_error("open " + path, errno);
+        }
+        // Reserve the blocks, so that a full disk is reported here rather
+        // than as SIGBUS on the first store to a page without one.
+        int error = 0;
+        if(m_size > 0) {
+            do {
+                error = ::posix_fallocate(
+                        m_fd, 0, static_cast<off_t>(m_size));
+            } while(error == EINTR);
+        }
+        if(error == EOPNOTSUPP) {
+            error = ::ftruncate(m_fd, static_cast<off_t>(m_size)) != 0
+                    ? errno
+                    : 0;
+            if(error != 0) {
+                ::close(m_fd);
+                throw_error("ftruncate " + path, error);
+            }
+        } else if(error != 0) {
+            ::close(m_fd);
+            throw_error("posix_fallocate " + path, error);
+        }
+        // Mapping zero bytes fails, and there is nothing to write anyway.
+        if(m_size > 0) {
+            void* data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, m_fd, 0);
+            if(data == MAP_FAILED) {
+                const int error = errno;
+                ::close(m_fd);
+                throw_error("mmap " + path, error);
+            }
+            m_data = static_cast<char*>(data);
+        }
+    }
+
+    /** Unmap and close the file without reporting errors. The data stays
+     *  in the page cache and is written back by the kernel; call
+     *  finalize() to wait for that and see errors.
+     */
+    ~MappedColorSink() override { release(); }
+
+    MappedColorSink(const MappedColorSink& other) = delete;
+    MappedColorSink& operator=(const MappedColorSink& other) = delete;
+
+    /** Pack all elements between \a first and \a last, starting at the
+     *  color at \a index. Thread-safe for disjoint ranges.
+     *  \throws std::out_of_range if the colors do not fit into the file.
+     */
+    template <typename Iterator>
+    void pack_at(std::uint64_t index, Iterator first, Iterator last) {
+        COLOR_INSTRUMENT_SCOPE(timer, "MappedColorSink::pack_at", 0);
+        const auto n = static_cast<std::uint64_t>(std::distance(first, last));
+        check_range(index, n);
+        m_packer->pack(first, last, data_at(index));
+        COLOR_INSTRUMENT_ELEMENTS(timer, n);
+    }
+
+    /** Pack one color at \a index. Thread-safe for distinct indices.
+     *  \throws std::out_of_range if \a index is not in the file.
+     */
+    void pack_single_at(std::uint64_t index, const Color& color) {
+        check_range(index, 1);
+        m_packer->pack_single(color, data_at(index));
+    }
+
+    /** Pack all elements between the random access iterators \a first and
+     *  \a last, starting at the color at \a index, on \a num_threads
+     *  threads. 0 uses every hardware thread. Each thread packs one
+     *  contiguous part of the range.
+     *  \throws std::out_of_range if the colors do not fit into the file.
+     */
+    template <typename Iterator>
+    void pack_parallel(std::uint64_t index,
+            Iterator first,
+            Iterator last,
+            int num_threads = 0) {
+        COLOR_INSTRUMENT_SCOPE(timer, "MappedColorSink::pack_parallel", 0);
+        const auto n = static_cast<std::uint64_t>(std::distance(first, last));
+        check_range(index, n);
+        // Parts smaller than this are not worth a thread.
+        const std::uint64_t min_part = 4096;
+        details::parallel_parts(n,
+                num_threads,
+                min_part,
+                [&](std::uint64_t begin, std::uint64_t end) {
+                    m_packer->pack(first + begin,
+                            first + end,
+                            data_at(index + begin));
+                });
+        COLOR_INSTRUMENT_ELEMENTS(timer, n);
+    }
+
+    void write(const void* data, std::size_t size) override {
+        if(auto out = reserve(size)) {
+            std::memcpy(out, data, size);
+            commit(size);
+        }
+    }
+
+    void* reserve(std::size_t size) override {
+        if(!good() || m_size - m_position < size) {
+            m_failed = true;
+            return nullptr;
+        }
+        return m_data + m_position;
+    }
+
+    void commit(std::size_t size) override { m_position += size; }
+
+    /// The data is already in the page cache, so there is nothing to do.
+    bool flush() override { return good(); }
+
+    /** Write the mapped data back to the file and wait until it is
+     *  durably stored.
+     *  \returns good().
+     */
+    bool sync() override {
+        if(good() && m_data && ::msync(m_data, m_size, MS_SYNC) != 0) {
+            m_failed = true;
+        }
+        return good();
+    }
+
+    bool good() const override { return !m_failed; }
+
+    bool fail() const override { return m_failed; }
+
+    bool bad() const override { return m_failed; }
+
+    /** Write the mapped data back to the file, then unmap and close it.
+     *  Afterward the MappedColorSink should not be used.
+     *  \throws IOError if writing back, unmapping or closing fails, e.g.
+     *  because the disk is full.
+     */
+    void finalize() {
+        COLOR_INSTRUMENT_SCOPE(timer, "MappedColorSink::finalize", m_count);
+        if(m_data && ::msync(m_data, m_size, MS_SYNC) != 0) {
+            const int error = errno;
+            release();
+            throw_error("msync", error);
+        }
+        if(m_data && ::munmap(m_data, m_size) != 0) {
+            const int error = errno;
+            m_data = nullptr;
+            release();
+            throw_error("munmap", error);
+        }
+        m_data = nullptr;
+        if(m_fd >= 0 && ::close(m_fd) != 0) {
+            m_fd = -1;
+            throw_error("close", errno);
+        }
+        m_fd = -1;
+    }
+
+    /// Get the mapped bytes.
+    char* data() { return m_data; }
+
+    /// Get the mapped bytes.
+    const char* data() const { return m_data; }
+
+    /// Get the number of colors the file holds.
+    std::uint64_t count() const { return m_count; }
+
+    /// Get the size of the file in bytes.
+    std::size_t size() const { return m_size; }
+
+    /// Get the internal Packer.
+    const Packer<Color>& get_packer() const { return *m_packer; }
+
+private:
+    char* data_at(std::uint64_t index) {
+        return m_data + index * m_packer->packed_size();
+    }
+
+    void check_range(std::uint64_t index, std::uint64_t n) const {
+        if(index > m_count || m_count - index < n) {
+            throw std::out_of_range("MappedColorSink: colors " +
+                    std::to_string(index) + " to " + std::to_string(index + n) +
+                    " are out of range for " + std::to_string(m_count) +
+                    " colors");
+        }
+    }
+
+    /// The size of \a count colors of \a packed_size bytes, checked.
+    static std::size_t file_size(const std::string& path,
+            std::uint64_t count,
+            std::size_t packed_size) {
+        const auto max = std::min<std::uint64_t>(
+                std::numeric_limits<std::size_t>::max(),
+                std::numeric_limits<off_t>::max());
+        if(packed_size > 0 && count > max / packed_size) {
+            throw_error("MappedColorSink " + path + " with " +
+                            std::to_string(count) + " colors",
+                    EFBIG);
+        }
+        return static_cast<std::size_t>(count * packed_size);
+    }
+
+    void release() {
+        if(m_data) {
+            ::munmap(m_data, m_size);
+            m_data = nullptr;
+        }
+        if(m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    [[noreturn]] static void throw_error(const std::string& call, int error) {
+        throw IOError(call + ": " + std::strerror(error), error);
+    }
+
+    std::unique_ptr<Packer<Color>> m_packer;
+    std::uint64_t m_count;
+    std::size_t m_size;
+    int m_fd = -1;
+    char* m_data = nullptr;
+
+    // Position of the sequential Sink interface.
+    std::size_t m_position = 0;
+    bool m_failed = false;
+};
+}
+
+#endif
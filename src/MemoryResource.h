@@ -0,0 +1,437 @@
+/** \file
+ *  Memory resources and a polymorphic allocator for the buffers of the
+ *  library, modeled on `std::pmr` of C++17.
+ *
+ *  Functions that return vectors of colors, such as Unpacker::unpack()
+ *  and StreamUnpacker::unpack_all(), have overloads taking an allocator,
+ *  and the stream classes take a MemoryResource for their internal
+ *  buffers. With an ArenaResource, request-scoped decoding allocates by
+ *  bumping a pointer into a buffer that is released all at once:
+ *
+ *      alignas(16) char scratch[1 << 16];
+ *      ArenaResource arena(scratch, sizeof(scratch));
+ *      auto colors = unpacker.unpack(
+ *              src, num_bytes, PolymorphicAllocator<Rgb<uint8_t>>(&arena));
+ */
+#ifndef COLOR_MEMORYRESOURCE_H_
+#define COLOR_MEMORYRESOURCE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace color {
+
+/** Interface of memory resources, like `std::pmr::memory_resource`.
+ *  Subclasses implement do_allocate(), do_deallocate() and do_is_equal().
+ */
+class MemoryResource {
+public:
+    virtual ~MemoryResource() {}
+
+    /** Allocate \a bytes bytes aligned to \a alignment, which must be a
+     *  power of two.
+     *  \throws std::bad_alloc if the memory cannot be allocated.
+     */
+    void* allocate(std::size_t bytes,
+            std::size_t alignment = alignof(std::max_align_t)) {
+        assert((alignment & (alignment - 1)) == 0 &&
+                "alignment must be a power of two");
+        return do_allocate(bytes, alignment);
+    }
+
+    /// Free memory returned by allocate() with the same arguments.
+    void deallocate(void* p,
+            std::size_t bytes,
+            std::size_t alignment = alignof(std::max_align_t)) {
+        do_deallocate(p, bytes, alignment);
+    }
+
+    /** Return whether memory allocated by this resource can be freed by
+     *  \a other and vice versa.
+     */
+    bool is_equal(const MemoryResource& other) const noexcept {
+        return this == &other || do_is_equal(other);
+    }
+
+protected:
+    virtual void* do_allocate(std::size_t bytes, std::size_t alignment) = 0;
+    virtual void do_deallocate(
+            void* p, std::size_t bytes, std::size_t alignment) = 0;
+    virtual bool do_is_equal(const MemoryResource& other) const noexcept = 0;
+};
+
+inline bool operator==(const MemoryResource& lhs, const MemoryResource& rhs) {
+    return lhs.is_equal(rhs);
+}
+
+inline bool operator!=(const MemoryResource& lhs, const MemoryResource& rhs) {
+    return !(lhs == rhs);
+}
+
+namespace details {
+
+/** Allocates with the global `operator new`. Alignments beyond what it
+ *  guarantees are met by allocating more and storing the original pointer
+ *  in front of the aligned block.
+ */
+class NewDeleteResource : public MemoryResource {
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if(alignment <= alignof(std::max_align_t)) {
+            return ::operator new(bytes);
+        }
+        const auto raw = static_cast<unsigned char*>(
+                ::operator new(bytes + alignment + sizeof(void*)));
+        const auto first =
+                reinterpret_cast<std::uintptr_t>(raw + sizeof(void*));
+        const auto aligned = reinterpret_cast<unsigned char*>(
+                (first + alignment - 1) & ~std::uintptr_t(alignment - 1));
+        reinterpret_cast<void**>(aligned)[-1] = raw;
+        return aligned;
+    }
+
+    void do_deallocate(void* p, std::size_t, std::size_t alignment) override {
+        if(alignment <= alignof(std::max_align_t)) {
+            ::operator delete(p);
+        } else if(p) {
+            ::operator delete(static_cast<void**>(p)[-1]);
+        }
+    }
+
+    bool do_is_equal(const MemoryResource& other) const noexcept override {
+        return dynamic_cast<const NewDeleteResource*>(&other) != nullptr;
+    }
+};
+
+/// Fails every allocation.
+class NullResource : public MemoryResource {
+protected:
+    void* do_allocate(std::size_t, std::size_t) override {
+        throw std::bad_alloc();
+    }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const MemoryResource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+inline std::atomic<MemoryResource*>& default_resource_ptr();
+}
+
+/// The resource that allocates with the global `operator new`.
+inline MemoryResource* new_delete_resource() {
+    static auto resource = details::NewDeleteResource();
+    return &resource;
+}
+
+/** A resource whose allocations always throw std::bad_alloc, e.g. as the
+ *  upstream of an ArenaResource that must not touch the heap.
+ */
+inline MemoryResource* null_memory_resource() {
+    static auto resource = details::NullResource();
+    return &resource;
+}
+
+namespace details {
+
+inline std::atomic<MemoryResource*>& default_resource_ptr() {
+    static std::atomic<MemoryResource*> resource(new_delete_resource());
+    return resource;
+}
+}
+
+/** Return the resource used by default constructed PolymorphicAllocator
+ *  instances and the stream classes, new_delete_resource() unless changed
+ *  with set_default_resource().
+ */
+inline MemoryResource* get_default_resource() {
+    return details::default_resource_ptr().load();
+}
+
+/** Set the default resource, or reset it to new_delete_resource() if
+ *  \a resource is null.
+ *  \returns The previous default resource.
+ */
+inline MemoryResource* set_default_resource(MemoryResource* resource) {
+    return details::default_resource_ptr().exchange(
+            resource ? resource : new_delete_resource());
+}
+
+/** A resource that allocates by bumping a pointer through a buffer and
+ *  frees everything at once, like `std::pmr::monotonic_buffer_resource`.
+ *
+ *  Allocations are served from the initial buffer, if one is given, and
+ *  then from chunks of geometrically growing size requested from the
+ *  upstream resource. Deallocation does nothing; release() frees all
+ *  chunks and starts over at the initial buffer. ArenaResource is not
+ *  thread safe.
+ */
+class ArenaResource : public MemoryResource {
+public:
+    /// Size of the first chunk requested from upstream without a buffer.
+    static constexpr std::size_t default_chunk_size = 4096;
+
+    /// An arena allocating its chunks from \a upstream.
+    explicit ArenaResource(MemoryResource* upstream = get_default_resource())
+        : m_upstream(upstream), m_next_chunk_size(default_chunk_size) {}
+
+    /** An arena that first allocates from the \a size bytes at \a buffer,
+     *  then from \a upstream.
+     */
+    ArenaResource(void* buffer,
+            std::size_t size,
+            MemoryResource* upstream = get_default_resource())
+        : m_upstream(upstream), m_buffer(static_cast<unsigned char*>(buffer)),
+          m_buffer_size(size), m_current(m_buffer), m_end(m_buffer + size),
+          m_next_chunk_size(std::max(size, std::size_t(default_chunk_size))) {}
+
+    ~ArenaResource() override { release(); }
+
+    ArenaResource(const ArenaResource& other) = delete;
+    ArenaResource& operator=(const ArenaResource& other) = delete;
+
+    /** Free every chunk allocated from upstream and make the whole initial
+     *  buffer available again. Memory allocated before must no longer be
+     *  used.
+     */
+    void release() {
+        while(m_chunks) {
+            const auto chunk = m_chunks;
+            m_chunks = chunk->next;
+            m_upstream->deallocate(chunk, chunk->size, alignof(Chunk));
+        }
+        m_current = m_buffer;
+        m_end = m_buffer + m_buffer_size;
+    }
+
+    /// The resource chunks are allocated from.
+    MemoryResource* upstream_resource() const { return m_upstream; }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if(auto p = bump(bytes, alignment)) {
+            return p;
+        }
+        grow(bytes + alignment);
+        const auto p = bump(bytes, alignment);
+        assert(p && "a new chunk fits the allocation");
+        return p;
+    }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const MemoryResource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    /// Header of a chunk allocated from upstream, followed by its bytes.
+    struct alignas(std::max_align_t) Chunk {
+        Chunk* next;
+        std::size_t size;
+    };
+
+    void* bump(std::size_t bytes, std::size_t alignment) {
+        if(!m_current) {
+            return nullptr;
+        }
+        const auto address = reinterpret_cast<std::uintptr_t>(m_current);
+        const auto padding =
+                (alignment - address % alignment) % alignment;
+        if(std::size_t(m_end - m_current) < padding ||
+                std::size_t(m_end - m_current) - padding < bytes) {
+            return nullptr;
+        }
+        const auto p = m_current + padding;
+        m_current = p + bytes;
+        return p;
+    }
+
+    void grow(std::size_t min_bytes) {
+        const auto bytes = std::max(m_next_chunk_size, min_bytes);
+        const auto size = sizeof(Chunk) + bytes;
+        const auto chunk = static_cast<Chunk*>(
+                m_upstream->allocate(size, alignof(Chunk)));
+        chunk->next = m_chunks;
+        chunk->size = size;
+        m_chunks = chunk;
+        m_current = reinterpret_cast<unsigned char*>(chunk + 1);
+        m_end = m_current + bytes;
+        m_next_chunk_size = bytes * 2;
+    }
+
+    MemoryResource* m_upstream;
+    unsigned char* m_buffer = nullptr;
+    std::size_t m_buffer_size = 0;
+    unsigned char* m_current = nullptr;
+    unsigned char* m_end = nullptr;
+    std::size_t m_next_chunk_size;
+    Chunk* m_chunks = nullptr;
+};
+
+/** An allocator that allocates from a MemoryResource, like
+ *  `std::pmr::polymorphic_allocator`, so containers using different
+ *  resources have the same type.
+ *
+ *  Unlike `std::pmr::polymorphic_allocator`, the allocator moves along
+ *  with the contents on move assignment, so classes holding containers
+ *  with it keep their noexcept move assignment.
+ */
+template <typename T>
+class PolymorphicAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    /// Allocate from get_default_resource().
+    PolymorphicAllocator() noexcept : m_resource(get_default_resource()) {}
+
+    /// Allocate from \a resource, which must outlive the allocator.
+    PolymorphicAllocator(MemoryResource* resource) noexcept
+        : m_resource(resource) {
+        assert(resource && "resource must not be null");
+    }
+
+    template <typename U>
+    PolymorphicAllocator(const PolymorphicAllocator<U>& other) noexcept
+        : m_resource(other.resource()) {}
+
+    PolymorphicAllocator(const PolymorphicAllocator& other) = default;
+    PolymorphicAllocator& operator=(const PolymorphicAllocator& other) =
+            default;
+
+    T* allocate(std::size_t n) {
+        if(n > std::size_t(-1) / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(m_resource->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        m_resource->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    /// Copies of containers allocate from the default resource.
+    PolymorphicAllocator select_on_container_copy_construction() const {
+        return PolymorphicAllocator();
+    }
+
+    MemoryResource* resource() const { return m_resource; }
+
+private:
+    MemoryResource* m_resource;
+};
+
+template <typename T, typename U>
+bool operator==(const PolymorphicAllocator<T>& lhs,
+        const PolymorphicAllocator<U>& rhs) {
+    return *lhs.resource() == *rhs.resource();
+}
+
+template <typename T, typename U>
+bool operator!=(const PolymorphicAllocator<T>& lhs,
+        const PolymorphicAllocator<U>& rhs) {
+    return !(lhs == rhs);
+}
+
+/// A vector allocating from a MemoryResource.
+template <typename T>
+using PmrVector = std::vector<T, PolymorphicAllocator<T>>;
+
+/** An allocator adaptor whose construct() without arguments leaves
+ *  trivially copyable values, such as colors, uninitialized instead of
+ *  value-initializing them. A vector sized with it does not write its
+ *  memory, so the threads that fill it in parallel are the first to touch
+ *  each page. Elements added later by `resize()` are uninitialized as
+ *  well and must be written before they are read.
+ */
+template <typename Allocator>
+class UninitializedAllocator : public Allocator {
+    using Traits = std::allocator_traits<Allocator>;
+
+public:
+    template <typename U>
+    struct rebind {
+        using other = UninitializedAllocator<
+                typename Traits::template rebind_alloc<U>>;
+    };
+
+    UninitializedAllocator() = default;
+
+    /// Adapt \a alloc, allocating from wherever it does.
+    UninitializedAllocator(const Allocator& alloc) : Allocator(alloc) {}
+
+    template <typename U>
+    UninitializedAllocator(const UninitializedAllocator<U>& other)
+        : Allocator(static_cast<const U&>(other)) {}
+
+    template <typename U>
+    void construct(U* p) {
+        construct_default(p,
+                std::integral_constant<bool,
+                        std::is_trivially_copyable<U>::value &&
+                                std::is_trivially_destructible<U>::value>());
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        Traits::construct(
+                static_cast<Allocator&>(*this), p, std::forward<Args>(args)...);
+    }
+
+private:
+    template <typename U>
+    void construct_default(U*, std::true_type) {}
+
+    template <typename U>
+    void construct_default(U* p, std::false_type) {
+        Traits::construct(static_cast<Allocator&>(*this), p);
+    }
+};
+
+template <typename A, typename B>
+bool operator==(const UninitializedAllocator<A>& lhs,
+        const UninitializedAllocator<B>& rhs) {
+    return static_cast<const A&>(lhs) == static_cast<const B&>(rhs);
+}
+
+template <typename A, typename B>
+bool operator!=(const UninitializedAllocator<A>& lhs,
+        const UninitializedAllocator<B>& rhs) {
+    return !(lhs == rhs);
+}
+
+/** A vector allocating from a MemoryResource without value-initializing
+ *  its elements, as returned by Unpacker::unpack_parallel().
+ */
+template <typename T>
+using UninitializedPmrVector =
+        std::vector<T, UninitializedAllocator<PolymorphicAllocator<T>>>;
+
+namespace details {
+
+/** True for allocators, so overloads taking one are not confused with
+ *  overloads taking an output iterator.
+ */
+template <typename T, typename = void>
+struct is_allocator : std::false_type {};
+
+template <typename T>
+struct is_allocator<T,
+        decltype(void(std::declval<typename T::value_type>()),
+                void(std::declval<T&>().allocate(std::size_t(0))))>
+        : std::true_type {};
+}
+}
+
+#endif
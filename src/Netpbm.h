@@ -0,0 +1,496 @@
+/** \file
+ *  Reading and writing PPM, PAM and PFM images.
+ *
+ *  These Netpbm formats consist of a short text header followed by the
+ *  raw pixels, which have the same layout as an array of Rgb or Alpha
+ *  colors. After the header is parsed, the pixels are therefore read
+ *  with a single bulk read straight into the color storage. The
+ *  big-endian samples of 16-bit PPM and PAM files, and PFM files written
+ *  on a machine of the other byte order, are fixed up afterward with
+ *  one vectorized byteswap() of the whole buffer.
+ *
+ *  The supported color types are:
+ *
+ *  - `Rgb<uint8_t>` and `Rgb<uint16_t>`: PPM (P6) or PAM (P7) with a
+ *    depth of 3.
+ *  - `Alpha<uint8_t, Rgb>` and `Alpha<uint16_t, Rgb>`: PAM with a depth
+ *    of 4.
+ *  - `Rgb<float>`: color PFM (PF).
+ *
+ *  Samples are stored as they are in the file. A maximum value other than
+ *  255 or 65535 is not rescaled, but reported in NetpbmHeader::maxval.
+ *
+ *  The header sizes the pixel buffer, so read_netpbm() rejects images
+ *  whose pixels exceed a limit before allocating for them.
+ */
+#ifndef COLOR_NETPBM_H_
+#define COLOR_NETPBM_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Alpha.h"
+#include "ByteOrder.h"
+#include "Exceptions.h"
+#include "Instrumentation.h"
+#include "Rgb.h"
+
+namespace color {
+
+/// Default limit on the pixel bytes read_netpbm() allocates, 4 GiB.
+constexpr std::uint64_t netpbm_max_payload_size = std::uint64_t(1) << 32;
+
+enum class NetpbmFormat {
+    /// Binary PPM (P6).
+    Ppm,
+    /// PAM (P7).
+    Pam,
+    /// PFM, color (PF) or grayscale (Pf).
+    Pfm
+};
+
+/// The header of a Netpbm image.
+struct NetpbmHeader {
+    NetpbmFormat format = NetpbmFormat::Ppm;
+    std::size_t width = 0;
+    std::size_t height = 0;
+    /// Samples per pixel.
+    std::size_t depth = 3;
+    /// Largest sample value of PPM and PAM images, 0 for PFM.
+    std::uint32_t maxval = 255;
+    /// PAM tuple type, e.g. `RGB` or `RGB_ALPHA`. Empty for other formats.
+    std::string tuple_type;
+    /// PFM scale factor. Negative values mean little endian samples.
+    float scale = -1.0f;
+
+    /// Get the size of one sample in bytes.
+    std::size_t sample_size() const {
+        return format == NetpbmFormat::Pfm ? 4 : maxval > 255 ? 2 : 1;
+    }
+
+    /// Get the byte order of the samples in the file.
+    ByteOrder byte_order() const {
+        return format == NetpbmFormat::Pfm && scale < 0 ? ByteOrder::Little
+                                                        : ByteOrder::Big;
+    }
+
+    /// Get the size of one row of pixels in bytes.
+    std::size_t row_size() const { return width * depth * sample_size(); }
+
+    /// Get the size of all pixels in bytes.
+    std::size_t payload_size() const { return row_size() * height; }
+};
+
+/** A width by height image of colors, stored row by row from the top.
+ *  PFM images, which are stored from the bottom, are flipped on reading
+ *  and writing.
+ */
+template <typename Color>
+struct Image {
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::vector<Color> pixels;
+};
+
+namespace details {
+
+/// How a color type is stored in a Netpbm file.
+template <typename Color>
+struct netpbm_layout;
+
+template <typename T>
+struct netpbm_layout<Rgb<T>> {
+    static constexpr std::size_t depth = 3;
+    static constexpr const char* tuple_type = "RGB";
+};
+
+template <typename T>
+struct netpbm_layout<Alpha<T, Rgb>> {
+    static constexpr std::size_t depth = 4;
+    static constexpr const char* tuple_type = "RGB_ALPHA";
+};
+
+template <typename Color>
+struct netpbm_traits {
+    using ElementType = typename Color::ElementType;
+    static constexpr std::size_t depth = netpbm_layout<Color>::depth;
+    static constexpr bool is_float = std::is_same<ElementType, float>::value;
+
+    static_assert(std::is_same<ElementType, std::uint8_t>::value ||
+                    std::is_same<ElementType, std::uint16_t>::value ||
+                    (is_float && depth == 3),
+            "Netpbm images hold Rgb or Alpha<Rgb> colors of uint8_t or "
+            "uint16_t, or Rgb<float>");
+    // Pixels are read straight into the colors.
+    static_assert(sizeof(Color) == depth * sizeof(ElementType),
+            "Netpbm colors must not have padding");
+
+    static constexpr NetpbmFormat default_format =
+            is_float ? NetpbmFormat::Pfm
+                     : depth == 3 ? NetpbmFormat::Ppm : NetpbmFormat::Pam;
+};
+
+/// Reads the whitespace separated tokens of a header.
+class NetpbmHeaderReader {
+public:
+    explicit NetpbmHeaderReader(std::istream& in) : m_in(in) {}
+
+    /// Skip whitespace and `#` comments.
+    void skip_space() {
+        for(;;) {
+            const auto c = m_in.peek();
+            if(c == '#') {
+                while(m_in.get() != '\n' && m_in) {
+                }
+            } else if(c != std::char_traits<char>::eof() && std::isspace(c)) {
+                m_in.get();
+            } else {
+                return;
+            }
+        }
+    }
+
+    std::string token() {
+        skip_space();
+        auto out = std::string();
+        for(;;) {
+            const auto c = m_in.peek();
+            if(c == std::char_traits<char>::eof() || std::isspace(c) ||
+                    c == '#') {
+                break;
+            }
+            out.push_back(static_cast<char>(m_in.get()));
+        }
+        if(out.empty()) {
+            throw ImageFormatError("truncated Netpbm header");
+        }
+        return out;
+    }
+
+    std::size_t number(const char* what) {
+        const auto text = token();
+        char* end = nullptr;
+        const auto value = std::strtoull(text.c_str(), &end, 10);
+        if(*end != '\0' ||
+                !std::isdigit(static_cast<unsigned char>(text[0]))) {
+            throw ImageFormatError(std::string("invalid ") + what +
+                    " in Netpbm header: " + text);
+        }
+        return static_cast<std::size_t>(value);
+    }
+
+    /// Consume the single whitespace character that ends the header.
+    void end() {
+        const auto c = m_in.get();
+        if(c == std::char_traits<char>::eof() || !std::isspace(c)) {
+            throw ImageFormatError("missing whitespace after Netpbm header");
+        }
+    }
+
+    /// Consume the rest of the current line.
+    std::string line() {
+        auto out = std::string();
+        std::getline(m_in, out);
+        return out;
+    }
+
+private:
+    std::istream& m_in;
+};
+
+template <typename Color>
+void check_netpbm_header(const NetpbmHeader& header) {
+    using Traits = netpbm_traits<Color>;
+    const auto sample_size = sizeof(typename Traits::ElementType);
+    const bool pfm = header.format == NetpbmFormat::Pfm;
+    if(pfm != Traits::is_float || header.depth != Traits::depth ||
+            header.sample_size() != sample_size) {
+        throw ImageFormatError("Netpbm image with " +
+                std::to_string(header.depth) + " samples of " +
+                std::to_string(header.sample_size()) +
+                " bytes does not match the color type");
+    }
+    if(header.format == NetpbmFormat::Pam && !header.tuple_type.empty() &&
+            header.tuple_type != netpbm_layout<Color>::tuple_type) {
+        throw ImageFormatError("PAM tuple type " + header.tuple_type +
+                " does not match the color type");
+    }
+}
+}
+
+/** Parse the header of a PPM, PAM or PFM image from \a in and leave \a in
+ *  at the first byte of the pixels.
+ *  \throws ImageFormatError if the header is malformed or of another
+ *  Netpbm format.
+ */
+inline NetpbmHeader read_netpbm_header(std::istream& in) {
+    auto reader = details::NetpbmHeaderReader(in);
+    auto header = NetpbmHeader();
+    const auto magic = reader.token();
+    if(magic == "P6") {
+        header.format = NetpbmFormat::Ppm;
+        header.width = reader.number("width");
+        header.height = reader.number("height");
+        header.maxval = static_cast<std::uint32_t>(reader.number("maxval"));
+        reader.end();
+    } else if(magic == "P7") {
+        header.format = NetpbmFormat::Pam;
+        header.depth = 0;
+        header.maxval = 0;
+        for(;;) {
+            const auto key = reader.token();
+            if(key == "ENDHDR") {
+                reader.line();
+                break;
+            } else if(key == "WIDTH") {
+                header.width = reader.number("width");
+            } else if(key == "HEIGHT") {
+                header.height = reader.number("height");
+            } else if(key == "DEPTH") {
+                header.depth = reader.number("depth");
+            } else if(key == "MAXVAL") {
+                header.maxval =
+                        static_cast<std::uint32_t>(reader.number("maxval"));
+            } else if(key == "TUPLTYPE") {
+                reader.skip_space();
+                header.tuple_type = reader.line();
+                while(!header.tuple_type.empty() &&
+                        std::isspace(static_cast<unsigned char>(
+                                header.tuple_type.back()))) {
+                    header.tuple_type.pop_back();
+                }
+            } else {
+                throw ImageFormatError("unknown PAM header field " + key);
+            }
+        }
+    } else if(magic == "PF" || magic == "Pf") {
+        header.format = NetpbmFormat::Pfm;
+        header.depth = magic == "PF" ? 3 : 1;
+        header.maxval = 0;
+        header.width = reader.number("width");
+        header.height = reader.number("height");
+        const auto scale = reader.token();
+        char* end = nullptr;
+        header.scale = std::strtof(scale.c_str(), &end);
+        if(*end != '\0' || header.scale == 0.0f) {
+            throw ImageFormatError("invalid PFM scale " + scale);
+        }
+        reader.end();
+    } else {
+        throw ImageFormatError("unsupported Netpbm format " + magic);
+    }
+    if(!in) {
+        throw ImageFormatError("truncated Netpbm header");
+    }
+    if(header.format != NetpbmFormat::Pfm &&
+            (header.maxval == 0 || header.maxval > 65535)) {
+        throw ImageFormatError(
+                "invalid Netpbm maxval " + std::to_string(header.maxval));
+    }
+    if(header.width == 0 || header.height == 0 || header.depth == 0) {
+        throw ImageFormatError("empty Netpbm image");
+    }
+    // The sizes come from the file; their product must not wrap.
+    auto size = std::uint64_t(header.sample_size());
+    for(const auto factor : {header.width, header.height, header.depth}) {
+        if(factor > std::numeric_limits<std::size_t>::max() / size) {
+            throw ImageFormatError("Netpbm image too large");
+        }
+        size *= factor;
+    }
+    return header;
+}
+
+/** Write \a header to \a out. PFM files are written in the native byte
+ *  order, so the sign of NetpbmHeader::scale is ignored.
+ */
+inline void write_netpbm_header(std::ostream& out, const NetpbmHeader& header) {
+    switch(header.format) {
+    case NetpbmFormat::Ppm:
+        out << "P6\n"
+            << header.width << ' ' << header.height << '\n'
+            << header.maxval << '\n';
+        break;
+    case NetpbmFormat::Pam:
+        out << "P7\nWIDTH " << header.width << "\nHEIGHT " << header.height
+            << "\nDEPTH " << header.depth << "\nMAXVAL " << header.maxval
+            << '\n';
+        if(!header.tuple_type.empty()) {
+            out << "TUPLTYPE " << header.tuple_type << '\n';
+        }
+        out << "ENDHDR\n";
+        break;
+    case NetpbmFormat::Pfm: {
+        const auto scale = header.scale < 0 ? -header.scale : header.scale;
+        out << (header.depth == 3 ? "PF\n" : "Pf\n")
+            << header.width << ' ' << header.height << '\n'
+            << (native_byte_order() == ByteOrder::Little ? -scale : scale)
+            << '\n';
+        break;
+    }
+    }
+}
+
+/** Read the pixels of an image with the given \a header from \a in into
+ *  \a out, which must have room for `width * height` colors.
+ *  \throws ImageFormatError if the image does not match Color.
+ *  \throws CorruptDataError if the pixels are truncated.
+ */
+template <typename Color>
+void read_netpbm_pixels(std::istream& in,
+        const NetpbmHeader& header,
+        Color* out) {
+    COLOR_INSTRUMENT_SCOPE(
+            timer, "read_netpbm_pixels", header.width * header.height);
+    details::check_netpbm_header<Color>(header);
+    auto bytes = reinterpret_cast<char*>(out);
+    const auto row_size = header.row_size();
+    const auto size = header.payload_size();
+    if(header.format == NetpbmFormat::Pfm) {
+        // Rows are stored from the bottom.
+        for(std::size_t y = header.height; y-- > 0;) {
+            in.read(bytes + y * row_size, row_size);
+            if(static_cast<std::size_t>(in.gcount()) != row_size) {
+                throw CorruptDataError("truncated PFM pixels");
+            }
+        }
+    } else {
+        in.read(bytes, size);
+        if(static_cast<std::size_t>(in.gcount()) != size) {
+            throw CorruptDataError("truncated Netpbm pixels");
+        }
+    }
+    if(header.byte_order() != native_byte_order()) {
+        byteswap(out->data(), header.width * header.height * header.depth);
+    }
+}
+
+/** Read a PPM, PAM or PFM image from \a in.
+ *  \throws ImageFormatError if the header is malformed, the image does
+ *  not match Color or its pixels take more than \a max_payload_size
+ *  bytes.
+ *  \throws CorruptDataError if the pixels are truncated.
+ */
+template <typename Color>
+Image<Color> read_netpbm(std::istream& in,
+        std::uint64_t max_payload_size = netpbm_max_payload_size) {
+    const auto header = read_netpbm_header(in);
+    details::check_netpbm_header<Color>(header);
+    if(header.payload_size() > max_payload_size) {
+        throw ImageFormatError("Netpbm image of " +
+                std::to_string(header.payload_size()) +
+                " bytes exceeds the limit");
+    }
+    auto image = Image<Color>();
+    image.width = header.width;
+    image.height = header.height;
+    image.pixels.resize(header.width * header.height);
+    read_netpbm_pixels(in, header, image.pixels.data());
+    return image;
+}
+
+/** Read a PPM, PAM or PFM image from the file at \a path, see
+ *  read_netpbm(std::istream&, std::uint64_t).
+ *  \throws IOError if the file cannot be opened.
+ */
+template <typename Color>
+Image<Color> read_netpbm(const std::string& path,
+        std::uint64_t max_payload_size = netpbm_max_payload_size) {
+    errno = 0;
+    auto in = std::ifstream(path, std::ios::binary);
+    if(!in) {
+        const int error = errno;
+        throw IOError("cannot open " + path, error);
+    }
+    return read_netpbm<Color>(in, max_payload_size);
+}
+
+/** Write \a pixels, `width * height` colors stored row by row from the top,
+ *  to \a out as a PPM (Rgb), PAM (Alpha) or PFM (float) image. 16-bit
+ *  samples are byte swapped in blocks on little endian machines; all
+ *  other pixels are written as they are.
+ */
+template <typename Color>
+void write_netpbm(std::ostream& out,
+        const Color* pixels,
+        std::size_t width,
+        std::size_t height) {
+    COLOR_INSTRUMENT_SCOPE(timer, "write_netpbm", width * height);
+    using Traits = details::netpbm_traits<Color>;
+    using T = typename Traits::ElementType;
+    auto header = NetpbmHeader();
+    header.format = Traits::default_format;
+    header.width = width;
+    header.height = height;
+    header.depth = Traits::depth;
+    if(header.format == NetpbmFormat::Pfm) {
+        header.maxval = 0;
+    } else {
+        header.maxval = sizeof(T) == 1 ? 255 : 65535;
+        if(header.format == NetpbmFormat::Pam) {
+            header.tuple_type = details::netpbm_layout<Color>::tuple_type;
+        }
+    }
+    write_netpbm_header(out, header);
+
+    const auto bytes = reinterpret_cast<const char*>(pixels);
+    const auto row_size = header.row_size();
+    if(header.format == NetpbmFormat::Pfm) {
+        for(std::size_t y = height; y-- > 0;) {
+            out.write(bytes + y * row_size, row_size);
+        }
+    } else if(sizeof(T) == 1 || native_byte_order() == ByteOrder::Big) {
+        out.write(bytes, header.payload_size());
+    } else {
+        const auto samples = width * height * Traits::depth;
+        const std::size_t block = 16384;
+        auto buffer = std::vector<T>(std::min(samples, block));
+        for(std::size_t i = 0; i < samples; i += block) {
+            const auto n = std::min(block, samples - i);
+            std::copy_n(pixels->data() + i, n, buffer.data());
+            byteswap(buffer.data(), n);
+            out.write(reinterpret_cast<const char*>(buffer.data()),
+                    n * sizeof(T));
+        }
+    }
+}
+
+/// Write \a image to \a out, see write_netpbm().
+template <typename Color>
+void write_netpbm(std::ostream& out, const Image<Color>& image) {
+    write_netpbm(out, image.pixels.data(), image.width, image.height);
+}
+
+/** Write \a image to the file at \a path, see write_netpbm().
+ *  \throws IOError if the file cannot be written. Its error_code() is the
+ *  `errno` value of the failed open, or 0 for a failed write, for which
+ *  streams report no cause.
+ */
+template <typename Color>
+void write_netpbm(const std::string& path, const Image<Color>& image) {
+    errno = 0;
+    auto out = std::ofstream(path, std::ios::binary);
+    if(!out) {
+        const int error = errno;
+        throw IOError("cannot open " + path, error);
+    }
+    write_netpbm(out, image);
+    out.close();
+    if(!out) {
+        throw IOError("cannot write " + path, 0);
+    }
+}
+}
+
+#endif
@@ -4,8 +4,13 @@
 #ifndef COLOR_PACKER_H_
 #define COLOR_PACKER_H_
 
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
 #include <vector>
 
+#include "Iterator_Util.h"
+
 namespace color {
 static constexpr int packer_index_skip = -1;
 
@@ -27,6 +32,19 @@ public:
      */
     virtual void* pack_single(const Color& src, void* out) const = 0;
 
+    /** Pack \a count colors stored contiguously at \a src into \a out.
+     *  The default implementation calls pack_single() for every color.
+     *  Subclasses override it with bulk implementations.
+     *  \returns A pointer to one byte after the written data in \a out.
+     */
+    virtual void* pack_contiguous(
+            const Color* src, std::size_t count, void* out) const {
+        for(std::size_t i = 0; i < count; ++i) {
+            out = pack_single(src[i], out);
+        }
+        return out;
+    }
+
     /** Pack a collection of colors into a buffer.
      *  All elements from \a first to \a last are packed
      *  into \a out. \a out must be large enough to hold
@@ -35,10 +53,48 @@ public:
      *  `Packer::packed_size() * element_count` is the number of
      *  bytes requires to pack `element_count`colors.
      *
+     *  Ranges in contiguous storage are packed with pack_contiguous().
+     *
      *  \returns A pointer to one byte after the written data in \a out.
      */
     template <typename Iterator>
     void* pack(Iterator first, Iterator last, void* out) const {
+        return pack_impl(first,
+                last,
+                out,
+                details::is_contiguous_iterator<Iterator, Color>());
+    }
+
+    /** Pack every color of a lazy view (see Views.h) into a buffer. The
+     *  view is converted a chunk at a time and each chunk is packed with
+     *  pack_contiguous(), so no array of all converted colors is built.
+     *  \returns A pointer to one byte after the written data in \a out.
+     */
+    template <typename View,
+            typename = std::enable_if_t<details::is_color_view<View>::value>>
+    void* pack(const View& view, void* out) const {
+        static_assert(std::is_same<typename View::value_type, Color>::value,
+                "the view must produce the packed color type");
+        view.for_each_chunk([&](const Color* colors, std::size_t count) {
+            out = pack_contiguous(colors, count, out);
+        });
+        return out;
+    }
+
+private:
+    template <typename Iterator>
+    void* pack_impl(
+            Iterator first, Iterator last, void* out, std::true_type) const {
+        if(first == last) {
+            return out;
+        }
+        return pack_contiguous(
+                details::to_address(first), std::distance(first, last), out);
+    }
+
+    template <typename Iterator>
+    void* pack_impl(
+            Iterator first, Iterator last, void* out, std::false_type) const {
         for(auto it = first; it != last; ++it) {
             out = pack_single(*it, out);
         }
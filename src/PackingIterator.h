@@ -0,0 +1,282 @@
+/** \file
+ *  Iterators that unpack colors from, and pack colors into, packed buffers
+ *  one color at a time, so standard algorithms work on packed memory:
+ *
+ *      auto colors = unpacked(data, num_bytes, unpacker);
+ *      auto it = std::find_if(colors.begin(), colors.end(), is_red);
+ *
+ *      std::copy(first, last, make_packing_iterator(out, packer));
+ *
+ *  Iterators over a FlatColorUnpacker or FlatColorPacker, as made by
+ *  unpacked(), make_unpacking_iterator() and make_packing_iterator(),
+ *  unpack and pack without the virtual functions of Unpacker and Packer.
+ *
+ *  Unpacking a whole buffer with Unpacker::unpack() or packing a range with
+ *  Packer::pack() uses the bulk kernels and is faster whenever every color
+ *  is needed. The iterators are for algorithms that stop early or only
+ *  need one color at a time.
+ */
+#ifndef COLOR_PACKINGITERATOR_H_
+#define COLOR_PACKINGITERATOR_H_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "ByteOrder.h"
+#include "Dispatch.h"
+#include "Packer.h"
+#include "Unpacker.h"
+
+namespace color {
+namespace details {
+
+/** Unpacks single colors for unpacking_iterator with
+ *  Unpacker::unpack_single(), through a virtual call.
+ */
+template <typename Color, typename UnpackerType>
+class single_unpacker {
+public:
+    single_unpacker() = default;
+
+    explicit single_unpacker(const UnpackerType& unpacker)
+        : m_unpacker(&unpacker) {}
+
+    void unpack(const void* src, Color& out) const {
+        m_unpacker->unpack_single(src, out);
+    }
+
+private:
+    const UnpackerType* m_unpacker = nullptr;
+};
+
+/** Unpacks single colors for FlatColorUnpacker from a copy of its channel
+ *  sources, which the compiler keeps in registers in a loop over an
+ *  iterator, rather than going through the unpacker.
+ */
+template <typename Color>
+class single_unpacker<Color, FlatColorUnpacker<Color>> {
+public:
+    using T = typename Color::ElementType;
+
+    single_unpacker() = default;
+
+    explicit single_unpacker(const FlatColorUnpacker<Color>& unpacker)
+        : m_sources(unpacker.channel_sources()),
+          m_swap(sizeof(T) > 1 &&
+                  unpacker.byte_order() != native_byte_order()) {}
+
+    void unpack(const void* src, Color& out) const {
+        const auto in = static_cast<const T*>(src);
+        COLOR_UNROLL
+        for(int c = 0; c < Color::num_channels; ++c) {
+            const auto elem = m_sources[c];
+            out.data()[c] = elem == -1
+                    ? T(0)
+                    : (m_swap ? byteswap_value(in[elem]) : in[elem]);
+        }
+    }
+
+private:
+    std::array<int, Color::num_channels> m_sources{};
+    bool m_swap = false;
+};
+
+/// Calls Packer::pack_single(), through a virtual call.
+template <typename PackerType>
+struct single_packer {
+    template <typename Color>
+    static void* pack(const PackerType& packer, const Color& in, void* out) {
+        return packer.pack_single(in, out);
+    }
+};
+
+template <typename Color>
+struct single_packer<FlatColorPacker<Color>> {
+    static void* pack(
+            const FlatColorPacker<Color>& packer, const Color& in, void* out) {
+        return packer.FlatColorPacker<Color>::pack_single(in, out);
+    }
+};
+}
+
+/** An iterator over the colors packed in a buffer, which unpacks the color
+ *  it points to when it is dereferenced. Dereferencing returns the color by
+ *  value.
+ *
+ *  \a UnpackerType is Unpacker<Color> for any unpacker, or the class of
+ *  the unpacker, e.g. FlatColorUnpacker<Color>, to unpack without virtual
+ *  calls. The iterator refers to the unpacker and the buffer, which must
+ *  outlive it.
+ */
+template <typename Color, typename UnpackerType = Unpacker<Color>>
+class unpacking_iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Color;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Color;
+
+    unpacking_iterator() = default;
+
+    /// Point at the packed color at \a src.
+    unpacking_iterator(const void* src, const UnpackerType& unpacker)
+        : m_pos(static_cast<const unsigned char*>(src)),
+          m_unpacker(unpacker),
+          m_packed_size(unpacker.packed_size()) {}
+
+    Color operator*() const {
+        auto color = Color();
+        m_unpacker.unpack(m_pos, color);
+        return color;
+    }
+
+    Color operator[](difference_type n) const { return *(*this + n); }
+
+    unpacking_iterator& operator++() {
+        m_pos += m_packed_size;
+        return *this;
+    }
+
+    unpacking_iterator operator++(int) {
+        auto old = *this;
+        ++*this;
+        return old;
+    }
+
+    unpacking_iterator& operator+=(difference_type n) {
+        m_pos += n * difference_type(m_packed_size);
+        return *this;
+    }
+
+    unpacking_iterator operator+(difference_type n) const {
+        auto out = *this;
+        return out += n;
+    }
+
+    /// Number of colors between two iterators over the same buffer.
+    difference_type operator-(const unpacking_iterator& rhs) const {
+        return (m_pos - rhs.m_pos) / difference_type(m_packed_size);
+    }
+
+    bool operator==(const unpacking_iterator& rhs) const {
+        return m_pos == rhs.m_pos;
+    }
+
+    bool operator!=(const unpacking_iterator& rhs) const {
+        return !(*this == rhs);
+    }
+
+    /// The packed color the iterator points to.
+    const void* base() const { return m_pos; }
+
+private:
+    const unsigned char* m_pos = nullptr;
+    details::single_unpacker<Color, UnpackerType> m_unpacker;
+    std::size_t m_packed_size = 0;
+};
+
+/** An output iterator that packs every color assigned to it into a buffer,
+ *  for `std::copy()`, `std::transform()` and the like. The buffer must
+ *  have room for Packer::packed_size() bytes per color.
+ *
+ *  \a PackerType is Packer<Color> for any packer, or the class of the
+ *  packer, e.g. FlatColorPacker<Color>, to pack without virtual calls.
+ */
+template <typename Color, typename PackerType = Packer<Color>>
+class packing_output_iterator {
+public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    /// Pack colors into \a out on.
+    packing_output_iterator(void* out, const PackerType& packer)
+        : m_pos(out), m_packer(&packer) {}
+
+    /// Pack \a color and move on to the next color.
+    packing_output_iterator& operator=(const Color& color) {
+        m_pos = details::single_packer<PackerType>::pack(
+                *m_packer, color, m_pos);
+        return *this;
+    }
+
+    packing_output_iterator& operator*() { return *this; }
+
+    packing_output_iterator& operator++() { return *this; }
+
+    packing_output_iterator& operator++(int) { return *this; }
+
+    /// One byte after the data packed so far.
+    void* base() const { return m_pos; }
+
+private:
+    void* m_pos;
+    const PackerType* m_packer;
+};
+
+/** The colors packed in a buffer as a range of unpacking_iterator, for
+ *  range-based for loops and algorithms.
+ */
+template <typename Color, typename UnpackerType = Unpacker<Color>>
+class UnpackedRange {
+public:
+    using iterator = unpacking_iterator<Color, UnpackerType>;
+
+    UnpackedRange(iterator first, iterator last)
+        : m_begin(first), m_end(last) {}
+
+    iterator begin() const { return m_begin; }
+
+    iterator end() const { return m_end; }
+
+    std::size_t size() const { return m_end - m_begin; }
+
+    bool empty() const { return m_begin == m_end; }
+
+private:
+    iterator m_begin;
+    iterator m_end;
+};
+
+/** Make an unpacking_iterator for the color packed at \a src, which
+ *  unpacks with the class of \a unpacker.
+ */
+template <template <typename> class UnpackerClass, typename Color>
+unpacking_iterator<Color, UnpackerClass<Color>> make_unpacking_iterator(
+        const void* src, const UnpackerClass<Color>& unpacker) {
+    return {src, unpacker};
+}
+
+/** The colors packed in the \a num_bytes bytes at \a src. \a num_bytes
+ *  must be a multiple of the packed size of \a unpacker.
+ */
+template <template <typename> class UnpackerClass, typename Color>
+UnpackedRange<Color, UnpackerClass<Color>> unpacked(const void* src,
+        std::size_t num_bytes,
+        const UnpackerClass<Color>& unpacker) {
+    assert(num_bytes % unpacker.packed_size() == 0 &&
+            "num_bytes must be a multiple of packed_size()");
+    const auto first = static_cast<const unsigned char*>(src);
+    return {make_unpacking_iterator(first, unpacker),
+            make_unpacking_iterator(first + num_bytes, unpacker)};
+}
+
+/** Make a packing_output_iterator that packs colors into \a out with the
+ *  class of \a packer.
+ */
+template <template <typename> class PackerClass, typename Color>
+packing_output_iterator<Color, PackerClass<Color>> make_packing_iterator(
+        void* out, const PackerClass<Color>& packer) {
+    return {out, packer};
+}
+}
+
+#endif
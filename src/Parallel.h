@@ -0,0 +1,200 @@
+/** \file
+ *  Splitting work on contiguous ranges across threads.
+ *
+ *  On Linux the threads are pinned to CPUs, so that memory first touched
+ *  by one split is processed on the same NUMA node by the next.
+ */
+#ifndef COLOR_PARALLEL_H_
+#define COLOR_PARALLEL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace color {
+namespace details {
+
+/** Bytes of memory below which processing them is not worth another
+ *  thread.
+ */
+constexpr std::uint64_t parallel_min_part_bytes = std::uint64_t(1) << 16;
+
+/** Fewest elements of \a element_size bytes in a part, so that each part
+ *  covers about parallel_min_part_bytes.
+ */
+inline std::uint64_t parallel_min_part(std::size_t element_size) {
+    return std::max<std::uint64_t>(parallel_min_part_bytes / element_size, 1);
+}
+
+/** Number of parts parallel_parts() splits \a n items into: at most
+ *  \a num_threads, or every hardware thread for 0, and no part smaller
+ *  than \a min_part items unless there is only one.
+ */
+inline std::uint64_t num_parallel_parts(
+        std::uint64_t n, int num_threads, std::uint64_t min_part) {
+    if(num_threads <= 0) {
+        num_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+    return std::max<std::uint64_t>(
+            std::min<std::uint64_t>(num_threads, n / min_part), 1);
+}
+
+#ifdef __linux__
+/// The NUMA node of \a cpu, or 0 if the system does not report one.
+inline int cpu_node(int cpu) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = ::opendir(path);
+    if(!dir) {
+        return 0;
+    }
+    int node = 0;
+    while(const dirent* entry = ::readdir(dir)) {
+        if(std::strncmp(entry->d_name, "node", 4) == 0 &&
+                entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    ::closedir(dir);
+    return node;
+}
+#endif
+
+/** The CPUs the process was allowed to run on when first called, ordered
+ *  by NUMA node and then by number, so that neighboring parts run on the
+ *  same node. Empty where threads cannot be pinned.
+ */
+inline const std::vector<int>& parallel_cpus() {
+    static const std::vector<int> cpus = [] {
+        auto nodes = std::vector<std::pair<int, int>>();
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(::sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if(CPU_ISSET(cpu, &set)) {
+                    nodes.emplace_back(cpu_node(cpu), cpu);
+                }
+            }
+        }
+#endif
+        std::sort(nodes.begin(), nodes.end());
+        auto out = std::vector<int>();
+        for(const auto& node : nodes) {
+            out.push_back(node.second);
+        }
+        return out;
+    }();
+    return cpus;
+}
+
+/** The CPU parallel_parts() runs part \a index of \a parts on, or -1 if
+ *  threads are not pinned. The parts are spread evenly over
+ *  parallel_cpus().
+ */
+inline int parallel_part_cpu(std::uint64_t index, std::uint64_t parts) {
+    const auto& cpus = parallel_cpus();
+    if(cpus.empty()) {
+        return -1;
+    }
+    return cpus[index * cpus.size() / parts];
+}
+
+/// Pin the calling thread to \a cpu, if it is not -1.
+inline void pin_current_thread(int cpu) {
+#ifdef __linux__
+    if(cpu < 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // Failure leaves the thread unpinned, which is only slower.
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+/** Split \a n items into contiguous parts as num_parallel_parts() does and
+ *  call `part(begin, end)` for each on its own thread. A single part runs
+ *  on the calling thread.
+ *
+ *  Part i of each split runs on a thread pinned to
+ *  `parallel_part_cpu(i, parts)`, so calls with the same \a n,
+ *  \a num_threads and \a min_part process every part on the same CPU,
+ *  and memory first touched by one call is local to the threads of the
+ *  next.
+ *  \throws The first exception thrown by \a part, or std::system_error if
+ *  a thread cannot be started, after all started threads are joined.
+ */
+template <typename Function>
+void parallel_parts(std::uint64_t n,
+        int num_threads,
+        std::uint64_t min_part,
+        Function part) {
+    const auto parts = num_parallel_parts(n, num_threads, min_part);
+    const auto part_size = (n + parts - 1) / parts;
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto run_part = [&](std::uint64_t index) {
+        const auto begin = std::min(index * part_size, n);
+        const auto end = std::min(begin + part_size, n);
+        try {
+            part(begin, end);
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+    if(parts == 1) {
+        run_part(0);
+    } else {
+        auto threads = std::vector<std::thread>();
+        try {
+            threads.reserve(parts);
+            for(std::uint64_t index = 0; index < parts; ++index) {
+                threads.emplace_back([&, index] {
+                    pin_current_thread(parallel_part_cpu(index, parts));
+                    run_part(index);
+                });
+            }
+        } catch(...) {
+            // Destroying a joinable thread terminates, so wait for the
+            // parts already started before passing the error on.
+            for(auto& thread : threads) {
+                thread.join();
+            }
+            throw;
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+}
+}
+
+#endif
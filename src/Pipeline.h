@@ -0,0 +1,269 @@
+/** \file
+ *  Multithreaded unpack, transform and pack pipeline.
+ */
+#ifndef COLOR_PIPELINE_H_
+#define COLOR_PIPELINE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Instrumentation.h"
+#include "RingBuffer.h"
+#include "StreamPacker.h"
+#include "StreamUnpacker.h"
+
+namespace color {
+
+/// Tuning parameters of run_pipeline().
+struct PipelineOptions {
+    /// Number of colors read, transformed and written at a time.
+    std::size_t chunk_colors = std::size_t(1) << 14;
+    /** Number of transform threads. 0 uses every hardware thread not
+     *  taken by the reader and writer, but at least one.
+     */
+    int num_workers = 0;
+    /** Number of chunks in flight, which bounds the memory used by the
+     *  pipeline. 0 uses two per worker plus one each for the reader and
+     *  writer.
+     */
+    std::size_t num_chunks = 0;
+};
+
+namespace details {
+
+/// Waits for a queue with progressively less eager polling.
+class Backoff {
+public:
+    void wait() {
+        if(m_count < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        ++m_count;
+    }
+
+    void reset() { m_count = 0; }
+
+private:
+    int m_count = 0;
+};
+
+template <typename InColor, typename OutColor>
+struct PipelineChunk {
+    std::uint64_t sequence = 0;
+    std::size_t count = 0;
+    std::vector<char> in_bytes;
+    std::vector<InColor> in_colors;
+    std::vector<OutColor> out_colors;
+    std::vector<char> out_bytes;
+};
+}
+
+/** Unpack every color remaining in \a source, apply \a transform and pack
+ *  the results into \a sink in their original order.
+ *
+ *  Reading, transforming and writing overlap. A reader thread reads
+ *  chunks of raw bytes from the source stream, worker threads unpack
+ *  them, call `transform(const InColor* in, std::size_t count,
+ *  OutColor* out)` and pack the results, and the calling thread writes
+ *  finished chunks to the sink as soon as all earlier chunks are
+ *  written. The stages are connected by lock-free queues, and chunks are
+ *  recycled from the writer back to the reader, so nothing is allocated
+ *  after start-up. Any batch function, such as batch::to_hsv, can be
+ *  used as \a transform; it is called concurrently from all workers.
+ *
+ *  Like StreamUnpacker::unpack_all(), reading stops at the end of the
+ *  source stream, and a trailing partial color is ignored. Writing stops
+ *  early if writing to the sink fails, which can be checked with
+ *  StreamPacker::good(). If \a transform or reading the source stream
+ *  throws, the pipeline is stopped and the first exception is rethrown
+ *  once all threads have finished.
+ *
+ *  \returns The number of colors written to \a sink.
+ */
+template <typename InColor, typename OutColor, typename Transform>
+std::uint64_t run_pipeline(StreamUnpacker<InColor>& source,
+        Transform transform,
+        StreamPacker<OutColor>& sink,
+        PipelineOptions options = PipelineOptions()) {
+    using Chunk = details::PipelineChunk<InColor, OutColor>;
+    COLOR_INSTRUMENT_SCOPE(timer, "run_pipeline", 0);
+
+    if(options.num_workers <= 0) {
+        const int threads = std::thread::hardware_concurrency();
+        options.num_workers = std::max(threads - 2, 1);
+    }
+    if(options.num_chunks == 0) {
+        options.num_chunks = 2 * options.num_workers + 2;
+    }
+    options.chunk_colors = std::max<std::size_t>(options.chunk_colors, 1);
+
+    const auto& unpacker = source.get_unpacker();
+    const auto& packer = sink.get_packer();
+    const auto in_size = unpacker.packed_size();
+    const auto out_size = packer.packed_size();
+
+    auto chunks = std::vector<Chunk>(options.num_chunks);
+    for(auto& chunk : chunks) {
+        chunk.in_bytes.resize(options.chunk_colors * in_size);
+        chunk.in_colors.resize(options.chunk_colors);
+        chunk.out_colors.resize(options.chunk_colors);
+        chunk.out_bytes.resize(options.chunk_colors * out_size);
+    }
+
+    // Empty chunks go from the writer to the reader, filled chunks from
+    // the reader to any worker, and transformed chunks to the writer.
+    SpscRing<Chunk*> free_chunks(options.num_chunks);
+    MpmcRing<Chunk*> filled_chunks(options.num_chunks);
+    MpmcRing<Chunk*> done_chunks(options.num_chunks);
+    for(auto& chunk : chunks) {
+        free_chunks.try_push(&chunk);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> reader_done{false};
+    std::atomic<std::uint64_t> num_sequences{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto reader = std::thread([&] {
+        auto& stream = source.get_stream();
+        std::uint64_t sequence = 0;
+        auto backoff = details::Backoff();
+        while(!stop.load(std::memory_order_relaxed)) {
+            Chunk* chunk;
+            if(!free_chunks.try_pop(chunk)) {
+                backoff.wait();
+                continue;
+            }
+            backoff.reset();
+            try {
+                stream.read(chunk->in_bytes.data(), chunk->in_bytes.size());
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+                stop.store(true, std::memory_order_relaxed);
+                break;
+            }
+            chunk->count = stream.gcount() / in_size;
+            if(chunk->count == 0) {
+                break;
+            }
+            chunk->sequence = sequence++;
+            while(!filled_chunks.try_push(chunk)) {
+                backoff.wait();
+            }
+            if(!stream.good()) {
+                break;
+            }
+        }
+        num_sequences.store(sequence, std::memory_order_relaxed);
+        reader_done.store(true, std::memory_order_release);
+    });
+
+    auto workers = std::vector<std::thread>();
+    for(int i = 0; i < options.num_workers; ++i) {
+        workers.emplace_back([&] {
+            auto backoff = details::Backoff();
+            while(!stop.load(std::memory_order_relaxed)) {
+                Chunk* chunk;
+                if(!filled_chunks.try_pop(chunk)) {
+                    // Every chunk was pushed before reader_done was set,
+                    // so one more attempt afterward cannot miss any.
+                    const bool done =
+                            reader_done.load(std::memory_order_acquire);
+                    if(filled_chunks.try_pop(chunk)) {
+                        // Fall through and process it.
+                    } else if(done) {
+                        return;
+                    } else {
+                        backoff.wait();
+                        continue;
+                    }
+                }
+                backoff.reset();
+                try {
+                    unpacker.unpack_contiguous(chunk->in_bytes.data(),
+                            chunk->count,
+                            chunk->in_colors.data());
+                    transform(static_cast<const InColor*>(
+                                      chunk->in_colors.data()),
+                            chunk->count,
+                            chunk->out_colors.data());
+                    packer.pack_contiguous(chunk->out_colors.data(),
+                            chunk->count,
+                            chunk->out_bytes.data());
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                    stop.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                while(!done_chunks.try_push(chunk)) {
+                    backoff.wait();
+                }
+            }
+        });
+    }
+
+    // Chunks can finish out of order, but at most num_chunks sequences are
+    // in flight, so each has its own slot in a window of that size.
+    auto pending = std::vector<Chunk*>(options.num_chunks, nullptr);
+    auto& out = sink.get_sink();
+    std::uint64_t next_sequence = 0;
+    std::uint64_t written = 0;
+    auto backoff = details::Backoff();
+    while(!stop.load(std::memory_order_relaxed)) {
+        Chunk* chunk;
+        if(done_chunks.try_pop(chunk)) {
+            backoff.reset();
+            pending[chunk->sequence % pending.size()] = chunk;
+        } else if(reader_done.load(std::memory_order_acquire) &&
+                next_sequence ==
+                        num_sequences.load(std::memory_order_relaxed)) {
+            break;
+        } else {
+            backoff.wait();
+        }
+        for(;;) {
+            auto& slot = pending[next_sequence % pending.size()];
+            if(!slot) {
+                break;
+            }
+            out.write(slot->out_bytes.data(), slot->count * out_size);
+            if(!out.good()) {
+                stop.store(true, std::memory_order_relaxed);
+                break;
+            }
+            written += slot->count;
+            free_chunks.try_push(slot);
+            slot = nullptr;
+            ++next_sequence;
+        }
+    }
+
+    reader.join();
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    COLOR_INSTRUMENT_ELEMENTS(timer, written);
+    if(error) {
+        std::rethrow_exception(error);
+    }
+    return written;
+}
+}
+
+#endif
@@ -0,0 +1,1023 @@
+/** \file
+ *  Pixel formats known only at runtime.
+ *
+ *  Defines PixelFormat, a descriptor of the memory layout of a pixel,
+ *  parse_pixel_format(), which builds one from a name such as `"BGRA8"`,
+ *  `"RGB565"`, `"RGBA16F"` or a DRM FourCC code such as `"XR24"`,
+ *  PixelConverter, which converts buffers between any two formats, and
+ *  PixelFormatRegistry, which caches formats and converters by name.
+ *
+ *  A PixelConverter selects its kernel when it is constructed, so the
+ *  format is looked at once per buffer, never per pixel.
+ */
+#ifndef COLOR_PIXELFORMAT_H_
+#define COLOR_PIXELFORMAT_H_
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Alpha.h"
+#include "ByteOrder.h"
+#include "ByteShuffle.h"
+#include "Dispatch.h"
+#include "Exceptions.h"
+#include "Instrumentation.h"
+#include "Rgb.h"
+
+namespace color {
+
+/// The meaning of one field of a pixel.
+enum class PixelChannel { Red = 0, Green, Blue, Alpha, Unused };
+
+/// How the fields of a pixel encode values.
+enum class PixelEncoding {
+    /// Unsigned integers normalized to `[0, 1]`.
+    Unorm,
+    /// IEEE 754 half or single precision floats.
+    Float
+};
+
+/// One field of a pixel: a channel stored in a number of bits.
+struct PixelField {
+    PixelChannel channel;
+    int bits;
+
+    bool operator==(const PixelField& rhs) const {
+        return channel == rhs.channel && bits == rhs.bits;
+    }
+};
+
+/** Describes the memory layout of a pixel.
+ *
+ *  A pixel is either an array of elements of the same size, in memory
+ *  order and the native byte order, or a packed little endian word of bit
+ *  fields, listed from the most significant bit down. Packed formats
+ *  whose fields are all whole bytes are stored as the equivalent array,
+ *  so `"XRGB8888"` and `"BGRX8"` describe the same layout.
+ */
+struct PixelFormat {
+    /// The name the format was parsed from.
+    std::string name;
+    std::vector<PixelField> fields;
+    PixelEncoding encoding = PixelEncoding::Unorm;
+    /// Whether the fields are bit fields of one word.
+    bool packed = false;
+
+    /// Get the size of a pixel in bytes.
+    std::size_t size() const {
+        std::size_t bits = 0;
+        for(const auto& field : fields) {
+            bits += field.bits;
+        }
+        return bits / 8;
+    }
+
+    /// Return whether the pixel has a field for \a channel.
+    bool has(PixelChannel channel) const {
+        return std::any_of(
+                fields.begin(), fields.end(), [channel](const PixelField& f) {
+                    return f.channel == channel;
+                });
+    }
+
+    /// Two formats are equal if they have the same layout.
+    bool operator==(const PixelFormat& rhs) const {
+        return fields == rhs.fields && encoding == rhs.encoding &&
+                packed == rhs.packed;
+    }
+
+    bool operator!=(const PixelFormat& rhs) const { return !(*this == rhs); }
+};
+
+namespace details {
+
+inline float half_to_float(std::uint16_t h) {
+    const std::uint32_t sign = std::uint32_t(h & 0x8000u) << 16;
+    const std::uint32_t exponent = (h >> 10) & 0x1fu;
+    const std::uint32_t mantissa = h & 0x3ffu;
+    std::uint32_t bits;
+    if(exponent == 0x1f) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else if(exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        // Zero or subnormal, in units of 2^-24.
+        const auto value = float(mantissa) * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+    float out;
+    std::memcpy(&out, &bits, sizeof(out));
+    return out;
+}
+
+/// Round \a value to the nearest half, ties to even.
+inline std::uint16_t float_to_half(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+    const auto magnitude = bits & 0x7fffffffu;
+    if(magnitude >= 0x7f800000u) {
+        // Infinity stays infinity, NaN stays a quiet NaN.
+        return sign | (magnitude > 0x7f800000u ? 0x7e00 : 0x7c00);
+    }
+    if(magnitude >= 0x477ff000u) {
+        // Rounds to above the largest half.
+        return sign | 0x7c00;
+    }
+    if(magnitude < 0x38800000u) {
+        // Subnormal half or zero.
+        if(magnitude < 0x33000000u) {
+            return sign;
+        }
+        const auto shift = 126 - (magnitude >> 23);
+        const auto mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+        auto out = mantissa >> shift;
+        const auto rest = mantissa & ((1u << shift) - 1);
+        const auto half = 1u << (shift - 1);
+        if(rest > half || (rest == half && (out & 1))) {
+            ++out;
+        }
+        return static_cast<std::uint16_t>(sign | out);
+    }
+    auto out = magnitude - (112u << 23);
+    out += 0xfffu + ((out >> 13) & 1);
+    return static_cast<std::uint16_t>(sign | (out >> 13));
+}
+
+/// Clamp \a value to `[0, 1]`, mapping NaN to 0, without branches.
+inline float saturate(float value) {
+    return std::min(std::max(0.0f, value), 1.0f);
+}
+
+/// Storage of the elements of array formats.
+template <typename T>
+struct unorm_element {
+    static constexpr float max = float(T(~T(0)));
+
+    static float load(const unsigned char* in) {
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        return float(value) * (1.0f / max);
+    }
+
+    static void store(float value, unsigned char* out) {
+        const auto element = static_cast<T>(saturate(value) * max + 0.5f);
+        std::memcpy(out, &element, sizeof(T));
+    }
+};
+
+struct half_element {
+    static float load(const unsigned char* in) {
+        std::uint16_t value;
+        std::memcpy(&value, in, sizeof(value));
+        return half_to_float(value);
+    }
+
+    static void store(float value, unsigned char* out) {
+        const auto element = float_to_half(value);
+        std::memcpy(out, &element, sizeof(element));
+    }
+};
+
+struct float_element {
+    static float load(const unsigned char* in) {
+        float value;
+        std::memcpy(&value, in, sizeof(value));
+        return value;
+    }
+
+    static void store(float value, unsigned char* out) {
+        std::memcpy(out, &value, sizeof(value));
+    }
+};
+
+struct PixelCodec;
+
+/// Decodes \a count pixels into RGBA floats.
+using PixelDecodeFn = void (*)(
+        const PixelCodec&, const unsigned char*, std::size_t, float*);
+/// Encodes \a count RGBA floats into pixels.
+using PixelEncodeFn = void (*)(
+        const PixelCodec&, const float*, std::size_t, unsigned char*);
+
+/** Converts pixels of one format from and to RGBA floats. The positions
+ *  of the fields are resolved when the codec is built.
+ *
+ *  The kernels copy the tables they use into locals first: their stores
+ *  through `unsigned char*` would otherwise reload them for every pixel.
+ */
+struct PixelCodec {
+    std::size_t size = 0;
+    /// Byte offset (arrays) or bit shift (packed) of R, G, B and A, or -1.
+    std::array<int, 4> position{{-1, -1, -1, -1}};
+    /// Bits of R, G, B and A (packed only).
+    std::array<int, 4> bits{{0, 0, 0, 0}};
+    std::size_t num_fields = 0;
+    /// Channel index of every field, or -1 for unused fields.
+    std::array<int, 4> field_channels{{-1, -1, -1, -1}};
+    /// Byte offset (arrays) or bit shift (packed) of every field.
+    std::array<int, 4> field_positions{{0, 0, 0, 0}};
+    /// Bits of every field (packed only).
+    std::array<int, 4> field_bits{{0, 0, 0, 0}};
+    PixelDecodeFn decode = nullptr;
+    PixelEncodeFn encode = nullptr;
+};
+
+template <typename Element>
+void decode_array(const PixelCodec& codec,
+        const unsigned char* in,
+        std::size_t count,
+        float* out) {
+    const auto size = codec.size;
+    // One channel at a time, so the inner loops do not branch.
+    for(int c = 0; c < 4; ++c) {
+        const auto position = codec.position[c];
+        if(position < 0) {
+            const auto value = c == 3 ? 1.0f : 0.0f;
+            for(std::size_t i = 0; i < count; ++i) {
+                out[4 * i + c] = value;
+            }
+            continue;
+        }
+        const auto channel = in + position;
+        for(std::size_t i = 0; i < count; ++i) {
+            out[4 * i + c] = Element::load(channel + i * size);
+        }
+    }
+}
+
+template <typename Element>
+void encode_array(const PixelCodec& codec,
+        const float* in,
+        std::size_t count,
+        unsigned char* out) {
+    const auto size = codec.size;
+    for(std::size_t f = 0; f < codec.num_fields; ++f) {
+        const auto c = codec.field_channels[f];
+        const auto field = out + codec.field_positions[f];
+        if(c < 0) {
+            for(std::size_t i = 0; i < count; ++i) {
+                Element::store(0.0f, field + i * size);
+            }
+            continue;
+        }
+        for(std::size_t i = 0; i < count; ++i) {
+            Element::store(in[4 * i + c], field + i * size);
+        }
+    }
+}
+
+/// Pixels of \a Bytes bytes stored as a little endian word.
+template <std::size_t Bytes>
+std::uint64_t load_word(const unsigned char* in) {
+    std::uint64_t word = 0;
+    if(native_byte_order() == ByteOrder::Little) {
+        std::memcpy(&word, in, Bytes);
+        return word;
+    }
+    COLOR_UNROLL
+    for(std::size_t b = 0; b < Bytes; ++b) {
+        word |= std::uint64_t(in[b]) << (8 * b);
+    }
+    return word;
+}
+
+template <std::size_t Bytes>
+void store_word(std::uint64_t word, unsigned char* out) {
+    if(native_byte_order() == ByteOrder::Little) {
+        std::memcpy(out, &word, Bytes);
+        return;
+    }
+    COLOR_UNROLL
+    for(std::size_t b = 0; b < Bytes; ++b) {
+        out[b] = static_cast<unsigned char>(word >> (8 * b));
+    }
+}
+
+template <std::size_t Bytes>
+void decode_packed(const PixelCodec& codec,
+        const unsigned char* in,
+        std::size_t count,
+        float* out) {
+    const auto position = codec.position;
+    std::array<std::uint64_t, 4> masks;
+    std::array<float, 4> scales;
+    for(int c = 0; c < 4; ++c) {
+        masks[c] = (std::uint64_t(1) << codec.bits[c]) - 1;
+        scales[c] = masks[c] ? 1.0f / float(masks[c]) : 0.0f;
+    }
+    for(std::size_t i = 0; i < count; ++i) {
+        const auto word = load_word<Bytes>(in);
+        for(int c = 0; c < 4; ++c) {
+            out[c] = position[c] >= 0
+                    ? float((word >> position[c]) & masks[c]) * scales[c]
+                    : (c == 3 ? 1.0f : 0.0f);
+        }
+        in += Bytes;
+        out += 4;
+    }
+}
+
+template <std::size_t Bytes>
+void encode_packed(const PixelCodec& codec,
+        const float* in,
+        std::size_t count,
+        unsigned char* out) {
+    const auto fields = codec.num_fields;
+    const auto channels = codec.field_channels;
+    const auto positions = codec.field_positions;
+    std::array<float, 4> maxes;
+    for(std::size_t f = 0; f < fields; ++f) {
+        maxes[f] = float((std::uint64_t(1) << codec.field_bits[f]) - 1);
+    }
+    for(std::size_t i = 0; i < count; ++i) {
+        std::uint64_t word = 0;
+        for(std::size_t f = 0; f < fields; ++f) {
+            const auto c = channels[f];
+            if(c >= 0) {
+                const auto value = static_cast<std::uint64_t>(
+                        saturate(in[c]) * maxes[f] + 0.5f);
+                word |= value << positions[f];
+            }
+        }
+        store_word<Bytes>(word, out);
+        in += 4;
+        out += Bytes;
+    }
+}
+
+inline PixelCodec make_pixel_codec(const PixelFormat& format) {
+    auto codec = PixelCodec();
+    codec.size = format.size();
+    // Packed fields are listed from the most significant bit down.
+    int position = format.packed ? int(codec.size * 8) : 0;
+    for(const auto& field : format.fields) {
+        if(format.packed) {
+            position -= field.bits;
+        }
+        const auto c = field.channel == PixelChannel::Unused
+                ? -1
+                : static_cast<int>(field.channel);
+        const auto f = codec.num_fields++;
+        codec.field_channels[f] = c;
+        codec.field_positions[f] = position;
+        codec.field_bits[f] = field.bits;
+        if(c >= 0) {
+            codec.position[c] = position;
+            codec.bits[c] = field.bits;
+        }
+        if(!format.packed) {
+            position += field.bits / 8;
+        }
+    }
+
+    if(format.packed) {
+        switch(codec.size) {
+        case 1:
+            codec.decode = &decode_packed<1>;
+            codec.encode = &encode_packed<1>;
+            break;
+        case 2:
+            codec.decode = &decode_packed<2>;
+            codec.encode = &encode_packed<2>;
+            break;
+        case 4:
+            codec.decode = &decode_packed<4>;
+            codec.encode = &encode_packed<4>;
+            break;
+        default:
+            codec.decode = &decode_packed<8>;
+            codec.encode = &encode_packed<8>;
+            break;
+        }
+    } else if(format.encoding == PixelEncoding::Float) {
+        if(format.fields[0].bits == 16) {
+            codec.decode = &decode_array<half_element>;
+            codec.encode = &encode_array<half_element>;
+        } else {
+            codec.decode = &decode_array<float_element>;
+            codec.encode = &encode_array<float_element>;
+        }
+    } else if(format.fields[0].bits == 8) {
+        codec.decode = &decode_array<unorm_element<std::uint8_t>>;
+        codec.encode = &encode_array<unorm_element<std::uint8_t>>;
+    } else {
+        codec.decode = &decode_array<unorm_element<std::uint16_t>>;
+        codec.encode = &encode_array<unorm_element<std::uint16_t>>;
+    }
+    return codec;
+}
+
+/** Converts between unsigned normalized formats of at most 8 bytes with
+ *  integers: every output field is looked up in a table indexed by its
+ *  source field. Used when the source fields are narrow enough for small
+ *  tables.
+ */
+struct PixelRescale {
+    /// Widest source field that gets a table.
+    static constexpr int max_bits = 10;
+
+    std::size_t num_fields = 0;
+    /// Shift and mask of the source of every output field.
+    std::array<int, 4> in_shifts{{0, 0, 0, 0}};
+    std::array<std::uint64_t, 4> in_masks{{0, 0, 0, 0}};
+    /// Shift of every output field.
+    std::array<int, 4> out_shifts{{0, 0, 0, 0}};
+    /// Output fields without a source, such as an opaque alpha.
+    std::uint64_t fill = 0;
+    std::array<const std::uint16_t*, 4> tables{{}};
+    std::vector<std::uint16_t> storage;
+};
+
+/** Bit shift of every field of \a codec within a little endian word of the
+ *  pixel, or false if the pixel is not such a word of unorm fields.
+ */
+inline bool pixel_word_shifts(const PixelFormat& format,
+        const PixelCodec& codec,
+        std::array<int, 4>& shifts) {
+    if(format.encoding != PixelEncoding::Unorm || codec.size > 8) {
+        return false;
+    }
+    if(format.packed) {
+        shifts = codec.field_positions;
+        return true;
+    }
+    // The elements of 16 bit arrays are only little endian on such targets.
+    if(format.fields[0].bits != 8 &&
+            native_byte_order() != ByteOrder::Little) {
+        return false;
+    }
+    for(std::size_t f = 0; f < codec.num_fields; ++f) {
+        shifts[f] = codec.field_positions[f] * 8;
+    }
+    return true;
+}
+
+/** Build \a rescale from \a from to \a to.
+ *  \returns false if the formats cannot be converted with tables.
+ */
+inline bool make_pixel_rescale(const PixelFormat& from,
+        const PixelCodec& decoder,
+        const PixelFormat& to,
+        const PixelCodec& encoder,
+        PixelRescale& rescale) {
+    std::array<int, 4> in_shifts, out_shifts;
+    if(!pixel_word_shifts(from, decoder, in_shifts) ||
+            !pixel_word_shifts(to, encoder, out_shifts)) {
+        return false;
+    }
+    for(std::size_t f = 0; f < decoder.num_fields; ++f) {
+        if(decoder.field_bits[f] > PixelRescale::max_bits) {
+            return false;
+        }
+    }
+
+    rescale = PixelRescale();
+    std::array<std::uint64_t, 4> out_maxes;
+    std::size_t entries = 0;
+    for(std::size_t f = 0; f < encoder.num_fields; ++f) {
+        const auto c = encoder.field_channels[f];
+        const auto out_max = (std::uint64_t(1) << encoder.field_bits[f]) - 1;
+        if(c < 0 || decoder.position[c] < 0) {
+            if(c == 3) {
+                rescale.fill |= out_max << out_shifts[f];
+            }
+            continue;
+        }
+        const auto channels = decoder.field_channels.begin();
+        const auto source = std::find(channels, channels + 4, c) - channels;
+        const auto k = rescale.num_fields++;
+        rescale.in_shifts[k] = in_shifts[source];
+        rescale.in_masks[k] =
+                (std::uint64_t(1) << decoder.field_bits[source]) - 1;
+        rescale.out_shifts[k] = out_shifts[f];
+        out_maxes[k] = out_max;
+        entries += std::size_t(rescale.in_masks[k]) + 1;
+    }
+
+    rescale.storage.reserve(entries);
+    for(std::size_t k = 0; k < rescale.num_fields; ++k) {
+        const auto in_max = rescale.in_masks[k];
+        for(std::uint64_t v = 0; v <= in_max; ++v) {
+            // Round to nearest.
+            rescale.storage.push_back(static_cast<std::uint16_t>(
+                    (2 * v * out_maxes[k] + in_max) / (2 * in_max)));
+        }
+    }
+    static const std::uint16_t zero = 0;
+    auto table = rescale.storage.data();
+    for(std::size_t k = 0; k < 4; ++k) {
+        if(k < rescale.num_fields) {
+            rescale.tables[k] = table;
+            table += rescale.in_masks[k] + 1;
+        } else {
+            rescale.tables[k] = &zero;
+        }
+    }
+    return true;
+}
+
+/// Split \a digits into one field size per channel, each 1 to 16 bits.
+inline bool split_field_bits(
+        const std::string& digits, std::size_t fields, std::vector<int>& out) {
+    if(fields == 0) {
+        return digits.empty();
+    }
+    for(std::size_t length = 1; length <= 2 && length <= digits.size();
+            ++length) {
+        if(length == 2 && digits[0] == '0') {
+            break;
+        }
+        const auto bits = std::stoi(digits.substr(0, length));
+        if(bits < 1 || bits > 16) {
+            continue;
+        }
+        out.push_back(bits);
+        if(split_field_bits(digits.substr(length), fields - 1, out)) {
+            return true;
+        }
+        out.pop_back();
+    }
+    return false;
+}
+
+/// Names of the DRM FourCC codes parse_pixel_format() understands.
+inline const std::map<std::string, std::string>& drm_fourcc_names() {
+    static const std::map<std::string, std::string> names = {
+            {"RG16", "RGB565"},
+            {"BG16", "BGR565"},
+            {"AR12", "ARGB4444"},
+            {"XR12", "XRGB4444"},
+            {"AB12", "ABGR4444"},
+            {"RA12", "RGBA4444"},
+            {"AR15", "ARGB1555"},
+            {"XR15", "XRGB1555"},
+            {"AB15", "ABGR1555"},
+            {"RA15", "RGBA5551"},
+            {"RG24", "RGB888"},
+            {"BG24", "BGR888"},
+            {"AR24", "ARGB8888"},
+            {"XR24", "XRGB8888"},
+            {"AB24", "ABGR8888"},
+            {"XB24", "XBGR8888"},
+            {"RA24", "RGBA8888"},
+            {"RX24", "RGBX8888"},
+            {"BA24", "BGRA8888"},
+            {"BX24", "BGRX8888"},
+            {"AR30", "ARGB2101010"},
+            {"XR30", "XRGB2101010"},
+            {"AB30", "ABGR2101010"},
+            {"XB30", "XBGR2101010"},
+            {"RA30", "RGBA1010102"},
+            {"BA30", "BGRA1010102"},
+            {"AB48", "ABGR16161616"},
+            {"XB48", "XBGR16161616"},
+            {"AB4H", "ABGR16161616F"},
+            {"XB4H", "XBGR16161616F"}};
+    return names;
+}
+
+[[noreturn]] inline void throw_pixel_format_error(
+        const std::string& name, const char* why) {
+    throw InvalidPackingFormatError(
+            "Invalid pixel format \"" + name + "\": " + why);
+}
+}
+
+/** Parse a pixel format descriptor.
+ *
+ *  A descriptor is a list of channels from `R`, `G`, `B`, `A` and `X`
+ *  (unused), followed by either
+ *
+ *  - one element size for all channels: `8` or `16` for unsigned
+ *    normalized integers, `16F` or `32F` for floats, e.g. `"BGRA8"` or
+ *    `"RGBA16F"`. The elements are in memory order.
+ *  - the size of every channel, e.g. `"RGB565"`, `"ARGB2101010"` or
+ *    `"ABGR16161616F"`. Following DRM, these are packed little endian
+ *    words, listed from the most significant bit down, so `"XRGB8888"` is
+ *    stored as the bytes B, G, R, X.
+ *
+ *  DRM FourCC codes, such as `"XR24"` or `"RG16"`, name the equivalent
+ *  packed format. Descriptors are not case sensitive, FourCC codes are.
+ *  \throws InvalidPackingFormatError if \a name is not a valid descriptor.
+ */
+inline PixelFormat parse_pixel_format(const std::string& name) {
+    const auto& fourccs = details::drm_fourcc_names();
+    const auto fourcc = fourccs.find(name);
+    if(fourcc != fourccs.end()) {
+        auto format = parse_pixel_format(fourcc->second);
+        format.name = name;
+        return format;
+    }
+
+    auto upper = name;
+    std::transform(upper.begin(), upper.end(), upper.begin(), [](char c) {
+        return static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    });
+    auto format = PixelFormat();
+    format.name = name;
+
+    std::size_t i = 0;
+    auto channels = std::vector<PixelChannel>();
+    for(; i < upper.size() && !std::isdigit(static_cast<unsigned char>(
+                                      upper[i]));
+            ++i) {
+        const auto found = std::string("RGBAX").find(upper[i]);
+        if(found == std::string::npos) {
+            details::throw_pixel_format_error(name, "unknown channel");
+        }
+        const auto channel = static_cast<PixelChannel>(found);
+        if(channel != PixelChannel::Unused &&
+                std::count(channels.begin(), channels.end(), channel)) {
+            details::throw_pixel_format_error(name, "repeated channel");
+        }
+        channels.push_back(channel);
+    }
+    auto digits = upper.substr(i);
+    if(!digits.empty() && digits.back() == 'F') {
+        format.encoding = PixelEncoding::Float;
+        digits.pop_back();
+    }
+    if(channels.empty() || channels.size() > 4 || digits.empty() ||
+            !std::all_of(digits.begin(), digits.end(), [](char c) {
+                return std::isdigit(static_cast<unsigned char>(c));
+            })) {
+        details::throw_pixel_format_error(
+                name, "expected 1 to 4 channels followed by their sizes");
+    }
+
+    const bool is_float = format.encoding == PixelEncoding::Float;
+    auto bits = std::vector<int>();
+    if(is_float ? digits == "16" || digits == "32"
+                : digits == "8" || digits == "16") {
+        bits.assign(channels.size(), std::stoi(digits));
+    } else if(details::split_field_bits(digits, channels.size(), bits)) {
+        format.packed = true;
+    } else {
+        details::throw_pixel_format_error(name, "invalid channel sizes");
+    }
+    for(std::size_t c = 0; c < channels.size(); ++c) {
+        format.fields.push_back(PixelField{channels[c], bits[c]});
+    }
+
+    if(format.packed) {
+        // Packed fields of whole bytes, and all floats, are stored as the
+        // array of their bytes in reverse.
+        const bool whole_bytes =
+                std::all_of(bits.begin(), bits.end(), [&](int b) {
+                    return b == bits[0] && (b == 8 || b == 16);
+                });
+        if(whole_bytes || is_float) {
+            if(native_byte_order() != ByteOrder::Little && bits[0] != 8) {
+                details::throw_pixel_format_error(
+                        name, "little endian words on a big endian target");
+            }
+            if(is_float && (!whole_bytes || bits[0] != 16)) {
+                details::throw_pixel_format_error(
+                        name, "packed floats must be 16 bits each");
+            }
+            std::reverse(format.fields.begin(), format.fields.end());
+            format.packed = false;
+        } else {
+            const auto size = format.size() * 8;
+            std::size_t total = 0;
+            for(auto b : bits) {
+                total += b;
+            }
+            if(total != size || (size != 8 && size != 16 && size != 32 &&
+                                        size != 64)) {
+                details::throw_pixel_format_error(
+                        name, "packed fields must fill 8, 16, 32 or 64 bits");
+            }
+        }
+    }
+    return format;
+}
+
+/// Return the PixelFormat of an array of Rgb<T> colors, e.g. `RGB8`.
+template <typename T>
+PixelFormat pixel_format_of(const Rgb<T>*) {
+    static_assert(sizeof(T) <= 2 || std::is_same<T, float>::value,
+            "pixel formats hold 8 or 16 bit integers or floats");
+    return parse_pixel_format(std::is_same<T, float>::value
+                    ? "RGB32F"
+                    : sizeof(T) == 1 ? "RGB8" : "RGB16");
+}
+
+/// Return the PixelFormat of an array of Rgba<T> colors, e.g. `RGBA8`.
+template <typename T>
+PixelFormat pixel_format_of(const Alpha<T, Rgb>*) {
+    static_assert(sizeof(T) <= 2 || std::is_same<T, float>::value,
+            "pixel formats hold 8 or 16 bit integers or floats");
+    return parse_pixel_format(std::is_same<T, float>::value
+                    ? "RGBA32F"
+                    : sizeof(T) == 1 ? "RGBA8" : "RGBA16");
+}
+
+/** Converts buffers of pixels from one PixelFormat to another.
+ *
+ *  The conversion kernel is chosen once on construction:
+ *
+ *  - equal layouts without unused fields are copied.
+ *  - array formats with the same element type, such as `BGRA8` and
+ *    `RGBX8`, are permuted with one `pshufb` per 16 bytes (see
+ *    ByteShuffle) where available, filling in missing channels.
+ *  - unsigned normalized formats whose source fields have at most 10
+ *    bits, such as `RGB565` to `RGBA8`, are rescaled with integer
+ *    tables, one table lookup per field.
+ *  - all other pairs are decoded to RGBA floats and encoded again, in
+ *    blocks that stay in the L1 cache.
+ *
+ *  Channels the source does not have are zero, except alpha, which is
+ *  opaque. Unused (`X`) fields are written as zero.
+ */
+class PixelConverter {
+public:
+    PixelConverter(const PixelFormat& from, const PixelFormat& to)
+        : m_from(from), m_to(to), m_decoder(details::make_pixel_codec(from)),
+          m_encoder(details::make_pixel_codec(to)) {
+        if(from == to && !has_unused_fields(m_encoder)) {
+            m_kernel = &copy;
+        } else if(make_shuffle()) {
+            m_kernel = &shuffle;
+        } else if(details::make_pixel_rescale(
+                          from, m_decoder, to, m_encoder, m_rescale)) {
+            m_kernel = rescale_kernel(m_decoder.size, m_encoder.size);
+        } else {
+            m_kernel = &transcode;
+        }
+    }
+
+    /// Convert \a count pixels from \a in into \a out.
+    void convert(const void* in, std::size_t count, void* out) const {
+        COLOR_INSTRUMENT_SCOPE(timer, "PixelConverter::convert", count);
+        m_kernel(*this,
+                static_cast<const unsigned char*>(in),
+                count,
+                static_cast<unsigned char*>(out));
+    }
+
+    const PixelFormat& from() const { return m_from; }
+
+    const PixelFormat& to() const { return m_to; }
+
+    /// Return whether the conversion only moves bytes.
+    bool is_byte_shuffle() const {
+        return m_kernel == &copy || m_kernel == &shuffle;
+    }
+
+private:
+    using Kernel = void (*)(const PixelConverter&,
+            const unsigned char*,
+            std::size_t,
+            unsigned char*);
+
+    /// Pixels converted at a time by transcode().
+    static constexpr std::size_t block_size = 256;
+
+    /// Return whether \a codec has unused (`X`) fields.
+    static bool has_unused_fields(const details::PixelCodec& codec) {
+        for(std::size_t f = 0; f < codec.num_fields; ++f) {
+            if(codec.field_channels[f] < 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Build m_shuffle if both formats are arrays of the same elements.
+    bool make_shuffle() {
+        if(m_from.packed || m_to.packed || m_from.encoding != m_to.encoding ||
+                m_from.fields[0].bits != m_to.fields[0].bits) {
+            return false;
+        }
+        const auto element = std::size_t(m_from.fields[0].bits / 8);
+        // The bytes of an opaque alpha element.
+        auto opaque = std::vector<unsigned char>(element);
+        if(m_to.encoding == PixelEncoding::Unorm) {
+            std::fill(opaque.begin(), opaque.end(), 0xff);
+        } else if(element == 2) {
+            const auto one = details::float_to_half(1.0f);
+            std::memcpy(opaque.data(), &one, element);
+        } else {
+            const auto one = 1.0f;
+            std::memcpy(opaque.data(), &one, element);
+        }
+
+        auto sources = std::vector<int>();
+        auto fill = std::vector<unsigned char>();
+        for(std::size_t f = 0; f < m_encoder.num_fields; ++f) {
+            const auto c = m_encoder.field_channels[f];
+            const auto position = c >= 0 ? m_decoder.position[c] : -1;
+            for(std::size_t b = 0; b < element; ++b) {
+                sources.push_back(position >= 0 ? position + int(b) : -1);
+                fill.push_back(position < 0 && c == 3 ? opaque[b] : 0);
+            }
+        }
+        m_shuffle = details::make_byte_shuffle(
+                m_from.size(), std::move(sources), std::move(fill));
+        return true;
+    }
+
+    static void copy(const PixelConverter& self,
+            const unsigned char* in,
+            std::size_t count,
+            unsigned char* out) {
+        std::memcpy(out, in, count * self.m_from.size());
+    }
+
+    static void shuffle(const PixelConverter& self,
+            const unsigned char* in,
+            std::size_t count,
+            unsigned char* out) {
+        dispatch<details::byte_shuffle_kernel>(
+                in, count, &self.m_shuffle, out);
+    }
+
+    template <std::size_t InBytes, std::size_t OutBytes>
+    static void rescale(const PixelConverter& self,
+            const unsigned char* in,
+            std::size_t count,
+            unsigned char* out) {
+        const auto& rescale = self.m_rescale;
+        const auto in_shifts = rescale.in_shifts;
+        const auto in_masks = rescale.in_masks;
+        const auto out_shifts = rescale.out_shifts;
+        const auto tables = rescale.tables;
+        const auto fill = rescale.fill;
+        for(std::size_t i = 0; i < count; ++i) {
+            const auto word = details::load_word<InBytes>(in + i * InBytes);
+            auto out_word = fill;
+            // Unused entries look up zero, so the loop has a fixed count.
+            COLOR_UNROLL
+            for(std::size_t k = 0; k < 4; ++k) {
+                const auto v = (word >> in_shifts[k]) & in_masks[k];
+                out_word |= std::uint64_t(tables[k][v]) << out_shifts[k];
+            }
+            details::store_word<OutBytes>(out_word, out + i * OutBytes);
+        }
+    }
+
+    template <std::size_t InBytes>
+    static Kernel rescale_kernel(std::size_t out_size) {
+        switch(out_size) {
+        case 1:
+            return &rescale<InBytes, 1>;
+        case 2:
+            return &rescale<InBytes, 2>;
+        case 3:
+            return &rescale<InBytes, 3>;
+        case 4:
+            return &rescale<InBytes, 4>;
+        case 6:
+            return &rescale<InBytes, 6>;
+        default:
+            return &rescale<InBytes, 8>;
+        }
+    }
+
+    /// Get the rescale() kernel for pixels of the given sizes.
+    static Kernel rescale_kernel(std::size_t in_size, std::size_t out_size) {
+        switch(in_size) {
+        case 1:
+            return rescale_kernel<1>(out_size);
+        case 2:
+            return rescale_kernel<2>(out_size);
+        case 3:
+            return rescale_kernel<3>(out_size);
+        case 4:
+            return rescale_kernel<4>(out_size);
+        case 6:
+            return rescale_kernel<6>(out_size);
+        default:
+            return rescale_kernel<8>(out_size);
+        }
+    }
+
+    static void transcode(const PixelConverter& self,
+            const unsigned char* in,
+            std::size_t count,
+            unsigned char* out) {
+        float rgba[4 * block_size];
+        const auto in_size = self.m_decoder.size;
+        const auto out_size = self.m_encoder.size;
+        for(std::size_t i = 0; i < count; i += block_size) {
+            const auto n = std::min(count - i, std::size_t(block_size));
+            self.m_decoder.decode(self.m_decoder, in + i * in_size, n, rgba);
+            self.m_encoder.encode(self.m_encoder, rgba, n, out + i * out_size);
+        }
+    }
+
+    PixelFormat m_from;
+    PixelFormat m_to;
+    details::PixelCodec m_decoder;
+    details::PixelCodec m_encoder;
+    details::ByteShuffle m_shuffle;
+    details::PixelRescale m_rescale;
+    Kernel m_kernel = nullptr;
+};
+
+/** A thread-safe table of pixel formats and of converters between them,
+ *  keyed by name.
+ *
+ *  Formats are parsed with parse_pixel_format() the first time their
+ *  name is used, unless a format was registered under that name with
+ *  add(). Converters are built the first time a pair of names is used and
+ *  kept for the lifetime of the registry, so an ingest layer that looks up
+ *  the converter for every buffer pays a map lookup, not a parse.
+ */
+class PixelFormatRegistry {
+public:
+    /** Register \a format under \a name, e.g. to name a vendor specific
+     *  layout. Replaces a previous format of that name.
+     */
+    void add(const std::string& name, PixelFormat format) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        format.name = name;
+        m_formats[name] = std::make_unique<PixelFormat>(std::move(format));
+        // Converters from or to the old format are stale.
+        for(auto it = m_converters.begin(); it != m_converters.end();) {
+            if(it->first.first == name || it->first.second == name) {
+                it = m_converters.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /** Get the format called \a name.
+     *  \throws InvalidPackingFormatError if \a name is neither registered
+     *  nor a valid descriptor.
+     */
+    const PixelFormat& format(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return format_locked(name);
+    }
+
+    /** Get the converter between the formats called \a from and \a to.
+     *  The reference stays valid until either format is replaced by add().
+     *  \throws InvalidPackingFormatError if either name is invalid.
+     */
+    const PixelConverter& converter(
+            const std::string& from, const std::string& to) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& converter = m_converters[std::make_pair(from, to)];
+        if(!converter) {
+            try {
+                converter = std::make_unique<PixelConverter>(
+                        format_locked(from), format_locked(to));
+            } catch(...) {
+                m_converters.erase(std::make_pair(from, to));
+                throw;
+            }
+        }
+        return *converter;
+    }
+
+    /// Convert \a count pixels from format \a from to format \a to.
+    void convert(const std::string& from,
+            const void* in,
+            std::size_t count,
+            const std::string& to,
+            void* out) {
+        converter(from, to).convert(in, count, out);
+    }
+
+    /// Get the registry shared by the whole program.
+    static PixelFormatRegistry& global() {
+        static PixelFormatRegistry registry;
+        return registry;
+    }
+
+private:
+    const PixelFormat& format_locked(const std::string& name) {
+        auto& format = m_formats[name];
+        if(!format) {
+            try {
+                format = std::make_unique<PixelFormat>(
+                        parse_pixel_format(name));
+            } catch(...) {
+                m_formats.erase(name);
+                throw;
+            }
+        }
+        return *format;
+    }
+
+    std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<PixelFormat>> m_formats;
+    std::map<std::pair<std::string, std::string>,
+            std::unique_ptr<PixelConverter>>
+            m_converters;
+};
+}
+
+#endif
@@ -0,0 +1,262 @@
+/** \file
+ *  Defines the ReadAheadStreamBuf class.
+ */
+#ifndef COLOR_READAHEAD_H_
+#define COLOR_READAHEAD_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <ios>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+
+namespace color {
+
+/// Buffering parameters of ReadAheadStreamBuf.
+struct ReadAheadOptions {
+    /// Size of each buffer in bytes.
+    std::size_t buffer_size = std::size_t(1) << 20;
+    /** Number of buffers, at least 2. Together with buffer_size this
+     *  bounds the memory used, and how far ahead of the consumer the
+     *  background thread reads.
+     */
+    std::size_t num_buffers = 4;
+};
+
+/** Input stream buffer that reads another stream buffer ahead of its
+ *  consumer on a background thread.
+ *
+ *  A prefetch thread fills a ring of large buffers from the source while
+ *  the consumer reads from the filled ones, so waiting for a slow source
+ *  such as a pipe or a network file system overlaps with processing the
+ *  data already read. Reading from the ReadAheadStreamBuf itself is a
+ *  copy out of the current buffer, and the consumer only synchronizes
+ *  with the prefetch thread once per buffer.
+ *
+ *  The source must not be used by anyone else while the
+ *  ReadAheadStreamBuf exists. Seeking is supported if the source supports
+ *  it; it stops the prefetch thread, discards the buffered data and
+ *  restarts reading at the new position. If the source reports no
+ *  position when the ReadAheadStreamBuf is created, seeking fails without
+ *  disturbing the data read ahead.
+ *
+ *  An exception thrown by the source on the prefetch thread is rethrown
+ *  by the consumer once it has read the data buffered before it, so an
+ *  std::istream reading through the ReadAheadStreamBuf sets badbit.
+ */
+class ReadAheadStreamBuf : public std::streambuf {
+public:
+    ReadAheadStreamBuf(std::streambuf* source,
+            ReadAheadOptions options = ReadAheadOptions())
+        : m_source(source),
+          m_filled(std::max<std::size_t>(options.num_buffers, 2)),
+          m_free(std::max<std::size_t>(options.num_buffers, 2)) {
+        const auto num_buffers = std::max<std::size_t>(options.num_buffers, 2);
+        m_buffers.resize(num_buffers);
+        for(auto& buffer : m_buffers) {
+            buffer.data.resize(std::max<std::size_t>(options.buffer_size, 1));
+        }
+        const auto position =
+                m_source->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+        m_seekable = position != pos_type(off_type(-1));
+        if(m_seekable) {
+            m_position = position;
+        }
+        start();
+    }
+
+    ~ReadAheadStreamBuf() override { stop(); }
+
+    ReadAheadStreamBuf(const ReadAheadStreamBuf& other) = delete;
+    ReadAheadStreamBuf& operator=(const ReadAheadStreamBuf& other) = delete;
+
+protected:
+    int_type underflow() override {
+        if(gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_current) {
+            m_position += m_current->size;
+            m_current->size = 0;
+            m_free.try_push(m_current);
+            m_current = nullptr;
+            m_changed.notify_all();
+        }
+        Buffer* next = nullptr;
+        m_changed.wait(lock, [&] { return m_filled.try_pop(next) || m_done; });
+        // The prefetch thread may have pushed its last buffer right before
+        // finishing.
+        if(!next && !m_filled.try_pop(next)) {
+            setg(nullptr, nullptr, nullptr);
+            if(m_error) {
+                std::rethrow_exception(m_error);
+            }
+            return traits_type::eof();
+        }
+        if(next->size == 0) {
+            m_free.try_push(next);
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+        m_current = next;
+        auto begin = m_current->data.data();
+        setg(begin, begin, begin + m_current->size);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::streamsize showmanyc() override { return egptr() - gptr(); }
+
+    pos_type seekoff(off_type offset,
+            std::ios_base::seekdir dir,
+            std::ios_base::openmode which) override {
+        if(!(which & std::ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+        // Like the source, an unseekable stream has no position to tell.
+        if(!m_seekable) {
+            return pos_type(off_type(-1));
+        }
+        const auto current = current_position();
+        if(dir == std::ios_base::cur) {
+            if(offset == 0) {
+                return pos_type(current);
+            }
+            return seekpos(pos_type(current + offset), which);
+        }
+        stop();
+        const auto result =
+                m_source->pubseekoff(offset, dir, std::ios_base::in);
+        restart(result, current);
+        return result;
+    }
+
+    pos_type seekpos(
+            pos_type position, std::ios_base::openmode which) override {
+        if(!(which & std::ios_base::in) || !m_seekable) {
+            return pos_type(off_type(-1));
+        }
+        const auto current = current_position();
+        stop();
+        const auto result = m_source->pubseekpos(position, std::ios_base::in);
+        restart(result, current);
+        return result;
+    }
+
+private:
+    struct Buffer {
+        std::vector<char> data;
+        std::size_t size = 0;
+    };
+
+    void start() {
+        for(auto& buffer : m_buffers) {
+            buffer.size = 0;
+            m_free.try_push(&buffer);
+        }
+        m_stopping = false;
+        m_done = false;
+        m_error = nullptr;
+        m_thread = std::thread([this] { prefetch_loop(); });
+    }
+
+    void stop() {
+        if(!m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+        // Drop everything read ahead; the buffers are recycled by start().
+        Buffer* buffer;
+        while(m_filled.try_pop(buffer)) {
+        }
+        while(m_free.try_pop(buffer)) {
+        }
+        m_current = nullptr;
+        setg(nullptr, nullptr, nullptr);
+    }
+
+    off_type current_position() const {
+        return m_position + (gptr() - eback());
+    }
+
+    /** Restart reading at \a position, the result of seeking the source.
+     *  If the seek failed, the source is moved back to \a previous, the
+     *  position of the consumer before the seek, so no data is skipped.
+     */
+    void restart(pos_type position, off_type previous) {
+        if(position == pos_type(off_type(-1))) {
+            position = m_source->pubseekpos(
+                    pos_type(previous), std::ios_base::in);
+        }
+        if(position != pos_type(off_type(-1))) {
+            m_position = position;
+        }
+        start();
+    }
+
+    void prefetch_loop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;) {
+            Buffer* buffer = nullptr;
+            m_changed.wait(lock,
+                    [&] { return m_stopping || m_free.try_pop(buffer); });
+            if(m_stopping) {
+                break;
+            }
+            lock.unlock();
+            // sgetn() returns short counts only at the end of the source or
+            // on an error, so the read ends after the first short buffer.
+            try {
+                buffer->size = static_cast<std::size_t>(m_source->sgetn(
+                        buffer->data.data(), buffer->data.size()));
+            } catch(...) {
+                lock.lock();
+                m_error = std::current_exception();
+                break;
+            }
+            const bool last = buffer->size < buffer->data.size();
+            lock.lock();
+            m_filled.try_push(buffer);
+            m_changed.notify_all();
+            if(last) {
+                break;
+            }
+        }
+        m_done = true;
+        m_changed.notify_all();
+    }
+
+    std::streambuf* m_source;
+    std::vector<Buffer> m_buffers;
+
+    // Only touched by the consumer.
+    Buffer* m_current = nullptr;
+    /// Source position of the start of m_current.
+    off_type m_position = 0;
+    bool m_seekable = false;
+
+    // The rings are accessed under m_mutex, like in AsyncStreamPacker.
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    SpscRing<Buffer*> m_filled;
+    SpscRing<Buffer*> m_free;
+    bool m_stopping = false;
+    bool m_done = false;
+    /// Thrown by the source on the prefetch thread, rethrown by underflow().
+    std::exception_ptr m_error;
+    std::thread m_thread;
+};
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <algorithm>
 
 #include "Channel.h"
+#include "Color.h"
 
 namespace color {
 
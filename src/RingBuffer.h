@@ -0,0 +1,197 @@
+/** \file
+ *  Bounded lock-free queues used to connect pipeline stages.
+ *
+ *  Both queues have a fixed capacity chosen at construction and never
+ *  allocate afterward. Operations never block: try_push() fails when the
+ *  queue is full and try_pop() when it is empty, leaving the waiting
+ *  policy to the caller.
+ */
+#ifndef COLOR_RINGBUFFER_H_
+#define COLOR_RINGBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace color {
+
+/// Size of a cache line, used to keep producer and consumer state apart.
+static constexpr std::size_t cache_line_size = 64;
+
+namespace details {
+
+inline std::size_t round_up_pow2(std::size_t n) {
+    std::size_t out = 1;
+    while(out < n) {
+        out <<= 1;
+    }
+    return out;
+}
+}
+
+/** Single producer, single consumer ring buffer.
+ *  One thread may call try_push() while another calls try_pop(). Each
+ *  side only writes its own index, so an operation is one acquire load of
+ *  the other side's index and one release store.
+ */
+template <typename T>
+class SpscRing {
+    static_assert(std::is_nothrow_move_assignable<T>::value,
+            "SpscRing elements must be nothrow move assignable");
+
+public:
+    /// Construct a ring holding at least \a capacity elements.
+    explicit SpscRing(std::size_t capacity)
+        : m_mask(details::round_up_pow2(capacity < 1 ? 1 : capacity) - 1),
+          m_slots(new T[m_mask + 1]) {}
+
+    SpscRing(const SpscRing& other) = delete;
+    SpscRing& operator=(const SpscRing& other) = delete;
+
+    /// Get the number of elements the ring can hold.
+    std::size_t capacity() const { return m_mask + 1; }
+
+    /** Append \a value. Producer thread only.
+     *  \returns false, leaving \a value untouched, if the ring is full.
+     */
+    bool try_push(T& value) {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if(tail - m_cached_head == capacity()) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if(tail - m_cached_head == capacity()) {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// \copydoc try_push(T&)
+    bool try_push(T&& value) { return try_push(value); }
+
+    /** Remove the oldest element into \a out. Consumer thread only.
+     *  \returns false if the ring is empty.
+     */
+    bool try_pop(T& out) {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if(head == m_cached_tail) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if(head == m_cached_tail) {
+                return false;
+            }
+        }
+        out = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    const std::size_t m_mask;
+    const std::unique_ptr<T[]> m_slots;
+
+    // Each index shares its line with the other side's index as last seen
+    // by its owner, so the shared lines are only read when a cached index
+    // says the ring is full or empty.
+    alignas(cache_line_size) std::atomic<std::size_t> m_head{0};
+    std::size_t m_cached_tail = 0;
+    alignas(cache_line_size) std::atomic<std::size_t> m_tail{0};
+    std::size_t m_cached_head = 0;
+};
+
+/** Multi producer, multi consumer ring buffer.
+ *  Any number of threads may push and pop concurrently. Every slot
+ *  carries a sequence number telling whether it is ready to be written or
+ *  read in the current lap, so producers and consumers only contend on
+ *  their own index (D. Vyukov's bounded queue).
+ */
+template <typename T>
+class MpmcRing {
+    static_assert(std::is_nothrow_move_assignable<T>::value,
+            "MpmcRing elements must be nothrow move assignable");
+
+public:
+    /// Construct a ring holding at least \a capacity elements.
+    explicit MpmcRing(std::size_t capacity)
+        : m_mask(details::round_up_pow2(capacity < 1 ? 1 : capacity) - 1),
+          m_slots(new Slot[m_mask + 1]) {
+        for(std::size_t i = 0; i <= m_mask; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcRing(const MpmcRing& other) = delete;
+    MpmcRing& operator=(const MpmcRing& other) = delete;
+
+    /// Get the number of elements the ring can hold.
+    std::size_t capacity() const { return m_mask + 1; }
+
+    /** Append \a value.
+     *  \returns false, leaving \a value untouched, if the ring is full.
+     */
+    bool try_push(T& value) {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        for(;;) {
+            auto& slot = m_slots[pos & m_mask];
+            const auto sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+            if(diff == 0) {
+                if(m_tail.compare_exchange_weak(
+                           pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// \copydoc try_push(T&)
+    bool try_push(T&& value) { return try_push(value); }
+
+    /** Remove the oldest element into \a out.
+     *  \returns false if the ring is empty.
+     */
+    bool try_pop(T& out) {
+        auto pos = m_head.load(std::memory_order_relaxed);
+        for(;;) {
+            auto& slot = m_slots[pos & m_mask];
+            const auto sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence - (pos + 1));
+            if(diff == 0) {
+                if(m_head.compare_exchange_weak(
+                           pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(slot.value);
+                    slot.sequence.store(
+                            pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    const std::size_t m_mask;
+    const std::unique_ptr<Slot[]> m_slots;
+
+    alignas(cache_line_size) std::atomic<std::size_t> m_head{0};
+    alignas(cache_line_size) std::atomic<std::size_t> m_tail{0};
+};
+}
+
+#endif
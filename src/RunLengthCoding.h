@@ -0,0 +1,465 @@
+/** \file
+ *  Run-length and dictionary coding of packed colors.
+ *
+ *  Defines RunLengthSink, which encodes packed colors for a StreamPacker,
+ *  and RunLengthStreamBuf, which decodes them for a StreamUnpacker.
+ */
+#ifndef COLOR_RUNLENGTHCODING_H_
+#define COLOR_RUNLENGTHCODING_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <streambuf>
+#include <vector>
+
+#include "Exceptions.h"
+#include "Sink.h"
+
+namespace color {
+
+namespace details {
+
+/** The coding works on whole packed colors of a fixed number of bytes,
+ *  like QOI. A previous color and a dictionary of recently seen colors,
+ *  indexed by a hash of their bytes, are kept by both sides. Every color
+ *  is coded by the first of these ops that applies:
+ *
+ *  - `00iiiiii`: the color in dictionary slot i.
+ *  - `01rrrrrr`: the previous color, repeated r + 1 times.
+ *  - `10rrrrrr rrrrrrrr`: the previous color, repeated r + 65 times.
+ *  - `11nnnnnn`: n + 1 literal colors follow. Each is stored in the
+ *    dictionary.
+ *
+ *  The previous color and all dictionary slots start out as zero bytes.
+ */
+struct RunLengthCode {
+    static constexpr int dictionary_bits = 6;
+    static constexpr std::size_t dictionary_size = 1 << dictionary_bits;
+    static constexpr unsigned char op_index = 0x00;
+    static constexpr unsigned char op_run = 0x40;
+    static constexpr unsigned char op_long_run = 0x80;
+    static constexpr unsigned char op_literals = 0xc0;
+    static constexpr std::size_t max_run = 64;
+    static constexpr std::size_t max_long_run = (1 << 14) + max_run;
+    static constexpr std::size_t max_literals = 64;
+
+    /** Dictionary slot of the color at \a color. \a Stride is the size of
+     *  a color in bytes if it is known at compile time, otherwise 0 and
+     *  \a stride is used.
+     */
+    template <std::size_t Stride>
+    static std::size_t hash(const unsigned char* color, std::size_t stride) {
+        const auto size = Stride ? Stride : stride;
+        std::uint64_t h = 0;
+        for(std::size_t i = 0; i < size; i += 8) {
+            std::uint64_t chunk = 0;
+            std::memcpy(&chunk, color + i, size - i < 8 ? size - i : 8);
+            h = (h ^ chunk) * 0x9e3779b97f4a7c15ull;
+        }
+        return static_cast<std::size_t>(h >> (64 - dictionary_bits));
+    }
+};
+}
+
+/** Sink that codes packed colors with runs of repeated colors and indices
+ *  into a dictionary of recent colors, and writes the result to another
+ *  Sink.
+ *
+ *  Flat regions cost one or two bytes per run of up to 16448 colors, and
+ *  colors from a small palette one byte each, which suits screenshots and
+ *  sprite sheets. Colors are compared and hashed on their packed bytes, so
+ *  the coding works for any Packer. Other colors are written as they are,
+ *  with one extra byte per 64 colors.
+ *
+ *  Usually created by StreamPacker::enable_run_length_coding() and read
+ *  with StreamUnpacker::enable_run_length_decoding().
+ */
+class RunLengthSink : public Sink {
+public:
+    /** Construct a RunLengthSink for colors of \a stride bytes, usually
+     *  Packer::packed_size(), writing to \a inner.
+     */
+    RunLengthSink(std::unique_ptr<Sink> inner, std::size_t stride)
+        : m_inner(std::move(inner)), m_stride(std::max<std::size_t>(stride, 1)),
+          m_previous(m_stride, 0),
+          m_dictionary(Code::dictionary_size * m_stride, 0),
+          m_out(std::max(static_cast<std::size_t>(out_capacity),
+                  4 * max_op_size(m_stride))),
+          m_partial(m_stride) {}
+
+    /** Write any pending run or literals. Errors are swallowed here, so
+     *  call flush() first to see them, for example as an exception from a
+     *  stream with exceptions enabled.
+     */
+    ~RunLengthSink() override {
+        try {
+            flush();
+        } catch(...) {
+        }
+    }
+
+    RunLengthSink(const RunLengthSink& other) = delete;
+    RunLengthSink& operator=(const RunLengthSink& other) = delete;
+
+    void write(const void* data, std::size_t size) override {
+        auto bytes = static_cast<const unsigned char*>(data);
+        // Complete a color split across writes.
+        if(m_partial_size > 0) {
+            const auto n = std::min(size, m_stride - m_partial_size);
+            std::memcpy(m_partial.data() + m_partial_size, bytes, n);
+            m_partial_size += n;
+            bytes += n;
+            size -= n;
+            if(m_partial_size < m_stride) {
+                return;
+            }
+            encode(m_partial.data(), 1);
+            m_partial_size = 0;
+        }
+        const auto count = size / m_stride;
+        encode(bytes, count);
+        m_partial_size = size - count * m_stride;
+        std::memcpy(m_partial.data(), bytes + count * m_stride, m_partial_size);
+    }
+
+    /** End the current run and write everything coded so far. A color
+     *  split across writes stays pending until it is complete.
+     */
+    bool flush() override {
+        write_out();
+        return m_inner->flush();
+    }
+
+    /// Write out the pending colors and sync the inner Sink.
+    bool sync() override {
+        write_out();
+        return m_inner->sync();
+    }
+
+    bool good() const override { return m_inner->good(); }
+
+    bool fail() const override { return m_inner->fail(); }
+
+    bool bad() const override { return m_inner->bad(); }
+
+    /// Get the Sink the coded colors are written to.
+    Sink& get_inner() { return *m_inner; }
+
+private:
+    using Code = details::RunLengthCode;
+
+    /// Coded bytes collected before writing them to the inner sink.
+    static constexpr std::size_t out_capacity = std::size_t(1) << 16;
+
+    /// Upper bound for the bytes coding one color can append.
+    static std::size_t max_op_size(std::size_t stride) { return stride + 3; }
+
+    void encode(const unsigned char* colors, std::size_t count) {
+        // Compile-time strides let the compiler turn the comparisons and
+        // copies into plain loads and stores.
+        switch(m_stride) {
+        case 1: encode<1>(colors, count); break;
+        case 2: encode<2>(colors, count); break;
+        case 3: encode<3>(colors, count); break;
+        case 4: encode<4>(colors, count); break;
+        case 6: encode<6>(colors, count); break;
+        case 8: encode<8>(colors, count); break;
+        case 12: encode<12>(colors, count); break;
+        case 16: encode<16>(colors, count); break;
+        default: encode<0>(colors, count); break;
+        }
+    }
+
+    /** Code \a count colors of \a Stride bytes, or m_stride if \a Stride
+     *  is 0. Literals are written straight to m_out after an op byte whose
+     *  count grows with them.
+     */
+    template <std::size_t Stride>
+    void encode(const unsigned char* colors, std::size_t count) {
+        const auto stride = Stride ? Stride : m_stride;
+        const auto previous = m_previous.data();
+        const auto dictionary = m_dictionary.data();
+        const auto base = m_out.data();
+        while(count > 0) {
+            // Code as many colors as surely fit into m_out, leaving room
+            // for the op of a run still going on afterward.
+            const auto free = m_out.size() - m_out_size;
+            const auto room = free > 2 ? (free - 2) / max_op_size(stride) : 0;
+            if(room == 0) {
+                write_out();
+                continue;
+            }
+            const auto n = std::min(count, room);
+            auto out = base + m_out_size;
+            auto run = m_run;
+            auto literal_op = m_literal_op;
+            for(std::size_t i = 0; i < n; ++i) {
+                const auto color = colors + i * stride;
+                if(std::memcmp(color, previous, stride) == 0) {
+                    if(++run == Code::max_long_run) {
+                        out = put_run(out, run);
+                        run = 0;
+                        literal_op = nullptr;
+                    }
+                    continue;
+                }
+                if(run > 0) {
+                    out = put_run(out, run);
+                    run = 0;
+                    literal_op = nullptr;
+                }
+                const auto slot = Code::hash<Stride>(color, stride);
+                const auto entry = dictionary + slot * stride;
+                if(std::memcmp(entry, color, stride) == 0) {
+                    *out++ = static_cast<unsigned char>(Code::op_index | slot);
+                    literal_op = nullptr;
+                } else {
+                    std::memcpy(entry, color, stride);
+                    if(!literal_op) {
+                        literal_op = out;
+                        *out++ = Code::op_literals;
+                    } else {
+                        ++*literal_op;
+                    }
+                    std::memcpy(out, color, stride);
+                    out += stride;
+                    if(*literal_op == (Code::op_literals | 0x3f)) {
+                        literal_op = nullptr;
+                    }
+                }
+                std::memcpy(previous, color, stride);
+            }
+            m_out_size = static_cast<std::size_t>(out - base);
+            m_run = run;
+            m_literal_op = literal_op;
+            colors += n * stride;
+            count -= n;
+        }
+    }
+
+    /// Append the op for a run of \a run colors at \a out.
+    static unsigned char* put_run(unsigned char* out, std::size_t run) {
+        if(run <= Code::max_run) {
+            *out++ = static_cast<unsigned char>(Code::op_run | (run - 1));
+        } else {
+            const auto n = run - Code::max_run - 1;
+            *out++ = static_cast<unsigned char>(Code::op_long_run | (n >> 8));
+            *out++ = static_cast<unsigned char>(n & 0xff);
+        }
+        return out;
+    }
+
+    /// End the current run and write the coded bytes to the inner sink.
+    void write_out() {
+        if(m_run > 0) {
+            m_out_size = static_cast<std::size_t>(
+                    put_run(m_out.data() + m_out_size, m_run) - m_out.data());
+            m_run = 0;
+        }
+        // Literals written out cannot be counted any more.
+        m_literal_op = nullptr;
+        if(m_out_size > 0) {
+            m_inner->write(m_out.data(), m_out_size);
+            m_out_size = 0;
+        }
+    }
+
+    std::unique_ptr<Sink> m_inner;
+    std::size_t m_stride;
+    std::vector<unsigned char> m_previous;
+    std::vector<unsigned char> m_dictionary;
+    std::size_t m_run = 0;
+    std::vector<unsigned char> m_out;
+    std::size_t m_out_size = 0;
+    /// Op byte of the literals being written to m_out, if any.
+    unsigned char* m_literal_op = nullptr;
+    std::vector<unsigned char> m_partial;
+    std::size_t m_partial_size = 0;
+};
+
+/** Input stream buffer that decodes colors written by a RunLengthSink
+ *  from another stream buffer.
+ *
+ *  Malformed data throws CorruptDataError from the read, which
+ *  std::istream turns into `badbit`. Seeking is not supported.
+ */
+class RunLengthStreamBuf : public std::streambuf {
+public:
+    /// Construct a RunLengthStreamBuf for colors of \a stride bytes.
+    RunLengthStreamBuf(std::streambuf* source, std::size_t stride)
+        : m_source(source), m_stride(std::max<std::size_t>(stride, 1)),
+          m_previous(m_stride, 0),
+          m_dictionary(Code::dictionary_size * m_stride, 0) {
+        // Whole literal ops always fit into m_in after a refill.
+        m_in.resize(std::max(static_cast<std::size_t>(in_capacity),
+                2 * max_op_size(m_stride)));
+        m_colors.resize(out_capacity * m_stride);
+    }
+
+    RunLengthStreamBuf(const RunLengthStreamBuf& other) = delete;
+    RunLengthStreamBuf& operator=(const RunLengthStreamBuf& other) = delete;
+
+protected:
+    int_type underflow() override {
+        if(gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        const auto size = decode();
+        if(size == 0) {
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+        auto begin = reinterpret_cast<char*>(m_colors.data());
+        setg(begin, begin, begin + size);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::streamsize showmanyc() override { return egptr() - gptr(); }
+
+private:
+    using Code = details::RunLengthCode;
+
+    /// Bytes read from the source at a time.
+    static constexpr std::size_t in_capacity = std::size_t(1) << 16;
+    /// Colors decoded at a time, except for longer runs.
+    static constexpr std::size_t out_capacity = std::size_t(1) << 14;
+
+    /// Largest op: literals and their op byte.
+    static std::size_t max_op_size(std::size_t stride) {
+        return 1 + Code::max_literals * stride;
+    }
+
+    /// Decode the next ops into m_colors. \returns The number of bytes.
+    std::size_t decode() {
+        switch(m_stride) {
+        case 1: return decode<1>();
+        case 2: return decode<2>();
+        case 3: return decode<3>();
+        case 4: return decode<4>();
+        case 6: return decode<6>();
+        case 8: return decode<8>();
+        case 12: return decode<12>();
+        case 16: return decode<16>();
+        default: return decode<0>();
+        }
+    }
+
+    /// Decode colors of \a Stride bytes, or m_stride if \a Stride is 0.
+    template <std::size_t Stride>
+    std::size_t decode() {
+        const auto stride = Stride ? Stride : m_stride;
+        const auto capacity = m_colors.size() / stride;
+        const auto out = m_colors.data();
+        const auto previous = m_previous.data();
+        const auto dictionary = m_dictionary.data();
+        std::size_t count = 0;
+        for(;;) {
+            // A long run is decoded in pieces that fit into m_colors.
+            if(m_pending_run > 0) {
+                const auto n = std::min(m_pending_run, capacity - count);
+                fill(out + count * stride, n);
+                count += n;
+                m_pending_run -= n;
+                if(m_pending_run > 0) {
+                    return count * stride;
+                }
+            }
+            if(count + Code::max_literals > capacity) {
+                return count * stride;
+            }
+            if(m_in_size - m_in_pos < max_op_size(stride) && !refill()) {
+                return count * stride;
+            }
+            const auto in = m_in.data();
+            const int op = in[m_in_pos++];
+            const auto arg = static_cast<std::size_t>(op & 0x3f);
+            switch(op & 0xc0) {
+            case Code::op_index:
+                std::memcpy(previous, dictionary + arg * stride, stride);
+                std::memcpy(out + count * stride, previous, stride);
+                ++count;
+                break;
+            case Code::op_run:
+                m_pending_run = arg + 1;
+                break;
+            case Code::op_long_run:
+                if(m_in_pos == m_in_size) {
+                    throw CorruptDataError("truncated run-length data");
+                }
+                m_pending_run =
+                        ((arg << 8) | in[m_in_pos++]) + Code::max_run + 1;
+                break;
+            default: {
+                const auto bytes = (arg + 1) * stride;
+                if(m_in_size - m_in_pos < bytes) {
+                    throw CorruptDataError("truncated run-length data");
+                }
+                const auto colors = out + count * stride;
+                const auto source = in + m_in_pos;
+                std::memcpy(colors, source, bytes);
+                for(std::size_t i = 0; i < bytes; i += stride) {
+                    const auto slot = Code::hash<Stride>(source + i, stride);
+                    std::memcpy(dictionary + slot * stride, source + i, stride);
+                }
+                std::memcpy(previous, source + bytes - stride, stride);
+                m_in_pos += bytes;
+                count += arg + 1;
+            }
+            }
+        }
+    }
+
+    /// Write \a n copies of the previous color to \a out.
+    void fill(unsigned char* out, std::size_t n) {
+        if(n == 0) {
+            return;
+        }
+        const auto size = n * m_stride;
+        std::memcpy(out, m_previous.data(), m_stride);
+        // Double the filled part with every copy.
+        for(auto filled = m_stride; filled < size;) {
+            const auto chunk = std::min(filled, size - filled);
+            std::memcpy(out + filled, out, chunk);
+            filled += chunk;
+        }
+    }
+
+    /** Move the unread bytes to the front of m_in and read from the source
+     *  until m_in is full or the source ends.
+     *  \returns Whether any bytes are left to read.
+     */
+    bool refill() {
+        const auto left = m_in_size - m_in_pos;
+        std::memmove(m_in.data(), m_in.data() + m_in_pos, left);
+        m_in_pos = 0;
+        m_in_size = left;
+        while(!m_source_done && m_in_size < m_in.size()) {
+            const auto n = m_source->sgetn(
+                    reinterpret_cast<char*>(m_in.data() + m_in_size),
+                    static_cast<std::streamsize>(m_in.size() - m_in_size));
+            if(n <= 0) {
+                m_source_done = true;
+            } else {
+                m_in_size += static_cast<std::size_t>(n);
+            }
+        }
+        return m_in_size > 0;
+    }
+
+    std::streambuf* m_source;
+    std::size_t m_stride;
+    std::vector<unsigned char> m_previous;
+    std::vector<unsigned char> m_dictionary;
+    std::size_t m_pending_run = 0;
+
+    std::vector<unsigned char> m_in;
+    std::size_t m_in_pos = 0;
+    std::size_t m_in_size = 0;
+    bool m_source_done = false;
+    std::vector<unsigned char> m_colors;
+};
+}
+
+#endif
@@ -0,0 +1,118 @@
+/** \file
+ *  Defines the Sink and OstreamSink classes.
+ */
+#ifndef COLOR_SINK_H_
+#define COLOR_SINK_H_
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+
+namespace color {
+
+/** Base class for byte destinations of the stream packers.
+ *  Like std::ostream, a Sink does not throw on write errors. A failed
+ *  write sets its error state, which is reported by good(), fail() and
+ *  bad().
+ */
+class Sink {
+public:
+    virtual ~Sink() {}
+
+    /// Write \a size bytes from \a data.
+    virtual void write(const void* data, std::size_t size) = 0;
+
+    /** Get memory for the next \a size bytes, so they can be produced in
+     *  place instead of being copied by write(). The bytes are written once
+     *  commit() is called, and nothing else may be written before that.
+     *  \returns null if the Sink does not support it, which is the default.
+     */
+    virtual void* reserve(std::size_t size) {
+        (void)size;
+        return nullptr;
+    }
+
+    /// Complete a write of \a size bytes into memory from reserve().
+    virtual void commit(std::size_t size) { (void)size; }
+
+    /** Pass everything written so far on to the underlying destination.
+     *  \returns good().
+     */
+    virtual bool flush() = 0;
+
+    /** Flush, then wait until everything written is durably stored, where
+     *  the destination supports it. The default only flushes.
+     *  \returns good().
+     */
+    virtual bool sync() { return flush(); }
+
+    /// True if no operation has failed.
+    virtual bool good() const = 0;
+
+    /// True if an operation has failed.
+    virtual bool fail() const = 0;
+
+    /// True if an operation failed in a way that cannot be recovered.
+    virtual bool bad() const = 0;
+};
+
+/// Sink writing to an std::ostream.
+class OstreamSink : public Sink {
+public:
+    /// Construct an OstreamSink that takes ownership of \a owned_stream.
+    explicit OstreamSink(std::unique_ptr<std::ostream> owned_stream)
+        : m_owned_stream(std::move(owned_stream)),
+          m_stream_ptr(m_owned_stream.get()) {}
+
+    /** Construct an OstreamSink writing to \a stream, which must outlive
+     *  the OstreamSink.
+     */
+    explicit OstreamSink(std::ostream& stream) : m_stream_ptr(&stream) {}
+
+    /// Write \a size bytes from \a data. Does nothing once released.
+    void write(const void* data, std::size_t size) override {
+        if(m_stream_ptr) {
+            m_stream_ptr->write(static_cast<const char*>(data), size);
+        }
+    }
+
+    bool flush() override {
+        if(m_stream_ptr) {
+            m_stream_ptr->flush();
+        }
+        return good();
+    }
+
+    /// False once the stream has been released.
+    bool good() const override {
+        return m_stream_ptr && m_stream_ptr->good();
+    }
+
+    /// True once the stream has been released.
+    bool fail() const override { return !m_stream_ptr || m_stream_ptr->fail(); }
+
+    /// True once the stream has been released.
+    bool bad() const override { return !m_stream_ptr || m_stream_ptr->bad(); }
+
+    /// Get the std::ostream written to.
+    std::ostream& get_stream() { return *m_stream_ptr; }
+
+    /// Get the std::ostream written to.
+    const std::ostream& get_stream() const { return *m_stream_ptr; }
+
+    /** Take ownership of the owned std::ostream, or return null if the
+     *  stream is not owned. Afterward the OstreamSink writes nothing and
+     *  reports bad().
+     */
+    std::unique_ptr<std::ostream> release_stream() {
+        m_stream_ptr = nullptr;
+        return std::move(m_owned_stream);
+    }
+
+private:
+    std::unique_ptr<std::ostream> m_owned_stream;
+    std::ostream* m_stream_ptr;
+};
+}
+
+#endif
@@ -4,27 +4,40 @@
 #ifndef COLOR_STREAMPACKER_H_
 #define COLOR_STREAMPACKER_H_
 
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <ostream>
 
+#include "Instrumentation.h"
+#include "Iterator_Util.h"
+#include "MemoryResource.h"
 #include "Packer.h"
+#include "RunLengthCoding.h"
+#include "Sink.h"
 
 namespace color {
 
 /** Adapter class for packing colors into a stream.
+ *  The packed bytes are written to a Sink. The constructors taking an
+ *  std::ostream write through an OstreamSink.
  */
 template <typename Color>
 class StreamPacker {
 public:
     /** Construct a StreamPacker instance the packs Color instances to an
      *  std::ostream using a given Packer. The StreamPacker takes ownership
-     *  of both the stream and the Packer.
+     *  of both the stream and the Packer. The internal buffer is allocated
+     *  from \a resource.
      */
     StreamPacker(std::unique_ptr<std::ostream> owned_stream,
-            std::unique_ptr<Packer<Color>> packer)
-        : m_owned_stream(std::move(owned_stream)), m_packer(std::move(packer)) {
-        m_stream_ptr = m_owned_stream.get();
+            std::unique_ptr<Packer<Color>> packer,
+            MemoryResource* resource = get_default_resource())
+        : m_packer(std::move(packer)),
+          m_elem_buffer(PolymorphicAllocator<char>(resource)) {
+        auto sink = std::make_unique<OstreamSink>(std::move(owned_stream));
+        m_ostream_sink = sink.get();
+        m_sink = std::move(sink);
         m_elem_buffer.resize(m_packer->packed_size());
     }
 
@@ -36,8 +49,27 @@ public:
      *  be owned.
      */
     StreamPacker(std::ostream& referenced_stream,
-            std::unique_ptr<Packer<Color>> packer)
-        : m_stream_ptr(&referenced_stream), m_packer(std::move(packer)) {}
+            std::unique_ptr<Packer<Color>> packer,
+            MemoryResource* resource = get_default_resource())
+        : m_packer(std::move(packer)),
+          m_elem_buffer(PolymorphicAllocator<char>(resource)) {
+        auto sink = std::make_unique<OstreamSink>(referenced_stream);
+        m_ostream_sink = sink.get();
+        m_sink = std::move(sink);
+        m_elem_buffer.resize(m_packer->packed_size());
+    }
+
+    /** Construct a StreamPacker instance the packs Color instances to a
+     *  Sink, such as an FdSink, using a given Packer. The StreamPacker takes
+     *  ownership of both the Sink and the Packer.
+     */
+    StreamPacker(std::unique_ptr<Sink> sink,
+            std::unique_ptr<Packer<Color>> packer,
+            MemoryResource* resource = get_default_resource())
+        : m_sink(std::move(sink)), m_packer(std::move(packer)),
+          m_elem_buffer(PolymorphicAllocator<char>(resource)) {
+        m_elem_buffer.resize(m_packer->packed_size());
+    }
 
     ~StreamPacker() = default;
 
@@ -47,61 +79,164 @@ public:
     StreamPacker& operator=(StreamPacker&& other) noexcept = default;
 
     /** Pack one Color into the current position of the stream.
-     *  If an error occurs, the relevant state flags of the
-     *  stream object will be set accordingly and the
-     *  color will not be written.
+     *  If an error occurs, the error state of the sink will be set
+     *  accordingly and the color will not be written.
      */
     StreamPacker& operator<<(const Color& color) { return pack_single(color); }
 
     /// Equivalent to operator <<(const Color&).
     StreamPacker& pack_single(const Color& color) {
-        auto& stream = get_stream();
-        m_packer->pack_single(color, m_elem_buffer.data());
-        stream.write(m_elem_buffer.data(), m_packer->packed_size());
+        const auto size = m_packer->packed_size();
+        if(auto out = m_sink->reserve(size)) {
+            m_packer->pack_single(color, out);
+            m_sink->commit(size);
+        } else {
+            m_packer->pack_single(color, m_elem_buffer.data());
+            m_sink->write(m_elem_buffer.data(), size);
+        }
         return *this;
     }
 
     /** Pack all elements between \a first and \a last.
+     *  Ranges in contiguous storage are packed in blocks, with one write
+     *  to the sink per block.
      */
     template <typename Iterator>
     void pack(Iterator first, Iterator last) {
-        for(auto it = first; it != last; ++it) {
-            pack_single(*it);
-        }
+        COLOR_INSTRUMENT_SCOPE(timer, "StreamPacker::pack", 0);
+        const auto count = pack_impl(first,
+                last,
+                details::is_contiguous_iterator<Iterator, Color>());
+        COLOR_INSTRUMENT_ELEMENTS(timer, count);
+        (void)count;
     }
 
-    /// Equivalent to get_stream().good().
-    bool good() const { return get_stream().good(); }
+    /** Pack every color of a lazy view (see Views.h). The view is
+     *  converted and packed a chunk at a time.
+     */
+    template <typename View,
+            typename = std::enable_if_t<details::is_color_view<View>::value>>
+    void pack(const View& view) {
+        static_assert(std::is_same<typename View::value_type, Color>::value,
+                "the view must produce the packed color type");
+        COLOR_INSTRUMENT_SCOPE(timer, "StreamPacker::pack", 0);
+        std::size_t total = 0;
+        view.for_each_chunk([&](const Color* colors, std::size_t count) {
+            total += pack_impl(colors, colors + count, std::true_type());
+        });
+        COLOR_INSTRUMENT_ELEMENTS(timer, total);
+    }
+
+    /** Pass everything packed so far on to the destination.
+     *  \returns good().
+     */
+    bool flush() { return m_sink->flush(); }
+
+    /** Code the packed colors with runs and a dictionary of recent colors
+     *  before writing them, see RunLengthSink. Must be called before any
+     *  color is packed; read the result with
+     *  StreamUnpacker::enable_run_length_decoding().
+     */
+    void enable_run_length_coding() {
+        m_sink = std::make_unique<RunLengthSink>(
+                std::move(m_sink), m_packer->packed_size());
+    }
+
+    /// Equivalent to get_sink().good().
+    bool good() const { return m_sink->good(); }
+
+    /// Equivalent to get_sink().fail().
+    bool fail() const { return m_sink->fail(); }
+
+    /** Equivalent to get_stream().eof() when writing to an std::ostream,
+     *  false otherwise.
+     */
+    bool eof() const { return m_ostream_sink && get_stream().eof(); }
+
+    /// Equivalent to get_sink().bad().
+    bool bad() const { return m_sink->bad(); }
 
-    /// Equivalent to get_stream().fail().
-    bool fail() const { return get_stream().fail(); }
+    /// Get the internal Sink.
+    Sink& get_sink() { return *m_sink; }
 
-    /// Equivalent to get_stream().eof().
-    bool eof() const { return get_stream().eof(); }
+    /// Get the internal Sink.
+    const Sink& get_sink() const { return *m_sink; }
 
-    /// Equivalent to get_stream().bad().
-    bool bad() const { return get_stream().bad(); }
+    /** Get the internal stream object. Only available if the StreamPacker
+     *  was constructed with an std::ostream.
+     */
+    std::ostream& get_stream() { return m_ostream_sink->get_stream(); }
 
-    /// Get the internal stream object.
-    std::ostream& get_stream() { return *m_stream_ptr; }
+    /** Get the internal stream object. Only available if the StreamPacker
+     *  was constructed with an std::ostream.
+     */
+    const std::ostream& get_stream() const {
+        return m_ostream_sink->get_stream();
+    }
 
-    /// Get the internal stream object.
-    const std::ostream& get_stream() const { return *m_stream_ptr; }
+    /// Get the internal Packer.
+    const Packer<Color>& get_packer() const { return *m_packer; }
 
     /** Take ownership of the internal std::ostream.
-     *  This should be treated similarly to a move operation,
-     *  afterward the StreamPacker object should not be used.
+     *  Everything packed so far, including colors held back by run-length
+     *  coding, is flushed to the stream first. This should be treated
+     *  similarly to a move operation, afterward the StreamPacker object
+     *  should not be used.
      */
     std::unique_ptr<std::ostream> release_stream() {
-        m_stream_ptr = nullptr;
-        return std::move(m_owned_stream);
+        if(!m_ostream_sink) {
+            return nullptr;
+        }
+        m_sink->flush();
+        auto stream = m_ostream_sink->release_stream();
+        m_ostream_sink = nullptr;
+        return stream;
     }
 
 private:
-    std::ostream* m_stream_ptr;
+    /// Colors packed per write in the bulk path.
+    static constexpr std::size_t block_colors = 4096;
+
+    template <typename Iterator>
+    std::size_t pack_impl(Iterator first, Iterator last, std::false_type) {
+        std::size_t count = 0;
+        for(auto it = first; it != last; ++it, ++count) {
+            pack_single(*it);
+        }
+        return count;
+    }
+
+    template <typename Iterator>
+    std::size_t pack_impl(Iterator first, Iterator last, std::true_type) {
+        if(first == last) {
+            return 0;
+        }
+        const auto color_size = m_packer->packed_size();
+        const auto n = static_cast<std::size_t>(std::distance(first, last));
+        const Color* src = details::to_address(first);
+        // Pack straight into the destination if the sink allows it.
+        if(auto out = m_sink->reserve(n * color_size)) {
+            m_packer->pack_contiguous(src, n, out);
+            m_sink->commit(n * color_size);
+            return n;
+        }
+        if(m_elem_buffer.size() < block_colors * color_size) {
+            m_elem_buffer.resize(block_colors * color_size);
+        }
+        for(std::size_t done = 0; done < n; done += block_colors) {
+            const auto count = std::min(
+                    n - done, static_cast<std::size_t>(block_colors));
+            m_packer->pack_contiguous(src + done, count, m_elem_buffer.data());
+            m_sink->write(m_elem_buffer.data(), count * color_size);
+        }
+        return n;
+    }
+
+    std::unique_ptr<Sink> m_sink;
+    /// m_sink if it is an OstreamSink, otherwise null.
+    OstreamSink* m_ostream_sink = nullptr;
     std::unique_ptr<Packer<Color>> m_packer;
-    std::unique_ptr<std::ostream> m_owned_stream;
-    std::vector<char> m_elem_buffer;
+    PmrVector<char> m_elem_buffer;
 };
 }
 
@@ -4,11 +4,20 @@
 #ifndef COLOR_STREAMUNPACKER_H_
 #define COLOR_STREAMUNPACKER_H_
 
+#include <algorithm>
+#include <cstdint>
 #include <istream>
+#include <iterator>
 #include <memory>
+#include <type_traits>
 #include <vector>
 #include <limits>
 
+#include "BlockCodec.h"
+#include "Instrumentation.h"
+#include "MemoryResource.h"
+#include "ReadAhead.h"
+#include "RunLengthCoding.h"
 #include "Unpacker.h"
 
 namespace color {
@@ -20,12 +29,15 @@ class StreamUnpacker {
 public:
     /** Construct a StreamUnpacker instance that unpacks from an std::istream
      *  using a given Unpacker. The StreamUnpacker takes ownership of both
-     *  the stream and Packer.
+     *  the stream and Packer. The internal buffer is allocated from
+     *  \a resource.
      */
     StreamUnpacker(std::unique_ptr<std::istream> owned_stream,
-            std::unique_ptr<Unpacker<Color>> unpacker)
+            std::unique_ptr<Unpacker<Color>> unpacker,
+            MemoryResource* resource = get_default_resource())
         : m_owned_stream(std::move(owned_stream)),
-          m_unpacker(std::move(unpacker)) {
+          m_unpacker(std::move(unpacker)),
+          m_elem_buffer(PolymorphicAllocator<char>(resource)) {
         m_stream_ptr = m_owned_stream.get();
         m_elem_buffer.resize(m_unpacker->packed_size());
     }
@@ -37,9 +49,13 @@ public:
      *  as long as the referencing StreamUnpacker. This overload is primarily
      *  provided to support the standard streams which cannot be owned.
      */
-    StreamUnpacker(
-            std::istream& stream, std::unique_ptr<Unpacker<Color>> unpacker)
-        : m_unpacker(std::move(unpacker)), m_stream_ptr(&stream) {}
+    StreamUnpacker(std::istream& stream,
+            std::unique_ptr<Unpacker<Color>> unpacker,
+            MemoryResource* resource = get_default_resource())
+        : m_unpacker(std::move(unpacker)), m_stream_ptr(&stream),
+          m_elem_buffer(PolymorphicAllocator<char>(resource)) {
+        m_elem_buffer.resize(m_unpacker->packed_size());
+    }
 
     ~StreamUnpacker() = default;
 
@@ -79,23 +95,20 @@ public:
      */
     template <typename OutIterator>
     std::streamsize unpack(std::streamsize n, OutIterator&& out) {
-        for(decltype(n) i = 0; i < n; ++i) {
-            // Passing *out to unpack_single does not work
-            // for insertion iterators.
-            auto color = Color();
-            unpack_single(color);
-            *out = color;
-            if(!good()) {
-                return i;
-            }
-            ++out;
-        }
-        return n;
+        COLOR_INSTRUMENT_SCOPE(timer, "StreamUnpacker::unpack", 0);
+        const auto count = unpack_impl(n,
+                out,
+                details::is_contiguous_iterator<std::decay_t<OutIterator>,
+                        Color>());
+        COLOR_INSTRUMENT_ELEMENTS(timer, count);
+        return count;
     }
 
     /// Unpacks as many colors as can be extracted from the stream.
     /// Equivalent to StreamUnpacker::unpack with a sufficiently large \a n.
-    template <typename OutIterator>
+    template <typename OutIterator,
+            typename = std::enable_if_t<
+                    !details::is_allocator<std::decay_t<OutIterator>>::value>>
     std::streamsize unpack_all(OutIterator&& out) {
         return unpack(std::numeric_limits<std::streamsize>::max(), out);
     }
@@ -107,6 +120,149 @@ public:
         return out;
     }
 
+    /// Unpack all colors to a vector allocating with \a alloc.
+    template <typename Allocator,
+            typename =
+                    std::enable_if_t<details::is_allocator<Allocator>::value>>
+    std::vector<Color, Allocator> unpack_all(const Allocator& alloc) {
+        auto out = std::vector<Color, Allocator>(alloc);
+        unpack_all(std::back_inserter(out));
+        return out;
+    }
+
+    /** Move the read position to the color at \a index, counted from the
+     *  start of the stream. Any error or end-of-file state is cleared
+     *  first. Seeking past the end succeeds, but the next read fails.
+     *  \returns false if the stream is not seekable, or if the offset of
+     *  \a index does not fit into `std::streamoff`; failbit is set then.
+     */
+    bool seek(std::uint64_t index) {
+        auto& stream = get_stream();
+        stream.clear();
+        const auto size = m_unpacker->packed_size();
+        if(index > std::uint64_t(std::numeric_limits<std::streamoff>::max()) /
+                        size) {
+            stream.setstate(std::ios_base::failbit);
+            return false;
+        }
+        stream.seekg(static_cast<std::streamoff>(index * size));
+        return !stream.fail();
+    }
+
+    /** Get the index of the color at the read position.
+     *  \returns -1 if the stream is not seekable or has failed.
+     */
+    std::streamoff tell() {
+        const auto position = static_cast<std::streamoff>(
+                get_stream().tellg());
+        if(position < 0) {
+            return -1;
+        }
+        return position / m_unpacker->packed_size();
+    }
+
+    /** Get the number of whole colors in the stream, including those
+     *  before the read position. Does not move the read position.
+     *  \returns -1 if the stream is not seekable or has failed.
+     */
+    std::streamoff size() {
+        auto& stream = get_stream();
+        const auto position = stream.tellg();
+        if(position < 0) {
+            return -1;
+        }
+        // A source that tells its position may still fail to seek to the
+        // end, which must not leave the stream failed.
+        const auto state = stream.rdstate();
+        stream.seekg(0, std::ios_base::end);
+        const auto end = static_cast<std::streamoff>(stream.tellg());
+        if(end < 0 || stream.fail()) {
+            stream.clear(state);
+            return -1;
+        }
+        stream.seekg(position);
+        if(stream.fail()) {
+            return -1;
+        }
+        return end / m_unpacker->packed_size();
+    }
+
+    /** Unpack up to \a n colors starting at the color at \a index,
+     *  writing them to \a out. Equivalent to seek() followed by unpack(),
+     *  so the read position ends up after the last color read.
+     *  \returns The number of colors unpacked, which is less than \a n
+     *  if the end of the stream is reached, or 0 if the stream is not
+     *  seekable.
+     */
+    template <typename OutIterator>
+    std::streamsize read_at(
+            std::uint64_t index, std::streamsize n, OutIterator&& out) {
+        if(!seek(index)) {
+            return 0;
+        }
+        return unpack(n, out);
+    }
+
+    /** Read the stream ahead of unpacking on a background thread.
+     *  Afterward all reads go through a ReadAheadStreamBuf over the
+     *  stream's buffer, so unpack() and unpack_all() consume data that
+     *  was read while earlier colors were being processed. Useful for
+     *  slow sources such as pipes and network file systems.
+     *
+     *  get_stream() then returns a stream over the ReadAheadStreamBuf;
+     *  the original stream must no longer be used directly. Has no effect
+     *  if read-ahead is already enabled.
+     */
+    void enable_read_ahead(ReadAheadOptions options = ReadAheadOptions()) {
+        if(m_read_ahead) {
+            return;
+        }
+        m_read_ahead = std::make_unique<ReadAheadStreamBuf>(
+                m_stream_ptr->rdbuf(), std::move(options));
+        m_read_ahead_stream = std::make_unique<std::istream>(m_read_ahead.get());
+        m_read_ahead_stream->exceptions(m_stream_ptr->exceptions());
+        m_stream_ptr = m_read_ahead_stream.get();
+    }
+
+    /** Decode a stream of blocks written through a CompressingSink.
+     *  Afterward all reads go through a DecompressingStreamBuf over the
+     *  stream's buffer, and the stream can no longer be seeked.
+     *
+     *  Combined with enable_read_ahead(), decompression runs on the
+     *  prefetch thread if it is enabled first, and the compressed data is
+     *  read ahead if it is enabled second. Has no effect if decompression
+     *  is already enabled.
+     */
+    void enable_decompression() {
+        if(m_decompressor) {
+            return;
+        }
+        m_decompressor =
+                std::make_unique<DecompressingStreamBuf>(m_stream_ptr->rdbuf());
+        m_decompressor_stream =
+                std::make_unique<std::istream>(m_decompressor.get());
+        m_decompressor_stream->exceptions(m_stream_ptr->exceptions());
+        m_stream_ptr = m_decompressor_stream.get();
+    }
+
+    /** Decode colors written by a StreamPacker with
+     *  StreamPacker::enable_run_length_coding(). Afterward all reads go
+     *  through a RunLengthStreamBuf over the stream's buffer, and the
+     *  stream can no longer be seeked. Has no effect if run-length decoding
+     *  is already enabled.
+     */
+    void enable_run_length_decoding() {
+        if(m_run_length) {
+            return;
+        }
+        m_run_length = std::make_unique<RunLengthStreamBuf>(
+                m_stream_ptr->rdbuf(), m_unpacker->packed_size());
+        m_run_length_stream =
+                std::make_unique<std::istream>(m_run_length.get());
+        m_run_length_stream->exceptions(m_stream_ptr->exceptions());
+        m_stream_ptr = m_run_length_stream.get();
+    }
+
     /// Equivalent to get_stream().good().
     bool good() const { return get_stream().good(); }
 
@@ -120,7 +276,7 @@ public:
     bool bad() const { return get_stream().bad(); }
 
     /// Get the internal std::istream instance.
-    std::istream& get_stream() { return *m_owned_stream; }
+    std::istream& get_stream() { return *m_stream_ptr; }
 
     /// Get the internal std::istream instance.
     const std::istream& get_stream() const { return *m_stream_ptr; }
@@ -134,15 +290,82 @@ public:
      */
     std::unique_ptr<std::istream> release_stream() {
         m_stream_ptr = nullptr;
+        m_read_ahead_stream.reset();
+        m_read_ahead.reset();
+        m_run_length_stream.reset();
+        m_run_length.reset();
+        m_decompressor_stream.reset();
+        m_decompressor.reset();
         return std::move(m_owned_stream);
     }
 
 private:
+    /// Number of colors read from the stream at a time by bulk unpacks.
+    static constexpr std::size_t block_colors = 4096;
+
+    template <typename OutIterator>
+    std::streamsize unpack_impl(
+            std::streamsize n, OutIterator& out, std::false_type) {
+        for(decltype(n) i = 0; i < n; ++i) {
+            // Passing *out to unpack_single does not work
+            // for insertion iterators.
+            auto color = Color();
+            unpack_single(color);
+            // Check before writing so a short read never touches
+            // the output range past the last unpacked color.
+            if(!good()) {
+                return i;
+            }
+            *out = color;
+            ++out;
+        }
+        return n;
+    }
+
+    /// Read whole blocks and unpack them straight into the output range.
+    template <typename OutIterator>
+    std::streamsize unpack_impl(
+            std::streamsize n, OutIterator& out, std::true_type) {
+        auto& stream = get_stream();
+        const auto color_size = m_unpacker->packed_size();
+        if(m_elem_buffer.size() < block_colors * color_size) {
+            m_elem_buffer.resize(block_colors * color_size);
+        }
+        std::streamsize count = 0;
+        while(count < n) {
+            const auto wanted = std::min<std::streamsize>(n - count,
+                    static_cast<std::streamsize>(block_colors));
+            stream.read(m_elem_buffer.data(), wanted * color_size);
+            // A trailing partial color is consumed but not unpacked, like
+            // a failed unpack_single().
+            const auto read = static_cast<std::streamsize>(
+                    stream.gcount() / color_size);
+            if(read > 0) {
+                m_unpacker->unpack_contiguous(
+                        m_elem_buffer.data(), read, details::to_address(out));
+                std::advance(out, read);
+                count += read;
+            }
+            if(read < wanted) {
+                break;
+            }
+        }
+        return count;
+    }
+
     std::unique_ptr<std::istream> m_owned_stream;
     std::unique_ptr<Unpacker<Color>> m_unpacker;
     std::istream* m_stream_ptr;
+    std::unique_ptr<DecompressingStreamBuf> m_decompressor;
+    std::unique_ptr<std::istream> m_decompressor_stream;
+    std::unique_ptr<RunLengthStreamBuf> m_run_length;
+    std::unique_ptr<std::istream> m_run_length_stream;
+    // Declared after the streams it may read from, so the prefetch thread
+    // is stopped before they are destroyed.
+    std::unique_ptr<ReadAheadStreamBuf> m_read_ahead;
+    std::unique_ptr<std::istream> m_read_ahead_stream;
 
-    std::vector<char> m_elem_buffer;
+    PmrVector<char> m_elem_buffer;
 };
 }
 
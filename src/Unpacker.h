@@ -6,8 +6,14 @@
 
 #include <cassert>
 #include <cstdint>
+#include <iterator>
+#include <type_traits>
 #include <vector>
 
+#include "Iterator_Util.h"
+#include "MemoryResource.h"
+#include "Parallel.h"
+
 namespace color {
 
 /** Base class for all Unpacker types.
@@ -29,6 +35,20 @@ public:
      */
     virtual const void* unpack_single(const void* src, Color& out) const = 0;
 
+    /** Unpack \a count colors from \a src into contiguous storage at
+     *  \a out. The default implementation calls unpack_single() for every
+     *  color. Subclasses override it with bulk implementations.
+     *  \returns A pointer to one byte after the read data in \a src.
+     */
+    virtual const void* unpack_contiguous(
+            const void* src, std::size_t count, Color* out) const {
+        for(std::size_t i = 0; i < count; ++i) {
+            out[i] = Color();
+            src = unpack_single(src, out[i]);
+        }
+        return src;
+    }
+
     /** Unpack colors from a buffer.
      *  \param src should point to the first element of the buffer and
      *  should be a multiple of Unpacker::packed_size() in length.
@@ -39,22 +59,23 @@ public:
      *  colors. \a out will be overwritten with an iterator to the element after
      *  the last inserted element.
      *
+     *  Output ranges in contiguous storage are filled with
+     *  unpack_contiguous().
+     *
      *  \returns A pointer to one byte after the read data in \a src.
      */
-    template <typename OutIterator>
+    template <typename OutIterator,
+            typename = std::enable_if_t<
+                    !details::is_allocator<std::decay_t<OutIterator>>::value>>
     const void* unpack(
             const void* src, std::size_t num_bytes, OutIterator&& out) {
         assert(num_bytes % packed_size() == 0 &&
                 "src must have a length that is a multiple of packed_size()");
-        auto last = reinterpret_cast<void*>(
-                reinterpret_cast<uintptr_t>(src) + num_bytes);
-        while(src != last) {
-            auto color = Color();
-            src = unpack_single(src, color);
-            *out = color;
-            ++out;
-        }
-        return src;
+        return unpack_impl(src,
+                num_bytes,
+                out,
+                details::is_contiguous_iterator<std::decay_t<OutIterator>,
+                        Color>());
     }
 
     /** Unpack colors from a buffer into an std::vector.
@@ -66,6 +87,98 @@ public:
         unpack(src, num_bytes, out.begin());
         return out;
     }
+
+    /** Unpack colors from a buffer into an std::vector allocating with
+     *  \a alloc, e.g. a PolymorphicAllocator over an ArenaResource.
+     */
+    template <typename Allocator,
+            typename =
+                    std::enable_if_t<details::is_allocator<Allocator>::value>>
+    std::vector<Color, Allocator> unpack(
+            const void* src, std::size_t num_bytes, const Allocator& alloc) {
+        std::vector<Color, Allocator> out(num_bytes / packed_size(), alloc);
+        unpack(src, num_bytes, out.data());
+        return out;
+    }
+
+    /** Unpack the colors in the \a num_bytes bytes at \a src into \a out
+     *  on \a num_threads threads, 0 for every hardware thread. Each thread
+     *  unpacks one contiguous part of the output. The parts match those of
+     *  first_touch() over the output on as many threads and run on the
+     *  same CPUs, so with HugePageResource and
+     *  HugePageOptions::first_touch every thread writes to memory on its
+     *  own NUMA node.
+     *  \returns A pointer to one byte after the read data in \a src.
+     */
+    const void* unpack_parallel(const void* src,
+            std::size_t num_bytes,
+            Color* out,
+            int num_threads = 0) const {
+        assert(num_bytes % packed_size() == 0 &&
+                "src must have a length that is a multiple of packed_size()");
+        const auto in = static_cast<const unsigned char*>(src);
+        const auto size = packed_size();
+        const auto count = num_bytes / size;
+        details::parallel_parts(count,
+                num_threads,
+                details::parallel_min_part(sizeof(Color)),
+                [&](std::uint64_t begin, std::uint64_t end) {
+                    unpack_contiguous(
+                            in + begin * size, end - begin, out + begin);
+                });
+        return in + num_bytes;
+    }
+
+    /** Unpack colors in parallel into an std::vector allocating with
+     *  \a alloc. Same as unpack_parallel(const void*, std::size_t, Color*,
+     *  int), but returns a vector holding the unpacked colors. The vector
+     *  is not value-initialized first, see UninitializedAllocator, so the
+     *  unpacking threads are the first to write each part of it.
+     */
+    template <typename Allocator,
+            typename =
+                    std::enable_if_t<details::is_allocator<Allocator>::value>>
+    std::vector<Color, UninitializedAllocator<Allocator>> unpack_parallel(
+            const void* src,
+            std::size_t num_bytes,
+            const Allocator& alloc,
+            int num_threads = 0) const {
+        std::vector<Color, UninitializedAllocator<Allocator>> out(
+                num_bytes / packed_size(), alloc);
+        unpack_parallel(src, num_bytes, out.data(), num_threads);
+        return out;
+    }
+
+private:
+    template <typename OutIterator>
+    const void* unpack_impl(const void* src,
+            std::size_t num_bytes,
+            OutIterator& out,
+            std::true_type) {
+        const auto count = num_bytes / packed_size();
+        if(count == 0) {
+            return src;
+        }
+        src = unpack_contiguous(src, count, details::to_address(out));
+        std::advance(out, count);
+        return src;
+    }
+
+    template <typename OutIterator>
+    const void* unpack_impl(const void* src,
+            std::size_t num_bytes,
+            OutIterator& out,
+            std::false_type) {
+        auto last = reinterpret_cast<void*>(
+                reinterpret_cast<uintptr_t>(src) + num_bytes);
+        while(src != last) {
+            auto color = Color();
+            src = unpack_single(src, color);
+            *out = color;
+            ++out;
+        }
+        return src;
+    }
 };
 }
 
@@ -0,0 +1,388 @@
+/** \file
+ *  Lazy, composable conversions over ranges of colors.
+ *
+ *  The adaptors in color::views build views that convert colors only
+ *  when they are read, so a chain of conversions needs no temporary array
+ *  per stage:
+ *
+ *      auto view = colors | views::as<Hsv>
+ *              | views::map([](Hsv<float> c) { ... })
+ *              | views::as<Rgb> | views::cast<uint8_t>;
+ *      packer.pack(view, out);
+ *
+ *  A view is read element by element through its iterators, or chunk by
+ *  chunk with for_each_chunk(), which converts view_chunk_colors colors
+ *  at a time into a buffer on the stack with the batch functions of
+ *  Batch.h. Packer::pack() and StreamPacker::pack() take views and read
+ *  them in chunks.
+ *
+ *  Views refer to the range they were made from and must not outlive it.
+ */
+#ifndef COLOR_VIEWS_H_
+#define COLOR_VIEWS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Batch.h"
+#include "ColorCast.h"
+#include "ColorSpan.h"
+#include "Hsi.h"
+#include "Hsl.h"
+#include "Hsv.h"
+#include "Iterator_Util.h"
+#include "Rgb.h"
+
+namespace color {
+
+/** Colors converted at a time by ColorView::for_each_chunk(). Every stage
+ *  of a chain that does not read straight from memory uses a buffer of
+ *  this many of its input colors on the stack.
+ */
+static constexpr std::size_t view_chunk_colors = 256;
+
+namespace details {
+
+/** Uninitialized storage for view_chunk_colors colors on the stack, so
+ *  chunks are not zeroed by the color constructors before every read.
+ *  Colors consist of nothing but their elements (see color_layout), so
+ *  the chunk is filled by assigning to its colors.
+ */
+template <typename Color>
+class ViewChunk {
+    static_assert(sizeof(color_layout<Color>) > 0,
+            "checks the layout of Color");
+
+public:
+    Color* data() { return reinterpret_cast<Color*>(m_bytes); }
+
+private:
+    alignas(Color) unsigned char m_bytes[view_chunk_colors * sizeof(Color)];
+};
+
+/** Iterates over a view by index, converting each color as it is read.
+ *  Dereferencing returns the color by value.
+ */
+template <typename View>
+class view_iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename View::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    view_iterator() = default;
+
+    view_iterator(const View* view, std::size_t index)
+        : m_view(view), m_index(index) {}
+
+    value_type operator*() const { return m_view->at(m_index); }
+
+    view_iterator& operator++() {
+        ++m_index;
+        return *this;
+    }
+
+    view_iterator operator++(int) {
+        auto old = *this;
+        ++m_index;
+        return old;
+    }
+
+    bool operator==(const view_iterator& rhs) const {
+        return m_index == rhs.m_index;
+    }
+
+    bool operator!=(const view_iterator& rhs) const { return !(*this == rhs); }
+
+private:
+    const View* m_view = nullptr;
+    std::size_t m_index = 0;
+};
+}
+
+/** Base of all views, which provides iteration and chunked reads.
+ *
+ *  \a Derived implements `std::size_t size()`, `Color at(std::size_t)`,
+ *  `read(std::size_t first, std::size_t count, Color* out)` for up to
+ *  view_chunk_colors colors and `const Color* data()`, which returns the
+ *  colors in memory, or nullptr if they are computed.
+ */
+template <typename Derived, typename Color>
+class ColorView {
+public:
+    using value_type = Color;
+    using iterator = details::view_iterator<Derived>;
+    /// Marks views for Packer::pack() and StreamPacker::pack().
+    using color_view_tag = void;
+
+    iterator begin() const { return iterator(&derived(), 0); }
+
+    iterator end() const { return iterator(&derived(), derived().size()); }
+
+    bool empty() const { return derived().size() == 0; }
+
+    /** Call `fn(const Color* colors, std::size_t count)` for consecutive
+     *  chunks of the colors of the view, in order.
+     */
+    template <typename Fn>
+    void for_each_chunk(Fn&& fn) const {
+        const auto size = derived().size();
+        if(size == 0) {
+            return;
+        }
+        if(const Color* colors = derived().data()) {
+            fn(colors, size);
+            return;
+        }
+        details::ViewChunk<Color> chunk;
+        for(std::size_t first = 0; first < size; first += view_chunk_colors) {
+            const auto count = std::min(size - first, view_chunk_colors);
+            derived().read(first, count, chunk.data());
+            fn(static_cast<const Color*>(chunk.data()), count);
+        }
+    }
+
+    /// Convert every color of the view into a vector.
+    std::vector<Color> to_vector() const {
+        auto out = std::vector<Color>(derived().size());
+        auto next = out.data();
+        for_each_chunk([&](const Color* colors, std::size_t count) {
+            next = std::copy(colors, colors + count, next);
+        });
+        return out;
+    }
+
+private:
+    const Derived& derived() const {
+        return static_cast<const Derived&>(*this);
+    }
+};
+
+/// A view of colors in memory, the start of every chain of views.
+template <typename Color>
+class SpanView : public ColorView<SpanView<Color>, Color> {
+public:
+    SpanView(const Color* data, std::size_t size)
+        : m_data(data), m_size(size) {}
+
+    std::size_t size() const { return m_size; }
+
+    Color at(std::size_t index) const { return m_data[index]; }
+
+    void read(std::size_t first, std::size_t count, Color* out) const {
+        std::copy(m_data + first, m_data + first + count, out);
+    }
+
+    const Color* data() const { return m_data; }
+
+private:
+    const Color* m_data;
+    std::size_t m_size;
+};
+
+/** A view that converts the colors of \a Base with \a Op, which provides
+ *  `one(const In&)` for a single color and `many(const In*, std::size_t,
+ *  Out*)` for a chunk.
+ */
+template <typename Base, typename Op>
+class TransformView
+        : public ColorView<TransformView<Base, Op>,
+                  std::decay_t<decltype(std::declval<const Op&>().one(
+                          std::declval<const typename Base::value_type&>()))>> {
+public:
+    using In = typename Base::value_type;
+    using Out = std::decay_t<decltype(
+            std::declval<const Op&>().one(std::declval<const In&>()))>;
+
+    TransformView(Base base, Op op)
+        : m_base(std::move(base)), m_op(std::move(op)) {}
+
+    std::size_t size() const { return m_base.size(); }
+
+    Out at(std::size_t index) const { return m_op.one(m_base.at(index)); }
+
+    void read(std::size_t first, std::size_t count, Out* out) const {
+        if(const In* in = m_base.data()) {
+            m_op.many(in + first, count, out);
+            return;
+        }
+        color::details::ViewChunk<In> chunk;
+        m_base.read(first, count, chunk.data());
+        m_op.many(static_cast<const In*>(chunk.data()), count, out);
+    }
+
+    const Out* data() const { return nullptr; }
+
+    const Base& base() const { return m_base; }
+
+private:
+    Base m_base;
+    Op m_op;
+};
+
+namespace views {
+namespace details {
+
+template <template <typename> class To>
+struct as_op;
+
+template <>
+struct as_op<Hsv> {
+    template <typename In>
+    auto one(const In& color) const {
+        return to_hsv(color);
+    }
+
+    template <typename In, typename Out>
+    void many(const In* in, std::size_t count, Out* out) const {
+        batch::to_hsv(in, count, out);
+    }
+};
+
+template <>
+struct as_op<Hsl> {
+    template <typename In>
+    auto one(const In& color) const {
+        return to_hsl(color);
+    }
+
+    template <typename In, typename Out>
+    void many(const In* in, std::size_t count, Out* out) const {
+        batch::to_hsl(in, count, out);
+    }
+};
+
+template <>
+struct as_op<Hsi> {
+    template <typename In>
+    auto one(const In& color) const {
+        return to_hsi(color);
+    }
+
+    template <typename In, typename Out>
+    void many(const In* in, std::size_t count, Out* out) const {
+        batch::to_hsi(in, count, out);
+    }
+};
+
+template <>
+struct as_op<Rgb> {
+    template <typename In>
+    auto one(const In& color) const {
+        return to_rgb(color);
+    }
+
+    template <typename In, typename Out>
+    void many(const In* in, std::size_t count, Out* out) const {
+        batch::to_rgb(in, count, out);
+    }
+};
+
+template <typename To>
+struct cast_op {
+    template <typename In>
+    auto one(const In& color) const {
+        return color_cast<To>(color);
+    }
+
+    template <typename In, typename Out>
+    void many(const In* in, std::size_t count, Out* out) const {
+        batch::color_cast<To>(in, count, out);
+    }
+};
+
+template <typename Fn>
+struct map_op {
+    Fn fn;
+
+    template <typename In>
+    auto one(const In& color) const {
+        return fn(color);
+    }
+
+    template <typename In, typename Out>
+    void many(const In* in, std::size_t count, Out* out) const {
+        for(std::size_t i = 0; i < count; ++i) {
+            out[i] = fn(in[i]);
+        }
+    }
+};
+
+}
+
+/** A conversion waiting to be applied to a range with `|`, as returned by
+ *  as, cast and map().
+ */
+template <typename Op>
+struct Adaptor {
+    Op op;
+};
+
+/** Adaptor converting colors to the color model \a To, e.g. `as<Hsv>`,
+ *  with to_hsv(), to_hsl(), to_hsi() or to_rgb().
+ */
+template <template <typename> class To>
+constexpr Adaptor<details::as_op<To>> as{};
+
+/// Adaptor casting the elements of colors to \a To with color_cast().
+template <typename To>
+constexpr Adaptor<details::cast_op<To>> cast{};
+
+/** Adaptor applying \a fn to every color. \a fn is called for every
+ *  color of every chunk read, so it should be cheap to copy and free of
+ *  side effects.
+ */
+template <typename Fn>
+Adaptor<details::map_op<std::decay_t<Fn>>> map(Fn&& fn) {
+    return {details::map_op<std::decay_t<Fn>>{std::forward<Fn>(fn)}};
+}
+
+/// View the colors of a ColorSpan.
+template <typename Color>
+SpanView<std::remove_cv_t<Color>> all(ColorSpan<Color> colors) {
+    return SpanView<std::remove_cv_t<Color>>(colors.data(), colors.size());
+}
+
+/// View the colors of a vector. The view must not outlive \a colors.
+template <typename Color>
+SpanView<Color> all(const std::vector<Color>& colors) {
+    return SpanView<Color>(colors.data(), colors.size());
+}
+
+template <typename Color>
+SpanView<Color> all(const std::vector<Color>&& colors) = delete;
+
+/// Apply an adaptor to a view.
+template <typename View,
+        typename Op,
+        typename = std::enable_if_t<
+                color::details::is_color_view<View>::value>>
+TransformView<View, Op> operator|(View view, const Adaptor<Op>& a) {
+    return TransformView<View, Op>(std::move(view), a.op);
+}
+
+/// Apply an adaptor to the colors of a vector.
+template <typename Color, typename Op>
+auto operator|(const std::vector<Color>& colors, const Adaptor<Op>& a) {
+    return all(colors) | a;
+}
+
+template <typename Color, typename Op>
+auto operator|(const std::vector<Color>&& colors,
+        const Adaptor<Op>& a) = delete;
+
+/// Apply an adaptor to the colors of a ColorSpan.
+template <typename Color, typename Op>
+auto operator|(ColorSpan<Color> colors, const Adaptor<Op>& a) {
+    return all(colors) | a;
+}
+}
+}
+
+#endif
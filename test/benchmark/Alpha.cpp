@@ -0,0 +1,47 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Alpha.h"
+
+using namespace color;
+
+template <typename T>
+static void BM_alpha_blend(benchmark::State& state) {
+    const auto src = bench::inputs<Rgba<T>>(state);
+    auto dest = src;
+    std::reverse(dest.begin(), dest.end());
+    auto output = std::vector<Rgba<T>>(src.size());
+
+    for(auto _ : state) {
+        for(std::size_t i = 0; i < src.size(); ++i) {
+            output[i] = alpha_blend(src[i], dest[i]);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Rgba<T>));
+}
+
+template <typename T>
+static void BM_alpha_blend_opaque(benchmark::State& state) {
+    const auto src = bench::inputs<Rgba<T>>(state);
+    auto dest = bench::inputs<Rgb<T>>(state);
+    std::reverse(dest.begin(), dest.end());
+    auto output = std::vector<Rgba<T>>(src.size());
+
+    for(auto _ : state) {
+        for(std::size_t i = 0; i < src.size(); ++i) {
+            output[i] = alpha_blend(src[i], dest[i]);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Rgba<T>));
+}
+
+BENCHMARK_TEMPLATE(BM_alpha_blend, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_alpha_blend, uint16_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_alpha_blend, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_alpha_blend, double)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_alpha_blend_opaque, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_alpha_blend_opaque, float)->COLOR_CORPUS_ARGS();
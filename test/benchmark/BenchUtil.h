@@ -0,0 +1,62 @@
+#ifndef BENCHUTIL_H_
+#define BENCHUTIL_H_
+
+#include "benchmark/benchmark.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "Corpus.h"
+
+namespace bench {
+
+/// Batch sizes (in colors) exercised by each benchmark.
+static constexpr std::array<int, 3> BATCH_SIZES = {{64, 4096, 32768}};
+
+/** Benchmark arguments: every batch size over every corpus.
+ *  `state.range(0)` is the batch size and `state.range(1)` the Corpus.
+ */
+inline void corpus_args(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"batch", "corpus"});
+    for(int corpus = 0; corpus < NUM_CORPORA; ++corpus) {
+        for(auto n : BATCH_SIZES) {
+            b->Args({n, corpus});
+        }
+    }
+}
+
+/// Corpus selected by a benchmark registered with corpus_args().
+inline Corpus corpus(const benchmark::State& state) {
+    return static_cast<Corpus>(state.range(1));
+}
+
+/** Return the inputs for a benchmark registered with corpus_args() and
+ *  label the run with the corpus name.
+ */
+template <typename Color>
+inline std::vector<Color> inputs(benchmark::State& state) {
+    state.SetLabel(corpus_name(corpus(state)));
+    return corpus_colors<Color>(corpus(state), state.range(0));
+}
+
+/** Report colors/s and bytes/s for a benchmark that processed
+ *  `state.range(0)` colors of \a bytes_per_color bytes each per iteration.
+ */
+inline void set_throughput(
+        benchmark::State& state, std::size_t bytes_per_color) {
+    const auto colors = state.iterations() * state.range(0);
+    state.SetItemsProcessed(colors);
+    state.SetBytesProcessed(colors * bytes_per_color);
+}
+
+/// Path to a scratch file inside the benchmark data directory.
+inline std::string data_path(const std::string& name) {
+    return std::string(BENCHMARK_DATA_DIR) + "/" + name;
+}
+}
+
+/// Register a benchmark over every batch size and corpus.
+#define COLOR_CORPUS_ARGS() Apply(bench::corpus_args)
+
+#endif
@@ -0,0 +1,73 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "BlockCodec.h"
+#include "FlatColorPacker.h"
+
+using namespace color;
+
+// Back ends exercised by the codec benchmarks, selected by
+// `state.range(2)`.
+static const std::vector<BlockCodecMethod> METHODS = {
+        BlockCodecMethod::Rle, BlockCodecMethod::Lz};
+
+static void codec_args(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"batch", "corpus", "method"});
+    for(int corpus = 0; corpus < bench::NUM_CORPORA; ++corpus) {
+        for(int method = 0; method < int(METHODS.size()); ++method) {
+            b->Args({bench::BATCH_SIZES.back(), corpus, method});
+        }
+    }
+}
+
+/// Packed colors of the benchmark's corpus and the codec options for them.
+template <typename T>
+static std::vector<char> packed_input(
+        benchmark::State& state, BlockCodecOptions& options) {
+    using ColorType = Rgb<T>;
+    const auto colors = bench::inputs<ColorType>(state);
+    const auto packer = FlatColorPacker<ColorType>({0, 1, 2});
+    auto packed = std::vector<char>(packer.packed_size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), packed.data());
+    options.stride = packer.packed_size();
+    options.element_size = sizeof(T);
+    options.method = METHODS[state.range(2)];
+    return packed;
+}
+
+template <typename T>
+static void BM_block_compress(benchmark::State& state) {
+    auto options = BlockCodecOptions();
+    const auto packed = packed_input<T>(state, options);
+    std::size_t compressed_size = 0;
+
+    for(auto _ : state) {
+        const auto compressed =
+                compress_blocks(packed.data(), packed.size(), options);
+        compressed_size = compressed.size();
+        benchmark::DoNotOptimize(compressed.data());
+    }
+    bench::set_throughput(state, options.stride);
+    state.counters["ratio"] = double(packed.size()) / compressed_size;
+}
+
+template <typename T>
+static void BM_block_decompress(benchmark::State& state) {
+    auto options = BlockCodecOptions();
+    const auto packed = packed_input<T>(state, options);
+    const auto compressed =
+            compress_blocks(packed.data(), packed.size(), options);
+
+    for(auto _ : state) {
+        const auto raw =
+                decompress_blocks(compressed.data(), compressed.size(), 1);
+        benchmark::DoNotOptimize(raw.data());
+    }
+    bench::set_throughput(state, options.stride);
+    state.counters["ratio"] = double(packed.size()) / compressed.size();
+}
+
+BENCHMARK_TEMPLATE(BM_block_compress, uint8_t)->Apply(codec_args);
+BENCHMARK_TEMPLATE(BM_block_compress, float)->Apply(codec_args);
+BENCHMARK_TEMPLATE(BM_block_decompress, uint8_t)->Apply(codec_args);
+BENCHMARK_TEMPLATE(BM_block_decompress, float)->Apply(codec_args);
@@ -0,0 +1,54 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "Hsv.h"
+#include "ColorCast.h"
+#include "Batch.h"
+
+using namespace color;
+
+template <typename FromColor, typename To>
+static void BM_color_cast(benchmark::State& state) {
+    const auto input = bench::inputs<FromColor>(state);
+    auto output = std::vector<decltype(color_cast<To>(input[0]))>(input.size());
+
+    for(auto _ : state) {
+        for(std::size_t i = 0; i < input.size(); ++i) {
+            output[i] = color_cast<To>(input[i]);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(FromColor));
+}
+
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<uint8_t>, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<uint8_t>, uint16_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<uint16_t>, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<uint16_t>, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<float>, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<float>, uint16_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<float>, double)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgb<double>, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgba<uint8_t>, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Rgba<float>, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Hsv<uint8_t>, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_color_cast, Hsv<float>, uint8_t)->COLOR_CORPUS_ARGS();
+
+// Cost of the clip telemetry pass relative to the cast itself.
+template <typename FromColor, typename To>
+static void BM_count_cast_loss(benchmark::State& state) {
+    const auto input = bench::inputs<FromColor>(state);
+
+    for(auto _ : state) {
+        auto counts = batch::count_cast_loss<To>(input.data(), input.size());
+        benchmark::DoNotOptimize(counts);
+    }
+    bench::set_throughput(state, sizeof(FromColor));
+}
+
+BENCHMARK_TEMPLATE(BM_count_cast_loss, Rgb<float>, uint8_t)
+        ->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_count_cast_loss, Rgb<uint16_t>, uint8_t)
+        ->COLOR_CORPUS_ARGS();
@@ -0,0 +1,103 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Hsv.h"
+#include "Hsl.h"
+#include "Hsi.h"
+#include "Batch.h"
+
+using namespace color;
+
+template <typename From, typename To, typename Fn>
+static void run_conversion(benchmark::State& state, const Fn& convert) {
+    const auto input = bench::inputs<From>(state);
+    auto output = std::vector<To>(input.size());
+
+    for(auto _ : state) {
+        for(std::size_t i = 0; i < input.size(); ++i) {
+            output[i] = convert(input[i]);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(From));
+}
+
+template <typename T>
+static void BM_to_hsv(benchmark::State& state) {
+    run_conversion<Rgb<T>, Hsv<T>>(
+            state, [](const Rgb<T>& c) { return to_hsv(c); });
+}
+
+template <typename T>
+static void BM_to_hsl(benchmark::State& state) {
+    run_conversion<Rgb<T>, Hsl<T>>(
+            state, [](const Rgb<T>& c) { return to_hsl(c); });
+}
+
+template <typename T>
+static void BM_to_hsi(benchmark::State& state) {
+    run_conversion<Rgb<T>, Hsi<T>>(
+            state, [](const Rgb<T>& c) { return to_hsi(c); });
+}
+
+template <typename T>
+static void BM_hsv_to_rgb(benchmark::State& state) {
+    run_conversion<Hsv<T>, Rgb<T>>(
+            state, [](const Hsv<T>& c) { return to_rgb(c); });
+}
+
+template <typename T>
+static void BM_hsl_to_rgb(benchmark::State& state) {
+    run_conversion<Hsl<T>, Rgb<T>>(
+            state, [](const Hsl<T>& c) { return to_rgb(c); });
+}
+
+template <typename T>
+static void BM_hsi_to_rgb(benchmark::State& state) {
+    run_conversion<Hsi<T>, Rgb<T>>(
+            state, [](const Hsi<T>& c) { return to_rgb(c); });
+}
+
+// The same conversions through the runtime dispatched batch kernels.
+template <typename From, typename To, typename Fn>
+static void run_batch_conversion(benchmark::State& state, const Fn& convert) {
+    const auto input = bench::inputs<From>(state);
+    auto output = std::vector<To>(input.size());
+
+    for(auto _ : state) {
+        convert(input.data(), input.size(), output.data());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(From));
+}
+
+template <typename T>
+static void BM_batch_to_hsv(benchmark::State& state) {
+    run_batch_conversion<Rgb<T>, Hsv<T>>(state, batch::to_hsv<Rgb<T>>);
+}
+
+template <typename T>
+static void BM_batch_hsv_to_rgb(benchmark::State& state) {
+    run_batch_conversion<Hsv<T>, Rgb<T>>(state, batch::to_rgb<Hsv<T>>);
+}
+
+#define COLOR_CONVERSION_BENCHMARK(name)                                       \
+    BENCHMARK_TEMPLATE(name, uint8_t)->COLOR_CORPUS_ARGS();                    \
+    BENCHMARK_TEMPLATE(name, uint16_t)->COLOR_CORPUS_ARGS();                   \
+    BENCHMARK_TEMPLATE(name, float)->COLOR_CORPUS_ARGS();                      \
+    BENCHMARK_TEMPLATE(name, double)->COLOR_CORPUS_ARGS()
+
+COLOR_CONVERSION_BENCHMARK(BM_to_hsv);
+COLOR_CONVERSION_BENCHMARK(BM_to_hsl);
+COLOR_CONVERSION_BENCHMARK(BM_to_hsi);
+COLOR_CONVERSION_BENCHMARK(BM_hsv_to_rgb);
+COLOR_CONVERSION_BENCHMARK(BM_hsl_to_rgb);
+
+// Hsi -> Rgb is only defined for floating point channels.
+BENCHMARK_TEMPLATE(BM_hsi_to_rgb, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_hsi_to_rgb, double)->COLOR_CORPUS_ARGS();
+
+COLOR_CONVERSION_BENCHMARK(BM_batch_to_hsv);
+COLOR_CONVERSION_BENCHMARK(BM_batch_hsv_to_rgb);
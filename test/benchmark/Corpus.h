@@ -0,0 +1,291 @@
+#ifndef CORPUS_H_
+#define CORPUS_H_
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "Hsv.h"
+#include "Hsl.h"
+#include "Hsi.h"
+#include "ColorCast.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "StreamPacker.h"
+#include "StreamUnpacker.h"
+
+namespace bench {
+
+/** Synthetic image distributions used as benchmark inputs.
+ *  Uniform noise makes every branch in the conversions equally likely,
+ *  which real images never do, so all benchmarks run over these instead.
+ */
+enum class Corpus {
+    /// Smooth horizontal, vertical and diagonal ramps.
+    Gradient,
+    /// Multi-octave value noise mapped to muted, natural-looking colors.
+    FractalNoise,
+    /// Flat rectangles from a small palette with thin text-like lines.
+    FlatUi,
+    /// Fully saturated hues with hard edges, like charts and sprites.
+    HighSaturation,
+    /// Fractal noise with equal channels.
+    Grayscale,
+};
+
+static constexpr int NUM_CORPORA = 5;
+
+/// Width and height of every generated image. Large enough for MAX_BATCH.
+static constexpr int CORPUS_WIDTH = 256;
+static constexpr int CORPUS_HEIGHT = 256;
+
+/// Bump when a generator changes so stale cache files are not reused.
+static constexpr int CORPUS_VERSION = 1;
+
+inline const char* corpus_name(Corpus corpus) {
+    switch(corpus) {
+    case Corpus::Gradient:
+        return "gradient";
+    case Corpus::FractalNoise:
+        return "fractal_noise";
+    case Corpus::FlatUi:
+        return "flat_ui";
+    case Corpus::HighSaturation:
+        return "high_saturation";
+    case Corpus::Grayscale:
+        return "grayscale";
+    }
+    return "unknown";
+}
+
+namespace details {
+
+// The generators only use integer hashing and basic float arithmetic so
+// the images are identical across standard libraries and platforms.
+
+inline std::uint32_t hash(std::uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+inline std::uint32_t hash(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+    return hash(x ^ hash(y ^ hash(z)));
+}
+
+/// Hash to a float in `[0, 1)`.
+inline float hash_unit(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+    return (hash(x, y, z) >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float smoothstep(float t) { return t * t * (3.0f - 2.0f * t); }
+
+/// Bilinearly interpolated lattice noise in `[0, 1)`.
+inline float value_noise(float x, float y, std::uint32_t seed) {
+    const auto x0 = static_cast<std::uint32_t>(x);
+    const auto y0 = static_cast<std::uint32_t>(y);
+    const auto tx = smoothstep(x - x0);
+    const auto ty = smoothstep(y - y0);
+    const auto top = hash_unit(x0, y0, seed) * (1.0f - tx) +
+            hash_unit(x0 + 1, y0, seed) * tx;
+    const auto bottom = hash_unit(x0, y0 + 1, seed) * (1.0f - tx) +
+            hash_unit(x0 + 1, y0 + 1, seed) * tx;
+    return top * (1.0f - ty) + bottom * ty;
+}
+
+/// Fractal Brownian motion: octaves of value noise with halving amplitude.
+inline float fbm(float x, float y, std::uint32_t seed, int octaves = 5) {
+    auto sum = 0.0f;
+    auto amplitude = 0.5f;
+    auto norm = 0.0f;
+    for(int i = 0; i < octaves; ++i) {
+        sum += amplitude * value_noise(x, y, seed + i);
+        norm += amplitude;
+        x *= 2.0f;
+        y *= 2.0f;
+        amplitude *= 0.5f;
+    }
+    return sum / norm;
+}
+
+inline color::Rgb<float> gradient_pixel(int x, int y) {
+    const auto u = float(x) / (CORPUS_WIDTH - 1);
+    const auto v = float(y) / (CORPUS_HEIGHT - 1);
+    return color::Rgb<float>(u, v, 0.5f * (1.0f - u) + 0.5f * v);
+}
+
+inline color::Rgb<float> fractal_pixel(int x, int y) {
+    const auto scale = 1.0f / 32.0f;
+    const auto lum = fbm(x * scale, y * scale, 11);
+    const auto hue = fbm(x * scale * 0.5f, y * scale * 0.5f, 23, 3);
+    const auto sat = 0.15f + 0.35f * fbm(x * scale, y * scale, 37, 2);
+    return color::to_rgb(color::Hsv<float>(hue, sat, lum));
+}
+
+inline color::Rgb<float> flat_ui_pixel(int x, int y) {
+    static const std::array<color::Rgb<float>, 6> palette = {{
+            {0.96f, 0.96f, 0.96f},
+            {1.0f, 1.0f, 1.0f},
+            {0.2f, 0.4f, 0.8f},
+            {0.85f, 0.85f, 0.88f},
+            {0.13f, 0.13f, 0.13f},
+            {0.9f, 0.3f, 0.25f},
+    }};
+    // Panels on a 64x32 grid, with one of a few palette colors each.
+    const auto panel = hash(x / 64, y / 32, 1);
+    auto color = palette[panel % 3 == 0 ? 0 : 1 + (panel >> 4) % 3];
+    // Sparse one pixel "text" lines inside some panels.
+    const bool in_text_row = (y % 32) > 8 && (y % 32) < 24 && (y % 4) == 0;
+    if(in_text_row && (panel & 1) && (hash(x / 6, y, 2) & 3) != 0) {
+        color = palette[4];
+    }
+    // Rare accent elements such as badges and buttons.
+    if((hash(x / 16, y / 16, 3) & 63) == 0) {
+        color = palette[5];
+    }
+    return color;
+}
+
+inline color::Rgb<float> high_saturation_pixel(int x, int y) {
+    // Hard edged shapes with a hue from a coarse noise field.
+    const auto cell = hash(x / 24, y / 24, 4);
+    const auto hue = (cell & 0xff) / 256.0f;
+    const auto value = 0.8f + 0.2f * ((cell >> 8) & 1);
+    return color::to_rgb(color::Hsv<float>(hue, 1.0f, value));
+}
+
+inline color::Rgb<float> grayscale_pixel(int x, int y) {
+    const auto lum = fbm(x / 32.0f, y / 32.0f, 53);
+    return color::Rgb<float>::broadcast(lum);
+}
+
+inline std::vector<color::Rgb<float>> generate_corpus(Corpus corpus) {
+    auto out = std::vector<color::Rgb<float>>();
+    out.reserve(CORPUS_WIDTH * CORPUS_HEIGHT);
+    for(int y = 0; y < CORPUS_HEIGHT; ++y) {
+        for(int x = 0; x < CORPUS_WIDTH; ++x) {
+            switch(corpus) {
+            case Corpus::Gradient:
+                out.push_back(gradient_pixel(x, y));
+                break;
+            case Corpus::FractalNoise:
+                out.push_back(fractal_pixel(x, y));
+                break;
+            case Corpus::FlatUi:
+                out.push_back(flat_ui_pixel(x, y));
+                break;
+            case Corpus::HighSaturation:
+                out.push_back(high_saturation_pixel(x, y));
+                break;
+            case Corpus::Grayscale:
+                out.push_back(grayscale_pixel(x, y));
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+inline std::string corpus_path(Corpus corpus) {
+    return std::string(BENCHMARK_DATA_DIR) + "/corpus_" +
+            corpus_name(corpus) + "_" + std::to_string(CORPUS_WIDTH) + "x" +
+            std::to_string(CORPUS_HEIGHT) + "_v" +
+            std::to_string(CORPUS_VERSION) + ".rgbf";
+}
+
+/** Load a corpus image from the benchmark data cache, generating and
+ *  writing it first if it is missing or truncated.
+ */
+inline std::vector<color::Rgb<float>> load_corpus(Corpus corpus) {
+    using ColorType = color::Rgb<float>;
+    const auto format = std::vector<int>{0, 1, 2};
+    const auto path = corpus_path(corpus);
+    const auto num_pixels = std::size_t(CORPUS_WIDTH) * CORPUS_HEIGHT;
+
+    {
+        auto unpacker = color::StreamUnpacker<ColorType>(
+                std::make_unique<std::ifstream>(path, std::ios::binary),
+                std::make_unique<color::FlatColorUnpacker<ColorType>>(format));
+        auto cached = unpacker.unpack_all();
+        if(cached.size() == num_pixels) {
+            return cached;
+        }
+    }
+
+    auto image = generate_corpus(corpus);
+    auto packer = color::StreamPacker<ColorType>(
+            std::make_unique<std::ofstream>(path, std::ios::binary),
+            std::make_unique<color::FlatColorPacker<ColorType>>(format));
+    packer.pack(image.begin(), image.end());
+    return image;
+}
+
+// Derive benchmark inputs of any color type from a corpus pixel.
+
+template <typename T>
+inline void from_corpus(const color::Rgb<float>& rgb, color::Rgb<T>& out) {
+    out = color::color_cast<T>(rgb);
+}
+
+template <typename T>
+inline void from_corpus(const color::Rgb<float>& rgb, color::Hsv<T>& out) {
+    out = color::color_cast<T>(color::to_hsv(rgb));
+}
+
+template <typename T>
+inline void from_corpus(const color::Rgb<float>& rgb, color::Hsl<T>& out) {
+    out = color::color_cast<T>(color::to_hsl(rgb));
+}
+
+template <typename T>
+inline void from_corpus(const color::Rgb<float>& rgb, color::Hsi<T>& out) {
+    out = color::color_cast<T>(color::to_hsi(rgb));
+}
+
+// Alpha follows the luminance of the image, so opaque, transparent and
+// partially transparent pixels all appear in coherent regions.
+template <typename T, template <typename> class Inner>
+inline void from_corpus(
+        const color::Rgb<float>& rgb, color::Alpha<T, Inner>& out) {
+    from_corpus(rgb, out.color());
+    const auto alpha = color::BoundedChannel<float>(
+            0.25f * rgb.red() + 0.5f * rgb.green() + 0.25f * rgb.blue());
+    out.alpha_channel() =
+            color::BoundedChannel<T>::from_float_channel(alpha.normalize());
+}
+}
+
+/// Return a corpus image, loading it at most once per process.
+inline const std::vector<color::Rgb<float>>& corpus_image(Corpus corpus) {
+    static std::array<std::vector<color::Rgb<float>>, NUM_CORPORA> images;
+    auto& image = images[static_cast<int>(corpus)];
+    if(image.empty()) {
+        image = details::load_corpus(corpus);
+    }
+    return image;
+}
+
+/** Return the first \a n pixels of a corpus image as colors of type Color.
+ *  \a n must not exceed `CORPUS_WIDTH * CORPUS_HEIGHT`.
+ */
+template <typename Color>
+inline std::vector<Color> corpus_colors(Corpus corpus, std::size_t n) {
+    const auto& image = corpus_image(corpus);
+    auto out = std::vector<Color>(n);
+    for(std::size_t i = 0; i < n; ++i) {
+        details::from_corpus(image[i], out[i]);
+    }
+    return out;
+}
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Expressions.h"
+
+using namespace color;
+
+/// `((a * k + b.inverse()).normalize().lerp(b, t)).clamp(lo, hi)`, one
+/// pass over the buffer per operation.
+static void BM_compose_passes(benchmark::State& state) {
+    const auto a = bench::inputs<Rgb<float>>(state);
+    const auto b = std::vector<Rgb<float>>(a.rbegin(), a.rend());
+    const auto n = a.size();
+    auto out = std::vector<Rgb<float>>(n);
+    auto tmp = std::vector<Rgb<float>>(n);
+
+    for(auto _ : state) {
+        for(std::size_t i = 0; i < n; ++i) {
+            out[i] = a[i] * 0.8f;
+        }
+        for(std::size_t i = 0; i < n; ++i) {
+            tmp[i] = b[i].inverse();
+        }
+        for(std::size_t i = 0; i < n; ++i) {
+            out[i] += tmp[i];
+        }
+        for(std::size_t i = 0; i < n; ++i) {
+            out[i] = out[i].normalize();
+        }
+        for(std::size_t i = 0; i < n; ++i) {
+            out[i] = out[i].lerp(b[i], 0.25f);
+        }
+        for(std::size_t i = 0; i < n; ++i) {
+            out[i] = out[i].clamp(0.05f, 0.95f);
+        }
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Rgb<float>));
+}
+
+/// The same formula as a single expression.
+static void BM_compose_expression(benchmark::State& state) {
+    const auto a = bench::inputs<Rgb<float>>(state);
+    const auto b = std::vector<Rgb<float>>(a.rbegin(), a.rend());
+    auto out = std::vector<Rgb<float>>(a.size());
+
+    for(auto _ : state) {
+        const auto ea = expr::buffer(a);
+        const auto eb = expr::buffer(b);
+        ((ea * 0.8f + eb.inverse()).normalize().lerp(eb, 0.25f))
+                .clamp(0.05f, 0.95f)
+                .eval(out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Rgb<float>));
+}
+
+BENCHMARK(BM_compose_passes)->COLOR_CORPUS_ARGS();
+BENCHMARK(BM_compose_expression)->COLOR_CORPUS_ARGS();
@@ -0,0 +1,53 @@
+#include "BenchUtil.h"
+
+#include <sstream>
+
+#include "Rgb.h"
+#include "Netpbm.h"
+
+using namespace color;
+
+/// The benchmark's corpus as an image file held in memory.
+template <typename T>
+static std::string image_file(benchmark::State& state) {
+    auto image = Image<Rgb<T>>();
+    image.pixels = bench::inputs<Rgb<T>>(state);
+    image.width = image.pixels.size();
+    image.height = 1;
+    std::stringstream stream;
+    write_netpbm(stream, image);
+    return stream.str();
+}
+
+template <typename T>
+static void BM_netpbm_read(benchmark::State& state) {
+    const auto file = image_file<T>(state);
+    auto pixels = std::vector<Rgb<T>>(state.range(0));
+
+    for(auto _ : state) {
+        std::stringstream stream(file);
+        const auto header = read_netpbm_header(stream);
+        read_netpbm_pixels(stream, header, pixels.data());
+        benchmark::DoNotOptimize(pixels.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Rgb<T>));
+}
+
+template <typename T>
+static void BM_netpbm_write(benchmark::State& state) {
+    const auto pixels = bench::inputs<Rgb<T>>(state);
+    std::stringstream stream;
+
+    for(auto _ : state) {
+        stream.seekp(0);
+        write_netpbm(stream, pixels.data(), pixels.size(), 1);
+        benchmark::DoNotOptimize(stream.tellp());
+    }
+    bench::set_throughput(state, sizeof(Rgb<T>));
+}
+
+BENCHMARK_TEMPLATE(BM_netpbm_read, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_netpbm_read, uint16_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_netpbm_read, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_netpbm_write, uint16_t)->COLOR_CORPUS_ARGS();
@@ -0,0 +1,263 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "HugePageResource.h"
+#include "MemoryResource.h"
+#include "PackingIterator.h"
+
+#include <numeric>
+
+using namespace color;
+
+// Packing formats exercised by the packer benchmarks, selected by
+// `state.range(2)`.
+static const std::vector<std::vector<int>> RGB_FORMATS = {
+        {0, 1, 2}, {2, 1, 0}, {packer_index_skip, 0, 1, 2}};
+
+template <typename T>
+static void BM_flat_pack(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    const auto packer = FlatColorPacker<ColorType>(RGB_FORMATS[state.range(2)]);
+    auto output = std::vector<char>(packer.packed_size() * input.size());
+
+    for(auto _ : state) {
+        packer.pack(input.begin(), input.end(), output.data());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, packer.packed_size());
+}
+
+template <typename T>
+static void BM_flat_unpack(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto colors = bench::inputs<ColorType>(state);
+    const auto& format = RGB_FORMATS[state.range(2)];
+    const auto packer = FlatColorPacker<ColorType>(format);
+    auto unpacker = FlatColorUnpacker<ColorType>(format);
+
+    auto input = std::vector<char>(packer.packed_size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), input.data());
+    auto output = std::vector<ColorType>(colors.size());
+
+    for(auto _ : state) {
+        unpacker.unpack(input.data(), input.size(), output.begin());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, unpacker.packed_size());
+}
+
+/// Unpacking a request into a fresh vector from the heap.
+static void BM_flat_unpack_heap(benchmark::State& state) {
+    using ColorType = Rgb<uint8_t>;
+    const auto colors = bench::inputs<ColorType>(state);
+    const auto& format = RGB_FORMATS[state.range(2)];
+    const auto packer = FlatColorPacker<ColorType>(format);
+    auto unpacker = FlatColorUnpacker<ColorType>(format);
+
+    auto input = std::vector<char>(packer.packed_size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), input.data());
+
+    for(auto _ : state) {
+        const auto output = unpacker.unpack(input.data(), input.size());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, unpacker.packed_size());
+}
+
+/// The same with the vector in an arena released after every request.
+static void BM_flat_unpack_arena(benchmark::State& state) {
+    using ColorType = Rgb<uint8_t>;
+    const auto colors = bench::inputs<ColorType>(state);
+    const auto& format = RGB_FORMATS[state.range(2)];
+    const auto packer = FlatColorPacker<ColorType>(format);
+    auto unpacker = FlatColorUnpacker<ColorType>(format);
+
+    auto input = std::vector<char>(packer.packed_size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), input.data());
+    auto scratch = std::vector<char>(sizeof(ColorType) * colors.size() + 64);
+    ArenaResource arena(scratch.data(), scratch.size());
+
+    for(auto _ : state) {
+        {
+            const auto output = unpacker.unpack(input.data(),
+                    input.size(),
+                    PolymorphicAllocator<ColorType>(&arena));
+            benchmark::DoNotOptimize(output.data());
+            benchmark::ClobberMemory();
+        }
+        arena.release();
+    }
+    bench::set_throughput(state, unpacker.packed_size());
+}
+
+/// Unpacking a 4K frame of float colors on every hardware thread into a
+/// buffer from the heap, or with `state.range(0)` from a HugePageResource
+/// that first touches it on the same threads.
+static void BM_flat_unpack_frame(benchmark::State& state) {
+    using ColorType = Rgb<float>;
+    const std::size_t n = 3840 * 2160;
+    const auto& format = RGB_FORMATS[1];
+    const auto packer = FlatColorPacker<ColorType>(format);
+    auto unpacker = FlatColorUnpacker<ColorType>(format);
+    auto colors = std::vector<ColorType>(n);
+    for(std::size_t i = 0; i < n; ++i) {
+        colors[i] = ColorType(float(i % 3840) / 3840.0f,
+                float(i / 3840) / 2160.0f,
+                0.5f);
+    }
+    auto input = std::vector<char>(packer.packed_size() * n);
+    packer.pack(colors.begin(), colors.end(), input.data());
+
+    auto options = HugePageOptions();
+    options.first_touch = true;
+    options.element_size = sizeof(ColorType);
+    HugePageResource huge_pages(options);
+    auto output = PmrVector<ColorType>(n,
+            state.range(0) ? static_cast<MemoryResource*>(&huge_pages)
+                           : new_delete_resource());
+
+    for(auto _ : state) {
+        unpacker.unpack_parallel(input.data(), input.size(), output.data());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+/// Reading packed colors through FlatColorUnpacker::view_or_unpack(),
+/// which skips the copy for the identity format.
+template <typename T>
+static void BM_flat_view_or_unpack(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto colors = bench::inputs<ColorType>(state);
+    const auto& format = RGB_FORMATS[state.range(2)];
+    const auto packer = FlatColorPacker<ColorType>(format);
+    const auto unpacker = FlatColorUnpacker<ColorType>(format);
+
+    // Elements, so the buffer is aligned for ColorType.
+    auto input = std::vector<T>(format.size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), input.data());
+    auto storage = std::vector<ColorType>();
+
+    for(auto _ : state) {
+        const auto view = unpacker.view_or_unpack(
+                input.data(), unpacker.packed_size() * colors.size(), storage);
+        benchmark::DoNotOptimize(view.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, unpacker.packed_size());
+}
+
+static long add_red(long total, const Rgb<uint8_t>& color) {
+    return total + color.red();
+}
+
+/// A reduction over packed colors, unpacked into a vector first.
+static void BM_flat_reduce_unpack(benchmark::State& state) {
+    const auto colors = bench::inputs<Rgb<uint8_t>>(state);
+    const auto& format = RGB_FORMATS[state.range(2)];
+    const auto packer = FlatColorPacker<Rgb<uint8_t>>(format);
+    auto unpacker = FlatColorUnpacker<Rgb<uint8_t>>(format);
+    auto input = std::vector<char>(packer.packed_size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), input.data());
+
+    for(auto _ : state) {
+        const auto unpacked = unpacker.unpack(input.data(), input.size());
+        auto total = std::accumulate(
+                unpacked.begin(), unpacked.end(), 0L, add_red);
+        benchmark::DoNotOptimize(total);
+    }
+    bench::set_throughput(state, unpacker.packed_size());
+}
+
+/// The same reduction run directly on the packed colors.
+static void BM_flat_reduce_iterator(benchmark::State& state) {
+    const auto colors = bench::inputs<Rgb<uint8_t>>(state);
+    const auto& format = RGB_FORMATS[state.range(2)];
+    const auto packer = FlatColorPacker<Rgb<uint8_t>>(format);
+    const auto unpacker = FlatColorUnpacker<Rgb<uint8_t>>(format);
+    auto input = std::vector<char>(packer.packed_size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), input.data());
+
+    for(auto _ : state) {
+        const auto range = unpacked(input.data(), input.size(), unpacker);
+        auto total = std::accumulate(range.begin(), range.end(), 0L, add_red);
+        benchmark::DoNotOptimize(total);
+    }
+    bench::set_throughput(state, unpacker.packed_size());
+}
+
+/// Packing in the other byte order, e.g. big endian on x86.
+template <typename T>
+static void BM_flat_pack_swapped(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    const auto other = native_byte_order() == ByteOrder::Little
+            ? ByteOrder::Big
+            : ByteOrder::Little;
+    const auto packer =
+            FlatColorPacker<ColorType>(RGB_FORMATS[state.range(2)], other);
+    auto output = std::vector<char>(packer.packed_size() * input.size());
+
+    for(auto _ : state) {
+        packer.pack(input.begin(), input.end(), output.data());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, packer.packed_size());
+}
+
+template <typename T>
+static void BM_flat_pack_rgba(benchmark::State& state) {
+    using ColorType = Rgba<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    // ARGB is the most common reordering for alpha colors.
+    const auto packer = FlatColorPacker<ColorType>({3, 0, 1, 2});
+    auto output = std::vector<char>(packer.packed_size() * input.size());
+
+    for(auto _ : state) {
+        packer.pack(input.begin(), input.end(), output.data());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, packer.packed_size());
+}
+
+static void packer_args(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"batch", "corpus", "format"});
+    for(std::size_t format = 0; format < RGB_FORMATS.size(); ++format) {
+        for(int corpus = 0; corpus < bench::NUM_CORPORA; ++corpus) {
+            for(auto n : bench::BATCH_SIZES) {
+                b->Args({n, corpus, std::int64_t(format)});
+            }
+        }
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_flat_pack, uint8_t)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_pack, uint16_t)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_pack, float)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_pack_swapped, uint16_t)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_pack_swapped, float)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_unpack, uint8_t)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_unpack, uint16_t)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_unpack, float)->Apply(packer_args);
+BENCHMARK(BM_flat_unpack_heap)->Apply(packer_args);
+BENCHMARK(BM_flat_unpack_arena)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_view_or_unpack, uint16_t)->Apply(packer_args);
+BENCHMARK(BM_flat_unpack_frame)
+        ->ArgName("huge_pages")
+        ->Arg(0)
+        ->Arg(1)
+        ->UseRealTime();
+BENCHMARK(BM_flat_reduce_unpack)->Apply(packer_args);
+BENCHMARK(BM_flat_reduce_iterator)->Apply(packer_args);
+BENCHMARK_TEMPLATE(BM_flat_pack_rgba, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_flat_pack_rgba, float)->COLOR_CORPUS_ARGS();
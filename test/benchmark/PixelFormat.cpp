@@ -0,0 +1,44 @@
+#include "BenchUtil.h"
+
+#include <cstring>
+
+#include "Alpha.h"
+#include "PixelFormat.h"
+#include "Rgb.h"
+
+using namespace color;
+
+/// The benchmark's corpus as pixels of the format called \a name.
+static std::vector<unsigned char> pixels(
+        benchmark::State& state, const std::string& name) {
+    const auto colors = bench::inputs<Alpha<uint16_t, Rgb>>(state);
+    const auto& format = PixelFormatRegistry::global().format(name);
+    auto out = std::vector<unsigned char>(colors.size() * format.size());
+    PixelFormatRegistry::global().convert(
+            "RGBA16", colors.data(), colors.size(), name, out.data());
+    return out;
+}
+
+static void BM_pixel_convert(
+        benchmark::State& state, const char* from, const char* to) {
+    const auto in = pixels(state, from);
+    const auto& converter = PixelFormatRegistry::global().converter(from, to);
+    const auto count = in.size() / converter.from().size();
+    auto out = std::vector<unsigned char>(count * converter.to().size());
+
+    for(auto _ : state) {
+        converter.convert(in.data(), count, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, converter.from().size());
+}
+
+BENCHMARK_CAPTURE(BM_pixel_convert, BGRA8_RGBA8, "BGRA8", "RGBA8")
+        ->COLOR_CORPUS_ARGS();
+BENCHMARK_CAPTURE(BM_pixel_convert, XR24_RGB8, "XR24", "RGB8")
+        ->COLOR_CORPUS_ARGS();
+BENCHMARK_CAPTURE(BM_pixel_convert, RGB565_RGBA8, "RGB565", "RGBA8")
+        ->COLOR_CORPUS_ARGS();
+BENCHMARK_CAPTURE(BM_pixel_convert, RGBA16F_RGBA8, "RGBA16F", "RGBA8")
+        ->COLOR_CORPUS_ARGS();
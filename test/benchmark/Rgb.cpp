@@ -0,0 +1,31 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Hsv.h"
+
+using namespace color;
+
+template <typename Color>
+static void BM_lerp(benchmark::State& state) {
+    const auto start = bench::inputs<Color>(state);
+    auto end = start;
+    std::reverse(end.begin(), end.end());
+    auto output = std::vector<Color>(start.size());
+
+    for(auto _ : state) {
+        for(std::size_t i = 0; i < start.size(); ++i) {
+            output[i] = start[i].lerp(end[i], 0.3f);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Color));
+}
+
+BENCHMARK_TEMPLATE(BM_lerp, Rgb<uint8_t>)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_lerp, Rgb<uint16_t>)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_lerp, Rgb<float>)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_lerp, Rgb<double>)->COLOR_CORPUS_ARGS();
+// Hue is periodic, so these take the cyclic interpolation path.
+BENCHMARK_TEMPLATE(BM_lerp, Hsv<uint8_t>)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_lerp, Hsv<float>)->COLOR_CORPUS_ARGS();
@@ -0,0 +1,263 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Hsv.h"
+#include "Batch.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "StreamPacker.h"
+#include "AsyncStreamPacker.h"
+#include "FdSink.h"
+#include "MappedColorSink.h"
+#include "StreamUnpacker.h"
+#include "Pipeline.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace color;
+
+static const std::vector<int> RGB_FORMAT = {0, 1, 2};
+
+template <typename T>
+static void BM_stream_pack_stringstream(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+
+    for(auto _ : state) {
+        auto packer = StreamPacker<ColorType>(
+                std::make_unique<std::stringstream>(),
+                std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+        packer.pack(input.begin(), input.end());
+        benchmark::DoNotOptimize(packer.good());
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+}
+
+template <typename T>
+static void BM_stream_unpack_stringstream(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto colors = bench::inputs<ColorType>(state);
+    auto packed = std::vector<char>(colors.size() * sizeof(T) * 3);
+    FlatColorPacker<ColorType>(RGB_FORMAT).pack(
+            colors.begin(), colors.end(), packed.data());
+    const auto packed_string = std::string(packed.begin(), packed.end());
+    auto output = std::vector<ColorType>(colors.size());
+
+    for(auto _ : state) {
+        auto unpacker = StreamUnpacker<ColorType>(
+                std::make_unique<std::stringstream>(packed_string),
+                std::make_unique<FlatColorUnpacker<ColorType>>(RGB_FORMAT));
+        unpacker.unpack_all(output.begin());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+}
+
+template <typename T>
+static void BM_run_length_pack(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    std::size_t coded_size = 0;
+
+    for(auto _ : state) {
+        std::stringstream stream;
+        auto packer = StreamPacker<ColorType>(stream,
+                std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+        packer.enable_run_length_coding();
+        packer.pack(input.begin(), input.end());
+        benchmark::DoNotOptimize(packer.flush());
+        coded_size = stream.tellp();
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+    state.counters["ratio"] =
+            double(input.size() * sizeof(T) * RGB_FORMAT.size()) / coded_size;
+}
+
+template <typename T>
+static void BM_run_length_unpack(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto colors = bench::inputs<ColorType>(state);
+    std::stringstream coded;
+    {
+        auto packer = StreamPacker<ColorType>(coded,
+                std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+        packer.enable_run_length_coding();
+        packer.pack(colors.begin(), colors.end());
+    }
+    const auto coded_string = coded.str();
+    auto output = std::vector<ColorType>(colors.size());
+
+    for(auto _ : state) {
+        auto unpacker = StreamUnpacker<ColorType>(
+                std::make_unique<std::stringstream>(coded_string),
+                std::make_unique<FlatColorUnpacker<ColorType>>(RGB_FORMAT));
+        unpacker.enable_run_length_decoding();
+        unpacker.unpack_all(output.begin());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+}
+
+template <typename T>
+static void BM_stream_pack_file(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    const auto path = bench::data_path("stream_pack.bin");
+
+    for(auto _ : state) {
+        auto packer = StreamPacker<ColorType>(
+                std::make_unique<std::ofstream>(path, std::ios::binary),
+                std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+        packer.pack(input.begin(), input.end());
+        packer.get_stream().flush();
+        benchmark::DoNotOptimize(packer.good());
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+    std::remove(path.c_str());
+}
+
+/** Steady-state packing to a file through an FdSink. The sink is kept open
+ *  across iterations, so the file grows and only the write path is timed.
+ */
+template <typename T>
+static void BM_fd_sink_pack_file(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    const auto path = bench::data_path("fd_sink_pack.bin");
+
+    auto packer = StreamPacker<ColorType>(std::make_unique<FdSink>(path),
+            std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+    for(auto _ : state) {
+        packer.pack(input.begin(), input.end());
+        benchmark::DoNotOptimize(packer.flush());
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+    std::remove(path.c_str());
+}
+
+/** Packing into a memory-mapped file on every hardware thread, including
+ *  sizing and mapping the file, but not writing it back to disk.
+ */
+template <typename T>
+static void BM_mapped_sink_pack_file(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    const auto path = bench::data_path("mapped_sink_pack.bin");
+
+    for(auto _ : state) {
+        MappedColorSink<ColorType> sink(path,
+                input.size(),
+                std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+        sink.pack_parallel(0, input.begin(), input.end());
+        benchmark::DoNotOptimize(sink.data());
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+    std::remove(path.c_str());
+}
+
+/** Packing cost seen by the caller of an AsyncStreamPacker. The stream is
+ *  written in the background and only flushed after timing stops.
+ */
+template <typename T>
+static void BM_async_stream_pack_file(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto input = bench::inputs<ColorType>(state);
+    const auto path = bench::data_path("async_stream_pack.bin");
+    AsyncStreamPacker<ColorType> packer(
+            std::make_unique<std::ofstream>(path, std::ios::binary),
+            std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+
+    for(auto _ : state) {
+        packer.pack(input.begin(), input.end());
+    }
+    benchmark::DoNotOptimize(packer.flush());
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+    std::remove(path.c_str());
+}
+
+template <typename T>
+static void BM_stream_unpack_file(benchmark::State& state) {
+    using ColorType = Rgb<T>;
+    const auto colors = bench::inputs<ColorType>(state);
+    const auto path = bench::data_path("stream_unpack.bin");
+    {
+        auto packer = StreamPacker<ColorType>(
+                std::make_unique<std::ofstream>(path, std::ios::binary),
+                std::make_unique<FlatColorPacker<ColorType>>(RGB_FORMAT));
+        packer.pack(colors.begin(), colors.end());
+    }
+    auto output = std::vector<ColorType>(colors.size());
+
+    for(auto _ : state) {
+        auto unpacker = StreamUnpacker<ColorType>(
+                std::make_unique<std::ifstream>(path, std::ios::binary),
+                std::make_unique<FlatColorUnpacker<ColorType>>(RGB_FORMAT));
+        unpacker.unpack_all(output.begin());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(T) * RGB_FORMAT.size());
+    std::remove(path.c_str());
+}
+
+/** Unpack, convert to HSV and pack a whole corpus image between string
+ *  streams with run_pipeline(), using `state.range(0)` workers.
+ */
+static void BM_pipeline_to_hsv(benchmark::State& state) {
+    using ColorType = Rgb<float>;
+    const auto& image = bench::corpus_image(bench::Corpus::FractalNoise);
+    auto packed = std::string(image.size() * sizeof(ColorType), '\0');
+    FlatColorPacker<ColorType>(RGB_FORMAT).pack(
+            image.begin(), image.end(), &packed[0]);
+    auto options = PipelineOptions();
+    options.num_workers = state.range(0);
+    options.chunk_colors = 4096;
+
+    for(auto _ : state) {
+        auto source = StreamUnpacker<ColorType>(
+                std::make_unique<std::stringstream>(packed),
+                std::make_unique<FlatColorUnpacker<ColorType>>(RGB_FORMAT));
+        auto sink = StreamPacker<Hsv<float>>(
+                std::make_unique<std::stringstream>(),
+                std::make_unique<FlatColorPacker<Hsv<float>>>(RGB_FORMAT));
+        benchmark::DoNotOptimize(run_pipeline(source,
+                [](const ColorType* in, std::size_t count, Hsv<float>* out) {
+                    batch::to_hsv(in, count, out);
+                },
+                sink,
+                options));
+    }
+    const auto colors = state.iterations() * image.size();
+    state.SetItemsProcessed(colors);
+    state.SetBytesProcessed(colors * sizeof(ColorType));
+}
+
+BENCHMARK(BM_pipeline_to_hsv)
+        ->ArgName("workers")
+        ->Arg(1)
+        ->Arg(2)
+        ->Arg(4)
+        ->Arg(8)
+        ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_stream_pack_stringstream, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_stream_pack_stringstream, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_stream_unpack_stringstream, uint8_t)
+        ->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_stream_unpack_stringstream, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_run_length_pack, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_run_length_unpack, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_stream_pack_file, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_stream_pack_file, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_fd_sink_pack_file, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_fd_sink_pack_file, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_mapped_sink_pack_file, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_mapped_sink_pack_file, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_async_stream_pack_file, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_async_stream_pack_file, float)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_stream_unpack_file, uint8_t)->COLOR_CORPUS_ARGS();
+BENCHMARK_TEMPLATE(BM_stream_unpack_file, float)->COLOR_CORPUS_ARGS();
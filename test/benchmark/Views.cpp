@@ -0,0 +1,57 @@
+#include "BenchUtil.h"
+
+#include "Rgb.h"
+#include "Hsv.h"
+#include "Batch.h"
+#include "FlatColorPacker.h"
+#include "Views.h"
+
+using namespace color;
+
+static Hsv<float> darken(Hsv<float> color) {
+    color.value() *= 0.5f;
+    return color;
+}
+
+/// RGB -> HSV -> darken -> RGB -> uint8_t -> packed, one array per stage.
+static void BM_chain_batch(benchmark::State& state) {
+    const auto colors = bench::inputs<Rgb<float>>(state);
+    const auto n = colors.size();
+    const auto packer = FlatColorPacker<Rgb<uint8_t>>({2, 1, 0});
+    auto hsv = std::vector<Hsv<float>>(n);
+    auto rgb = std::vector<Rgb<float>>(n);
+    auto rgb8 = std::vector<Rgb<uint8_t>>(n);
+    auto out = std::vector<char>(n * packer.packed_size());
+
+    for(auto _ : state) {
+        batch::to_hsv(colors.data(), n, hsv.data());
+        for(auto& color : hsv) {
+            color = darken(color);
+        }
+        batch::to_rgb(hsv.data(), n, rgb.data());
+        batch::color_cast<uint8_t>(rgb.data(), n, rgb8.data());
+        packer.pack(rgb8.begin(), rgb8.end(), out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Rgb<float>));
+}
+
+/// The same chain as a lazy view, packed a chunk at a time.
+static void BM_chain_view(benchmark::State& state) {
+    const auto colors = bench::inputs<Rgb<float>>(state);
+    const auto packer = FlatColorPacker<Rgb<uint8_t>>({2, 1, 0});
+    auto out = std::vector<char>(colors.size() * packer.packed_size());
+
+    for(auto _ : state) {
+        const auto view = colors | views::as<Hsv> | views::map(darken) |
+                views::as<Rgb> | views::cast<uint8_t>;
+        packer.pack(view, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    bench::set_throughput(state, sizeof(Rgb<float>));
+}
+
+BENCHMARK(BM_chain_batch)->COLOR_CORPUS_ARGS();
+BENCHMARK(BM_chain_view)->COLOR_CORPUS_ARGS();
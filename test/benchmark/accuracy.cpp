@@ -0,0 +1,72 @@
+// Accuracy report for the conversion kernels.
+//
+// Sweeps every Rgb<uint8_t> and a dense grid of floating point colors,
+// comparing each conversion against a double precision reference. Pass a
+// stride as the first argument to sweep a subset of the Rgb<uint8_t> cube.
+
+#include "ConversionRef.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "ColorCast.h"
+
+using namespace color;
+using namespace conversion_error;
+
+template <typename Report>
+static void print_report(const std::string& name, const Report& report) {
+    std::cout << name << ": " << report << "\n";
+}
+
+int main(int argc, char** argv) {
+    const int stride = argc > 1 ? std::atoi(argv[1]) : 1;
+    const auto rgb8 = Rgb8Space(std::max(stride, 1));
+    const auto float_grid = FloatGridSpace<Rgb<float>>(257);
+
+    print_report("to_hsv<uint8_t>",
+            measure_conversion(rgb8,
+                    [](const Rgb<uint8_t>& c) {
+                        return to_hsv<uint8_t, double>(c);
+                    },
+                    [](const Rgb<uint8_t>& c) { return to_hsv(c); },
+                    [](const Hsv<uint8_t>& c) { return to_rgb(c); }));
+    print_report("to_hsl<uint8_t>",
+            measure_conversion(rgb8,
+                    [](const Rgb<uint8_t>& c) {
+                        return to_hsl<uint8_t, double>(c);
+                    },
+                    [](const Rgb<uint8_t>& c) { return to_hsl(c); },
+                    [](const Hsl<uint8_t>& c) { return to_rgb(c); }));
+    print_report("to_hsi<uint8_t>",
+            measure_conversion(rgb8,
+                    [](const Rgb<uint8_t>& c) {
+                        return to_hsi<uint8_t, double>(c);
+                    },
+                    [](const Rgb<uint8_t>& c) { return to_hsi(c); }));
+
+    print_report("to_hsv<float>",
+            measure_conversion(float_grid,
+                    [](const Rgb<float>& c) {
+                        return color_cast<float>(to_hsv(color_cast<double>(c)));
+                    },
+                    [](const Rgb<float>& c) { return to_hsv(c); },
+                    [](const Hsv<float>& c) { return to_rgb(c); }));
+    print_report("to_hsl<float>",
+            measure_conversion(float_grid,
+                    [](const Rgb<float>& c) {
+                        return color_cast<float>(to_hsl(color_cast<double>(c)));
+                    },
+                    [](const Rgb<float>& c) { return to_hsl(c); },
+                    [](const Hsl<float>& c) { return to_rgb(c); }));
+    print_report("to_hsi<float>",
+            measure_conversion(float_grid,
+                    [](const Rgb<float>& c) {
+                        return color_cast<float>(to_hsi(color_cast<double>(c)));
+                    },
+                    [](const Rgb<float>& c) { return to_hsi(c); },
+                    [](const Hsi<float>& c) { return to_rgb(c); }));
+
+    return 0;
+}
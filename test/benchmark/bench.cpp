@@ -0,0 +1,53 @@
+#include "benchmark/benchmark.h"
+
+#include "Dispatch.h"
+
+#include <fstream>
+#include <string>
+
+namespace {
+
+/// Read the CPU model name from /proc/cpuinfo, if available.
+std::string cpu_model() {
+    auto cpuinfo = std::ifstream("/proc/cpuinfo");
+    auto line = std::string();
+    while(std::getline(cpuinfo, line)) {
+        if(line.compare(0, 10, "model name") == 0) {
+            auto pos = line.find(':');
+            if(pos != std::string::npos) {
+                return line.substr(line.find_first_not_of(' ', pos + 1));
+            }
+        }
+    }
+    return "unknown";
+}
+
+std::string compiler() {
+#if defined(__clang__)
+    return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    return std::string("gcc ") + __VERSION__;
+#else
+    return "unknown";
+#endif
+}
+}
+
+// Records the build and machine configuration in the context section of
+// every report, so JSON results (--benchmark_out=<file>
+// --benchmark_out_format=json) can be compared meaningfully.
+int main(int argc, char** argv) {
+    benchmark::AddCustomContext("cpu_model", cpu_model());
+    benchmark::AddCustomContext("compiler", compiler());
+    benchmark::AddCustomContext("cxx_flags", BENCHMARK_CXX_FLAGS);
+    benchmark::AddCustomContext(
+            "isa_level", color::isa_level_name(color::active_isa_level()));
+
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+"""Record, store and compare benchmark results.
+
+Subcommands:
+
+  run BINARY OUT.json       Run the benchmarks with repetitions and write the
+                            raw Google Benchmark JSON (including the build and
+                            machine context) to OUT.json.
+  record BINARY DIR         Run the benchmarks and write one compact baseline
+                            file per kernel (BM_to_hsv -> DIR/to_hsv.json).
+  compare OLD NEW           Compare two result sets. OLD and NEW may each be a
+                            raw JSON file, a baseline file or a directory of
+                            baseline files. A benchmark regresses when its
+                            median time grows by more than --threshold and a
+                            Mann-Whitney U test over the repetitions rejects
+                            "no difference" at --alpha. Results missing from
+                            OLD are listed as having no baseline. Exits with
+                            status 1 if anything regressed.
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+DEFAULT_REPETITIONS = 5
+DEFAULT_MIN_TIME = 0.05
+DEFAULT_THRESHOLD = 0.03
+DEFAULT_ALPHA = 0.05
+
+CONTEXT_KEYS = ("cpu_model", "compiler", "cxx_flags", "isa_level",
+                "num_cpus", "mhz_per_cpu", "library_build_type")
+
+
+def run_benchmarks(binary, out_path, repetitions, min_time, bench_filter):
+    cmd = [binary,
+           "--benchmark_out=" + out_path,
+           "--benchmark_out_format=json",
+           "--benchmark_repetitions=%d" % repetitions,
+           "--benchmark_min_time=%g" % min_time]
+    if bench_filter:
+        cmd.append("--benchmark_filter=" + bench_filter)
+    subprocess.check_call(cmd, stdout=subprocess.DEVNULL)
+    with open(out_path) as f:
+        return json.load(f)
+
+
+def kernel_name(run_name):
+    """BM_to_hsv<uint8_t>/64 -> to_hsv"""
+    name = re.split(r"[</]", run_name, maxsplit=1)[0]
+    return name[3:] if name.startswith("BM_") else name
+
+
+def samples_from_raw(raw):
+    """Collect per-repetition samples from raw Google Benchmark JSON."""
+    out = {}
+    for bench in raw.get("benchmarks", []):
+        if bench.get("run_type", "iteration") != "iteration":
+            continue
+        name = bench.get("run_name", bench["name"])
+        entry = out.setdefault(name, {"time_unit": bench["time_unit"],
+                                      "real_time": [], "cpu_time": []})
+        entry["real_time"].append(bench["real_time"])
+        entry["cpu_time"].append(bench["cpu_time"])
+    return out
+
+
+def split_baselines(raw):
+    context = {k: v for k, v in raw.get("context", {}).items()
+               if k in CONTEXT_KEYS}
+    kernels = {}
+    for name, entry in samples_from_raw(raw).items():
+        kernels.setdefault(kernel_name(name), {})[name] = entry
+    return {kernel: {"context": context, "benchmarks": benchmarks}
+            for kernel, benchmarks in kernels.items()}
+
+
+def load_results(path):
+    """Return (context, {name: entry}) from any supported result format."""
+    if os.path.isdir(path):
+        context, merged = {}, {}
+        for file_name in sorted(os.listdir(path)):
+            if file_name.endswith(".json"):
+                file_context, results = load_results(
+                    os.path.join(path, file_name))
+                context = context or file_context
+                merged.update(results)
+        return context, merged
+    with open(path) as f:
+        data = json.load(f)
+    if isinstance(data.get("benchmarks"), list):
+        return data.get("context", {}), samples_from_raw(data)
+    return data.get("context", {}), data["benchmarks"]
+
+
+def median(values):
+    values = sorted(values)
+    mid = len(values) // 2
+    if len(values) % 2:
+        return values[mid]
+    return 0.5 * (values[mid - 1] + values[mid])
+
+
+def mann_whitney_p(xs, ys):
+    """Two-sided p-value of the Mann-Whitney U test.
+
+    Uses the exact null distribution for small samples without ties and
+    the tie-corrected normal approximation otherwise.
+    """
+    n1, n2 = len(xs), len(ys)
+    if n1 == 0 or n2 == 0:
+        return 1.0
+    combined = sorted([(v, 0) for v in xs] + [(v, 1) for v in ys])
+    ranks = [0.0] * len(combined)
+    tie_term = 0.0
+    i = 0
+    while i < len(combined):
+        j = i
+        while j + 1 < len(combined) and combined[j + 1][0] == combined[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = 0.5 * (i + j) + 1
+        ties = j - i + 1
+        tie_term += ties ** 3 - ties
+        i = j + 1
+    rank_sum = sum(r for r, (_, group) in zip(ranks, combined) if group == 0)
+    u = rank_sum - n1 * (n1 + 1) / 2.0
+    u = min(u, n1 * n2 - u)
+
+    if tie_term == 0 and n1 * n2 <= 400:
+        # counts[m][n][u]: orderings of m and n samples giving statistic u.
+        counts = {}
+
+        def count(m, n, target):
+            if target < 0:
+                return 0
+            if m == 0 or n == 0:
+                return 1 if target == 0 else 0
+            key = (m, n, target)
+            if key not in counts:
+                counts[key] = count(m - 1, n, target - n) + \
+                    count(m, n - 1, target)
+            return counts[key]
+
+        total = math.comb(n1 + n2, n1)
+        tail = sum(count(n1, n2, k) for k in range(int(u) + 1))
+        return min(1.0, 2.0 * tail / total)
+
+    mean = n1 * n2 / 2.0
+    n = n1 + n2
+    variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0:
+        return 1.0
+    z = (abs(u - mean) - 0.5) / math.sqrt(variance)
+    return math.erfc(max(z, 0.0) / math.sqrt(2.0))
+
+
+def compare(old_path, new_path, metric, threshold, alpha, out=sys.stdout):
+    old_context, old = load_results(old_path)
+    new_context, new = load_results(new_path)
+
+    for key in CONTEXT_KEYS:
+        if key in old_context and old_context.get(key) != new_context.get(key):
+            out.write("note: %s differs: %r -> %r\n" % (
+                key, old_context.get(key), new_context.get(key)))
+
+    regressions = []
+    out.write("%-50s %12s %12s %8s %8s\n" % (
+        "benchmark", "old", "new", "change", "p"))
+    for name in sorted(set(old) & set(new)):
+        old_samples = old[name][metric]
+        new_samples = new[name][metric]
+        old_median = median(old_samples)
+        change = median(new_samples) / old_median - 1.0 if old_median else 0.0
+        p = mann_whitney_p(old_samples, new_samples)
+        flag = ""
+        if p < alpha and abs(change) > threshold:
+            flag = "REGRESSION" if change > 0 else "improvement"
+            if change > 0:
+                regressions.append(name)
+        out.write("%-50s %12.1f %12.1f %+7.1f%% %8.3f %s\n" % (
+            name, old_median, median(new_samples), 100.0 * change, p, flag))
+
+    for name in sorted(set(old) - set(new)):
+        out.write("%-50s missing from new results\n" % name)
+
+    unbaselined = sorted(set(new) - set(old))
+    for name in unbaselined:
+        out.write("%-50s no baseline\n" % name)
+
+    out.write("\n%d regression(s) above %.1f%% (alpha=%g)\n" % (
+        len(regressions), 100.0 * threshold, alpha))
+    if unbaselined:
+        out.write("%d result(s) without a baseline\n" % len(unbaselined))
+    return regressions
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawTextHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    for command in ("run", "record"):
+        p = sub.add_parser(command)
+        p.add_argument("binary")
+        p.add_argument("out")
+        p.add_argument("--repetitions", type=int, default=DEFAULT_REPETITIONS)
+        p.add_argument("--min-time", type=float, default=DEFAULT_MIN_TIME)
+        p.add_argument("--filter", default="")
+
+    p = sub.add_parser("compare")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("--metric", choices=("cpu_time", "real_time"),
+                   default="cpu_time")
+    p.add_argument("--threshold", type=float, default=DEFAULT_THRESHOLD)
+    p.add_argument("--alpha", type=float, default=DEFAULT_ALPHA)
+
+    args = parser.parse_args(argv)
+
+    if args.command == "run":
+        run_benchmarks(args.binary, args.out, args.repetitions, args.min_time,
+                       args.filter)
+        return 0
+
+    if args.command == "record":
+        with tempfile.TemporaryDirectory() as tmp:
+            raw = run_benchmarks(args.binary, os.path.join(tmp, "out.json"),
+                                 args.repetitions, args.min_time, args.filter)
+        os.makedirs(args.out, exist_ok=True)
+        for kernel, baseline in sorted(split_baselines(raw).items()):
+            with open(os.path.join(args.out, kernel + ".json"), "w") as f:
+                json.dump(baseline, f, indent=1, sort_keys=True)
+                f.write("\n")
+        return 0
+
+    regressions = compare(args.old, args.new, args.metric, args.threshold,
+                          args.alpha)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,199 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+
+#include "Rgb.h"
+#include "AsyncStreamPacker.h"
+#include "StreamPacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+using ColorType = Rgb<uint8_t>;
+
+/// Stream buffer whose writes block until release() is called.
+class GateBuf : public std::stringbuf {
+public:
+    void release() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_open = true;
+        m_cv.notify_all();
+    }
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_open; });
+        return std::stringbuf::xsputn(s, n);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_open = false;
+};
+
+/// An OstreamSink counting how often it is synced in \a syncs.
+class SyncCountingSink : public OstreamSink {
+public:
+    SyncCountingSink(std::ostream& stream, std::atomic<int>& syncs)
+        : OstreamSink(stream), m_syncs(syncs) {}
+
+    bool sync() override {
+        ++m_syncs;
+        return OstreamSink::sync();
+    }
+
+private:
+    std::atomic<int>& m_syncs;
+};
+
+/// Stream buffer that accepts \a limit bytes and then fails.
+class FullBuf : public std::streambuf {
+public:
+    explicit FullBuf(std::streamsize limit) : m_left(limit) {}
+
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        const auto accepted = std::min(n, m_left);
+        m_left -= accepted;
+        return accepted;
+    }
+
+private:
+    std::streamsize m_left;
+};
+}
+
+TEST(AsyncStreamPacker, matches_stream_packer) {
+    const auto colors = make_colors<ColorType>(5000);
+    std::stringstream expected;
+    auto sync = StreamPacker<ColorType>(expected, make_packer<ColorType>());
+    sync.pack(colors.begin(), colors.end());
+    sync << ColorType(1, 2, 3);
+
+    auto options = AsyncStreamPackerOptions();
+    // Not a multiple of the packed size, and much smaller than the input.
+    options.buffer_size = 1000;
+    options.num_buffers = 3;
+    auto stream_ptr = std::make_unique<std::stringstream>();
+    AsyncStreamPacker<ColorType> async(
+            std::move(stream_ptr), make_packer<ColorType>(), options);
+    for(std::size_t i = 0; i < 100; ++i) {
+        async << colors[i];
+    }
+    async.pack(colors.begin() + 100, colors.end());
+    async.pack_single(ColorType(1, 2, 3));
+    ASSERT_TRUE(async.flush());
+    ASSERT_EQ(async.dropped(), 0);
+
+    auto stream = async.release_stream();
+    ASSERT_EQ(static_cast<std::stringstream&>(*stream).str(), expected.str());
+}
+
+TEST(AsyncStreamPacker, flush_on_destruction) {
+    const auto colors = make_colors<ColorType>(100);
+    std::stringstream stream;
+    {
+        AsyncStreamPacker<ColorType> async(stream, make_packer<ColorType>());
+        async.pack(colors.begin(), colors.end());
+    }
+    ASSERT_EQ(stream.str().size(), 300);
+}
+
+TEST(AsyncStreamPacker, flush_syncs_the_sink) {
+    const auto colors = make_colors<ColorType>(100);
+    std::stringstream stream;
+    std::atomic<int> syncs{0};
+    {
+        AsyncStreamPacker<ColorType> async(
+                std::make_unique<SyncCountingSink>(stream, syncs),
+                make_packer<ColorType>());
+        async.pack(colors.begin(), colors.end());
+        ASSERT_TRUE(async.flush());
+        ASSERT_EQ(syncs, 1);
+        ASSERT_EQ(stream.str().size(), 300);
+        async.pack(colors.begin(), colors.end());
+    }
+    // Destroying it writes the rest without syncing.
+    ASSERT_EQ(syncs, 1);
+    ASSERT_EQ(stream.str().size(), 600);
+}
+
+TEST(AsyncStreamPacker, drop_policy) {
+    const auto colors = make_colors<ColorType>(1000);
+    GateBuf buf;
+    std::ostream stream(&buf);
+
+    auto options = AsyncStreamPackerOptions();
+    options.buffer_size = 300;
+    options.num_buffers = 2;
+    options.policy = BackpressurePolicy::Drop;
+    AsyncStreamPacker<ColorType> async(
+            stream, make_packer<ColorType>(), options);
+    // The writer blocks on the first buffer, so once the second one is
+    // full everything else is dropped.
+    async.pack(colors.begin(), colors.end());
+    ASSERT_EQ(async.dropped(), 800);
+
+    buf.release();
+    ASSERT_TRUE(async.flush());
+    const auto written = buf.str();
+    ASSERT_EQ(written.size(), 600);
+
+    async.pack(colors.begin(), colors.begin() + 10);
+    ASSERT_TRUE(async.flush());
+    ASSERT_EQ(buf.str().size(), 630);
+    ASSERT_EQ(async.dropped(), 800);
+}
+
+TEST(AsyncStreamPacker, write_error) {
+    const auto colors = make_colors<ColorType>(1000);
+    FullBuf buf(100);
+    std::ostream stream(&buf);
+
+    auto options = AsyncStreamPackerOptions();
+    options.buffer_size = 64;
+    AsyncStreamPacker<ColorType> async(
+            stream, make_packer<ColorType>(), options);
+    async.pack(colors.begin(), colors.end());
+    ASSERT_FALSE(async.flush());
+    ASSERT_FALSE(async.good());
+    ASSERT_TRUE(async.bad());
+    ASSERT_TRUE(async.fail());
+}
+
+TEST(AsyncStreamPacker, write_exception) {
+    const auto colors = make_colors<ColorType>(1000);
+    FullBuf sync_buf(100);
+    std::ostream sync_stream(&sync_buf);
+    sync_stream.exceptions(std::ios_base::badbit);
+    StreamPacker<ColorType> packer(sync_stream, make_packer<ColorType>());
+    ASSERT_THROW(packer.pack(colors.begin(), colors.end()),
+            std::ios_base::failure);
+
+    // The writer thread must hand the exception to the packing thread
+    // instead of terminating.
+    FullBuf buf(100);
+    std::ostream stream(&buf);
+    stream.exceptions(std::ios_base::badbit);
+    auto options = AsyncStreamPackerOptions();
+    options.buffer_size = 64;
+    AsyncStreamPacker<ColorType> async(
+            stream, make_packer<ColorType>(), options);
+    async.pack(colors.begin(), colors.begin() + 100);
+    ASSERT_THROW(async.flush(), std::ios_base::failure);
+    ASSERT_TRUE(async.bad());
+    ASSERT_THROW(async.pack(colors.begin(), colors.end()),
+            std::ios_base::failure);
+    ASSERT_THROW(async << colors[0], std::ios_base::failure);
+}
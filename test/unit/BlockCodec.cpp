@@ -0,0 +1,223 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Rgb.h"
+#include "BlockCodec.h"
+#include "FlatColorUnpacker.h"
+#include "StreamPacker.h"
+#include "StreamUnpacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+/// Flat regions, a gradient and noise, like a screenshot.
+std::vector<Rgb<uint16_t>> make_screenshot(std::size_t n) {
+    auto out = std::vector<Rgb<uint16_t>>();
+    std::mt19937 rng(5);
+    for(std::size_t i = 0; i < n; ++i) {
+        if(i % 3000 < 1500) {
+            out.emplace_back(1000, 2000, 3000);
+        } else if(i % 3000 < 2500) {
+            out.emplace_back(i, 2 * i, 40000 - i);
+        } else {
+            out.emplace_back(rng(), rng(), rng());
+        }
+    }
+    return out;
+}
+
+std::vector<char> pack(const std::vector<Rgb<uint16_t>>& colors) {
+    const auto bytes = packed_bytes(colors, {0, 1, 2});
+    return std::vector<char>(bytes.begin(), bytes.end());
+}
+
+/// The header of a block of one byte elements.
+std::string block_header(std::uint32_t raw_size,
+        std::uint32_t payload_size,
+        BlockCodecMethod method) {
+    auto out = std::string(12, '\0');
+    for(int i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>(raw_size >> (8 * i));
+        out[4 + i] = static_cast<char>(payload_size >> (8 * i));
+    }
+    out[8] = 1;
+    out[10] = 1;
+    out[11] = static_cast<char>(method);
+    return out;
+}
+
+BlockCodecOptions options_for(BlockCodecMethod method) {
+    auto options = BlockCodecOptions();
+    options.stride = 6;
+    options.element_size = 2;
+    options.block_size = 10000;
+    options.method = method;
+    return options;
+}
+}
+
+TEST(BlockCodec, round_trip) {
+    const auto raw = pack(make_screenshot(20000));
+    for(auto method : {BlockCodecMethod::Store,
+                BlockCodecMethod::Rle,
+                BlockCodecMethod::Lz}) {
+        for(int filters = 0; filters < 4; ++filters) {
+            auto options = options_for(method);
+            options.delta = (filters & 1) != 0;
+            options.shuffle = (filters & 2) != 0;
+            const auto compressed =
+                    compress_blocks(raw.data(), raw.size(), options, 3);
+            if(method != BlockCodecMethod::Store && options.delta) {
+                ASSERT_LT(compressed.size(), raw.size() / 2);
+            }
+            ASSERT_EQ(decompress_blocks(
+                              compressed.data(), compressed.size(), 2),
+                    raw);
+        }
+    }
+}
+
+TEST(BlockCodec, edge_cases) {
+    const auto options = options_for(BlockCodecMethod::Lz);
+    ASSERT_TRUE(compress_blocks(nullptr, 0, options).empty());
+    ASSERT_TRUE(decompress_blocks(nullptr, 0).empty());
+
+    // Runs longer than the extended length limits, and tiny blocks.
+    for(std::size_t size : {1, 5, 7, 300, 70000}) {
+        auto raw = std::vector<char>(size, 'x');
+        raw[size / 2] = 'y';
+        for(auto method : {BlockCodecMethod::Rle, BlockCodecMethod::Lz}) {
+            auto options = options_for(method);
+            options.stride = 1;
+            options.block_size = 100000;
+            const auto compressed = compress_blocks(raw.data(), size, options);
+            ASSERT_EQ(decompress_blocks(compressed.data(), compressed.size()),
+                    raw);
+        }
+    }
+}
+
+TEST(BlockCodec, stream) {
+    using ColorType = Rgb<uint16_t>;
+    const auto colors = make_screenshot(20000);
+    auto stream_ptr = std::make_unique<std::stringstream>();
+    auto& stream = *stream_ptr;
+    {
+        auto sink = std::make_unique<CompressingSink>(
+                std::make_unique<OstreamSink>(stream),
+                options_for(BlockCodecMethod::Lz));
+        auto packer = StreamPacker<ColorType>(std::move(sink),
+                make_packer<ColorType>({0, 1, 2}));
+        packer << colors[0];
+        packer.pack(colors.begin() + 1, colors.begin() + 5000);
+        ASSERT_TRUE(packer.flush());
+        packer.pack(colors.begin() + 5000, colors.end());
+    }
+    ASSERT_LT(stream.str().size(), colors.size() * 6 / 2);
+
+    auto unpacker = StreamUnpacker<ColorType>(std::move(stream_ptr),
+            std::make_unique<FlatColorUnpacker<ColorType>>(
+                    std::vector<int>{0, 1, 2}));
+    unpacker.enable_decompression();
+    unpacker.enable_read_ahead();
+    ASSERT_EQ(unpacker.unpack_all(), colors);
+}
+
+TEST(BlockCodec, write_error_with_exceptions) {
+    using ColorType = Rgb<uint16_t>;
+    const auto colors = make_screenshot(10);
+    FailingBuf buf;
+    std::ostream stream(&buf);
+    stream.exceptions(std::ios_base::badbit);
+    for(const bool flush : {false, true}) {
+        stream.clear();
+        auto sink = std::make_unique<CompressingSink>(
+                std::make_unique<OstreamSink>(stream),
+                options_for(BlockCodecMethod::Lz));
+        auto packer = StreamPacker<ColorType>(std::move(sink),
+                make_packer<ColorType>({0, 1, 2}));
+        packer.pack(colors.begin(), colors.end());
+        // Without a flush, the block is only written by the destructor,
+        // which must not throw.
+        if(flush) {
+            ASSERT_THROW(packer.flush(), std::ios_base::failure);
+        }
+    }
+}
+
+TEST(BlockCodec, corrupt_data) {
+    const auto raw = pack(make_screenshot(5000));
+    auto compressed = compress_blocks(
+            raw.data(), raw.size(), options_for(BlockCodecMethod::Lz));
+    ASSERT_THROW(decompress_blocks(compressed.data(), compressed.size() - 1),
+            CorruptDataError);
+    ASSERT_THROW(decompress_blocks(compressed.data(), 5), CorruptDataError);
+    // Garbage in a payload must be detected, not read out of bounds.
+    for(std::size_t i = 12; i < compressed.size(); i += 97) {
+        auto damaged = compressed;
+        damaged[i] = static_cast<char>(damaged[i] ^ 0x5a);
+        try {
+            decompress_blocks(damaged.data(), damaged.size());
+        } catch(const CorruptDataError&) {
+        }
+    }
+
+    std::stringstream stream(std::string(compressed.begin(),
+            compressed.begin() + compressed.size() / 2));
+    DecompressingStreamBuf buf(stream.rdbuf());
+    std::istream in(&buf);
+    auto out = std::vector<char>(raw.size());
+    in.read(out.data(), out.size());
+    ASSERT_TRUE(in.bad());
+}
+
+TEST(BlockCodec, malformed_headers) {
+    // Headers of the largest blocks, but without payloads.
+    auto data = std::string();
+    for(int i = 0; i < 300; ++i) {
+        data += block_header(std::uint32_t(1) << 30, 0, BlockCodecMethod::Rle);
+    }
+    // Rejected before gigabytes are allocated for the output.
+    ASSERT_THROW(decompress_blocks(data.data(), data.size()),
+            CorruptDataError);
+
+    const auto lz = block_header(100000, 2, BlockCodecMethod::Lz) + "ab";
+    ASSERT_THROW(decompress_blocks(lz.data(), lz.size()), CorruptDataError);
+    const auto store = block_header(3, 2, BlockCodecMethod::Store) + "ab";
+    ASSERT_THROW(
+            decompress_blocks(store.data(), store.size()), CorruptDataError);
+
+    std::stringstream stream(data);
+    DecompressingStreamBuf buf(stream.rdbuf());
+    std::istream in(&buf);
+    char byte;
+    in.read(&byte, 1);
+    ASSERT_TRUE(in.bad());
+}
+
+TEST(BlockCodec, empty_blocks) {
+    // Far more empty blocks than stack frames fit in a thread's stack.
+    auto data = std::string();
+    const auto empty = block_header(0, 0, BlockCodecMethod::Store);
+    for(int i = 0; i < (1 << 20); ++i) {
+        data += empty;
+    }
+    data += block_header(3, 3, BlockCodecMethod::Store) + "abc" + empty;
+
+    std::stringstream stream(data);
+    DecompressingStreamBuf buf(stream.rdbuf());
+    std::istream in(&buf);
+    ASSERT_EQ(std::string(std::istreambuf_iterator<char>(in),
+                      std::istreambuf_iterator<char>()),
+            "abc");
+    ASSERT_FALSE(in.bad());
+}
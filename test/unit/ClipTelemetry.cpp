@@ -0,0 +1,203 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "Hsv.h"
+#include "Hsi.h"
+#include "Batch.h"
+#include "ClipTelemetry.h"
+
+using namespace color;
+
+TEST(ClipTelemetry, count_out_of_range) {
+    const auto colors = std::vector<Rgb<float>>{
+            {0.0f, 0.5f, 1.0f},
+            {-0.25f, 0.5f, 1.5f},
+            {0.1f, 2.0f, 0.2f},
+    };
+    const auto counts = batch::count_out_of_range(colors.data(), colors.size());
+    ASSERT_EQ(counts.channels, 9);
+    ASSERT_EQ(counts.clipped, 3);
+    ASSERT_EQ(counts.truncated, 0);
+    ASSERT_DOUBLE_EQ(counts.total_error, 1.75);
+    ASSERT_DOUBLE_EQ(counts.max_error, 1.0);
+}
+
+TEST(ClipTelemetry, hue_is_not_clipped) {
+    // Hue wraps instead of saturating, so it is never out of range.
+    const auto colors = std::vector<Hsv<float>>{{1.5f, 0.5f, 0.5f}};
+    ASSERT_EQ(batch::count_out_of_range(colors.data(), 1).clipped, 0);
+
+    auto saturated = std::vector<Hsv<float>>{{1.5f, 1.5f, 0.5f}};
+    batch::normalize(saturated.data(), 1);
+    ASSERT_FLOAT_EQ(saturated[0].hue(), 1.5f);
+    ASSERT_FLOAT_EQ(saturated[0].saturation(), 1.0f);
+}
+
+TEST(ClipTelemetry, normalize) {
+    // Enough colors to cover full lanes and a partial tail.
+    auto colors = std::vector<Rgba<float>>();
+    for(int i = 0; i < 101; ++i) {
+        const auto v = -1.0f + 0.03f * i;
+        colors.emplace_back(v, 0.5f, -v, 2.0f);
+    }
+    auto expected = colors;
+    for(auto& color : expected) {
+        for(int c = 0; c < 4; ++c) {
+            color.data()[c] =
+                    BoundedChannel<float>(color.data()[c]).normalize();
+        }
+    }
+    batch::normalize(colors.data(), colors.size());
+    for(std::size_t i = 0; i < colors.size(); ++i) {
+        ASSERT_EQ(colors[i], expected[i]);
+    }
+
+    auto clamped = std::vector<Rgb<float>>{{-1.0f, 0.5f, 3.0f}};
+    batch::clamp(clamped.data(), 1, 0.25f, 0.75f);
+    ASSERT_EQ(clamped[0], Rgb<float>(0.25f, 0.5f, 0.75f));
+}
+
+TEST(ClipTelemetry, count_cast_loss) {
+    // 0.5 * 255 = 127.5 truncates, 1.5 and -0.5 are out of range.
+    const auto colors = std::vector<Rgb<float>>{
+            {0.0f, 1.0f, 0.5f},
+            {1.5f, -0.5f, 0.0f},
+    };
+    auto counts = batch::count_cast_loss<uint8_t>(colors.data(), 2);
+    ASSERT_EQ(counts.channels, 6);
+    ASSERT_EQ(counts.clipped, 2);
+    ASSERT_EQ(counts.truncated, 1);
+    ASSERT_NEAR(counts.max_error, 0.5, 1e-9);
+
+    // Widening and casts to floating point lose nothing.
+    const auto bytes = std::vector<Rgb<uint8_t>>{{0, 128, 255}};
+    counts = batch::count_cast_loss<uint16_t>(bytes.data(), 1);
+    ASSERT_EQ(counts.clipped + counts.truncated, 0);
+    counts = batch::count_cast_loss<float>(bytes.data(), 1);
+    ASSERT_EQ(counts.channels, 3);
+    ASSERT_EQ(counts.clipped + counts.truncated, 0);
+
+    // Narrowing drops the low bits.
+    const auto words = std::vector<Rgb<uint16_t>>{{0, 257, 300}};
+    counts = batch::count_cast_loss<uint8_t>(words.data(), 1);
+    ASSERT_EQ(counts.truncated, 1);
+}
+
+TEST(ClipTelemetry, kernels_all_levels) {
+    auto colors = std::vector<Rgb<float>>();
+    for(int i = 0; i < 333; ++i) {
+        colors.emplace_back(-0.5f + 0.006f * i, 0.003f * i, 1.2f - 0.004f * i);
+    }
+    const float lo[] = {0.0f, 0.0f, 0.0f};
+    const float hi[] = {1.0f, 1.0f, 1.0f};
+    const double scale[] = {255.0, 255.0, 255.0};
+    const double shift[] = {0.0, 0.0, 0.0};
+    const double range[] = {255.0, 255.0, 255.0};
+
+    auto expected = ClipCounts();
+    dispatch_at<details::clamp_kernel<float, 3, false, true>>(IsaLevel::Scalar,
+            colors[0].data(),
+            colors.size(),
+            lo,
+            hi,
+            static_cast<float*>(nullptr),
+            &expected);
+    auto expected_cast = ClipCounts();
+    dispatch_at<details::cast_loss_kernel<float, uint8_t, 3>>(IsaLevel::Scalar,
+            colors[0].data(),
+            colors.size(),
+            scale,
+            shift,
+            range,
+            &expected_cast);
+
+    for(int i = 0; i <= static_cast<int>(detected_isa_level()); ++i) {
+        const auto level = static_cast<IsaLevel>(i);
+        SCOPED_TRACE(isa_level_name(level));
+        auto counts = ClipCounts();
+        dispatch_at<details::clamp_kernel<float, 3, false, true>>(level,
+                colors[0].data(),
+                colors.size(),
+                lo,
+                hi,
+                static_cast<float*>(nullptr),
+                &counts);
+        ASSERT_EQ(counts.clipped, expected.clipped);
+        ASSERT_NEAR(counts.total_error, expected.total_error, 1e-4);
+        ASSERT_DOUBLE_EQ(counts.max_error, expected.max_error);
+
+        auto cast_counts = ClipCounts();
+        dispatch_at<details::cast_loss_kernel<float, uint8_t, 3>>(level,
+                colors[0].data(),
+                colors.size(),
+                scale,
+                shift,
+                range,
+                &cast_counts);
+        ASSERT_EQ(cast_counts.clipped, expected_cast.clipped);
+        ASSERT_EQ(cast_counts.truncated, expected_cast.truncated);
+        ASSERT_NEAR(cast_counts.total_error, expected_cast.total_error, 1e-9);
+    }
+}
+
+TEST(ClipTelemetry, hsi_to_rgb_matches_clip_mode) {
+    auto colors = std::vector<Hsi<float>>();
+    for(int i = 0; i < 50; ++i) {
+        colors.emplace_back(0.02f * i, 1.0f, 0.2f + 0.015f * i);
+    }
+    auto out = std::vector<Rgb<float>>(colors.size());
+    batch::to_rgb(colors.data(), colors.size(), out.data());
+    for(std::size_t i = 0; i < colors.size(); ++i) {
+        ASSERT_EQ(out[i], to_rgb(colors[i]));
+    }
+}
+
+#ifdef COLOR_ENABLE_INSTRUMENTATION
+TEST(ClipTelemetry, call_sites) {
+    instrumentation::reset_clip();
+
+    auto hsi = std::vector<Hsi<float>>{
+            {0.1f, 1.0f, 0.9f}, {0.5f, 0.0f, 0.5f}, {0.8f, 1.0f, 0.8f}};
+    auto rgb = std::vector<Rgb<float>>(hsi.size());
+    {
+        instrumentation::ScopedClipSite site("decode");
+        batch::to_rgb(hsi.data(), hsi.size(), rgb.data());
+    }
+    const auto decode =
+            instrumentation::clip_snapshot("decode", "batch::to_rgb(Hsi)");
+    ASSERT_EQ(decode.calls, 1);
+    ASSERT_EQ(decode.counts.channels, 9);
+    ASSERT_GT(decode.counts.clipped, 0);
+
+    auto floats = std::vector<Rgb<float>>{{0.5f, 1.25f, 0.0f}};
+    auto bytes = std::vector<Rgb<uint8_t>>(floats.size());
+    {
+        instrumentation::ScopedClipSite outer("encode");
+        {
+            instrumentation::ScopedClipSite inner("quantize");
+            batch::color_cast<uint8_t>(floats.data(), 1, bytes.data());
+        }
+        batch::normalize(floats.data(), 1);
+    }
+    const auto quantize =
+            instrumentation::clip_snapshot("quantize", "batch::color_cast");
+    ASSERT_EQ(quantize.counts.clipped, 1);
+    ASSERT_EQ(quantize.counts.truncated, 1);
+    const auto encode =
+            instrumentation::clip_snapshot("encode", "batch::normalize");
+    ASSERT_EQ(encode.counts.clipped, 1);
+    ASSERT_DOUBLE_EQ(encode.counts.total_error, 0.25);
+
+    // Casts to a wider or floating point type are not recorded.
+    auto wide = std::vector<Rgb<uint16_t>>(1);
+    batch::color_cast<uint16_t>(bytes.data(), 1, wide.data());
+    ASSERT_EQ(instrumentation::clip_snapshot(
+                      instrumentation::unlabeled_site, "batch::color_cast")
+                      .calls,
+            1);
+}
+#endif
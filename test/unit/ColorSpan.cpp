@@ -0,0 +1,63 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "Hsv.h"
+#include "ColorSpan.h"
+
+using namespace color;
+
+TEST(ColorSpan, views_colors) {
+    auto colors = std::vector<Rgb<uint8_t>>{Rgb<uint8_t>(1, 2, 3),
+            Rgb<uint8_t>(4, 5, 6),
+            Rgb<uint8_t>(7, 8, 9)};
+    auto span = ColorSpan<Rgb<uint8_t>>(colors.data(), colors.size());
+    EXPECT_EQ(span.size(), 3u);
+    EXPECT_EQ(span.size_bytes(), 9u);
+    EXPECT_FALSE(span.empty());
+    EXPECT_EQ(span[1], Rgb<uint8_t>(4, 5, 6));
+    EXPECT_EQ(span.back(), Rgb<uint8_t>(7, 8, 9));
+    EXPECT_EQ(span.elements()[3], 4);
+    EXPECT_EQ(std::vector<Rgb<uint8_t>>(span.begin(), span.end()), colors);
+    EXPECT_EQ(*span.rbegin(), colors.back());
+
+    span[0] = Rgb<uint8_t>(10, 20, 30);
+    EXPECT_EQ(colors[0], Rgb<uint8_t>(10, 20, 30));
+
+    const ColorSpan<const Rgb<uint8_t>> read_only = span;
+    EXPECT_EQ(read_only.data(), colors.data());
+    EXPECT_EQ(read_only.subspan(1).front(), colors[1]);
+    EXPECT_EQ(read_only.subspan(1, 1).size(), 1u);
+    EXPECT_EQ(read_only.first(2).back(), colors[1]);
+    EXPECT_EQ(read_only.last(1).front(), colors[2]);
+    EXPECT_TRUE(ColorSpan<const Hsv<float>>().empty());
+}
+
+TEST(ColorSpan, color_span_cast) {
+    const uint16_t elements[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    const auto span =
+            color_span_cast<Alpha<uint16_t, Rgb>>(elements, sizeof(elements));
+    ASSERT_EQ(span.size(), 2u);
+    EXPECT_EQ(span[1], (Alpha<uint16_t, Rgb>(Rgb<uint16_t>(5, 6, 7), 8)));
+    EXPECT_EQ(static_cast<const void*>(span.data()), elements);
+
+    auto bytes = std::vector<float>(6);
+    auto mutable_span = color_span_cast<Rgb<float>>(
+            static_cast<void*>(bytes.data()), bytes.size() * sizeof(float));
+    mutable_span[1] = Rgb<float>(0.5f, 0.25f, 1.0f);
+    EXPECT_EQ(bytes[4], 0.25f);
+}
+
+TEST(ColorSpan, alignment) {
+    alignas(4) unsigned char bytes[16] = {};
+    EXPECT_TRUE(is_color_aligned<Rgb<float>>(bytes));
+    EXPECT_FALSE(is_color_aligned<Rgb<float>>(bytes + 2));
+    EXPECT_TRUE(is_color_aligned<Rgb<uint8_t>>(bytes + 1));
+    EXPECT_THROW(color_span_cast<Rgb<float>>(
+                         static_cast<const void*>(bytes + 2), 12),
+            AlignmentError);
+}
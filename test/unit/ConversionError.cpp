@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+
+#include "ConversionRef.h"
+#include "ColorCast.h"
+#include "Hsi.h"
+#include "Hsl.h"
+#include "Hsv.h"
+#include "Rgb.h"
+
+using namespace color;
+using namespace conversion_error;
+
+TEST(ConversionError, histogram) {
+    auto hist = ErrorHistogram();
+    for(int i = 0; i < 1000; ++i) {
+        hist.add(i < 990 ? 1e-6 : 1e-2);
+    }
+
+    ASSERT_EQ(hist.count(), 1000);
+    ASSERT_DOUBLE_EQ(hist.max(), 1e-2);
+    ASSERT_NEAR(hist.mean(), (990 * 1e-6 + 10 * 1e-2) / 1000, 1e-12);
+    // Percentiles are reported as the upper edge of their bin.
+    ASSERT_GE(hist.percentile(0.5), 1e-6);
+    ASSERT_LT(hist.percentile(0.5), 1.1e-6);
+    ASSERT_DOUBLE_EQ(hist.percentile(0.999), 1e-2);
+}
+
+TEST(ConversionError, input_spaces) {
+    auto all_rgb = Rgb8Space();
+    ASSERT_EQ(all_rgb.size(), 256 * 256 * 256);
+    ASSERT_EQ(all_rgb(0), Rgb<uint8_t>(0, 0, 0));
+    ASSERT_EQ(all_rgb(all_rgb.size() - 1), Rgb<uint8_t>(255, 255, 255));
+
+    auto sparse_rgb = Rgb8Space(5);
+    ASSERT_EQ(sparse_rgb.size(), 52 * 52 * 52);
+    ASSERT_EQ(sparse_rgb(sparse_rgb.size() - 1), Rgb<uint8_t>(255, 255, 255));
+
+    auto grid = FloatGridSpace<Rgb<float>>(5);
+    ASSERT_EQ(grid.size(), 125);
+    ASSERT_EQ(grid(1), Rgb<float>(0.25, 0.0, 0.0));
+    ASSERT_EQ(grid(124), Rgb<float>(1.0, 1.0, 1.0));
+}
+
+TEST(ConversionError, identical_paths) {
+    auto convert = [](const Rgb<float>& c) { return to_hsl(c); };
+    auto report = measure_conversion(FloatGridSpace<Rgb<float>>(9),
+            convert,
+            convert,
+            [](const Hsl<float>& c) { return to_rgb(c); });
+
+    ASSERT_EQ(report.samples, 9 * 9 * 9);
+    ASSERT_EQ(report.hue_channel, 0);
+    ASSERT_EQ(report.channels.size(), 3);
+    ASSERT_EQ(report.max_error(), 0.0);
+    ASSERT_EQ(report.round_trip.size(), 3);
+    ASSERT_LT(report.max_round_trip_error(), 1e-5);
+    ASSERT_GT(report.fast_rate, 0.0);
+}
+
+TEST(ConversionError, hue_is_cyclic) {
+    auto report = measure_conversion(FloatGridSpace<Rgb<float>>(2),
+            [](const Rgb<float>&) { return Hsv<float>(0.99, 0.5, 0.5); },
+            [](const Rgb<float>&) { return Hsv<float>(0.01, 0.5, 0.5); });
+
+    ASSERT_NEAR(report.channels[0].max, 0.02, 1e-6);
+    ASSERT_EQ(report.channels[1].max, 0.0);
+}
+
+TEST(ConversionError, float_vs_double_rgb8) {
+    auto report = measure_conversion(Rgb8Space(15),
+            [](const Rgb<uint8_t>& c) { return to_hsv<uint8_t, double>(c); },
+            [](const Rgb<uint8_t>& c) { return to_hsv<uint8_t, float>(c); },
+            [](const Hsv<uint8_t>& c) { return to_rgb(c); });
+
+    // Both paths quantize to the same 8 bit grid, so they may differ by
+    // at most one step.
+    ASSERT_LE(report.max_error(), 1.0 / 255.0 + 1e-9);
+    ASSERT_LE(report.channels[1].p99, 1.0 / 255.0 + 1e-9);
+    // Truncating casts lose a few steps over a round trip.
+    ASSERT_LT(report.max_round_trip_error(), 0.05);
+}
@@ -1,7 +1,18 @@
 #ifndef CONVERSIONREF_H_
 #define CONVERSIONREF_H_
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include "Rgb.h"
 #include "Hsv.h"
@@ -169,4 +180,401 @@ static constexpr std::array<float, 19> CIRCULAR_HUE_TEST = {
 };
 }
 
+
+// Accuracy harness for approximate conversion kernels.
+//
+// A fast path is compared against a scalar reference over an input space
+// (every Rgb<uint8_t>, or a dense grid of floating point colors). All
+// errors are measured on normalized channel values, so the numbers are
+// comparable across element types. Hue channels are compared by cyclic
+// distance, so 0.99 vs 0.01 is an error of 0.02.
+
+namespace conversion_error {
+
+/** Histogram of absolute errors on a log scale, used to estimate
+ *  percentiles without storing one error per sample.
+ */
+class ErrorHistogram {
+public:
+    static constexpr int bins_per_decade = 64;
+    static constexpr int min_exponent = -9;
+    static constexpr int num_decades = 10;
+    // Bin 0 holds exact matches and bin 1 everything below 10^min_exponent.
+    static constexpr int num_bins = bins_per_decade * num_decades + 2;
+
+    void add(double error) {
+        m_max = std::max(m_max, error);
+        m_sum += error;
+        ++m_count;
+        ++m_bins[bin_for(error)];
+    }
+
+    void merge(const ErrorHistogram& other) {
+        m_max = std::max(m_max, other.m_max);
+        m_sum += other.m_sum;
+        m_count += other.m_count;
+        for(int i = 0; i < num_bins; ++i) {
+            m_bins[i] += other.m_bins[i];
+        }
+    }
+
+    double max() const { return m_max; }
+    double mean() const { return m_count ? m_sum / m_count : 0.0; }
+    std::uint64_t count() const { return m_count; }
+
+    /** Return an upper bound on the \a p quantile (\a p in `[0, 1]`).
+     *  The bound is the upper edge of the bin holding the quantile,
+     *  so it is accurate to within 1/bins_per_decade of a decade.
+     */
+    double percentile(double p) const {
+        const auto target = static_cast<std::uint64_t>(p * m_count);
+        std::uint64_t seen = 0;
+        for(int i = 0; i < num_bins; ++i) {
+            seen += m_bins[i];
+            if(seen > target || (seen == m_count && seen != 0)) {
+                return std::min(upper_edge(i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+private:
+    static int bin_for(double error) {
+        if(error <= 0.0) {
+            return 0;
+        }
+        const auto scaled =
+                (std::log10(error) - min_exponent) * bins_per_decade;
+        if(scaled < 0.0) {
+            return 1;
+        }
+        return std::min(num_bins - 1, 2 + static_cast<int>(scaled));
+    }
+
+    static double upper_edge(int bin) {
+        if(bin == 0) {
+            return 0.0;
+        }
+        return std::pow(
+                10.0, min_exponent + double(bin - 1) / bins_per_decade);
+    }
+
+    std::array<std::uint64_t, num_bins> m_bins{};
+    double m_max = 0.0;
+    double m_sum = 0.0;
+    std::uint64_t m_count = 0;
+};
+
+/// Summary statistics for the error of a single channel.
+struct ErrorStats {
+    double max;
+    double mean;
+    double p50;
+    double p99;
+    double p999;
+
+    static ErrorStats from_histogram(const ErrorHistogram& hist) {
+        return {hist.max(),
+                hist.mean(),
+                hist.percentile(0.5),
+                hist.percentile(0.99),
+                hist.percentile(0.999)};
+    }
+};
+
+/// Result of comparing a fast conversion against its reference.
+struct ConversionErrorReport {
+    std::uint64_t samples = 0;
+    /// Error of fast vs. reference output, per output channel.
+    std::vector<ErrorStats> channels;
+    /// Index into ConversionErrorReport::channels of the hue, or -1.
+    int hue_channel = -1;
+    /// Drift of inverse(fast(x)) vs. x per input channel. Empty if no
+    /// inverse was supplied.
+    std::vector<ErrorStats> round_trip;
+    /// Colors converted per second by the reference path.
+    double reference_rate = 0.0;
+    /// Colors converted per second by the fast path.
+    double fast_rate = 0.0;
+
+    /// Largest error over all output channels.
+    double max_error() const {
+        double out = 0.0;
+        for(const auto& stats : channels) {
+            out = std::max(out, stats.max);
+        }
+        return out;
+    }
+
+    /// Largest round trip drift over all channels.
+    double max_round_trip_error() const {
+        double out = 0.0;
+        for(const auto& stats : round_trip) {
+            out = std::max(out, stats.max);
+        }
+        return out;
+    }
+};
+
+inline std::ostream& operator<<(
+        std::ostream& stream, const ConversionErrorReport& report) {
+    auto print_stats = [&stream](const char* label, const ErrorStats& stats) {
+        stream << "  " << std::setw(12) << std::left << label << std::right
+               << std::scientific << std::setprecision(3)
+               << " max=" << stats.max << " mean=" << stats.mean
+               << " p50=" << stats.p50 << " p99=" << stats.p99
+               << " p99.9=" << stats.p999 << "\n";
+    };
+    stream << report.samples << " samples\n";
+    for(std::size_t i = 0; i < report.channels.size(); ++i) {
+        auto label = std::string("channel ") + std::to_string(i);
+        if(int(i) == report.hue_channel) {
+            label += " (hue)";
+        }
+        print_stats(label.c_str(), report.channels[i]);
+    }
+    for(std::size_t i = 0; i < report.round_trip.size(); ++i) {
+        auto label = std::string("round trip ") + std::to_string(i);
+        print_stats(label.c_str(), report.round_trip[i]);
+    }
+    stream << std::defaultfloat << std::setprecision(4)
+           << "  reference: " << report.reference_rate * 1e-6
+           << " Mcolors/s, fast: " << report.fast_rate * 1e-6
+           << " Mcolors/s\n";
+    return stream;
+}
+
+/** Input space containing every Rgb<uint8_t>, or with \a stride > 1
+ *  every color whose channels are multiples of \a stride.
+ */
+class Rgb8Space {
+public:
+    using ColorType = Rgb<uint8_t>;
+
+    explicit Rgb8Space(int stride = 1)
+        : m_stride(stride), m_steps((255 + stride) / stride) {}
+
+    std::size_t size() const { return m_steps * m_steps * m_steps; }
+
+    ColorType operator()(std::size_t i) const {
+        const auto r = i % m_steps;
+        const auto g = (i / m_steps) % m_steps;
+        const auto b = i / (m_steps * m_steps);
+        return ColorType(uint8_t(r * m_stride),
+                uint8_t(g * m_stride),
+                uint8_t(b * m_stride));
+    }
+
+private:
+    std::size_t m_stride;
+    std::size_t m_steps;
+};
+
+/** Input space holding a uniform grid of floating point colors with
+ *  \a steps samples per channel, including both endpoints.
+ */
+template <typename Color>
+class FloatGridSpace {
+public:
+    using ColorType = Color;
+    using T = typename Color::ElementType;
+
+    explicit FloatGridSpace(std::size_t steps) : m_steps(steps) {}
+
+    std::size_t size() const {
+        std::size_t out = 1;
+        for(int i = 0; i < Color::num_channels; ++i) {
+            out *= m_steps;
+        }
+        return out;
+    }
+
+    ColorType operator()(std::size_t i) const {
+        auto out = ColorType();
+        for(int c = 0; c < Color::num_channels; ++c) {
+            out.data()[c] = T(i % m_steps) / T(m_steps - 1);
+            i /= m_steps;
+        }
+        return out;
+    }
+
+private:
+    std::size_t m_steps;
+};
+
+namespace details {
+
+template <typename Color>
+using is_cylindrical = std::is_base_of<
+        CylindricalColor<typename Color::ElementType, Color>,
+        Color>;
+
+/// Accumulate per-channel errors between \a lhs and \a rhs.
+template <typename Color>
+inline void accumulate_errors(const Color& lhs,
+        const Color& rhs,
+        bool cyclic_first_channel,
+        std::vector<ErrorHistogram>& hists) {
+    const auto lhs_norm = color_cast<double>(lhs).as_array();
+    const auto rhs_norm = color_cast<double>(rhs).as_array();
+    for(int c = 0; c < Color::num_channels; ++c) {
+        auto error = std::abs(lhs_norm[c] - rhs_norm[c]);
+        if(c == 0 && cyclic_first_channel) {
+            error = std::fmod(error, 1.0);
+            error = std::min(error, 1.0 - error);
+        }
+        hists[c].add(error);
+    }
+}
+
+/// Placeholder inverse for sweeps that skip the round trip.
+struct NoInverse {};
+
+template <typename Color, typename OutColor, typename InverseFn>
+inline void accumulate_round_trip(const Color& input,
+        const OutColor& output,
+        const InverseFn& inverse,
+        std::vector<ErrorHistogram>& hists) {
+    accumulate_errors(
+            input, inverse(output), is_cylindrical<Color>::value, hists);
+}
+
+template <typename Color, typename OutColor>
+inline void accumulate_round_trip(const Color& /* input */,
+        const OutColor& /* output */,
+        const NoInverse& /* inverse */,
+        std::vector<ErrorHistogram>& /* hists */) {}
+
+/// Run fn(begin, end, thread_index) over [0, n) split across threads.
+template <typename Fn>
+inline void parallel_for(std::size_t n, unsigned num_threads, const Fn& fn) {
+    num_threads = std::max(1u, num_threads);
+    const auto chunk = (n + num_threads - 1) / num_threads;
+    auto threads = std::vector<std::thread>();
+    for(unsigned t = 1; t < num_threads; ++t) {
+        const auto begin = std::min(n, t * chunk);
+        const auto end = std::min(n, begin + chunk);
+        threads.emplace_back([&fn, begin, end, t] { fn(begin, end, t); });
+    }
+    fn(0, std::min(n, chunk), 0u);
+    for(auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/// Time one pass of \a convert over \a inputs, returning colors/s.
+template <typename Space, typename Fn>
+inline double measure_rate(
+        const Space& inputs, const Fn& convert, unsigned num_threads) {
+    auto sinks = std::vector<double>(num_threads);
+    const auto start = std::chrono::steady_clock::now();
+    parallel_for(inputs.size(),
+            num_threads,
+            [&](std::size_t begin, std::size_t end, unsigned t) {
+                double sink = 0.0;
+                for(auto i = begin; i < end; ++i) {
+                    sink += convert(inputs(i)).data()[0];
+                }
+                sinks[t] = sink;
+            });
+    const auto elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start);
+    // Keep the conversions observable so they are not optimized away.
+    volatile double total = std::accumulate(sinks.begin(), sinks.end(), 0.0);
+    (void)total;
+    return inputs.size() / std::max(elapsed.count(), 1e-12);
+}
+
+template <typename Space,
+        typename RefFn,
+        typename FastFn,
+        typename InverseFn>
+inline ConversionErrorReport measure_impl(const Space& inputs,
+        const RefFn& reference,
+        const FastFn& fast,
+        const InverseFn& inverse,
+        unsigned num_threads) {
+    constexpr bool has_inverse = !std::is_same<InverseFn, NoInverse>::value;
+    using InColor = typename Space::ColorType;
+    using OutColor = std::decay_t<decltype(fast(inputs(0)))>;
+    constexpr bool out_is_cylindrical = is_cylindrical<OutColor>::value;
+
+    auto channel_hists = std::vector<std::vector<ErrorHistogram>>(
+            num_threads,
+            std::vector<ErrorHistogram>(OutColor::num_channels));
+    auto round_trip_hists = std::vector<std::vector<ErrorHistogram>>(
+            num_threads,
+            std::vector<ErrorHistogram>(InColor::num_channels));
+
+    parallel_for(inputs.size(),
+            num_threads,
+            [&](std::size_t begin, std::size_t end, unsigned t) {
+                for(auto i = begin; i < end; ++i) {
+                    const auto input = inputs(i);
+                    const auto fast_out = fast(input);
+                    accumulate_errors(reference(input),
+                            fast_out,
+                            out_is_cylindrical,
+                            channel_hists[t]);
+                    accumulate_round_trip(
+                            input, fast_out, inverse, round_trip_hists[t]);
+                }
+            });
+
+    auto report = ConversionErrorReport();
+    report.samples = inputs.size();
+    report.hue_channel = out_is_cylindrical ? 0 : -1;
+    for(int c = 0; c < OutColor::num_channels; ++c) {
+        for(unsigned t = 1; t < num_threads; ++t) {
+            channel_hists[0][c].merge(channel_hists[t][c]);
+        }
+        report.channels.push_back(
+                ErrorStats::from_histogram(channel_hists[0][c]));
+    }
+    if(has_inverse) {
+        for(int c = 0; c < InColor::num_channels; ++c) {
+            for(unsigned t = 1; t < num_threads; ++t) {
+                round_trip_hists[0][c].merge(round_trip_hists[t][c]);
+            }
+            report.round_trip.push_back(
+                    ErrorStats::from_histogram(round_trip_hists[0][c]));
+        }
+    }
+    report.reference_rate = measure_rate(inputs, reference, num_threads);
+    report.fast_rate = measure_rate(inputs, fast, num_threads);
+    return report;
+}
+}
+
+inline unsigned default_thread_count() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/** Compare \a fast against \a reference over every color in \a inputs.
+ *  Both functions take a `Space::ColorType` and must return the same
+ *  color type. The sweep runs on \a num_threads threads.
+ */
+template <typename Space, typename RefFn, typename FastFn>
+inline ConversionErrorReport measure_conversion(const Space& inputs,
+        const RefFn& reference,
+        const FastFn& fast,
+        unsigned num_threads = default_thread_count()) {
+    return details::measure_impl(
+            inputs, reference, fast, details::NoInverse(), num_threads);
+}
+
+/** Same as measure_conversion(), but also reports the round trip drift
+ *  of `inverse(fast(x))` against `x`.
+ */
+template <typename Space, typename RefFn, typename FastFn, typename InverseFn>
+inline ConversionErrorReport measure_conversion(const Space& inputs,
+        const RefFn& reference,
+        const FastFn& fast,
+        const InverseFn& inverse,
+        unsigned num_threads = default_thread_count()) {
+    return details::measure_impl(
+            inputs, reference, fast, inverse, num_threads);
+}
+}
+
 #endif
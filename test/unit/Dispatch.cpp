@@ -0,0 +1,286 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "Hsv.h"
+#include "Hsl.h"
+#include "Hsi.h"
+#include "ColorCast.h"
+#include "Batch.h"
+#include "ByteOrder.h"
+#include "ByteShuffle.h"
+#include "Dispatch.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+/// Deterministic colors covering every hue sector and the gray axis.
+template <typename T>
+std::vector<Rgb<T>> test_colors() {
+    auto out = std::vector<Rgb<T>>();
+    const int steps = 9;
+    for(int r = 0; r < steps; ++r) {
+        for(int g = 0; g < steps; ++g) {
+            for(int b = 0; b < steps; ++b) {
+                out.push_back(color_cast<T>(Rgb<float>(float(r) / (steps - 1),
+                        float(g) / (steps - 1),
+                        float(b) / (steps - 1))));
+            }
+        }
+    }
+    return out;
+}
+
+template <typename Color>
+void expect_near(const Color& expected, const Color& actual, double tolerance) {
+    for(std::size_t c = 0; c < Color::num_channels; ++c) {
+        EXPECT_NEAR(expected.data()[c], actual.data()[c], tolerance);
+    }
+}
+
+/** Run a transform kernel at every supported level and compare against
+ *  the scalar version. Different levels may contract floating point
+ *  operations differently, so allow a small tolerance.
+ */
+template <typename Fn, typename In, typename Out>
+void cross_check_transform(const std::vector<In>& in, double tolerance) {
+    using Kernel = details::transform_kernel<In, Out, Fn>;
+    auto expected = std::vector<Out>(in.size());
+    dispatch_at<Kernel>(IsaLevel::Scalar, in.data(), in.size(), expected.data());
+
+    for(auto level : supported_levels()) {
+        SCOPED_TRACE(isa_level_name(level));
+        auto actual = std::vector<Out>(in.size());
+        dispatch_at<Kernel>(level, in.data(), in.size(), actual.data());
+        for(std::size_t i = 0; i < in.size(); ++i) {
+            expect_near(expected[i], actual[i], tolerance);
+        }
+    }
+}
+}
+
+TEST(Dispatch, isa_level_names) {
+    for(int i = 0; i < num_isa_levels; ++i) {
+        const auto level = static_cast<IsaLevel>(i);
+        auto parsed = IsaLevel::Scalar;
+        ASSERT_TRUE(parse_isa_level(isa_level_name(level), parsed));
+        ASSERT_EQ(parsed, level);
+    }
+    auto parsed = IsaLevel::Avx2;
+    ASSERT_FALSE(parse_isa_level("avx3", parsed));
+    ASSERT_EQ(parsed, IsaLevel::Avx2);
+}
+
+TEST(Dispatch, active_level) {
+    ASSERT_LE(active_isa_level(), detected_isa_level());
+}
+
+TEST(Dispatch, batch_matches_single) {
+    const auto rgb = test_colors<uint8_t>();
+    auto hsv = std::vector<Hsv<uint8_t>>(rgb.size());
+    auto hsl = std::vector<Hsl<uint8_t>>(rgb.size());
+    auto hsi = std::vector<Hsi<uint8_t>>(rgb.size());
+    auto back = std::vector<Rgb<uint8_t>>(rgb.size());
+    auto as_float = std::vector<Rgb<float>>(rgb.size());
+
+    batch::to_hsv(rgb.data(), rgb.size(), hsv.data());
+    batch::to_hsl(rgb.data(), rgb.size(), hsl.data());
+    batch::to_hsi(rgb.data(), rgb.size(), hsi.data());
+    batch::to_rgb(hsv.data(), hsv.size(), back.data());
+    batch::color_cast<float>(rgb.data(), rgb.size(), as_float.data());
+
+    for(std::size_t i = 0; i < rgb.size(); ++i) {
+        ASSERT_EQ(hsv[i], to_hsv(rgb[i]));
+        ASSERT_EQ(hsl[i], to_hsl(rgb[i]));
+        ASSERT_EQ(hsi[i], to_hsi(rgb[i]));
+        ASSERT_EQ(back[i], to_rgb(hsv[i]));
+        ASSERT_EQ(as_float[i], color_cast<float>(rgb[i]));
+    }
+}
+
+TEST(Dispatch, conversions_all_levels) {
+    const auto rgb8 = test_colors<uint8_t>();
+    const auto rgbf = test_colors<float>();
+    const auto rgbd = test_colors<double>();
+
+    // Integer conversions compute in float and round, so a contracted
+    // multiply-add may move a result by one.
+    cross_check_transform<details::to_hsv_fn, Rgb<uint8_t>, Hsv<uint8_t>>(
+            rgb8, 1);
+    cross_check_transform<details::to_hsl_fn, Rgb<uint8_t>, Hsl<uint8_t>>(
+            rgb8, 1);
+    cross_check_transform<details::to_hsi_fn, Rgb<uint8_t>, Hsi<uint8_t>>(
+            rgb8, 1);
+    cross_check_transform<details::to_hsv_fn, Rgb<float>, Hsv<float>>(
+            rgbf, 1e-5);
+    cross_check_transform<details::to_hsl_fn, Rgb<float>, Hsl<float>>(
+            rgbf, 1e-5);
+    cross_check_transform<details::to_hsi_fn, Rgb<float>, Hsi<float>>(
+            rgbf, 1e-5);
+    cross_check_transform<details::to_hsv_fn, Rgb<double>, Hsv<double>>(
+            rgbd, 1e-12);
+
+    auto hsvf = std::vector<Hsv<float>>(rgbf.size());
+    batch::to_hsv(rgbf.data(), rgbf.size(), hsvf.data());
+    cross_check_transform<details::to_rgb_fn, Hsv<float>, Rgb<float>>(
+            hsvf, 1e-5);
+    auto hsif = std::vector<Hsi<float>>(rgbf.size());
+    batch::to_hsi(rgbf.data(), rgbf.size(), hsif.data());
+    cross_check_transform<details::to_rgb_fn, Hsi<float>, Rgb<float>>(
+            hsif, 1e-5);
+}
+
+TEST(Dispatch, casts_all_levels) {
+    const auto rgb8 = test_colors<uint8_t>();
+    const auto rgbf = test_colors<float>();
+    cross_check_transform<details::color_cast_fn<float>,
+            Rgb<uint8_t>,
+            Rgb<float>>(rgb8, 1e-6);
+    cross_check_transform<details::color_cast_fn<uint16_t>,
+            Rgb<uint8_t>,
+            Rgb<uint16_t>>(rgb8, 0);
+    cross_check_transform<details::color_cast_fn<uint8_t>,
+            Rgb<float>,
+            Rgb<uint8_t>>(rgbf, 0);
+}
+
+TEST(Dispatch, flat_packer_all_levels) {
+    const auto rgb = test_colors<uint16_t>();
+    const auto formats = std::vector<std::vector<int>>{
+            {0, 1, 2},
+            {2, 1, 0},
+            {packer_index_skip, 0, 1, 2},
+            {0, 1},
+            {2, 2, packer_index_skip, 1, 0}};
+
+    for(const auto& format : formats) {
+        const auto size = format.size();
+        auto expected = std::vector<uint16_t>(rgb.size() * size);
+        for(std::size_t i = 0; i < rgb.size(); ++i) {
+            for(std::size_t j = 0; j < size; ++j) {
+                expected[i * size + j] = format[j] == packer_index_skip
+                        ? 0
+                        : rgb[i].data()[format[j]];
+            }
+        }
+
+        for(auto level : supported_levels()) {
+            SCOPED_TRACE(isa_level_name(level));
+            auto actual = std::vector<uint16_t>(expected.size(), 1);
+            dispatch_at<details::flat_pack_kernel<uint16_t, 3, 0>>(level,
+                    rgb[0].data(),
+                    rgb.size(),
+                    format.data(),
+                    size,
+                    actual.data());
+            ASSERT_EQ(actual, expected);
+        }
+    }
+}
+
+TEST(Dispatch, flat_unpacker_all_levels) {
+    const auto rgba = std::vector<uint8_t>{
+            1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    // Channel sources for an ARGB format: red from element 1 and so on,
+    // with the alpha channel taken from element 0.
+    const auto sources = std::vector<int>{1, 2, 3, 0};
+    const auto no_alpha = std::vector<int>{1, 2, 3, -1};
+
+    for(auto level : supported_levels()) {
+        SCOPED_TRACE(isa_level_name(level));
+        auto out = std::vector<uint8_t>(rgba.size());
+        dispatch_at<details::flat_unpack_kernel<uint8_t, 4, 4>>(level,
+                rgba.data(),
+                std::size_t(4),
+                sources.data(),
+                std::size_t(4),
+                out.data());
+        ASSERT_EQ(out,
+                (std::vector<uint8_t>{
+                        2, 3, 4, 1, 6, 7, 8, 5, 10, 11, 12, 9, 14, 15, 16, 13}));
+
+        dispatch_at<details::flat_unpack_kernel<uint8_t, 4, 0>>(level,
+                rgba.data(),
+                std::size_t(4),
+                no_alpha.data(),
+                std::size_t(4),
+                out.data());
+        ASSERT_EQ(out,
+                (std::vector<uint8_t>{
+                        2, 3, 4, 0, 6, 7, 8, 0, 10, 11, 12, 0, 14, 15, 16, 0}));
+    }
+}
+
+TEST(Dispatch, byteswap_all_levels) {
+    auto values = std::vector<uint32_t>();
+    for(uint32_t i = 0; i < 100; ++i) {
+        values.push_back(i * 0x01020304u);
+    }
+
+    for(auto level : supported_levels()) {
+        SCOPED_TRACE(isa_level_name(level));
+        auto swapped = std::vector<uint32_t>(values.size());
+        dispatch_at<details::byteswap_kernel<uint32_t>>(level,
+                reinterpret_cast<const unsigned char*>(values.data()),
+                values.size(),
+                reinterpret_cast<unsigned char*>(swapped.data()));
+        for(std::size_t i = 0; i < values.size(); ++i) {
+            ASSERT_EQ(swapped[i], __builtin_bswap32(values[i]));
+        }
+    }
+}
+
+TEST(Dispatch, byte_shuffle_all_levels) {
+    // Swap the bytes of three 16-bit elements and reverse their order,
+    // then append a zero element.
+    const auto shuffle =
+            details::make_byte_shuffle(6, {5, 4, 3, 2, 1, 0, -1, -1});
+    auto in = std::vector<unsigned char>(6 * 37);
+    for(std::size_t i = 0; i < in.size(); ++i) {
+        in[i] = static_cast<unsigned char>(i);
+    }
+    auto expected = std::vector<unsigned char>();
+    for(std::size_t i = 0; i < in.size(); i += 6) {
+        for(int b = 5; b >= 0; --b) {
+            expected.push_back(in[i + b]);
+        }
+        expected.push_back(0);
+        expected.push_back(0);
+    }
+
+    for(auto level : supported_levels()) {
+        SCOPED_TRACE(isa_level_name(level));
+        auto out = std::vector<unsigned char>(expected.size(), 1);
+        dispatch_at<details::byte_shuffle_kernel>(level,
+                static_cast<const unsigned char*>(in.data()),
+                std::size_t(37),
+                &shuffle,
+                out.data());
+        ASSERT_EQ(out, expected);
+    }
+
+    // Bytes without a source take their fill byte instead.
+    const auto filled = details::make_byte_shuffle(
+            6, {5, 4, 3, 2, 1, 0, -1, -1}, {9, 9, 9, 9, 9, 9, 0xab, 0xcd});
+    for(std::size_t i = 0; i < expected.size(); i += 8) {
+        expected[i + 6] = 0xab;
+        expected[i + 7] = 0xcd;
+    }
+    for(auto level : supported_levels()) {
+        SCOPED_TRACE(isa_level_name(level));
+        auto out = std::vector<unsigned char>(expected.size(), 1);
+        dispatch_at<details::byte_shuffle_kernel>(level,
+                static_cast<const unsigned char*>(in.data()),
+                std::size_t(37),
+                &filled,
+                out.data());
+        ASSERT_EQ(out, expected);
+    }
+}
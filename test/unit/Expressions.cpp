@@ -0,0 +1,162 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "Hsv.h"
+#include "Expressions.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+/// Colors with random elements, which are rarely exact in binary.
+std::vector<Rgb<float>> random_colors(std::size_t count, unsigned seed) {
+    auto engine = std::mt19937(seed);
+    auto dist = std::uniform_real_distribution<float>(0.0f, 1.0f);
+    auto colors = std::vector<Rgb<float>>();
+    for(std::size_t i = 0; i < count; ++i) {
+        colors.emplace_back(dist(engine), dist(engine), dist(engine));
+    }
+    return colors;
+}
+}
+
+TEST(Arithmetic, rgb_operators) {
+    const auto a = Rgb<float>(0.5f, 0.25f, 1.0f);
+    const auto b = Rgb<float>(0.25f, 0.5f, 0.5f);
+
+    EXPECT_EQ(a + b, Rgb<float>(0.75f, 0.75f, 1.5f));
+    EXPECT_EQ(a - b, Rgb<float>(0.25f, -0.25f, 0.5f));
+    EXPECT_EQ(a * b, Rgb<float>(0.125f, 0.125f, 0.5f));
+    EXPECT_EQ(a * 2.0f, Rgb<float>(1.0f, 0.5f, 2.0f));
+    EXPECT_EQ(2.0f * a, a * 2.0f);
+    EXPECT_EQ(a / 2.0f, Rgb<float>(0.25f, 0.125f, 0.5f));
+    EXPECT_EQ(a * 0.5f, a.scale(0.5f));
+
+    auto c = a;
+    c += b;
+    c -= b;
+    EXPECT_EQ(c, a);
+    c *= 2.0f;
+    c /= 2.0f;
+    EXPECT_EQ(c, a);
+    c *= b;
+    EXPECT_EQ(c, a * b);
+}
+
+TEST(Arithmetic, integer_and_alpha_operators) {
+    const auto a = Rgb<uint8_t>(200, 100, 10);
+    const auto b = Rgb<uint8_t>(100, 50, 5);
+
+    // Integer elements wrap like the element type.
+    EXPECT_EQ(a + b, Rgb<uint8_t>(44, 150, 15));
+    EXPECT_EQ(a - b, b);
+    EXPECT_EQ(a * 0.5f, a.scale(0.5f));
+    EXPECT_EQ(a / 2, b);
+
+    const auto rgba = Rgba<float>(0.5f, 0.25f, 1.0f, 0.5f);
+    EXPECT_EQ(rgba + rgba, Rgba<float>(1.0f, 0.5f, 2.0f, 1.0f));
+    EXPECT_EQ(rgba.scale(2.0f), rgba * 2.0f);
+}
+
+TEST(Expressions, matches_color_operations) {
+    // Not a multiple of any vector width.
+    const auto a = make_unit_colors(1037, 0);
+    const auto b = make_unit_colors(1037, 3);
+    const auto k = 1.5f;
+
+    auto expected = std::vector<Rgb<float>>();
+    for(std::size_t i = 0; i < a.size(); ++i) {
+        const auto blend = (a[i] * k + b[i].inverse()).normalize();
+        expected.push_back(
+                blend.lerp(b[i], 0.25f).clamp(0.1f, 0.9f).inverse() / 2.0f);
+    }
+
+    const auto ea = expr::buffer(a);
+    const auto eb = expr::buffer(b);
+    const auto blend = (ea * k + eb.inverse()).normalize();
+    const auto e = blend.lerp(eb, 0.25f).clamp(0.1f, 0.9f).inverse() / 2.0f;
+    static_assert(decltype(e)::flat, "Rgb expressions are computed flat");
+    EXPECT_EQ(e.size(), a.size());
+    EXPECT_EQ(e.to_vector(), expected);
+
+    // Evaluated in place over one of its inputs.
+    auto in_place = a;
+    auto ei = expr::buffer(in_place);
+    (ei.scale(k) - eb * 0.5f).clamp(0.0f, 1.0f).eval(in_place.data());
+    for(std::size_t i = 0; i < a.size(); ++i) {
+        EXPECT_EQ(in_place[i],
+                (a[i].scale(k) - b[i] * 0.5f).clamp(0.0f, 1.0f));
+    }
+}
+
+TEST(Expressions, constant_colors) {
+    const auto a = make_unit_colors(100, 0);
+    const auto tint = Rgb<float>(1.0f, 0.5f, 0.25f);
+
+    const auto e = (expr::buffer(a) * tint + tint).lerp(tint, 0.5f);
+    static_assert(!decltype(e)::flat, "constant colors are per channel");
+
+    auto out = std::vector<Rgb<float>>(a.size());
+    e.eval(ColorSpan<Rgb<float>>(out.data(), out.size()));
+    for(std::size_t i = 0; i < a.size(); ++i) {
+        EXPECT_EQ(out[i], (a[i] * tint + tint).lerp(tint, 0.5f));
+    }
+}
+
+TEST(Expressions, integer_and_cylindrical_colors) {
+    auto rgb = std::vector<Rgba<uint8_t>>();
+    for(int i = 0; i < 300; ++i) {
+        rgb.emplace_back(uint8_t(i), uint8_t(i * 7), uint8_t(i * 13), 200);
+    }
+    const auto e8 = (expr::buffer(rgb).inverse() * 0.75f).lerp(
+            expr::buffer(rgb), 0.5f);
+    const auto out8 = e8.to_vector();
+    for(std::size_t i = 0; i < rgb.size(); ++i) {
+        EXPECT_EQ(out8[i], (rgb[i].inverse() * 0.75f).lerp(rgb[i], 0.5f));
+    }
+
+    // The periodic hue channel is inverted and normalized differently.
+    auto hsv = std::vector<Hsv<float>>();
+    for(int i = 0; i < 50; ++i) {
+        hsv.emplace_back(float(i) / 50.0f, 0.5f, float(i % 7) / 3.0f);
+    }
+    const auto eh = (expr::buffer(hsv).inverse() * 2.0f).normalize();
+    static_assert(!decltype(eh)::flat, "hue is computed per channel");
+    const auto out = eh.to_vector();
+    for(std::size_t i = 0; i < hsv.size(); ++i) {
+        EXPECT_EQ(out[i], (hsv[i].inverse() * 2.0f).normalize());
+    }
+}
+
+TEST(Expressions, exact_at_every_isa_level) {
+    // Products and sums of random floats round differently when fused.
+    const auto a = random_colors(4099, 1);
+    const auto b = random_colors(4099, 2);
+    const auto k = 0.7f;
+
+    auto expected = std::vector<Rgb<float>>();
+    for(std::size_t i = 0; i < a.size(); ++i) {
+        expected.push_back(
+                (a[i] * k + b[i]).lerp(a[i], 0.3f).clamp(0.1f, 0.9f));
+    }
+
+    const auto e = (expr::buffer(a) * k + expr::buffer(b))
+                           .lerp(expr::buffer(a), 0.3f)
+                           .clamp(0.1f, 0.9f);
+    using Expr = std::decay_t<decltype(e)>;
+    static_assert(Expr::vectorizable, "the expression is vectorized");
+    for(auto level : supported_levels()) {
+        auto out = std::vector<Rgb<float>>(a.size());
+        dispatch_at<expr::details::eval_kernel<Expr>>(level,
+                &e,
+                out.size() * Rgb<float>::num_channels,
+                reinterpret_cast<float*>(out.data()));
+        EXPECT_EQ(out, expected) << "at level " << int(level);
+    }
+}
@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Rgb.h"
+#include "AsyncStreamPacker.h"
+#include "FdSink.h"
+#include "StreamPacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+using ColorType = Rgb<uint8_t>;
+}
+
+TEST(FdSink, stream_packer) {
+    const auto colors = make_colors<ColorType>(10000);
+    TempFile temp;
+    {
+        auto options = FdSinkOptions();
+        // Smaller than the input, so both buffered and direct writes occur.
+        options.buffer_size = 5000;
+        auto packer = StreamPacker<ColorType>(
+                std::make_unique<FdSink>(temp.path(), options),
+                make_packer<ColorType>());
+        for(std::size_t i = 0; i < 10; ++i) {
+            packer << colors[i];
+        }
+        packer.pack(colors.begin() + 10, colors.end());
+        ASSERT_TRUE(packer.flush());
+        ASSERT_TRUE(packer.good());
+    }
+    ASSERT_EQ(temp.contents(), packed_bytes(colors));
+}
+
+TEST(FdSink, flush_on_destruction) {
+    const auto colors = make_colors<ColorType>(100);
+    TempFile temp;
+    {
+        FdSink sink(temp.path());
+        auto bytes = packed_bytes(colors);
+        sink.write(bytes.data(), bytes.size());
+    }
+    ASSERT_EQ(temp.contents(), packed_bytes(colors));
+}
+
+TEST(FdSink, referenced_fd) {
+    TempFile temp;
+    const int fd = ::open(temp.path().c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::write(fd, "xy", 2), 2);
+    {
+        FdSink sink(fd);
+        sink.write("abc", 3);
+        ASSERT_TRUE(sink.sync());
+        ASSERT_EQ(::lseek(fd, 0, SEEK_CUR), 5);
+        sink.write("de", 2);
+    }
+    // The offset is left after the written bytes, and the FdSink does not
+    // close descriptors it does not own.
+    ASSERT_EQ(::write(fd, "z", 1), 1);
+    ASSERT_EQ(::close(fd), 0);
+    ASSERT_EQ(temp.contents(), "xyabcdez");
+}
+
+TEST(FdSink, pipe) {
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    {
+        FdSink sink(fds[1]);
+        sink.write("hello", 5);
+        ASSERT_TRUE(sink.flush());
+    }
+    ::close(fds[1]);
+    char buffer[16];
+    ASSERT_EQ(::read(fds[0], buffer, sizeof(buffer)), 5);
+    ::close(fds[0]);
+    ASSERT_EQ(std::string(buffer, 5), "hello");
+}
+
+TEST(FdSink, direct) {
+    const auto colors = make_colors<ColorType>(5000);
+    TempFile temp;
+    auto options = FdSinkOptions();
+    options.buffer_size = 8192;
+    options.direct = true;
+    options.drop_cache = true;
+    // File systems without O_DIRECT support, such as tmpfs, fall back to
+    // buffered I/O, which direct() reports.
+    auto sink = std::make_unique<FdSink>(temp.path(), options);
+    const bool direct = sink->direct();
+    auto packer =
+            StreamPacker<ColorType>(std::move(sink), make_packer<ColorType>());
+    packer.pack(colors.begin(), colors.end());
+    ASSERT_TRUE(packer.flush());
+    ASSERT_EQ(temp.contents(), packed_bytes(colors));
+    // The unaligned tail was written without O_DIRECT, which stays off.
+    ASSERT_FALSE(static_cast<FdSink&>(packer.get_sink()).direct());
+
+    // Opening the same file again gives the same answer.
+    ASSERT_EQ(FdSink(temp.path(), options).direct(), direct);
+    options.direct = false;
+    ASSERT_FALSE(FdSink(temp.path(), options).direct());
+    // The option does not apply to file descriptors.
+    const int fd = ::open(temp.path().c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    options.direct = true;
+    ASSERT_FALSE(FdSink(fd, options).direct());
+    ::close(fd);
+}
+
+TEST(FdSink, async_stream_packer) {
+    const auto colors = make_colors<ColorType>(5000);
+    TempFile temp;
+    {
+        auto options = AsyncStreamPackerOptions();
+        options.buffer_size = 1000;
+        AsyncStreamPacker<ColorType> packer(
+                std::make_unique<FdSink>(temp.path()),
+                make_packer<ColorType>(),
+                options);
+        packer.pack(colors.begin(), colors.end());
+        ASSERT_TRUE(packer.flush());
+        ASSERT_EQ(packer.release_stream(), nullptr);
+    }
+    ASSERT_EQ(temp.contents(), packed_bytes(colors));
+}
+
+TEST(FdSink, errors) {
+    ASSERT_THROW(FdSink("/nonexistent/cppcolor/file"), IOError);
+
+    // A file opened before the constructor fails is closed again.
+    TempFile temp;
+    auto options = FdSinkOptions();
+    options.buffer_size = std::size_t(1) << 62;
+    const int next_fd = ::dup(0);
+    ::close(next_fd);
+    ASSERT_THROW(FdSink(temp.path(), options), std::bad_alloc);
+    const int fd = ::dup(0);
+    ::close(fd);
+    ASSERT_EQ(fd, next_fd);
+
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    ::close(fds[1]);
+    // Writing to the read end of a pipe fails with EBADF.
+    FdSink sink(fds[0]);
+    sink.write("abc", 3);
+    ASSERT_TRUE(sink.good());
+    ASSERT_FALSE(sink.flush());
+    ASSERT_TRUE(sink.fail());
+    ASSERT_TRUE(sink.bad());
+    ASSERT_EQ(sink.error_code(), EBADF);
+    ::close(fds[0]);
+}
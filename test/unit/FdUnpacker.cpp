@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Rgb.h"
+#include "FdUnpacker.h"
+#include "FlatColorUnpacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+using ColorType = Rgb<uint16_t>;
+
+const std::vector<int> format = {2, 1, 0};
+
+/// The contents of a file holding \a n packed colors and a partial one.
+std::string packed_file(std::size_t n) {
+    return packed_bytes(make_colors<ColorType>(n), format) + "abc";
+}
+
+std::unique_ptr<Unpacker<ColorType>> make_unpacker() {
+    return std::make_unique<FlatColorUnpacker<ColorType>>(format);
+}
+}
+
+TEST(FdUnpacker, read_at) {
+    const std::size_t n = 300000;
+    TempFile file(packed_file(n));
+    FdUnpacker<ColorType> unpacker(file.path(), make_unpacker());
+    ASSERT_EQ(unpacker.size(), n);
+
+    ColorType color;
+    ASSERT_EQ(unpacker.read_at(12345, 1, &color), 1);
+    ASSERT_EQ(color, color_at<ColorType>(12345));
+
+    // Larger than one block.
+    const auto many = unpacker.read_at(1000, 250000);
+    ASSERT_EQ(many.size(), 250000);
+    for(std::size_t i = 0; i < many.size(); ++i) {
+        ASSERT_EQ(many[i], color_at<ColorType>(1000 + i));
+    }
+
+    auto tail = std::vector<ColorType>();
+    ASSERT_EQ(unpacker.read_at(n - 2, 10, std::back_inserter(tail)), 2);
+    ASSERT_EQ(tail[1], color_at<ColorType>(n - 1));
+    ASSERT_EQ(unpacker.read_at(n + 5, 10).size(), 0);
+    // An index whose offset would wrap around to byte 2 is past the end.
+    const auto huge = std::numeric_limits<std::uint64_t>::max() / 6 + 1;
+    ASSERT_EQ(unpacker.read_at(huge, 10).size(), 0);
+}
+
+TEST(FdUnpacker, concurrent_reads) {
+    const std::size_t n = 40000;
+    const int num_threads = 4;
+    TempFile file(packed_file(n));
+    FdUnpacker<ColorType> unpacker(file.path(), make_unpacker());
+
+    auto results = std::vector<std::vector<ColorType>>(num_threads);
+    auto threads = std::vector<std::thread>();
+    for(int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            const auto per_thread = n / num_threads;
+            auto& out = results[t];
+            for(std::size_t i = 0; i < per_thread; i += 100) {
+                ColorType colors[100];
+                unpacker.read_at(t * per_thread + i, 100, colors);
+                out.insert(out.end(), colors, colors + 100);
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    for(int t = 0; t < num_threads; ++t) {
+        for(std::size_t i = 0; i < results[t].size(); ++i) {
+            ASSERT_EQ(results[t][i],
+                    color_at<ColorType>(t * (n / num_threads) + i));
+        }
+    }
+}
+
+TEST(FdUnpacker, errors) {
+    ASSERT_THROW(FdUnpacker<ColorType>(
+                         "/nonexistent/cppcolor/file", make_unpacker()),
+            IOError);
+
+    FdUnpacker<ColorType> unpacker(-1, make_unpacker());
+    ASSERT_THROW(unpacker.size(), IOError);
+    ColorType color;
+    try {
+        unpacker.read_at(0, 1, &color);
+        FAIL();
+    } catch(const IOError& error) {
+        ASSERT_EQ(error.error_code(), EBADF);
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef FIXTURES_H_
+#define FIXTURES_H_
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Dispatch.h"
+#include "FlatColorPacker.h"
+#include "Rgb.h"
+
+/** Color \a i of the sequence returned by make_colors(). Channels wrap
+ *  around at the range of the color's element type.
+ */
+template <typename Color>
+Color color_at(std::size_t i) {
+    using T = typename Color::ElementType;
+    return Color(T(i), T(3 * i), T(i / 7));
+}
+
+/// The first \a n colors of a pattern that covers every channel value.
+template <typename Color>
+std::vector<Color> make_colors(std::size_t n) {
+    auto out = std::vector<Color>();
+    out.reserve(n);
+    for(std::size_t i = 0; i < n; ++i) {
+        out.push_back(color_at<Color>(i));
+    }
+    return out;
+}
+
+/** \a n float colors with channels in [0, 1], repeating with small
+ *  periods. Different \a seed values shift the pattern.
+ */
+inline std::vector<color::Rgb<float>> make_unit_colors(
+        std::size_t n, int seed = 0) {
+    auto out = std::vector<color::Rgb<float>>();
+    out.reserve(n);
+    for(std::size_t i = 0; i < n; ++i) {
+        const auto k = int(i) + seed;
+        out.emplace_back(float(k % 17) / 16.0f,
+                float(k % 5) / 4.0f,
+                float(k % 11) / 10.0f);
+    }
+    return out;
+}
+
+/// Every IsaLevel the running CPU can execute.
+inline std::vector<color::IsaLevel> supported_levels() {
+    auto out = std::vector<color::IsaLevel>();
+    for(int i = 0; i <= static_cast<int>(color::detected_isa_level()); ++i) {
+        out.push_back(static_cast<color::IsaLevel>(i));
+    }
+    return out;
+}
+
+/// A FlatColorPacker storing the channels in the order \a format.
+template <typename Color>
+std::unique_ptr<color::Packer<Color>> make_packer(
+        std::vector<int> format = {2, 1, 0}) {
+    return std::make_unique<color::FlatColorPacker<Color>>(std::move(format));
+}
+
+/// The bytes a FlatColorPacker with \a format packs \a colors into.
+template <typename Color>
+std::string packed_bytes(const std::vector<Color>& colors,
+        std::vector<int> format = {2, 1, 0}) {
+    const auto packer = make_packer<Color>(std::move(format));
+    auto out = std::string(colors.size() * packer->packed_size(), '\0');
+    packer->pack(colors.begin(), colors.end(), &out[0]);
+    return out;
+}
+
+/// Stream buffer that fails every write.
+class FailingBuf : public std::streambuf {
+protected:
+    std::streamsize xsputn(const char*, std::streamsize) override {
+        return 0;
+    }
+
+    int_type overflow(int_type) override { return traits_type::eof(); }
+};
+
+/// A temporary file, removed at the end of the test.
+class TempFile {
+public:
+    /// Create the file holding \a contents.
+    explicit TempFile(const std::string& contents = std::string()) {
+        char path[] = "/tmp/cppcolor_test_XXXXXX";
+        const int fd = ::mkstemp(path);
+        if(fd < 0) {
+            throw std::system_error(
+                    errno, std::generic_category(), "mkstemp failed");
+        }
+        ::close(fd);
+        m_path = path;
+        if(!contents.empty()) {
+            std::ofstream file(m_path, std::ios::binary);
+            file.write(contents.data(), contents.size());
+        }
+    }
+
+    ~TempFile() { std::remove(m_path.c_str()); }
+
+    TempFile(const TempFile& other) = delete;
+    TempFile& operator=(const TempFile& other) = delete;
+
+    const std::string& path() const { return m_path; }
+
+    std::string contents() const {
+        std::ifstream file(m_path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+    }
+
+private:
+    std::string m_path;
+};
+
+#endif
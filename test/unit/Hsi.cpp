@@ -4,6 +4,7 @@
 #include <chrono>
 
 #include "Hsi.h"
+#include "Hsl.h"
 #include "Rgb.h"
 #include "ConversionRef.h"
 #include "Assertions.h"
@@ -81,6 +82,16 @@ TEST(Hsi, is_in_gamut) {
     ASSERT_TRUE(test_random_conversions_in_gamut<float>(0.015, 500));
 }
 
+TEST(Hsi, integer_conversion) {
+    // Intensity 93 in HSI, lightness 115 in HSL.
+    const auto c = Rgb<uint8_t>(200, 50, 30);
+    const auto hsi = to_hsi(c);
+    ASSERT_COLORS_EQ(hsi, color_cast<uint8_t>(to_hsi(color_cast<float>(c))));
+    ASSERT_EQ(hsi.intensity(), 93);
+    ASSERT_NE(hsi.intensity(),
+            color_cast<uint8_t>(to_hsl(color_cast<float>(c))).lightness());
+}
+
 template <typename ComponentType>
 ::testing::AssertionResult test_random_conversions_in_gamut(
         ComponentType error_tol, int test_count) {
@@ -0,0 +1,175 @@
+#include "gtest/gtest.h"
+
+#include "Rgb.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "HugePageResource.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <sched.h>
+
+using namespace color;
+
+namespace {
+
+using Part = std::pair<std::uint64_t, std::uint64_t>;
+
+/** Records the byte offsets of the parts unpack_parallel() writes, and
+ *  the CPUs they are written on.
+ */
+template <typename Color>
+class RecordingUnpacker : public FlatColorUnpacker<Color> {
+public:
+    using FlatColorUnpacker<Color>::FlatColorUnpacker;
+
+    const Color* base = nullptr;
+    mutable std::mutex mutex;
+    mutable std::vector<Part> parts;
+    mutable std::map<std::uint64_t, int> cpus;
+
+    const void* unpack_contiguous(
+            const void* src, std::size_t count, Color* out) const override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto begin = std::uint64_t(out - base) * sizeof(Color);
+            parts.emplace_back(begin, begin + count * sizeof(Color));
+            cpus[begin] = ::sched_getcpu();
+        }
+        return FlatColorUnpacker<Color>::unpack_contiguous(src, count, out);
+    }
+};
+}
+
+TEST(HugePageResource, allocation) {
+    auto options = HugePageOptions();
+    options.min_bytes = 1 << 20;
+    HugePageResource resource(options, null_memory_resource());
+
+    // Large allocations are mapped at huge page boundaries.
+    const auto size = (std::size_t(3) << 20) + 5;
+    const auto p = static_cast<unsigned char*>(resource.allocate(size, 16));
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) %
+                    HugePageResource::huge_page_size,
+            0u);
+    p[0] = 1;
+    p[size - 1] = 2;
+    first_touch(p, size, 1, 3);
+    first_touch(p, size, 0, 3);
+    EXPECT_EQ(p[0], 1);
+    EXPECT_EQ(p[size - 1], 2);
+    EXPECT_EQ(p[size / 2], 0);
+    resource.deallocate(p, size, 16);
+
+    // Small ones go upstream.
+    EXPECT_THROW(resource.allocate(100), std::bad_alloc);
+    EXPECT_TRUE(resource == resource);
+}
+
+TEST(HugePageResource, unpack_parallel) {
+    using ColorType = Rgb<float>;
+    auto colors = std::vector<ColorType>();
+    for(int i = 0; i < 100003; ++i) {
+        colors.emplace_back(float(i), float(i % 7), float(i % 13));
+    }
+    const auto format = std::vector<int>{2, 1, 0};
+    const auto packer = FlatColorPacker<ColorType>(format);
+    auto unpacker = FlatColorUnpacker<ColorType>(format);
+    auto packed = std::vector<char>(packer.packed_size() * colors.size());
+    packer.pack(colors.begin(), colors.end(), packed.data());
+
+    auto options = HugePageOptions();
+    options.first_touch = true;
+    options.num_threads = 4;
+    options.element_size = sizeof(ColorType);
+    options.min_bytes = 1 << 20;
+    HugePageResource resource(options);
+    for(int threads : {0, 1, 4}) {
+        const auto out = unpacker.unpack_parallel(packed.data(),
+                packed.size(),
+                PolymorphicAllocator<ColorType>(&resource),
+                threads);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(out.data()) %
+                        HugePageResource::huge_page_size,
+                0u);
+        EXPECT_TRUE(std::equal(out.begin(), out.end(), colors.begin()));
+        EXPECT_EQ(out.size(), colors.size());
+    }
+
+    auto out = std::vector<ColorType>(colors.size());
+    const auto end = unpacker.unpack_parallel(
+            packed.data(), packed.size(), out.data(), 3);
+    EXPECT_EQ(end, packed.data() + packed.size());
+    EXPECT_EQ(out, colors);
+}
+
+TEST(HugePageResource, first_touch_parts) {
+    // 12 byte colors, whose parts split by bytes would not fall on color
+    // boundaries.
+    using ColorType = Rgb<float>;
+    const auto count = std::size_t(100003);
+    const auto packer = FlatColorPacker<ColorType>({0, 1, 2});
+    RecordingUnpacker<ColorType> unpacker(std::vector<int>{0, 1, 2});
+    auto packed = std::vector<char>(packer.packed_size() * count);
+    auto out = std::vector<ColorType>(count);
+    unpacker.base = out.data();
+
+    for(int threads : {3, 4, 7}) {
+        unpacker.parts.clear();
+        unpacker.unpack_parallel(
+                packed.data(), packed.size(), out.data(), threads);
+        auto touched = std::vector<Part>();
+        std::mutex mutex;
+        details::first_touch_parts(count,
+                sizeof(ColorType),
+                threads,
+                [&](std::uint64_t begin, std::uint64_t end) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    touched.emplace_back(begin, end);
+                });
+        std::sort(unpacker.parts.begin(), unpacker.parts.end());
+        std::sort(touched.begin(), touched.end());
+        EXPECT_EQ(touched, unpacker.parts) << threads << " threads";
+        EXPECT_EQ(touched.size(), std::size_t(threads));
+    }
+}
+
+TEST(HugePageResource, pinned_parts) {
+    using ColorType = Rgb<float>;
+    const auto count = std::size_t(100003);
+    const auto packer = FlatColorPacker<ColorType>({0, 1, 2});
+    RecordingUnpacker<ColorType> unpacker(std::vector<int>{0, 1, 2});
+    auto packed = std::vector<char>(packer.packed_size() * count);
+    auto out = std::vector<ColorType>(count);
+    unpacker.base = out.data();
+
+    for(int threads : {2, 3, 4}) {
+        std::mutex mutex;
+        auto touched = std::map<std::uint64_t, int>();
+        details::first_touch_parts(count,
+                sizeof(ColorType),
+                threads,
+                [&](std::uint64_t begin, std::uint64_t) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    touched[begin] = ::sched_getcpu();
+                });
+        unpacker.cpus.clear();
+        unpacker.unpack_parallel(
+                packed.data(), packed.size(), out.data(), threads);
+        // Every part is unpacked on the CPU that first touched it.
+        EXPECT_EQ(touched, unpacker.cpus) << threads << " threads";
+
+        if(!details::parallel_cpus().empty()) {
+            std::uint64_t index = 0;
+            for(const auto& part : touched) {
+                EXPECT_EQ(part.second,
+                        details::parallel_part_cpu(index++, threads));
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Rgb.h"
+#include "Hsv.h"
+#include "Batch.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "Instrumentation.h"
+#include "StreamPacker.h"
+#include "StreamUnpacker.h"
+
+using namespace color;
+
+TEST(Instrumentation, register_kernel) {
+    const auto id = instrumentation::register_kernel("test::register");
+    ASSERT_GE(id, 0);
+    ASSERT_EQ(instrumentation::register_kernel("test::register"), id);
+    ASSERT_NE(instrumentation::register_kernel("test::register2"), id);
+}
+
+TEST(Instrumentation, scoped_timer) {
+    instrumentation::reset();
+    const auto id = instrumentation::register_kernel("test::timer");
+    {
+        instrumentation::ScopedTimer timer(id, "test::timer", 10);
+    }
+    {
+        instrumentation::ScopedTimer timer(id, "test::timer", 0);
+        timer.set_elements(5);
+    }
+
+    const auto stats = instrumentation::snapshot("test::timer");
+    ASSERT_EQ(stats.calls, 2);
+    ASSERT_EQ(stats.elements, 15);
+
+    instrumentation::reset();
+    ASSERT_EQ(instrumentation::snapshot("test::timer").calls, 0);
+    ASSERT_EQ(instrumentation::snapshot("test::unknown").calls, 0);
+}
+
+TEST(Instrumentation, threads) {
+    instrumentation::reset();
+    const auto id = instrumentation::register_kernel("test::threads");
+    const int num_threads = 4;
+    const int calls_per_thread = 1000;
+
+    auto threads = std::vector<std::thread>();
+    for(int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([id] {
+            for(int i = 0; i < calls_per_thread; ++i) {
+                instrumentation::record(id, 3, 1);
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    // Exited threads are folded into the totals, live ones are summed.
+    instrumentation::record(id, 1, 1);
+
+    const auto stats = instrumentation::snapshot("test::threads");
+    ASSERT_EQ(stats.calls, num_threads * calls_per_thread + 1);
+    ASSERT_EQ(stats.elements, num_threads * calls_per_thread * 3 + 1);
+    ASSERT_EQ(stats.nanoseconds, num_threads * calls_per_thread + 1);
+}
+
+#ifdef COLOR_ENABLE_INSTRUMENTATION
+TEST(Instrumentation, call_sites) {
+    instrumentation::reset();
+    auto rgb = std::vector<Rgb<uint8_t>>(100, Rgb<uint8_t>(10, 20, 30));
+    auto hsv = std::vector<Hsv<uint8_t>>(rgb.size());
+    batch::to_hsv(rgb.data(), rgb.size(), hsv.data());
+    batch::to_hsv(rgb.data(), 50, hsv.data());
+
+    auto stats = instrumentation::snapshot("batch::to_hsv");
+    ASSERT_EQ(stats.calls, 2);
+    ASSERT_EQ(stats.elements, 150);
+
+    auto packed = std::vector<uint8_t>(rgb.size() * 3);
+    auto packer = FlatColorPacker<Rgb<uint8_t>>({2, 1, 0});
+    packer.pack(rgb.begin(), rgb.end(), packed.data());
+    ASSERT_EQ(instrumentation::snapshot("FlatColorPacker::pack").elements,
+            rgb.size());
+
+    auto stream = std::make_unique<std::stringstream>();
+    auto& stream_ref = *stream;
+    auto stream_packer = StreamPacker<Rgb<uint8_t>>(std::move(stream),
+            std::make_unique<FlatColorPacker<Rgb<uint8_t>>>(
+                    std::vector<int>{0, 1, 2}));
+    stream_packer.pack(rgb.begin(), rgb.begin() + 7);
+    stats = instrumentation::snapshot("StreamPacker::pack");
+    ASSERT_EQ(stats.calls, 1);
+    ASSERT_EQ(stats.elements, 7);
+
+    auto stream_unpacker = StreamUnpacker<Rgb<uint8_t>>(
+            std::make_unique<std::stringstream>(stream_ref.str()),
+            std::make_unique<FlatColorUnpacker<Rgb<uint8_t>>>(
+                    std::vector<int>{0, 1, 2}));
+    ASSERT_EQ(stream_unpacker.unpack_all().size(), 7);
+    ASSERT_EQ(instrumentation::snapshot("StreamUnpacker::unpack").elements, 7);
+}
+#endif
@@ -0,0 +1,138 @@
+#include "gtest/gtest.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Rgb.h"
+#include "MappedColorSink.h"
+#include "StreamPacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+using ColorType = Rgb<uint16_t>;
+}
+
+TEST(MappedColorSink, pack_at) {
+    const auto colors = make_colors<ColorType>(1000);
+    TempFile temp;
+    MappedColorSink<ColorType> sink(
+            temp.path(), colors.size(), make_packer<ColorType>());
+    ASSERT_EQ(sink.size(), 6000);
+    // In any order.
+    sink.pack_at(500, colors.begin() + 500, colors.end());
+    sink.pack_at(0, colors.begin(), colors.begin() + 499);
+    sink.pack_single_at(499, colors[499]);
+    sink.finalize();
+    ASSERT_EQ(temp.contents(), packed_bytes(colors));
+}
+
+TEST(MappedColorSink, pack_parallel) {
+    const auto colors = make_colors<ColorType>(100000);
+    TempFile temp;
+    MappedColorSink<ColorType> sink(
+            temp.path(), colors.size() + 10, make_packer<ColorType>());
+    sink.pack_at(0, colors.begin(), colors.begin() + 10);
+    sink.pack_parallel(10, colors.begin(), colors.end(), 4);
+    sink.finalize();
+
+    auto all = std::vector<ColorType>(colors.begin(), colors.begin() + 10);
+    all.insert(all.end(), colors.begin(), colors.end());
+    ASSERT_EQ(temp.contents(), packed_bytes(all));
+}
+
+TEST(MappedColorSink, stream_packer) {
+    const auto colors = make_colors<ColorType>(1000);
+    TempFile temp;
+    auto sink = std::make_unique<MappedColorSink<ColorType>>(
+            temp.path(), colors.size(), make_packer<ColorType>());
+    auto& mapped = *sink;
+    auto packer =
+            StreamPacker<ColorType>(std::move(sink), make_packer<ColorType>());
+    packer << colors[0];
+    packer.pack(colors.begin() + 1, colors.end());
+    ASSERT_TRUE(packer.good());
+    ASSERT_TRUE(mapped.sync());
+    mapped.finalize();
+    ASSERT_EQ(temp.contents(), packed_bytes(colors));
+}
+
+TEST(MappedColorSink, errors) {
+    ASSERT_THROW(MappedColorSink<ColorType>("/nonexistent/cppcolor/file",
+                         10,
+                         make_packer<ColorType>()),
+            IOError);
+
+    const auto colors = make_colors<ColorType>(20);
+    TempFile temp;
+    // The size of the file would overflow.
+    try {
+        MappedColorSink<ColorType>(temp.path(),
+                std::numeric_limits<std::uint64_t>::max() / 2,
+                make_packer<ColorType>());
+        FAIL();
+    } catch(const IOError& error) {
+        ASSERT_EQ(error.error_code(), EFBIG);
+    }
+
+    MappedColorSink<ColorType> sink(temp.path(), 10, make_packer<ColorType>());
+    ASSERT_THROW(sink.pack_at(5, colors.begin(), colors.begin() + 6),
+            std::out_of_range);
+    ASSERT_THROW(sink.pack_single_at(10, colors[0]), std::out_of_range);
+
+    // Sequential writes past the end fail like a full stream.
+    sink.write(colors.data(), 60);
+    ASSERT_TRUE(sink.good());
+    sink.write(colors.data(), 1);
+    ASSERT_FALSE(sink.good());
+    ASSERT_TRUE(sink.fail());
+    sink.finalize();
+    ASSERT_EQ(temp.contents().size(), 60);
+}
+
+TEST(MappedColorSink, reserves_space) {
+    TempFile temp;
+    {
+        MappedColorSink<ColorType> sink(
+                temp.path(), 100000, make_packer<ColorType>());
+        struct stat st;
+        ASSERT_EQ(::stat(temp.path().c_str(), &st), 0);
+        ASSERT_EQ(st.st_size, 600000);
+        // The blocks exist before any color is written.
+        ASSERT_GE(st.st_blocks * 512, st.st_size);
+    }
+
+    // Running out of space is reported up front, not as SIGBUS later.
+    const auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+    struct rlimit old_limit;
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &old_limit), 0);
+    auto limit = old_limit;
+    limit.rlim_cur = 4096;
+    ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limit), 0);
+    EXPECT_THROW(MappedColorSink<ColorType>(
+                         temp.path(), 100000, make_packer<ColorType>()),
+            IOError);
+    ::setrlimit(RLIMIT_FSIZE, &old_limit);
+    std::signal(SIGXFSZ, old_handler);
+}
+
+TEST(MappedColorSink, empty) {
+    TempFile temp;
+    MappedColorSink<ColorType> sink(temp.path(), 0, make_packer<ColorType>());
+    const auto colors = make_colors<ColorType>(0);
+    sink.pack_parallel(0, colors.begin(), colors.end());
+    sink.finalize();
+    ASSERT_EQ(temp.contents().size(), 0);
+}
@@ -0,0 +1,200 @@
+#include "gtest/gtest.h"
+
+#include "Rgb.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "Iterator_Util.h"
+#include "MemoryResource.h"
+#include "StreamPacker.h"
+#include "StreamUnpacker.h"
+
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace color;
+
+namespace {
+
+/// Counts the allocations it forwards to new_delete_resource().
+class CountingResource : public MemoryResource {
+public:
+    int allocations = 0;
+    int deallocations = 0;
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++allocations;
+        return new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(
+            void* p, std::size_t bytes, std::size_t alignment) override {
+        ++deallocations;
+        new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const MemoryResource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+bool is_aligned(const void* p, std::size_t alignment) {
+    return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+}
+}
+
+TEST(MemoryResource, arena_allocation) {
+    alignas(16) unsigned char buffer[256];
+    auto upstream = CountingResource();
+    ArenaResource arena(buffer, sizeof(buffer), &upstream);
+
+    // Allocations bump through the buffer, aligned as requested.
+    const auto a = static_cast<unsigned char*>(arena.allocate(3, 1));
+    const auto b = arena.allocate(8, 8);
+    const auto c = arena.allocate(64, 64);
+    EXPECT_EQ(a, buffer);
+    EXPECT_EQ(b, buffer + 8);
+    EXPECT_TRUE(is_aligned(c, 64));
+    EXPECT_EQ(upstream.allocations, 0);
+
+    // Larger requests go to chunks from upstream.
+    const auto d = arena.allocate(1000, 32);
+    EXPECT_TRUE(is_aligned(d, 32));
+    EXPECT_EQ(upstream.allocations, 1);
+    arena.deallocate(d, 1000, 32);
+    arena.allocate(ArenaResource::default_chunk_size, 8);
+    EXPECT_EQ(upstream.allocations, 2);
+
+    // Releasing frees the chunks and reuses the buffer.
+    arena.release();
+    EXPECT_EQ(upstream.deallocations, 2);
+    EXPECT_EQ(arena.allocate(3, 1), buffer);
+
+    ArenaResource strict(buffer, sizeof(buffer), null_memory_resource());
+    EXPECT_THROW(strict.allocate(sizeof(buffer) + 1), std::bad_alloc);
+    EXPECT_TRUE(*new_delete_resource() != arena);
+    EXPECT_TRUE(arena == arena);
+}
+
+TEST(MemoryResource, polymorphic_allocator) {
+    auto counting = CountingResource();
+    {
+        auto colors = PmrVector<Rgb<float>>(100, &counting);
+        EXPECT_EQ(counting.allocations, 1);
+
+        // Copies allocate from the default resource, moves keep theirs.
+        const auto copy = colors;
+        EXPECT_EQ(copy.get_allocator().resource(), get_default_resource());
+        auto moved = PmrVector<Rgb<float>>();
+        moved = std::move(colors);
+        EXPECT_EQ(moved.get_allocator().resource(), &counting);
+        EXPECT_EQ(counting.allocations, 1);
+    }
+    EXPECT_EQ(counting.deallocations, 1);
+
+    auto previous = set_default_resource(&counting);
+    EXPECT_EQ(previous, new_delete_resource());
+    EXPECT_EQ(PolymorphicAllocator<int>().resource(), &counting);
+    set_default_resource(nullptr);
+    EXPECT_EQ(get_default_resource(), new_delete_resource());
+
+    // Over-aligned allocations from new_delete_resource().
+    const auto p = new_delete_resource()->allocate(100, 256);
+    EXPECT_TRUE(is_aligned(p, 256));
+    new_delete_resource()->deallocate(p, 100, 256);
+}
+
+TEST(MemoryResource, unpack_into_arena) {
+    using ColorType = Rgb<uint8_t>;
+    const auto packed = std::vector<uint8_t>{
+            1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    auto unpacker = FlatColorUnpacker<ColorType>({2, 1, 0});
+
+    alignas(16) unsigned char buffer[1024];
+    ArenaResource arena(buffer, sizeof(buffer), null_memory_resource());
+    const auto colors = unpacker.unpack(packed.data(),
+            packed.size(),
+            PolymorphicAllocator<ColorType>(&arena));
+    static_assert(std::is_same<std::decay_t<decltype(colors)>,
+                          std::vector<ColorType,
+                                  PolymorphicAllocator<ColorType>>>::value,
+            "unpack() returns a vector using the allocator passed");
+    EXPECT_EQ(colors.size(), 4u);
+    EXPECT_EQ(static_cast<const void*>(colors.data()), buffer);
+    EXPECT_EQ(colors[1], ColorType(6, 5, 4));
+    EXPECT_TRUE(std::equal(colors.begin(),
+            colors.end(),
+            unpacker.unpack(packed.data(), packed.size()).begin()));
+}
+
+TEST(MemoryResource, uninitialized_allocator) {
+    using ColorType = Rgb<uint8_t>;
+    alignas(16) unsigned char buffer[1024];
+    std::fill(std::begin(buffer), std::end(buffer), 0xab);
+    ArenaResource arena(buffer, sizeof(buffer), null_memory_resource());
+
+    // Sizing leaves trivially copyable elements as they were...
+    auto colors = UninitializedPmrVector<ColorType>(
+            4, PolymorphicAllocator<ColorType>(&arena));
+    EXPECT_EQ(static_cast<const void*>(colors.data()), buffer);
+    EXPECT_EQ(colors[3], ColorType(0xab, 0xab, 0xab));
+    EXPECT_TRUE(colors.get_allocator() ==
+            UninitializedAllocator<PolymorphicAllocator<int>>(&arena));
+    colors.emplace_back(1, 2, 3);
+    EXPECT_EQ(colors[4], ColorType(1, 2, 3));
+
+    // ...and constructs everything else as usual.
+    auto strings = std::vector<std::string,
+            UninitializedAllocator<PolymorphicAllocator<std::string>>>(
+            3, PolymorphicAllocator<std::string>(&arena));
+    EXPECT_EQ(strings[2], "");
+
+    static_assert(details::is_contiguous_iterator<
+                          UninitializedPmrVector<ColorType>::iterator,
+                          ColorType>::value,
+            "the vectors unpacked colors are returned in are contiguous");
+
+    // Unpacking into one writes every color.
+    const auto packed = std::vector<uint8_t>{1, 2, 3, 4, 5, 6};
+    const auto unpacked = FlatColorUnpacker<ColorType>({0, 1, 2})
+                                  .unpack_parallel(packed.data(),
+                                          packed.size(),
+                                          PolymorphicAllocator<ColorType>(
+                                                  &arena),
+                                          1);
+    EXPECT_EQ(unpacked[0], ColorType(1, 2, 3));
+    EXPECT_EQ(unpacked[1], ColorType(4, 5, 6));
+}
+
+TEST(MemoryResource, stream_buffers) {
+    using ColorType = Rgb<uint8_t>;
+    const auto colors = std::vector<ColorType>{
+            {1, 2, 3}, {4, 5, 6}, {7, 8, 9}, {10, 11, 12}};
+    const auto format = std::vector<int>{0, 1, 2};
+
+    auto stream = std::stringstream();
+    auto counting = CountingResource();
+    {
+        auto packer = StreamPacker<ColorType>(stream,
+                std::make_unique<FlatColorPacker<ColorType>>(format),
+                &counting);
+        packer.pack(colors.begin(), colors.end());
+    }
+    EXPECT_GT(counting.allocations, 0);
+    EXPECT_EQ(counting.allocations, counting.deallocations);
+
+    // Decoding a request does no global allocation besides the unpacker.
+    alignas(16) unsigned char buffer[1 << 15];
+    ArenaResource arena(buffer, sizeof(buffer), null_memory_resource());
+    auto unpacker = StreamUnpacker<ColorType>(stream,
+            std::make_unique<FlatColorUnpacker<ColorType>>(format),
+            &arena);
+    const auto out =
+            unpacker.unpack_all(PolymorphicAllocator<ColorType>(&arena));
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), colors.begin()));
+    EXPECT_EQ(out.size(), colors.size());
+}
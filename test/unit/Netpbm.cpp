@@ -0,0 +1,155 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "ByteOrder.h"
+#include "Netpbm.h"
+
+using namespace color;
+
+namespace {
+
+template <typename Color>
+Image<Color> make_image(std::size_t width, std::size_t height) {
+    using T = typename Color::ElementType;
+    auto image = Image<Color>();
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(width * height);
+    for(std::size_t i = 0; i < image.pixels.size(); ++i) {
+        for(int c = 0; c < Color::num_channels; ++c) {
+            image.pixels[i].data()[c] = static_cast<T>(i * 7 + c * 3 + 1);
+        }
+    }
+    return image;
+}
+
+template <typename Color>
+void expect_round_trip(std::size_t width, std::size_t height) {
+    const auto image = make_image<Color>(width, height);
+    std::stringstream stream;
+    write_netpbm(stream, image);
+    const auto read = read_netpbm<Color>(stream);
+    EXPECT_EQ(read.width, width);
+    EXPECT_EQ(read.height, height);
+    EXPECT_EQ(read.pixels, image.pixels);
+}
+}
+
+TEST(Netpbm, round_trip) {
+    expect_round_trip<Rgb<uint8_t>>(13, 7);
+    expect_round_trip<Rgb<uint16_t>>(13, 7);
+    expect_round_trip<Alpha<uint8_t, Rgb>>(5, 9);
+    expect_round_trip<Alpha<uint16_t, Rgb>>(5, 9);
+    expect_round_trip<Rgb<float>>(6, 4);
+}
+
+TEST(Netpbm, ppm_header_and_16_bit_samples) {
+    std::stringstream stream;
+    stream << "P6 # comment\n2 # width\n1\n1000\n";
+    const unsigned char pixels[] = {
+            0x01, 0x02, 0x00, 0xff, 0x03, 0xe8, 0x00, 0x00, 0x00, 0x01, 0x12,
+            0x34};
+    stream.write(reinterpret_cast<const char*>(pixels), sizeof(pixels));
+
+    const auto image = read_netpbm<Rgb<uint16_t>>(stream);
+    ASSERT_EQ(image.pixels.size(), 2u);
+    EXPECT_EQ(image.pixels[0], Rgb<uint16_t>(0x0102, 0x00ff, 1000));
+    EXPECT_EQ(image.pixels[1], Rgb<uint16_t>(0, 1, 0x1234));
+}
+
+TEST(Netpbm, pam_header) {
+    std::stringstream stream;
+    stream << "P7\nWIDTH 2\nHEIGHT 1\nDEPTH 4\nMAXVAL 255\n"
+           << "TUPLTYPE RGB_ALPHA\nENDHDR\n";
+    stream.write("\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+
+    const auto header = read_netpbm_header(stream);
+    EXPECT_EQ(header.format, NetpbmFormat::Pam);
+    EXPECT_EQ(header.depth, 4u);
+    EXPECT_EQ(header.tuple_type, "RGB_ALPHA");
+
+    auto pixels = std::vector<Alpha<uint8_t, Rgb>>(2);
+    read_netpbm_pixels(stream, header, pixels.data());
+    EXPECT_EQ(pixels[0], (Alpha<uint8_t, Rgb>(Rgb<uint8_t>(1, 2, 3), 4)));
+    EXPECT_EQ(pixels[1], (Alpha<uint8_t, Rgb>(Rgb<uint8_t>(5, 6, 7), 8)));
+}
+
+TEST(Netpbm, pfm_rows_and_byte_order) {
+    // Big endian, with the bottom row first.
+    auto samples = std::vector<float>{1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+    if(native_byte_order() == ByteOrder::Little) {
+        byteswap(samples.data(), samples.size());
+    }
+    std::stringstream stream;
+    stream << "PF\n1 2\n1.0\n";
+    stream.write(reinterpret_cast<const char*>(samples.data()),
+            samples.size() * sizeof(float));
+
+    const auto image = read_netpbm<Rgb<float>>(stream);
+    ASSERT_EQ(image.pixels.size(), 2u);
+    EXPECT_EQ(image.pixels[0], Rgb<float>(4.0f, 5.0f, 6.0f));
+    EXPECT_EQ(image.pixels[1], Rgb<float>(1.0f, 2.0f, 3.0f));
+}
+
+TEST(Netpbm, errors) {
+    std::stringstream mismatch("P6\n1 1\n65535\n\0\0\0\0\0\0");
+    EXPECT_THROW(read_netpbm<Rgb<uint8_t>>(mismatch), ImageFormatError);
+
+    std::stringstream wrong_magic("P3\n1 1\n255\n1 2 3\n");
+    EXPECT_THROW(read_netpbm<Rgb<uint8_t>>(wrong_magic), ImageFormatError);
+
+    std::stringstream bad_size("P6\n1 x\n255\n");
+    EXPECT_THROW(read_netpbm<Rgb<uint8_t>>(bad_size), ImageFormatError);
+
+    std::stringstream truncated("P6\n2 2\n255\n\x01\x02\x03");
+    EXPECT_THROW(read_netpbm<Rgb<uint8_t>>(truncated), CorruptDataError);
+
+    using Rgba = Alpha<uint8_t, Rgb>;
+    std::stringstream wrong_tuple_type("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 4\n"
+                                       "MAXVAL 255\nTUPLTYPE CMYK\nENDHDR\n"
+                                       "abcd");
+    EXPECT_THROW(read_netpbm<Rgba>(wrong_tuple_type), ImageFormatError);
+    std::stringstream wrong_depth("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 3\n"
+                                  "MAXVAL 255\nTUPLTYPE RGB\nENDHDR\nabc");
+    EXPECT_THROW(read_netpbm<Rgba>(wrong_depth), ImageFormatError);
+}
+
+TEST(Netpbm, size_limits) {
+    // Sizes whose product wraps around.
+    std::stringstream wrapping("P6\n4294967296 4294967296\n255\n");
+    EXPECT_THROW(read_netpbm_header(wrapping), ImageFormatError);
+
+    // Rejected before the pixels are allocated.
+    std::stringstream huge("P6\n1000000 1000000\n255\nabc");
+    EXPECT_THROW(read_netpbm<Rgb<uint8_t>>(huge), ImageFormatError);
+
+    const auto image = make_image<Rgb<uint8_t>>(2, 2);
+    std::stringstream stream;
+    write_netpbm(stream, image);
+    std::stringstream copy(stream.str());
+    EXPECT_THROW(read_netpbm<Rgb<uint8_t>>(stream, 11), ImageFormatError);
+    EXPECT_EQ(read_netpbm<Rgb<uint8_t>>(copy, 12).pixels, image.pixels);
+}
+
+TEST(Netpbm, byteswap) {
+    auto values16 = std::vector<uint16_t>();
+    auto values64 = std::vector<uint64_t>();
+    for(uint64_t i = 0; i < 100; ++i) {
+        values16.push_back(static_cast<uint16_t>(i * 0x0103));
+        values64.push_back(i * 0x0102030405060708ull);
+    }
+    auto swapped16 = values16;
+    auto swapped64 = values64;
+    byteswap(swapped16.data(), swapped16.size());
+    byteswap(swapped64.data(), swapped64.size());
+    for(std::size_t i = 0; i < values16.size(); ++i) {
+        EXPECT_EQ(swapped16[i], __builtin_bswap16(values16[i]));
+        EXPECT_EQ(swapped64[i], __builtin_bswap64(values64[i]));
+    }
+}
@@ -1,5 +1,7 @@
 #include "gtest/gtest.h"
 
+#include <list>
+
 #include "Rgb.h"
 #include "Alpha.h"
 #include "FlatColorPacker.h"
@@ -91,3 +93,57 @@ TEST(FlatColorPacker, pack) {
         ASSERT_EQ(values, test_array);
     }
 }
+
+TEST(FlatColorPacker, pack_contiguous) {
+    // Contiguous ranges take the bulk path, other ranges pack one color at
+    // a time. Both must produce the same bytes.
+    auto colors = std::vector<Rgba<uint16_t>>();
+    for(uint16_t i = 0; i < 37; ++i) {
+        colors.emplace_back(i, i + 1000, i + 2000, i + 3000);
+    }
+    const auto list = std::list<Rgba<uint16_t>>(colors.begin(), colors.end());
+
+    const auto formats = std::vector<std::vector<int>>{
+            {0, 1, 2, 3}, {3, 0, 1, 2}, {2, 1, 0}, {packer_index_skip, 0, 0}};
+    for(const auto& format : formats) {
+        auto packer = FlatColorPacker<Rgba<uint16_t>>(format);
+        auto bulk = std::vector<uint16_t>(colors.size() * format.size());
+        auto single = std::vector<uint16_t>(bulk.size());
+
+        auto end = packer.pack(colors.begin(), colors.end(), bulk.data());
+        ASSERT_EQ(end, bulk.data() + bulk.size());
+        packer.pack(list.begin(), list.end(), single.data());
+        ASSERT_EQ(bulk, single);
+    }
+}
+
+TEST(FlatColorPacker, byte_order) {
+    const auto other = native_byte_order() == ByteOrder::Little
+            ? ByteOrder::Big
+            : ByteOrder::Little;
+    auto colors = std::vector<Rgba<uint16_t>>();
+    for(uint16_t i = 0; i < 37; ++i) {
+        colors.emplace_back(i, i + 1000, i + 2000, i + 3000);
+    }
+    const auto list = std::list<Rgba<uint16_t>>(colors.begin(), colors.end());
+
+    const auto formats = std::vector<std::vector<int>>{
+            {0, 1, 2, 3}, {3, 0, 1, 2}, {2, 1, 0}, {packer_index_skip, 0, 0}};
+    for(const auto& format : formats) {
+        const auto native = FlatColorPacker<Rgba<uint16_t>>(format);
+        const auto swapped = FlatColorPacker<Rgba<uint16_t>>(format, other);
+        ASSERT_EQ(swapped.byte_order(), other);
+        auto expected = std::vector<uint16_t>(colors.size() * format.size());
+        auto bulk = std::vector<uint16_t>(expected.size());
+        auto single = std::vector<uint16_t>(expected.size());
+
+        native.pack(colors.begin(), colors.end(), expected.data());
+        for(auto& value : expected) {
+            value = __builtin_bswap16(value);
+        }
+        swapped.pack(colors.begin(), colors.end(), bulk.data());
+        swapped.pack(list.begin(), list.end(), single.data());
+        ASSERT_EQ(bulk, expected);
+        ASSERT_EQ(single, expected);
+    }
+}
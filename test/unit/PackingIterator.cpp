@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "Alpha.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "PackingIterator.h"
+#include "Rgb.h"
+
+using namespace color;
+
+namespace {
+
+std::vector<Rgba<uint16_t>> make_colors(std::size_t count) {
+    auto colors = std::vector<Rgba<uint16_t>>();
+    for(std::size_t i = 0; i < count; ++i) {
+        colors.emplace_back(uint16_t(i * 3),
+                uint16_t(i * 5),
+                uint16_t(i * 7),
+                uint16_t(65535 - i));
+    }
+    return colors;
+}
+}
+
+TEST(PackingIterator, unpacking_iterator) {
+    const auto colors = make_colors(100);
+    const auto packer =
+            FlatColorPacker<Rgba<uint16_t>>({3, 2, 1, 0}, ByteOrder::Big);
+    const auto unpacker =
+            FlatColorUnpacker<Rgba<uint16_t>>({3, 2, 1, 0}, ByteOrder::Big);
+    auto packed = std::vector<char>(colors.size() * packer.packed_size());
+    packer.pack(colors.begin(), colors.end(), packed.data());
+
+    const auto range = unpacked(packed.data(), packed.size(), unpacker);
+    static_assert(std::is_same<decltype(range.begin()),
+                          unpacking_iterator<Rgba<uint16_t>,
+                                  FlatColorUnpacker<Rgba<uint16_t>>>>::value,
+            "flat unpackers are iterated without virtual calls");
+    EXPECT_EQ(range.size(), colors.size());
+    EXPECT_EQ(std::vector<Rgba<uint16_t>>(range.begin(), range.end()), colors);
+    EXPECT_EQ(range.begin()[42], colors[42]);
+
+    const auto found = std::find_if(range.begin(),
+            range.end(),
+            [](const Rgba<uint16_t>& c) { return c.color().red() == 3 * 57; });
+    ASSERT_NE(found, range.end());
+    EXPECT_EQ(found - range.begin(), 57);
+    EXPECT_EQ(found.base(), packed.data() + 57 * packer.packed_size());
+
+    const auto sum = std::accumulate(range.begin(),
+            range.end(),
+            0,
+            [](int total, const Rgba<uint16_t>& c) {
+                return total + c.color().green();
+            });
+    EXPECT_EQ(sum, 5 * 99 * 100 / 2);
+
+    // Through the Unpacker interface.
+    const Unpacker<Rgba<uint16_t>>& base = unpacker;
+    auto it = unpacking_iterator<Rgba<uint16_t>>(packed.data(), base);
+    auto end = unpacking_iterator<Rgba<uint16_t>>(
+            packed.data() + packed.size(), base);
+    EXPECT_EQ(std::vector<Rgba<uint16_t>>(it, end), colors);
+}
+
+TEST(PackingIterator, packing_output_iterator) {
+    const auto colors = make_colors(100);
+    const auto packer = FlatColorPacker<Rgba<uint16_t>>({2, 1, 0, -1});
+    auto expected = std::vector<char>(colors.size() * packer.packed_size());
+    packer.pack(colors.begin(), colors.end(), expected.data());
+
+    auto packed = std::vector<char>(expected.size());
+    const auto out = std::copy(colors.begin(),
+            colors.end(),
+            make_packing_iterator(packed.data(), packer));
+    EXPECT_EQ(packed, expected);
+    EXPECT_EQ(out.base(), packed.data() + packed.size());
+
+    // Through the Packer interface, transforming on the way.
+    const Packer<Rgba<uint16_t>>& base = packer;
+    auto inverted = std::vector<char>(expected.size());
+    std::transform(colors.begin(),
+            colors.end(),
+            packing_output_iterator<Rgba<uint16_t>>(inverted.data(), base),
+            [](const Rgba<uint16_t>& c) { return c.inverse(); });
+
+    const auto unpacker = FlatColorUnpacker<Rgba<uint16_t>>({2, 1, 0, -1});
+    const auto range = unpacked(inverted.data(), inverted.size(), unpacker);
+    auto i = std::size_t(0);
+    for(const auto color : range) {
+        const auto inverse = colors[i++].inverse();
+        EXPECT_EQ(color.color(), inverse.color());
+        EXPECT_EQ(color.alpha(), 0);
+    }
+    EXPECT_EQ(i, colors.size());
+}
@@ -0,0 +1,224 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Rgb.h"
+#include "Hsv.h"
+#include "Batch.h"
+#include "FlatColorUnpacker.h"
+#include "Pipeline.h"
+#include "RingBuffer.h"
+#include "StreamPacker.h"
+#include "StreamUnpacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+TEST(RingBuffer, spsc) {
+    SpscRing<int> ring(3);
+    ASSERT_EQ(ring.capacity(), 4);
+
+    int value;
+    ASSERT_FALSE(ring.try_pop(value));
+    for(int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ring.try_push(i));
+    }
+    ASSERT_FALSE(ring.try_push(4));
+    for(int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ring.try_pop(value));
+        ASSERT_EQ(value, i);
+    }
+    ASSERT_FALSE(ring.try_pop(value));
+}
+
+TEST(RingBuffer, spsc_threads) {
+    const int count = 100000;
+    SpscRing<int> ring(16);
+    auto producer = std::thread([&] {
+        for(int i = 0; i < count; ++i) {
+            while(!ring.try_push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for(int i = 0; i < count; ++i) {
+        int value;
+        while(!ring.try_pop(value)) {
+            std::this_thread::yield();
+        }
+        ASSERT_EQ(value, i);
+    }
+    producer.join();
+}
+
+TEST(RingBuffer, mpmc_threads) {
+    const int num_threads = 4;
+    const int per_thread = 20000;
+    MpmcRing<int> ring(64);
+    auto seen = std::vector<std::atomic<int>>(num_threads * per_thread);
+
+    auto threads = std::vector<std::thread>();
+    for(int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            for(int i = 0; i < per_thread; ++i) {
+                while(!ring.try_push(t * per_thread + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        threads.emplace_back([&] {
+            for(int i = 0; i < per_thread; ++i) {
+                int value;
+                while(!ring.try_pop(value)) {
+                    std::this_thread::yield();
+                }
+                seen[value].fetch_add(1);
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    for(const auto& count : seen) {
+        ASSERT_EQ(count.load(), 1);
+    }
+}
+
+namespace {
+
+/// Stream buffer that returns \a data and then throws.
+class ThrowingBuf : public std::streambuf {
+public:
+    explicit ThrowingBuf(std::string data) : m_data(std::move(data)) {
+        setg(&m_data[0], &m_data[0], &m_data[0] + m_data.size());
+    }
+
+protected:
+    int_type underflow() override {
+        throw std::runtime_error("read failed");
+    }
+
+private:
+    std::string m_data;
+};
+}
+
+TEST(Pipeline, transform_in_order) {
+    using InColor = Rgb<uint8_t>;
+    using OutColor = Hsv<uint8_t>;
+    // Not a multiple of the chunk size, plus a trailing partial color.
+    const auto colors = make_colors<InColor>(10007);
+    auto in = std::make_unique<std::stringstream>(
+            packed_bytes(colors, {0, 1, 2}) + "x");
+    auto source = StreamUnpacker<InColor>(std::move(in),
+            std::make_unique<FlatColorUnpacker<InColor>>(
+                    std::vector<int>{0, 1, 2}));
+    auto sink = StreamPacker<OutColor>(std::make_unique<std::stringstream>(),
+            make_packer<OutColor>({0, 1, 2}));
+
+    auto options = PipelineOptions();
+    options.chunk_colors = 256;
+    options.num_workers = 4;
+    const auto written = run_pipeline(source,
+            [](const InColor* in, std::size_t count, OutColor* out) {
+                batch::to_hsv(in, count, out);
+            },
+            sink,
+            options);
+    ASSERT_EQ(written, colors.size());
+    ASSERT_TRUE(sink.good());
+    ASSERT_TRUE(source.eof());
+
+    auto out = std::unique_ptr<std::stringstream>(
+            static_cast<std::stringstream*>(sink.release_stream().release()));
+    auto result = StreamUnpacker<OutColor>(std::move(out),
+            std::make_unique<FlatColorUnpacker<OutColor>>(
+                    std::vector<int>{0, 1, 2}))
+                          .unpack_all();
+    ASSERT_EQ(result.size(), colors.size());
+    for(std::size_t i = 0; i < colors.size(); ++i) {
+        ASSERT_EQ(result[i], to_hsv(colors[i]));
+    }
+}
+
+TEST(Pipeline, empty_source) {
+    using ColorType = Rgb<uint8_t>;
+    std::stringstream in, out;
+    auto source = StreamUnpacker<ColorType>(in,
+            std::make_unique<FlatColorUnpacker<ColorType>>(
+                    std::vector<int>{0, 1, 2}));
+    auto sink = StreamPacker<ColorType>(out,
+            make_packer<ColorType>({2, 1, 0}));
+    const auto written = run_pipeline(source,
+            [](const ColorType* in, std::size_t count, ColorType* out) {
+                std::copy(in, in + count, out);
+            },
+            sink);
+    ASSERT_EQ(written, 0);
+    ASSERT_TRUE(out.str().empty());
+}
+
+TEST(Pipeline, transform_error) {
+    using ColorType = Rgb<uint8_t>;
+    std::stringstream in(
+            packed_bytes(make_colors<ColorType>(5000), {0, 1, 2})),
+            out;
+    auto source = StreamUnpacker<ColorType>(in,
+            std::make_unique<FlatColorUnpacker<ColorType>>(
+                    std::vector<int>{0, 1, 2}));
+    auto sink = StreamPacker<ColorType>(out,
+            make_packer<ColorType>({0, 1, 2}));
+
+    auto options = PipelineOptions();
+    options.chunk_colors = 100;
+    options.num_workers = 3;
+    std::atomic<int> calls{0};
+    ASSERT_THROW(run_pipeline(source,
+                         [&](const ColorType* in,
+                                 std::size_t count,
+                                 ColorType* out) {
+                             if(++calls == 10) {
+                                 throw std::runtime_error("transform failed");
+                             }
+                             std::copy(in, in + count, out);
+                         },
+                         sink,
+                         options),
+            std::runtime_error);
+    ASSERT_LT(out.str().size(), 5000 * 3);
+}
+
+TEST(Pipeline, read_error) {
+    using ColorType = Rgb<uint8_t>;
+    ThrowingBuf buf(packed_bytes(make_colors<ColorType>(1000), {0, 1, 2}));
+    std::istream in(&buf);
+    in.exceptions(std::ios::badbit);
+    std::stringstream out;
+    auto source = StreamUnpacker<ColorType>(in,
+            std::make_unique<FlatColorUnpacker<ColorType>>(
+                    std::vector<int>{0, 1, 2}));
+    auto sink = StreamPacker<ColorType>(out,
+            make_packer<ColorType>({0, 1, 2}));
+
+    auto options = PipelineOptions();
+    options.chunk_colors = 100;
+    options.num_workers = 2;
+    ASSERT_THROW(run_pipeline(source,
+                         [](const ColorType* in,
+                                 std::size_t count,
+                                 ColorType* out) {
+                             std::copy(in, in + count, out);
+                         },
+                         sink,
+                         options),
+            std::runtime_error);
+    ASSERT_LT(out.str().size(), 1000 * 3);
+}
@@ -0,0 +1,218 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "PixelFormat.h"
+
+using namespace color;
+
+namespace {
+
+std::vector<PixelField> fields(const std::string& channels, int bits) {
+    auto out = std::vector<PixelField>();
+    for(auto c : channels) {
+        const auto index = std::string("RGBAX").find(c);
+        out.push_back(PixelField{static_cast<PixelChannel>(index), bits});
+    }
+    return out;
+}
+
+std::vector<unsigned char> convert(const std::string& from,
+        const std::vector<unsigned char>& in,
+        const std::string& to) {
+    auto& registry = PixelFormatRegistry::global();
+    const auto& converter = registry.converter(from, to);
+    const auto count = in.size() / converter.from().size();
+    auto out = std::vector<unsigned char>(count * converter.to().size());
+    converter.convert(in.data(), count, out.data());
+    return out;
+}
+}
+
+TEST(PixelFormat, parse_arrays) {
+    const auto bgra = parse_pixel_format("BGRA8");
+    EXPECT_FALSE(bgra.packed);
+    EXPECT_EQ(bgra.encoding, PixelEncoding::Unorm);
+    EXPECT_EQ(bgra.fields, fields("BGRA", 8));
+    EXPECT_EQ(bgra.size(), 4u);
+
+    const auto half = parse_pixel_format("rgba16f");
+    EXPECT_EQ(half.encoding, PixelEncoding::Float);
+    EXPECT_EQ(half.fields, fields("RGBA", 16));
+    EXPECT_EQ(half.size(), 8u);
+
+    EXPECT_EQ(parse_pixel_format("RGB32F").size(), 12u);
+    EXPECT_EQ(parse_pixel_format("R16").size(), 2u);
+}
+
+TEST(PixelFormat, parse_packed) {
+    const auto rgb565 = parse_pixel_format("RGB565");
+    EXPECT_TRUE(rgb565.packed);
+    EXPECT_EQ(rgb565.size(), 2u);
+    ASSERT_EQ(rgb565.fields.size(), 3u);
+    EXPECT_EQ(rgb565.fields[1], (PixelField{PixelChannel::Green, 6}));
+
+    const auto rgb10 = parse_pixel_format("ARGB2101010");
+    EXPECT_TRUE(rgb10.packed);
+    ASSERT_EQ(rgb10.fields.size(), 4u);
+    EXPECT_EQ(rgb10.fields[0], (PixelField{PixelChannel::Alpha, 2}));
+    EXPECT_EQ(rgb10.fields[3], (PixelField{PixelChannel::Blue, 10}));
+
+    // Whole byte fields of a little endian word are an array in reverse.
+    EXPECT_EQ(parse_pixel_format("XRGB8888"), parse_pixel_format("BGRX8"));
+    EXPECT_EQ(parse_pixel_format("ABGR16161616F"),
+            parse_pixel_format("RGBA16F"));
+}
+
+TEST(PixelFormat, parse_fourcc) {
+    EXPECT_EQ(parse_pixel_format("XR24"), parse_pixel_format("BGRX8"));
+    EXPECT_EQ(parse_pixel_format("AB24"), parse_pixel_format("RGBA8"));
+    EXPECT_EQ(parse_pixel_format("RG16"), parse_pixel_format("RGB565"));
+    EXPECT_EQ(parse_pixel_format("AR30"), parse_pixel_format("ARGB2101010"));
+    EXPECT_EQ(parse_pixel_format("AB4H"), parse_pixel_format("RGBA16F"));
+    EXPECT_EQ(parse_pixel_format("XR24").name, "XR24");
+}
+
+TEST(PixelFormat, parse_errors) {
+    for(auto name : {"",
+                "RGBA",
+                "8",
+                "RGBQ8",
+                "RRG8",
+                "RGBAX8",
+                "RGB12",
+                "RGB555",
+                "RGBA8F",
+                "RGB565F",
+                "RGB8x"}) {
+        EXPECT_THROW(parse_pixel_format(name), InvalidPackingFormatError)
+                << name;
+    }
+}
+
+TEST(PixelFormat, shuffle_arrays) {
+    const auto in = std::vector<unsigned char>{
+            1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+            19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+            35, 36, 37, 38, 39, 40};
+    EXPECT_TRUE(PixelFormatRegistry::global()
+                        .converter("BGRA8", "RGBA8")
+                        .is_byte_shuffle());
+
+    const auto rgba = convert("BGRA8", in, "RGBA8");
+    ASSERT_EQ(rgba.size(), in.size());
+    for(std::size_t i = 0; i < in.size(); i += 4) {
+        EXPECT_EQ(rgba[i], in[i + 2]);
+        EXPECT_EQ(rgba[i + 1], in[i + 1]);
+        EXPECT_EQ(rgba[i + 2], in[i]);
+        EXPECT_EQ(rgba[i + 3], in[i + 3]);
+    }
+
+    // A missing alpha is opaque, unused bytes are zero.
+    const auto bxra = convert("RGB8", in, "BXRA8");
+    ASSERT_EQ(bxra.size(), in.size() / 3 * 4);
+    for(std::size_t i = 0; i < in.size() / 3; ++i) {
+        EXPECT_EQ(bxra[i * 4], in[i * 3 + 2]);
+        EXPECT_EQ(bxra[i * 4 + 1], 0);
+        EXPECT_EQ(bxra[i * 4 + 2], in[i * 3]);
+        EXPECT_EQ(bxra[i * 4 + 3], 0xff);
+    }
+
+    // Unused bytes are zeroed even between equal layouts. Both formats
+    // store X in the last byte.
+    auto zeroed = in;
+    for(std::size_t i = 3; i < zeroed.size(); i += 4) {
+        zeroed[i] = 0;
+    }
+    for(const auto format : {"RGBX8", "XRGB8888"}) {
+        EXPECT_EQ(convert(format, in, format), zeroed) << format;
+    }
+}
+
+TEST(PixelFormat, packed_conversions) {
+    // RGB565 little endian words: white, red, green, blue.
+    const auto rgb565 = std::vector<unsigned char>{
+            0xff, 0xff, 0x00, 0xf8, 0xe0, 0x07, 0x1f, 0x00};
+    EXPECT_EQ(convert("RGB565", rgb565, "RGBA8"),
+            (std::vector<unsigned char>{255, 255, 255, 255, 255, 0, 0, 255,
+                    0, 255, 0, 255, 0, 0, 255, 255}));
+    EXPECT_EQ(convert("RGB565", rgb565, "RG16"), rgb565);
+    EXPECT_EQ(convert(
+                      "RGBA8", convert("RGB565", rgb565, "RGBA8"), "RGB565"),
+            rgb565);
+
+    // The integer tables round like the float conversions.
+    auto all565 = std::vector<unsigned char>();
+    for(unsigned v = 0; v < 0x10000; ++v) {
+        all565.push_back(static_cast<unsigned char>(v));
+        all565.push_back(static_cast<unsigned char>(v >> 8));
+    }
+    EXPECT_EQ(convert("RGB565", all565, "BGRX8"),
+            convert("RGBA32F", convert("RGB565", all565, "RGBA32F"), "BGRX8"));
+
+    // 10 bit channels keep their precision through 16 bit formats.
+    auto words = std::vector<uint32_t>();
+    for(uint32_t i = 0; i < 100; ++i) {
+        words.push_back((3u << 30) | (i * 10 << 20) | (i << 10) | (1023 - i));
+    }
+    auto bytes = std::vector<unsigned char>(words.size() * 4);
+    std::memcpy(bytes.data(), words.data(), bytes.size());
+    const auto rgba16 = convert("AR30", bytes, "RGBA16");
+    EXPECT_EQ(convert("RGBA16", rgba16, "AR30"), bytes);
+}
+
+TEST(PixelFormat, half_floats) {
+    EXPECT_EQ(details::float_to_half(1.0f), 0x3c00);
+    EXPECT_EQ(details::float_to_half(-2.0f), 0xc000);
+    EXPECT_EQ(details::float_to_half(65504.0f), 0x7bff);
+    EXPECT_EQ(details::float_to_half(1e6f), 0x7c00);
+    EXPECT_EQ(details::float_to_half(5.96046448e-8f), 0x0001);
+    // 1 + 2^-11 is halfway between two halves and rounds to even.
+    EXPECT_EQ(details::float_to_half(1.00048828125f), 0x3c00);
+    for(uint32_t h = 0; h < 0x7c00; ++h) {
+        const auto value = details::half_to_float(static_cast<uint16_t>(h));
+        EXPECT_EQ(details::float_to_half(value), h);
+    }
+
+    const auto rgba8 = std::vector<unsigned char>{0, 64, 128, 255};
+    const auto half = convert("RGBA8", rgba8, "RGBA16F");
+    EXPECT_EQ(convert("RGBA16F", half, "RGBA8"), rgba8);
+    EXPECT_EQ(convert("RGB8", {0, 0, 0}, "RGBA16F"),
+            (std::vector<unsigned char>{0, 0, 0, 0, 0, 0, 0x00, 0x3c}));
+}
+
+TEST(PixelFormat, native_formats) {
+    EXPECT_EQ(pixel_format_of(static_cast<const Rgb<uint8_t>*>(nullptr)),
+            parse_pixel_format("RGB8"));
+    EXPECT_EQ(pixel_format_of(
+                      static_cast<const Alpha<float, Rgb>*>(nullptr)),
+            parse_pixel_format("RGBA32F"));
+
+    const auto colors = std::vector<Alpha<uint16_t, Rgb>>{
+            Alpha<uint16_t, Rgb>(Rgb<uint16_t>(1, 2, 3), 4)};
+    auto rgb = std::vector<Rgb<uint16_t>>(1);
+    PixelConverter(pixel_format_of(colors.data()), pixel_format_of(rgb.data()))
+            .convert(colors.data(), colors.size(), rgb.data());
+    EXPECT_EQ(rgb[0], Rgb<uint16_t>(1, 2, 3));
+}
+
+TEST(PixelFormatRegistry, named_formats) {
+    PixelFormatRegistry registry;
+    registry.add("vendor", parse_pixel_format("BGRX8"));
+    EXPECT_EQ(registry.format("vendor").name, "vendor");
+    EXPECT_EQ(&registry.converter("vendor", "RGB8"),
+            &registry.converter("vendor", "RGB8"));
+    EXPECT_THROW(registry.converter("vendor", "bogus"),
+            InvalidPackingFormatError);
+
+    const unsigned char in[] = {1, 2, 3, 4};
+    unsigned char out[3];
+    registry.convert("vendor", in, 1, "RGB8", out);
+    EXPECT_EQ(out[0], 3);
+    EXPECT_EQ(out[2], 1);
+}
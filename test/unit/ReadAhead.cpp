@@ -0,0 +1,186 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Rgb.h"
+#include "BlockCodec.h"
+#include "FlatColorPacker.h"
+#include "FlatColorUnpacker.h"
+#include "ReadAhead.h"
+#include "StreamUnpacker.h"
+
+using namespace color;
+
+namespace {
+
+std::string make_data(std::size_t n) {
+    auto out = std::string(n, '\0');
+    for(std::size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<char>((i * 31) ^ (i >> 8));
+    }
+    return out;
+}
+
+/// A stream buffer over a string that cannot be seeked, like a pipe.
+class PipeBuf : public std::stringbuf {
+public:
+    explicit PipeBuf(const std::string& data) : std::stringbuf(data) {}
+
+protected:
+    pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode)
+            override {
+        return pos_type(off_type(-1));
+    }
+
+    pos_type seekpos(pos_type, std::ios_base::openmode) override {
+        return pos_type(off_type(-1));
+    }
+};
+
+ReadAheadOptions small_buffers() {
+    auto options = ReadAheadOptions();
+    options.buffer_size = 1000;
+    options.num_buffers = 3;
+    return options;
+}
+}
+
+TEST(ReadAhead, read_all) {
+    for(const auto size : {0, 1, 999, 1000, 1001, 12345}) {
+        const auto data = make_data(size);
+        std::stringbuf source(data);
+        ReadAheadStreamBuf buf(&source, small_buffers());
+        std::istream stream(&buf);
+
+        auto out = std::string(size + 10, '\0');
+        stream.read(&out[0], 7);
+        stream.read(&out[std::min<int>(size, 7)], size + 3);
+        ASSERT_EQ(stream.gcount(), std::max(size - 7, 0));
+        ASSERT_TRUE(stream.eof());
+        out.resize(size);
+        ASSERT_EQ(out, data);
+    }
+}
+
+TEST(ReadAhead, seek) {
+    const auto data = make_data(10000);
+    std::stringbuf source(data);
+    ReadAheadStreamBuf buf(&source, small_buffers());
+    std::istream stream(&buf);
+
+    char c;
+    stream.seekg(4321);
+    ASSERT_EQ(stream.tellg(), 4321);
+    stream.get(c);
+    ASSERT_EQ(c, data[4321]);
+    ASSERT_EQ(stream.tellg(), 4322);
+
+    stream.seekg(-2, std::ios_base::end);
+    stream.get(c);
+    ASSERT_EQ(c, data[9998]);
+
+    stream.seekg(0);
+    auto out = std::string(data.size(), '\0');
+    stream.read(&out[0], out.size());
+    ASSERT_EQ(out, data);
+    stream.seekg(-10, std::ios_base::cur);
+    stream.get(c);
+    ASSERT_EQ(c, data[9990]);
+}
+
+TEST(ReadAhead, stream_unpacker) {
+    using ColorType = Rgb<uint8_t>;
+    const auto format = std::vector<int>{0, 1, 2};
+    const auto data = make_data(3 * 5000);
+    auto unpacker = StreamUnpacker<ColorType>(
+            std::make_unique<std::stringstream>(data),
+            std::make_unique<FlatColorUnpacker<ColorType>>(format));
+    const auto expected = FlatColorUnpacker<ColorType>(format).unpack(
+            data.data(), data.size());
+
+    ColorType first;
+    unpacker >> first;
+    unpacker.enable_read_ahead(small_buffers());
+    auto colors = unpacker.unpack_all();
+    colors.insert(colors.begin(), first);
+    ASSERT_EQ(colors, expected);
+    ASSERT_TRUE(unpacker.eof());
+
+    auto some = std::vector<ColorType>(10);
+    ASSERT_EQ(unpacker.read_at(2000, 10, some.begin()), 10);
+    ASSERT_TRUE(std::equal(some.begin(), some.end(), expected.begin() + 2000));
+    ASSERT_EQ(unpacker.tell(), 2010);
+    ASSERT_EQ(unpacker.size(), 5000);
+}
+
+TEST(ReadAhead, unseekable_source) {
+    const auto data = make_data(10000);
+    PipeBuf source(data);
+    ReadAheadStreamBuf buf(&source, small_buffers());
+    std::istream stream(&buf);
+
+    auto out = std::string(data.size(), '\0');
+    stream.read(&out[0], 10);
+    stream.seekg(5000);
+    ASSERT_TRUE(stream.fail());
+    stream.clear();
+    stream.seekg(-5, std::ios_base::end);
+    ASSERT_TRUE(stream.fail());
+    stream.clear();
+    // Nothing read ahead is lost by the failed seeks.
+    stream.read(&out[10], out.size() - 10);
+    ASSERT_EQ(out, data);
+}
+
+TEST(ReadAhead, unseekable_size) {
+    using ColorType = Rgb<uint8_t>;
+    const auto format = std::vector<int>{0, 1, 2};
+    const auto data = make_data(3 * 10);
+    const auto expected = FlatColorUnpacker<ColorType>(format).unpack(
+            data.data(), data.size());
+    for(const auto read_ahead : {false, true}) {
+        PipeBuf source(data);
+        std::istream stream(&source);
+        auto unpacker = StreamUnpacker<ColorType>(stream,
+                std::make_unique<FlatColorUnpacker<ColorType>>(format));
+        if(read_ahead) {
+            unpacker.enable_read_ahead(small_buffers());
+        }
+
+        ColorType first;
+        unpacker >> first;
+        ASSERT_EQ(unpacker.tell(), -1);
+        ASSERT_EQ(unpacker.size(), -1);
+        ASSERT_TRUE(unpacker.good());
+        auto colors = unpacker.unpack_all();
+        colors.insert(colors.begin(), first);
+        ASSERT_EQ(colors, expected);
+    }
+}
+
+TEST(ReadAhead, source_error) {
+    using ColorType = Rgb<uint8_t>;
+    const auto data = make_data(std::size_t(1) << 16);
+    auto options = BlockCodecOptions();
+    options.block_size = 1000;
+    const auto compressed =
+            compress_blocks(data.data(), data.size(), options);
+    // The decompressor throws on the prefetch thread at the truncated
+    // block, which must not terminate the process.
+    auto unpacker = StreamUnpacker<ColorType>(
+            std::make_unique<std::stringstream>(std::string(
+                    compressed.begin(),
+                    compressed.begin() + compressed.size() / 2)),
+            std::make_unique<FlatColorUnpacker<ColorType>>(
+                    std::vector<int>{0, 1, 2}));
+    unpacker.enable_decompression();
+    unpacker.enable_read_ahead(small_buffers());
+    const auto colors = unpacker.unpack_all();
+    ASSERT_TRUE(unpacker.bad());
+    ASSERT_LT(colors.size(), data.size() / 3);
+}
@@ -0,0 +1,158 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Rgb.h"
+#include "FlatColorUnpacker.h"
+#include "RunLengthCoding.h"
+#include "StreamPacker.h"
+#include "StreamUnpacker.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+using ColorType = Rgb<uint8_t>;
+
+const std::vector<int> format = {0, 1, 2};
+
+/// Long flat regions, a small palette and some noise, like a screenshot.
+std::vector<ColorType> make_screenshot(std::size_t n) {
+    const ColorType palette[] = {ColorType(255, 255, 255),
+            ColorType(30, 30, 30),
+            ColorType(0, 120, 215),
+            ColorType(240, 240, 240)};
+    auto out = std::vector<ColorType>();
+    std::mt19937 rng(3);
+    for(std::size_t i = 0; i < n; ++i) {
+        if(i % 50000 < 40000) {
+            out.push_back(palette[(i / 700) % 4]);
+        } else if(i % 50000 < 48000) {
+            out.push_back(palette[rng() % 4]);
+        } else {
+            out.emplace_back(rng(), rng(), rng());
+        }
+    }
+    return out;
+}
+
+std::string encode(const std::vector<ColorType>& colors) {
+    std::stringstream stream;
+    auto packer =
+            StreamPacker<ColorType>(stream, make_packer<ColorType>(format));
+    packer.enable_run_length_coding();
+    packer.pack(colors.begin(), colors.end());
+    packer.flush();
+    return stream.str();
+}
+
+std::vector<ColorType> decode(const std::string& data) {
+    auto unpacker = StreamUnpacker<ColorType>(
+            std::make_unique<std::stringstream>(data),
+            std::make_unique<FlatColorUnpacker<ColorType>>(format));
+    unpacker.enable_run_length_decoding();
+    return unpacker.unpack_all();
+}
+}
+
+TEST(RunLengthCoding, round_trip) {
+    const auto colors = make_screenshot(200000);
+    const auto encoded = encode(colors);
+    ASSERT_LT(encoded.size(), colors.size() * 3 / 10);
+    ASSERT_EQ(decode(encoded), colors);
+}
+
+TEST(RunLengthCoding, runs_and_literals) {
+    // Runs at and around every length limit, starting with the initial
+    // previous color of zero bytes.
+    auto colors = std::vector<ColorType>();
+    ColorType color(0, 0, 0);
+    for(std::size_t run : {1, 2, 63, 64, 65, 66, 16447, 16448, 16449, 40000}) {
+        colors.insert(colors.end(), run, color);
+        color = ColorType(run % 256, run / 256, 7);
+    }
+    // More distinct colors in a row than fit into one literal op.
+    for(std::size_t i = 0; i < 200; ++i) {
+        colors.emplace_back(i, 255 - i, i / 2);
+    }
+    ASSERT_EQ(decode(encode(colors)), colors);
+    ASSERT_TRUE(decode(encode({})).empty());
+}
+
+TEST(RunLengthCoding, split_writes) {
+    const auto colors = make_screenshot(1000);
+    const auto bytes = packed_bytes(colors, format);
+
+    std::stringstream stream;
+    {
+        RunLengthSink sink(std::make_unique<OstreamSink>(stream), 3);
+        // Writes that do not end at color boundaries, with flushes between.
+        for(std::size_t i = 0; i < bytes.size(); i += 7) {
+            sink.write(bytes.data() + i,
+                    std::min<std::size_t>(7, bytes.size() - i));
+            if(i % 700 == 0) {
+                sink.flush();
+            }
+        }
+    }
+    ASSERT_EQ(decode(stream.str()), colors);
+}
+
+TEST(RunLengthCoding, release_stream) {
+    const auto colors = make_screenshot(1000);
+    std::unique_ptr<std::ostream> stream;
+    {
+        auto packer = StreamPacker<ColorType>(
+                std::make_unique<std::stringstream>(),
+                make_packer<ColorType>(format));
+        packer.enable_run_length_coding();
+        packer.pack(colors.begin(), colors.end());
+        stream = packer.release_stream();
+        ASSERT_NE(stream, nullptr);
+        // Destroying the packer must not touch the released stream.
+    }
+    const auto& released = static_cast<std::stringstream&>(*stream);
+    ASSERT_EQ(decode(released.str()), colors);
+}
+
+TEST(RunLengthCoding, write_error_with_exceptions) {
+    const auto colors = make_screenshot(10);
+    FailingBuf buf;
+    std::ostream stream(&buf);
+    stream.exceptions(std::ios_base::badbit);
+    {
+        // The coded bytes are held back, so only the destructor writes
+        // them. It must not throw.
+        auto packer = StreamPacker<ColorType>(
+                stream, make_packer<ColorType>(format));
+        packer.enable_run_length_coding();
+        packer.pack(colors.begin(), colors.end());
+    }
+    stream.clear();
+    {
+        auto packer = StreamPacker<ColorType>(
+                stream, make_packer<ColorType>(format));
+        packer.enable_run_length_coding();
+        packer.pack(colors.begin(), colors.end());
+        ASSERT_THROW(packer.flush(), std::ios_base::failure);
+    }
+}
+
+TEST(RunLengthCoding, corrupt_data) {
+    const auto colors = make_screenshot(100);
+    auto encoded = encode(colors);
+    // Cut into the literal colors of the last op.
+    encoded.resize(encoded.size() - 1);
+    std::stringstream stream(encoded);
+    RunLengthStreamBuf buf(stream.rdbuf(), 3);
+    std::istream in(&buf);
+    auto out = std::vector<char>(300);
+    in.read(out.data(), out.size());
+    ASSERT_TRUE(in.bad());
+}
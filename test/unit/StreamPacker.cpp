@@ -8,6 +8,7 @@
 
 #include <sstream>
 #include <memory>
+#include <limits>
 
 using namespace color;
 
@@ -81,3 +82,79 @@ TEST(StreamPacker, stream_pack_unpack) {
                 end_test_data[scaled_i]);
     }
 }
+
+TEST(StreamUnpacker, bulk_unpack) {
+    using ColorType = Rgb<uint16_t>;
+    const auto format = std::vector<int>{2, 0, 1};
+    auto colors = std::vector<ColorType>();
+    for(int i = 0; i < 10000; ++i) {
+        colors.emplace_back(i, 3 * i, 65535 - i);
+    }
+    auto packed = std::string(colors.size() * 6, '\0');
+    FlatColorPacker<ColorType>(format).pack(
+            colors.begin(), colors.end(), &packed[0]);
+
+    // A trailing partial color is not unpacked.
+    std::stringstream stream(packed + "x");
+    auto unpacker = StreamUnpacker<ColorType>(
+            stream, std::make_unique<FlatColorUnpacker<ColorType>>(format));
+    auto out = std::vector<ColorType>(colors.size() + 10);
+    auto it = out.begin();
+    ASSERT_EQ(unpacker.unpack(100, it), 100);
+    ASSERT_EQ(it, out.begin() + 100);
+    ASSERT_EQ(unpacker.unpack_all(it), colors.size() - 100);
+    ASSERT_EQ(it, out.begin() + colors.size());
+    ASSERT_TRUE(unpacker.eof());
+    out.resize(colors.size());
+    ASSERT_EQ(out, colors);
+}
+
+TEST(StreamUnpacker, random_access) {
+    using ColorType = Rgb<uint8_t>;
+    const auto format = std::vector<int>{0, 1, 2};
+    std::stringstream stream;
+    auto packer = StreamPacker<ColorType>(
+            stream, std::make_unique<FlatColorPacker<ColorType>>(format));
+    for(int i = 0; i < 100; ++i) {
+        packer << ColorType(i, 2 * i, 255 - i);
+    }
+    stream << "xy";
+
+    auto unpacker = StreamUnpacker<ColorType>(
+            stream, std::make_unique<FlatColorUnpacker<ColorType>>(format));
+    ASSERT_EQ(unpacker.size(), 100);
+    ASSERT_EQ(unpacker.tell(), 0);
+
+    ASSERT_TRUE(unpacker.seek(42));
+    ASSERT_EQ(unpacker.tell(), 42);
+    ColorType color;
+    unpacker >> color;
+    ASSERT_EQ(color, ColorType(42, 84, 213));
+    ASSERT_EQ(unpacker.tell(), 43);
+
+    auto out = std::vector<ColorType>(5);
+    ASSERT_EQ(unpacker.read_at(10, 5, out.begin()), 5);
+    for(int i = 0; i < 5; ++i) {
+        ASSERT_EQ(out[i], ColorType(10 + i, 20 + 2 * i, 245 - i));
+    }
+    ASSERT_EQ(unpacker.tell(), 15);
+
+    // Reading past the end stops at the last whole color.
+    auto tail = std::vector<ColorType>();
+    ASSERT_EQ(unpacker.read_at(98, 5, std::back_inserter(tail)), 2);
+    ASSERT_EQ(tail.back(), ColorType(99, 198, 156));
+    ASSERT_TRUE(unpacker.eof());
+
+    // Seeking clears the end-of-file state.
+    ASSERT_TRUE(unpacker.seek(0));
+    unpacker >> color;
+    ASSERT_EQ(color, ColorType(0, 0, 255));
+    ASSERT_EQ(unpacker.size(), 100);
+    ASSERT_EQ(unpacker.tell(), 1);
+
+    // An index whose offset would wrap around to byte 2 is rejected.
+    const auto huge = std::numeric_limits<std::uint64_t>::max() / 3 + 1;
+    ASSERT_FALSE(unpacker.seek(huge));
+    ASSERT_TRUE(unpacker.fail());
+    ASSERT_EQ(unpacker.read_at(huge, 5, out.begin()), 0);
+}
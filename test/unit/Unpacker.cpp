@@ -1,5 +1,7 @@
 #include "gtest/gtest.h"
 
+#include <list>
+
 #include "Alpha.h"
 #include "Assertions.h"
 #include "FlatColorUnpacker.h"
@@ -81,3 +83,90 @@ TEST(Unpack, unpack) {
     ASSERT_EQ(packer.packed_size(), sizeof(float) * 4);
     ASSERT_EQ(unpacker.packed_size(), sizeof(float) * 4);
 }
+
+TEST(Unpack, unpack_contiguous) {
+    // Contiguous outputs take the bulk path, other outputs unpack one color
+    // at a time. Both must produce the same colors.
+    auto in_data = std::vector<uint8_t>();
+    for(int i = 0; i < 4 * 29; ++i) {
+        in_data.push_back(static_cast<uint8_t>(i * 7));
+    }
+
+    const auto formats = std::vector<std::vector<int>>{
+            {0, 1, 2, 3}, {3, 0, 1, 2}, {2, 1, 0, packer_index_skip}, {1, 1}};
+    for(const auto& format : formats) {
+        auto unpacker = FlatColorUnpacker<Rgba<uint8_t>>(format);
+        const auto num_colors = in_data.size() / format.size();
+        auto bulk = std::vector<Rgba<uint8_t>>(num_colors);
+        auto single = std::list<Rgba<uint8_t>>(num_colors);
+
+        auto end = unpacker.unpack(in_data.data(),
+                num_colors * unpacker.packed_size(),
+                bulk.begin());
+        ASSERT_EQ(end, in_data.data() + num_colors * format.size());
+        unpacker.unpack(in_data.data(),
+                num_colors * unpacker.packed_size(),
+                single.begin());
+        ASSERT_TRUE(std::equal(bulk.begin(), bulk.end(), single.begin()));
+    }
+}
+
+TEST(Unpack, byte_order) {
+    const auto other = native_byte_order() == ByteOrder::Little
+            ? ByteOrder::Big
+            : ByteOrder::Little;
+    auto colors = std::vector<Rgb<float>>();
+    for(int i = 0; i < 29; ++i) {
+        colors.emplace_back(i * 0.5f, i * 0.25f + 1.0f, -i * 2.0f);
+    }
+
+    const auto formats = std::vector<std::vector<int>>{
+            {0, 1, 2}, {2, 1, 0}, {packer_index_skip, 0, 1, 2}};
+    for(const auto& format : formats) {
+        const auto packer = FlatColorPacker<Rgb<float>>(format, other);
+        auto unpacker = FlatColorUnpacker<Rgb<float>>(format, other);
+        auto packed = std::vector<char>(colors.size() * packer.packed_size());
+        packer.pack(colors.begin(), colors.end(), packed.data());
+
+        auto bulk = std::vector<Rgb<float>>(colors.size());
+        auto single = std::list<Rgb<float>>(colors.size());
+        unpacker.unpack(packed.data(), packed.size(), bulk.begin());
+        unpacker.unpack(packed.data(), packed.size(), single.begin());
+        ASSERT_EQ(bulk, colors);
+        ASSERT_TRUE(std::equal(bulk.begin(), bulk.end(), single.begin()));
+    }
+}
+
+TEST(Unpack, view) {
+    const uint16_t packed[] = {1, 2, 3, 4, 5, 6};
+    auto unpacker = FlatColorUnpacker<Rgb<uint16_t>>({0, 1, 2});
+    ASSERT_TRUE(unpacker.can_view(packed));
+    const auto view = unpacker.view(packed, sizeof(packed));
+    ASSERT_EQ(view.size(), 2u);
+    EXPECT_EQ(static_cast<const void*>(view.data()), packed);
+    ASSERT_COLORS_EQ(view[1], Rgb<uint16_t>(4, 5, 6));
+
+    // Other layouts are unpacked into the storage instead.
+    auto storage = std::vector<Rgb<uint16_t>>();
+    EXPECT_EQ(unpacker.view_or_unpack(packed, sizeof(packed), storage).data(),
+            view.data());
+    EXPECT_TRUE(storage.empty());
+
+    auto reversed = FlatColorUnpacker<Rgb<uint16_t>>({2, 1, 0});
+    EXPECT_FALSE(reversed.can_view(packed));
+    EXPECT_THROW(reversed.view(packed, sizeof(packed)),
+            InvalidPackingFormatError);
+    const auto unpacked =
+            reversed.view_or_unpack(packed, sizeof(packed), storage);
+    EXPECT_EQ(unpacked.data(), storage.data());
+    ASSERT_COLORS_EQ(unpacked[0], Rgb<uint16_t>(3, 2, 1));
+
+    auto swapped =
+            FlatColorUnpacker<Rgb<uint16_t>>({0, 1, 2}, ByteOrder::Big);
+    if(native_byte_order() != ByteOrder::Big) {
+        EXPECT_FALSE(swapped.can_view(packed));
+    }
+    auto misaligned = reinterpret_cast<const unsigned char*>(packed) + 1;
+    EXPECT_FALSE(unpacker.can_view(misaligned));
+    EXPECT_THROW(unpacker.view(misaligned, 6), AlignmentError);
+}
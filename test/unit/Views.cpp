@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+#include "Rgb.h"
+#include "Alpha.h"
+#include "Hsv.h"
+#include "Hsl.h"
+#include "Batch.h"
+#include "FlatColorPacker.h"
+#include "StreamPacker.h"
+#include "Views.h"
+#include "Fixtures.h"
+
+using namespace color;
+
+namespace {
+
+Hsv<float> darken(Hsv<float> color) {
+    color.value() *= 0.5f;
+    return color;
+}
+}
+
+TEST(Views, chain_matches_batch_functions) {
+    // More than one chunk, and not a multiple of the chunk size.
+    const auto colors = make_unit_colors(2 * view_chunk_colors + 37);
+
+    auto hsv = std::vector<Hsv<float>>(colors.size());
+    batch::to_hsv(colors.data(), colors.size(), hsv.data());
+    for(auto& color : hsv) {
+        color = darken(color);
+    }
+    auto rgb = std::vector<Rgb<float>>(colors.size());
+    batch::to_rgb(hsv.data(), hsv.size(), rgb.data());
+    auto expected = std::vector<Rgb<uint8_t>>(colors.size());
+    batch::color_cast<uint8_t>(rgb.data(), rgb.size(), expected.data());
+
+    const auto view = colors | views::as<Hsv> | views::map(darken) |
+            views::as<Rgb> | views::cast<uint8_t>;
+    EXPECT_EQ(view.size(), colors.size());
+    EXPECT_EQ(view.to_vector(), expected);
+
+    // Element by element through the iterators.
+    auto elementwise = std::vector<Rgb<uint8_t>>(view.begin(), view.end());
+    EXPECT_EQ(elementwise, expected);
+}
+
+TEST(Views, chunks) {
+    const auto colors = make_unit_colors(view_chunk_colors + 1);
+    auto sizes = std::vector<std::size_t>();
+    (colors | views::as<Hsl>).for_each_chunk(
+            [&](const Hsl<float>*, std::size_t count) {
+                sizes.push_back(count);
+            });
+    EXPECT_EQ(sizes, (std::vector<std::size_t>{view_chunk_colors, 1}));
+
+    // Views of memory are read in one chunk, without copying.
+    const auto all = views::all(colors);
+    all.for_each_chunk([&](const Rgb<float>* data, std::size_t count) {
+        EXPECT_EQ(data, colors.data());
+        EXPECT_EQ(count, colors.size());
+    });
+
+    const auto empty = std::vector<Rgb<float>>();
+    EXPECT_TRUE((empty | views::cast<uint8_t>).empty());
+    EXPECT_TRUE((empty | views::cast<uint8_t>).to_vector().empty());
+}
+
+TEST(Views, alpha_and_spans) {
+    const auto colors = std::vector<Rgba<uint8_t>>{
+            Rgba<uint8_t>(Rgb<uint8_t>(255, 0, 0), 10),
+            Rgba<uint8_t>(Rgb<uint8_t>(0, 0, 255), 20)};
+    const auto span = ColorSpan<const Rgba<uint8_t>>(colors.data(), 2);
+    const auto view = span | views::cast<float> | views::as<Hsv>;
+    const auto hsv = view.to_vector();
+    ASSERT_EQ(hsv.size(), 2u);
+    EXPECT_EQ(hsv[0], to_hsv(color_cast<float>(colors[0])));
+    EXPECT_FLOAT_EQ(hsv[1].alpha(), 20.0f / 255.0f);
+}
+
+TEST(Views, pack) {
+    const auto colors = make_unit_colors(3 * view_chunk_colors + 5);
+    const auto view =
+            colors | views::map([](Rgb<float> c) {
+                return Rgb<float>(c.blue(), c.green(), c.red());
+            }) |
+            views::cast<uint8_t>;
+    const auto expected = view.to_vector();
+
+    const auto packer = FlatColorPacker<Rgb<uint8_t>>({0, 1, 2});
+    auto packed = std::vector<uint8_t>(colors.size() * 3);
+    const auto end = packer.pack(view, packed.data());
+    EXPECT_EQ(end, packed.data() + packed.size());
+    auto from_vector = std::vector<uint8_t>(packed.size());
+    packer.pack(expected.begin(), expected.end(), from_vector.data());
+    EXPECT_EQ(packed, from_vector);
+
+    std::stringstream bytes;
+    auto stream_packer = StreamPacker<Rgb<uint8_t>>(bytes,
+            std::make_unique<FlatColorPacker<Rgb<uint8_t>>>(
+                    std::vector<int>{0, 1, 2}));
+    stream_packer.pack(view);
+    stream_packer.flush();
+    EXPECT_EQ(bytes.str(),
+            std::string(from_vector.begin(), from_vector.end()));
+}